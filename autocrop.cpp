@@ -0,0 +1,111 @@
+/**
+ * Letterbox / pillarbox detection, see autocrop.h
+ */
+#include "autocrop.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUTOCROP_SSE2 1
+#endif
+
+static inline bool pixel_has_content(const uint8_t *pixel, uint8_t threshold)
+{
+	return pixel[0] > threshold || pixel[1] > threshold ||
+	       pixel[2] > threshold;
+}
+
+#ifdef AUTOCROP_SSE2
+/**
+ * @return bitmask with bit n set if pixel n of the four has content
+ */
+static inline int chunk_content(const uint8_t *pixels, __m128i threshold,
+				__m128i colour_mask)
+{
+	__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)pixels),
+				  colour_mask);
+	__m128i over = _mm_subs_epu8(v, threshold);
+	__m128i zero = _mm_cmpeq_epi32(over, _mm_setzero_si128());
+	return ~_mm_movemask_ps(_mm_castsi128_ps(zero)) & 0xF;
+}
+#endif
+
+/**
+ * Finds the first and last pixel with content in a row
+ * @return false if the row is empty
+ */
+static bool row_bounds(const uint8_t *row, uint32_t width, uint8_t threshold,
+		       uint32_t *first, uint32_t *last)
+{
+	uint32_t x = 0;
+	uint32_t end = width;
+
+#ifdef AUTOCROP_SSE2
+	const __m128i thr = _mm_set1_epi8((char)threshold);
+	const __m128i colour_mask = _mm_set1_epi32(0x00FFFFFF);
+
+	for (; x + 4 <= width; x += 4) {
+		if (chunk_content(row + x * 4, thr, colour_mask)) {
+			break;
+		}
+	}
+#endif
+	for (; x < width; x++) {
+		if (pixel_has_content(row + x * 4, threshold)) {
+			break;
+		}
+	}
+	if (x == width) {
+		return false;
+	}
+	*first = x;
+
+#ifdef AUTOCROP_SSE2
+	for (; end >= x + 4; end -= 4) {
+		if (chunk_content(row + (end - 4) * 4, thr, colour_mask)) {
+			break;
+		}
+	}
+#endif
+	while (end > x && !pixel_has_content(row + (end - 1) * 4, threshold)) {
+		end--;
+	}
+	*last = end - 1;
+	return true;
+}
+
+bool autocrop_detect(const uint8_t *pixels, uint32_t linesize, uint32_t width,
+		     uint32_t height, uint8_t threshold,
+		     struct autocrop_rect *rect)
+{
+	uint32_t top = height, bottom = 0;
+	uint32_t left = width, right = 0;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint32_t first, last;
+		if (!row_bounds(pixels + (size_t)y * linesize, width, threshold,
+				&first, &last)) {
+			continue;
+		}
+		if (top == height) {
+			top = y;
+		}
+		bottom = y;
+		if (first < left) {
+			left = first;
+		}
+		if (last > right) {
+			right = last;
+		}
+	}
+
+	if (top == height) {
+		return false;
+	}
+
+	rect->x = left;
+	rect->y = top;
+	rect->cx = right - left + 1;
+	rect->cy = bottom - top + 1;
+	return true;
+}
@@ -0,0 +1,34 @@
+/**
+ * Letterbox / pillarbox detection for 32-bit (BGRA/RGBA) frames
+ *
+ * Meant to run on a small, downscaled copy of a frame; the caller scales
+ * the result back up. Alpha is ignored. SSE2 where available.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct autocrop_rect {
+	uint32_t x;
+	uint32_t y;
+	uint32_t cx;
+	uint32_t cy;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Finds the bounding box of all pixels with any colour channel
+ * above threshold
+ * @return false if the whole frame is at or below threshold
+ */
+bool autocrop_detect(const uint8_t *pixels, uint32_t linesize, uint32_t width,
+		     uint32_t height, uint8_t threshold,
+		     struct autocrop_rect *rect);
+
+#ifdef __cplusplus
+}
+#endif
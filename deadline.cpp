@@ -0,0 +1,366 @@
+/**
+ * Calls with a deadline and the stall watchdog, see deadline.h
+ */
+#include "deadline.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+struct deadline_worker {
+	pthread_t thread;
+	// one caller at a time
+	pthread_mutex_t call_mutex;
+	// guards everything below
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	// the call being made, NULL while idle
+	deadline_fn fn;
+	uint8_t *args;
+	size_t max_args;
+	uint64_t call_id;
+	uint64_t done_id;
+	bool stopping;
+	// destroyed while a call was running, the thread frees the worker
+	bool detached;
+
+	struct deadline_stats stats;
+};
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// pthread_cond_timedwait takes wall clock time
+static void deadline_after(struct timespec *ts, uint32_t timeout_ms)
+{
+	timespec_get(ts, TIME_UTC);
+	uint64_t nsec = (uint64_t)ts->tv_nsec + (uint64_t)timeout_ms * 1000000;
+	ts->tv_sec += (time_t)(nsec / 1000000000);
+	ts->tv_nsec = (long)(nsec % 1000000000);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Worker */
+
+static void worker_free(struct deadline_worker *worker)
+{
+	pthread_cond_destroy(&worker->done_cond);
+	pthread_cond_destroy(&worker->work_cond);
+	pthread_mutex_destroy(&worker->mutex);
+	pthread_mutex_destroy(&worker->call_mutex);
+	free(worker->args);
+	free(worker);
+}
+
+static void *worker_thread(void *param)
+{
+	struct deadline_worker *worker = (struct deadline_worker *)param;
+
+	pthread_mutex_lock(&worker->mutex);
+	while (!worker->stopping || worker->fn) {
+		if (!worker->fn) {
+			pthread_cond_wait(&worker->work_cond, &worker->mutex);
+			continue;
+		}
+
+		deadline_fn fn = worker->fn;
+		pthread_mutex_unlock(&worker->mutex);
+		uint64_t start = now_ns();
+		fn(worker->args);
+		uint64_t elapsed = now_ns() - start;
+		pthread_mutex_lock(&worker->mutex);
+
+		if (elapsed > worker->stats.longest_ns) {
+			worker->stats.longest_ns = elapsed;
+		}
+		worker->fn = NULL;
+		worker->done_id = worker->call_id;
+		pthread_cond_broadcast(&worker->done_cond);
+	}
+	bool detached = worker->detached;
+	pthread_mutex_unlock(&worker->mutex);
+
+	if (detached) {
+		worker_free(worker);
+	}
+	return NULL;
+}
+
+struct deadline_worker *deadline_worker_create(size_t max_args)
+{
+	struct deadline_worker *worker =
+		(struct deadline_worker *)calloc(1, sizeof(*worker));
+	if (!worker) {
+		return NULL;
+	}
+	worker->args = (uint8_t *)calloc(1, max_args ? max_args : 1);
+	worker->max_args = max_args;
+	if (!worker->args) {
+		free(worker);
+		return NULL;
+	}
+
+	pthread_mutex_init(&worker->call_mutex, NULL);
+	pthread_mutex_init(&worker->mutex, NULL);
+	pthread_cond_init(&worker->work_cond, NULL);
+	pthread_cond_init(&worker->done_cond, NULL);
+	if (pthread_create(&worker->thread, NULL, worker_thread, worker) != 0) {
+		worker_free(worker);
+		return NULL;
+	}
+	return worker;
+}
+
+bool deadline_worker_destroy(struct deadline_worker *worker)
+{
+	if (!worker) {
+		return true;
+	}
+
+	pthread_mutex_lock(&worker->mutex);
+	bool running = worker->fn != NULL;
+	worker->stopping = true;
+	worker->detached = running;
+	pthread_cond_signal(&worker->work_cond);
+	pthread_mutex_unlock(&worker->mutex);
+
+	if (running) {
+		pthread_detach(worker->thread);
+		return false;
+	}
+	pthread_join(worker->thread, NULL);
+	worker_free(worker);
+	return true;
+}
+
+int deadline_worker_call(struct deadline_worker *worker, deadline_fn fn,
+			 void *args, size_t args_size, uint32_t timeout_ms)
+{
+	if (args_size > worker->max_args) {
+		args_size = worker->max_args;
+	}
+
+	pthread_mutex_lock(&worker->call_mutex);
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->fn) {
+		worker->stats.busy++;
+		pthread_mutex_unlock(&worker->mutex);
+		pthread_mutex_unlock(&worker->call_mutex);
+		return DEADLINE_BUSY;
+	}
+
+	memcpy(worker->args, args, args_size);
+	worker->fn = fn;
+	uint64_t id = ++worker->call_id;
+	worker->stats.calls++;
+	pthread_cond_signal(&worker->work_cond);
+
+	struct timespec deadline;
+	deadline_after(&deadline, timeout_ms);
+	while (worker->done_id != id) {
+		if (pthread_cond_timedwait(&worker->done_cond, &worker->mutex,
+					   &deadline) != 0 &&
+		    worker->done_id != id) {
+			break;
+		}
+	}
+
+	int result = DEADLINE_OK;
+	if (worker->done_id == id) {
+		memcpy(args, worker->args, args_size);
+	} else {
+		worker->stats.timeouts++;
+		result = DEADLINE_TIMEOUT;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+	pthread_mutex_unlock(&worker->call_mutex);
+	return result;
+}
+
+void deadline_worker_get_stats(struct deadline_worker *worker,
+			       struct deadline_stats *stats)
+{
+	pthread_mutex_lock(&worker->mutex);
+	*stats = worker->stats;
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Stall watchdog */
+
+#ifdef _MSC_VER
+static inline uint64_t load_u64(const volatile uint64_t *ptr)
+{
+	uint64_t val = *ptr;
+	_ReadWriteBarrier();
+	return val;
+}
+
+static inline void store_u64(volatile uint64_t *ptr, uint64_t val)
+{
+	_ReadWriteBarrier();
+	*ptr = val;
+}
+#else
+static inline uint64_t load_u64(const volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_u64(volatile uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+#endif
+
+// guards the section list and everything below
+static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+static struct stall_section *sections;
+static pthread_t watchdog_thread;
+static bool watchdog_running;
+static bool watchdog_stopping;
+static uint32_t watchdog_threshold_ms;
+static stall_log_t watchdog_log;
+
+// call with watchdog_mutex held
+static void check_section(struct stall_section *section, uint64_t now)
+{
+	uint64_t seq = load_u64(&section->seq);
+	uint64_t entered = load_u64(&section->entered);
+
+	if (section->reporting) {
+		if (!entered || seq != section->reported_seq) {
+			// it may have been entered and left again since
+			uint64_t duration =
+				load_u64(&section->duration_seq) ==
+						section->reported_seq
+					? load_u64(&section->duration)
+					: now - section->reported_entered;
+			section->reporting = false;
+			watchdog_log(section, duration / 1000000, true);
+		}
+		return;
+	}
+
+	uint64_t threshold = (uint64_t)watchdog_threshold_ms * 1000000;
+	if (entered && now > entered && now - entered >= threshold) {
+		section->reporting = true;
+		section->reported_seq = seq;
+		section->reported_entered = entered;
+		store_u64(&section->stalls, load_u64(&section->stalls) + 1);
+		watchdog_log(section, (now - entered) / 1000000, false);
+	}
+}
+
+static void *watchdog_loop(void *param)
+{
+	(void)param;
+
+	pthread_mutex_lock(&watchdog_mutex);
+	while (!watchdog_stopping) {
+		uint64_t now = now_ns();
+		for (struct stall_section *section = sections; section;
+		     section = section->next) {
+			check_section(section, now);
+		}
+
+		struct timespec deadline;
+		deadline_after(&deadline, watchdog_threshold_ms / 4 + 1);
+		pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex,
+				       &deadline);
+	}
+	pthread_mutex_unlock(&watchdog_mutex);
+	return NULL;
+}
+
+void stall_watchdog_start(uint32_t threshold_ms, stall_log_t log_cb)
+{
+	pthread_mutex_lock(&watchdog_mutex);
+	if (!watchdog_running) {
+		watchdog_threshold_ms = threshold_ms;
+		watchdog_log = log_cb;
+		watchdog_stopping = false;
+		watchdog_running = pthread_create(&watchdog_thread, NULL,
+						  watchdog_loop, NULL) == 0;
+	}
+	pthread_mutex_unlock(&watchdog_mutex);
+}
+
+void stall_watchdog_stop(void)
+{
+	pthread_mutex_lock(&watchdog_mutex);
+	bool running = watchdog_running;
+	watchdog_stopping = true;
+	watchdog_running = false;
+	pthread_cond_signal(&watchdog_cond);
+	pthread_mutex_unlock(&watchdog_mutex);
+
+	if (running) {
+		pthread_join(watchdog_thread, NULL);
+	}
+}
+
+void stall_section_add(struct stall_section *section, const char *name)
+{
+	memset(section, 0, sizeof(*section));
+	strncpy(section->name, name, STALL_SECTION_NAME_MAX - 1);
+
+	pthread_mutex_lock(&watchdog_mutex);
+	section->next = sections;
+	sections = section;
+	pthread_mutex_unlock(&watchdog_mutex);
+}
+
+void stall_section_remove(struct stall_section *section)
+{
+	pthread_mutex_lock(&watchdog_mutex);
+	for (struct stall_section **link = &sections; *link;
+	     link = &(*link)->next) {
+		if (*link == section) {
+			*link = section->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&watchdog_mutex);
+}
+
+void stall_section_enter(struct stall_section *section)
+{
+	store_u64(&section->seq, load_u64(&section->seq) + 1);
+	store_u64(&section->entered, now_ns());
+}
+
+void stall_section_leave(struct stall_section *section)
+{
+	uint64_t entered = load_u64(&section->entered);
+	store_u64(&section->duration_seq, 0);
+	store_u64(&section->duration, now_ns() - entered);
+	store_u64(&section->duration_seq, load_u64(&section->seq));
+	store_u64(&section->entered, 0);
+}
@@ -0,0 +1,119 @@
+/**
+ * Calls with a deadline, and a watchdog for stalled threads
+ *
+ * A deadline_worker runs calls that may block for good, e.g. on a
+ * cross-process mutex a hung process holds, on a thread of its own. The
+ * caller waits up to a timeout; if the call takes longer it carries on
+ * alone and its result is dropped, and further calls are refused until it
+ * returns, so the caller never waits on it again. Arguments and results
+ * travel in a copy owned by the worker, which stays valid however long a
+ * call runs.
+ *
+ * The stall watchdog is a single thread that checks sections of work,
+ * e.g. one per video tick, and reports those that take longer than a
+ * threshold while they're still stuck, then once more when they finish.
+ *
+ * Free of OBS dependencies, so both can be exercised on any platform.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+enum deadline_result {
+	DEADLINE_OK = 0,
+	// the call didn't return in time, it's still running
+	DEADLINE_TIMEOUT = -1,
+	// an earlier call is still running, this one wasn't made
+	DEADLINE_BUSY = -2,
+};
+
+/**
+ * Runs on the worker thread with the worker's copy of the arguments,
+ * whose changes are copied back to the caller if it returns in time
+ */
+typedef void (*deadline_fn)(void *args);
+
+struct deadline_stats {
+	uint64_t calls;
+	uint64_t timeouts;
+	// calls refused while a timed out one was still running
+	uint64_t busy;
+	uint64_t longest_ns;
+};
+
+#define STALL_SECTION_NAME_MAX 64
+
+struct stall_section {
+	char name[STALL_SECTION_NAME_MAX];
+	// when the section was entered, 0 while outside
+	volatile uint64_t entered;
+	volatile uint64_t seq;
+	// how long entry duration_seq took
+	volatile uint64_t duration;
+	volatile uint64_t duration_seq;
+	// times the watchdog caught it stalling
+	volatile uint64_t stalls;
+
+	// watchdog bookkeeping
+	bool reporting;
+	uint64_t reported_seq;
+	uint64_t reported_entered;
+	struct stall_section *next;
+};
+
+/**
+ * Reports a stall: while it lasts (finished false) with how long the
+ * section has been running, and when it ends with its total duration
+ */
+typedef void (*stall_log_t)(const struct stall_section *section,
+			    uint64_t stalled_ms, bool finished);
+
+struct deadline_worker;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Starts a worker taking arguments of up to max_args bytes
+ * @return NULL on failure
+ */
+struct deadline_worker *deadline_worker_create(size_t max_args);
+
+/**
+ * Stops the worker. If a timed out call is still running the thread is
+ * left to finish it and clean up after itself.
+ * @return false if a call was still running, whatever it uses has to
+ *         stay valid
+ */
+bool deadline_worker_destroy(struct deadline_worker *worker);
+
+/**
+ * Runs fn on a copy of args_size bytes of args and waits up to
+ * timeout_ms for it. Calls from several threads are made one at a time.
+ * @return one of deadline_result; args is only updated on DEADLINE_OK
+ */
+int deadline_worker_call(struct deadline_worker *worker, deadline_fn fn,
+			 void *args, size_t args_size, uint32_t timeout_ms);
+
+void deadline_worker_get_stats(struct deadline_worker *worker,
+			       struct deadline_stats *stats);
+
+/**
+ * Starts the watchdog thread, checking sections a few times per
+ * threshold_ms. Sections can be added before it starts.
+ */
+void stall_watchdog_start(uint32_t threshold_ms, stall_log_t log_cb);
+void stall_watchdog_stop(void);
+
+void stall_section_add(struct stall_section *section, const char *name);
+// not while the section is entered
+void stall_section_remove(struct stall_section *section);
+void stall_section_enter(struct stall_section *section);
+void stall_section_leave(struct stall_section *section);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,368 @@
+/**
+ * Frame checksums, see frame-hash.h
+ */
+#include "frame-hash.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+	defined(__i386__)
+#define FRAME_HASH_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE42
+#else
+#include <cpuid.h>
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#elif defined(__ARM_FEATURE_CRC32) || defined(_M_ARM64)
+#define FRAME_HASH_ARM 1
+#ifdef _MSC_VER
+#include <arm64_acle.h>
+#else
+#include <arm_acle.h>
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_HASH_SSE2 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78 // reflected
+
+// content hash: 64 byte stripes, accumulators scrambled every block
+#define HASH_STRIPE 64
+#define HASH_STRIPES_PER_BLOCK 16
+#define HASH_BLOCK (HASH_STRIPE * HASH_STRIPES_PER_BLOCK)
+// one key per stripe of a block, 8 bytes apart, plus the scramble key
+#define HASH_SECRET_SIZE (HASH_STRIPE + 8 * HASH_STRIPES_PER_BLOCK)
+#define HASH_PRIME32 0x9E3779B1U
+#define HASH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *data, size_t size);
+
+/* ------------------------------------------------------------------------- */
+/* Table, slicing-by-8 */
+
+#ifndef FRAME_HASH_ARM
+static uint32_t crc_table[8][256];
+
+static bool crc_table_init(void)
+{
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+		}
+		crc_table[0][i] = crc;
+	}
+	for (uint32_t i = 0; i < 256; i++) {
+		for (int slice = 1; slice < 8; slice++) {
+			crc_table[slice][i] =
+				(crc_table[slice - 1][i] >> 8) ^
+				crc_table[0][crc_table[slice - 1][i] & 0xFF];
+		}
+	}
+	return true;
+}
+
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size && ((uintptr_t)data & 7)) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+		size--;
+	}
+	while (size >= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, data, 4);
+		memcpy(&hi, data + 4, 4);
+		lo ^= crc;
+		crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+		      crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+		      crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+		      crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+		data += 8;
+		size -= 8;
+	}
+	while (size--) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+	}
+	return crc;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* CRC instructions */
+
+#ifdef FRAME_HASH_X86
+TARGET_SSE42
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size && ((uintptr_t)data & 7)) {
+		crc = _mm_crc32_u8(crc, *data++);
+		size--;
+	}
+#if defined(_M_X64) || defined(__x86_64__)
+	uint64_t crc64 = crc;
+	while (size >= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+		data += 8;
+		size -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while (size >= 4) {
+		uint32_t word;
+		memcpy(&word, data, 4);
+		crc = _mm_crc32_u32(crc, word);
+		data += 4;
+		size -= 4;
+	}
+	while (size--) {
+		crc = _mm_crc32_u8(crc, *data++);
+	}
+	return crc;
+}
+
+static bool cpu_has_sse42(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		return false;
+	}
+	return (ecx & bit_SSE4_2) != 0;
+#endif
+}
+#endif
+
+#ifdef FRAME_HASH_ARM
+static uint32_t crc32c_arm(uint32_t crc, const uint8_t *data, size_t size)
+{
+	while (size && ((uintptr_t)data & 7)) {
+		crc = __crc32cb(crc, *data++);
+		size--;
+	}
+	while (size >= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		crc = __crc32cd(crc, word);
+		data += 8;
+		size -= 8;
+	}
+	while (size--) {
+		crc = __crc32cb(crc, *data++);
+	}
+	return crc;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static crc32c_fn crc32c_pick(const char **name)
+{
+#ifdef FRAME_HASH_X86
+	if (cpu_has_sse42()) {
+		*name = "SSE4.2";
+		return crc32c_sse42;
+	}
+#endif
+#ifdef FRAME_HASH_ARM
+	*name = "ARMv8 CRC";
+	return crc32c_arm;
+#else
+	static const bool table_ready = crc_table_init();
+	(void)table_ready;
+	*name = "table";
+	return crc32c_table;
+#endif
+}
+
+static const char *crc32c_name = NULL;
+
+static crc32c_fn crc32c_get(void)
+{
+	static const crc32c_fn fn = crc32c_pick(&crc32c_name);
+	return fn;
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t size)
+{
+	return ~crc32c_get()(~crc, (const uint8_t *)data, size);
+}
+
+const char *crc32c_implementation(void)
+{
+	crc32c_get();
+	return crc32c_name;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Content hash, after XXH3's long-input loop */
+
+static uint8_t hash_secret[HASH_SECRET_SIZE];
+
+static bool hash_secret_init(void)
+{
+	// splitmix64, any fixed bytes will do
+	uint64_t state = HASH_PRIME64_2;
+	for (size_t i = 0; i < HASH_SECRET_SIZE; i += 8) {
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+		memcpy(hash_secret + i, &z, 8);
+	}
+	return true;
+}
+
+static inline uint64_t read64(const uint8_t *ptr)
+{
+	uint64_t val;
+	memcpy(&val, ptr, 8);
+	return val;
+}
+
+#ifdef FRAME_HASH_SSE2
+static inline void hash_stripe(__m128i *acc, const uint8_t *data,
+			       const uint8_t *key)
+{
+	for (int i = 0; i < 4; i++) {
+		__m128i d = _mm_loadu_si128((const __m128i *)data + i);
+		__m128i k = _mm_xor_si128(
+			d, _mm_loadu_si128((const __m128i *)key + i));
+		__m128i product = _mm_mul_epu32(
+			k, _mm_shuffle_epi32(k, _MM_SHUFFLE(0, 3, 0, 1)));
+		__m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+		acc[i] = _mm_add_epi64(acc[i],
+				       _mm_add_epi64(product, swapped));
+	}
+}
+
+static inline void hash_scramble(__m128i *acc, const uint8_t *key)
+{
+	const __m128i prime = _mm_set1_epi32((int)HASH_PRIME32);
+	for (int i = 0; i < 4; i++) {
+		__m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		a = _mm_xor_si128(a,
+				  _mm_loadu_si128((const __m128i *)key + i));
+		__m128i lo = _mm_mul_epu32(a, prime);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+		acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
+}
+#else
+static inline void hash_stripe(uint64_t *acc, const uint8_t *data,
+			       const uint8_t *key)
+{
+	for (int i = 0; i < 8; i++) {
+		uint64_t d = read64(data + i * 8);
+		uint64_t k = d ^ read64(key + i * 8);
+		acc[i ^ 1] += d;
+		acc[i] += (k & 0xFFFFFFFF) * (k >> 32);
+	}
+}
+
+static inline void hash_scramble(uint64_t *acc, const uint8_t *key)
+{
+	for (int i = 0; i < 8; i++) {
+		uint64_t a = acc[i] ^ (acc[i] >> 47);
+		a ^= read64(key + i * 8);
+		acc[i] = a * HASH_PRIME32;
+	}
+}
+#endif
+
+static inline uint64_t mul_fold64(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+#elif defined(_M_X64)
+	uint64_t high;
+	uint64_t low = _umul128(a, b, &high);
+	return low ^ high;
+#else
+	uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	uint64_t upper = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+	uint64_t lower = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+	return lower ^ upper;
+#endif
+}
+
+uint64_t frame_hash64(const void *data, size_t size)
+{
+	static const bool secret_ready = hash_secret_init();
+	(void)secret_ready;
+
+	const uint8_t *ptr = (const uint8_t *)data;
+	uint8_t tail[HASH_STRIPE] = {0};
+	if (size < HASH_STRIPE) {
+		memcpy(tail, ptr, size);
+	}
+
+	uint64_t lanes[8] = {HASH_PRIME32,   HASH_PRIME64_1, HASH_PRIME64_2,
+			     HASH_PRIME64_1, HASH_PRIME64_2, HASH_PRIME32,
+			     HASH_PRIME64_1, HASH_PRIME64_2};
+#ifdef FRAME_HASH_SSE2
+	__m128i acc[4];
+	for (int i = 0; i < 4; i++) {
+		acc[i] = _mm_loadu_si128((const __m128i *)lanes + i);
+	}
+#else
+	uint64_t *acc = lanes;
+#endif
+
+	const uint8_t *scramble_key = hash_secret + HASH_SECRET_SIZE - HASH_STRIPE;
+	size_t blocks = size / HASH_BLOCK;
+	for (size_t b = 0; b < blocks; b++) {
+		for (int s = 0; s < HASH_STRIPES_PER_BLOCK; s++) {
+			hash_stripe(acc, ptr + s * HASH_STRIPE,
+				    hash_secret + s * 8);
+		}
+		hash_scramble(acc, scramble_key);
+		ptr += HASH_BLOCK;
+	}
+
+	// whole stripes of the last block, then the last 64 bytes
+	size_t rest = size - blocks * HASH_BLOCK;
+	int s = 0;
+	for (; rest >= HASH_STRIPE * (size_t)(s + 1); s++) {
+		hash_stripe(acc, ptr + s * HASH_STRIPE, hash_secret + s * 8);
+	}
+	const uint8_t *last = size < HASH_STRIPE
+				      ? tail
+				      : (const uint8_t *)data + size -
+						HASH_STRIPE;
+	hash_stripe(acc, last, hash_secret + s * 8 + 7);
+
+#ifdef FRAME_HASH_SSE2
+	for (int i = 0; i < 4; i++) {
+		_mm_storeu_si128((__m128i *)lanes + i, acc[i]);
+	}
+#endif
+
+	uint64_t result = (uint64_t)size * HASH_PRIME64_1;
+	for (int i = 0; i < 4; i++) {
+		result += mul_fold64(lanes[2 * i] ^ read64(hash_secret + 16 * i),
+				     lanes[2 * i + 1] ^
+					     read64(hash_secret + 16 * i + 8));
+	}
+	result ^= result >> 37;
+	result *= 0x165667919E3779F9ULL;
+	return result ^ (result >> 32);
+}
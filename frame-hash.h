@@ -0,0 +1,40 @@
+/**
+ * Checksums over frame bytes
+ *
+ * CRC32C (Castagnoli) with the SSE4.2 or ARMv8 CRC instructions where the
+ * CPU has them, picked at run time on x86, and a slicing-by-8 table
+ * otherwise. All implementations give identical results.
+ *
+ * frame_hash64 is a non-cryptographic 64-bit content hash built like
+ * XXH3's long-input loop (SSE2 or scalar, same results), for telling
+ * whether a frame changed at memory speed. It isn't XXH3-compatible.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Continues a CRC32C over size more bytes; start with crc = 0.
+ * crc32c_update(crc32c_update(0, a, n), b, m) equals the CRC of a then b.
+ */
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t size);
+
+/**
+ * Name of the implementation crc32c_update uses, for logging
+ */
+const char *crc32c_implementation(void);
+
+/**
+ * Hashes size bytes; equal input always gives the same value, within and
+ * across processes
+ */
+uint64_t frame_hash64(const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,239 @@
+/**
+ * Frame buffer pool, see frame-pool.h
+ *
+ * Idle buffers are kept on one list per size class, linked through their
+ * own first bytes, so the pool itself never allocates. A buffer goes on
+ * the list of the largest class it can hold. Once FRAME_POOL_IDLE_MAX
+ * bytes are idle, released buffers go straight back to the OS.
+ */
+#include "frame-pool.h"
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// the smallest class; frame buffers are rarely smaller
+#define FRAME_POOL_MIN_SHIFT 16
+// classes up to 2^(FRAME_POOL_MIN_SHIFT + FRAME_POOL_CLASSES / 4)
+#define FRAME_POOL_CLASSES 64
+#define FRAME_POOL_IDLE_MAX ((uint64_t)512 * 1024 * 1024)
+#define FRAME_POOL_HUGE_PAGE ((size_t)2 * 1024 * 1024)
+
+struct idle_buffer {
+	struct idle_buffer *next;
+	size_t capacity;
+};
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct idle_buffer *idle_lists[FRAME_POOL_CLASSES];
+static struct frame_pool_stats pool_stats;
+
+static inline size_t class_size(int index)
+{
+	int shift = FRAME_POOL_MIN_SHIFT + index / 4;
+	return (size_t)(4 + index % 4) << (shift - 2);
+}
+
+/**
+ * Smallest class holding size
+ * @return FRAME_POOL_CLASSES if size is past the last class
+ */
+static int class_for_size(size_t size)
+{
+	for (int index = 0; index < FRAME_POOL_CLASSES; index++) {
+		if (class_size(index) >= size) {
+			return index;
+		}
+	}
+	return FRAME_POOL_CLASSES;
+}
+
+/**
+ * Largest class a buffer of capacity bytes can serve
+ * @return -1 if it's below the first class
+ */
+static int class_for_capacity(size_t capacity)
+{
+	int found = -1;
+	for (int index = 0; index < FRAME_POOL_CLASSES; index++) {
+		if (class_size(index) > capacity) {
+			break;
+		}
+		found = index;
+	}
+	return found;
+}
+
+/* ------------------------------------------------------------------------- */
+/* OS mappings */
+
+static inline size_t map_length(size_t size)
+{
+#ifndef _WIN32
+	if (size >= FRAME_POOL_HUGE_PAGE) {
+		return (size + FRAME_POOL_HUGE_PAGE - 1) /
+		       FRAME_POOL_HUGE_PAGE * FRAME_POOL_HUGE_PAGE;
+	}
+#endif
+	return size;
+}
+
+static uint8_t *os_map(size_t length)
+{
+#ifdef _WIN32
+	return (uint8_t *)VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT,
+				       PAGE_READWRITE);
+#else
+	if (length < FRAME_POOL_HUGE_PAGE) {
+		void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return ptr == MAP_FAILED ? NULL : (uint8_t *)ptr;
+	}
+
+	// over-map, then trim to a 2 MiB aligned range hugepages can back
+	size_t padded = length + FRAME_POOL_HUGE_PAGE;
+	void *ptr = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+		return NULL;
+	}
+	uintptr_t base = (uintptr_t)ptr;
+	uintptr_t aligned = (base + FRAME_POOL_HUGE_PAGE - 1) &
+			    ~(uintptr_t)(FRAME_POOL_HUGE_PAGE - 1);
+	if (aligned > base) {
+		munmap(ptr, aligned - base);
+	}
+	size_t tail = (base + padded) - (aligned + length);
+	if (tail) {
+		munmap((void *)(aligned + length), tail);
+	}
+#ifdef MADV_HUGEPAGE
+	if (madvise((void *)aligned, length, MADV_HUGEPAGE) == 0) {
+		pool_stats.huge += length;
+	}
+#endif
+	return (uint8_t *)aligned;
+#endif
+}
+
+static void os_unmap(uint8_t *buffer, size_t length)
+{
+#ifdef _WIN32
+	(void)length;
+	VirtualFree(buffer, 0, MEM_RELEASE);
+#else
+	munmap(buffer, length);
+#ifdef MADV_HUGEPAGE
+	if (length >= FRAME_POOL_HUGE_PAGE && pool_stats.huge >= length) {
+		pool_stats.huge -= length;
+	}
+#endif
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+uint8_t *frame_pool_alloc(size_t size, size_t *capacity)
+{
+	int index = class_for_size(size);
+	// classes between hugepage multiples are mapped rounded up, and
+	// released into the class of their real size: look there
+	if (index < FRAME_POOL_CLASSES) {
+		index = class_for_capacity(map_length(class_size(index)));
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	pool_stats.requests++;
+	if (index < FRAME_POOL_CLASSES && idle_lists[index]) {
+		struct idle_buffer *idle = idle_lists[index];
+		idle_lists[index] = idle->next;
+		pool_stats.hits++;
+		pool_stats.idle -= idle->capacity;
+		*capacity = idle->capacity;
+		pthread_mutex_unlock(&pool_mutex);
+		return (uint8_t *)idle;
+	}
+
+	size_t length = map_length(index < FRAME_POOL_CLASSES
+					   ? class_size(index)
+					   : size);
+	uint8_t *buffer = os_map(length);
+	if (buffer) {
+		pool_stats.footprint += length;
+		if (pool_stats.footprint > pool_stats.peak_footprint) {
+			pool_stats.peak_footprint = pool_stats.footprint;
+		}
+		*capacity = length;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	return buffer;
+}
+
+void frame_pool_release(uint8_t *buffer, size_t capacity)
+{
+	if (!buffer) {
+		return;
+	}
+
+	int index = class_for_capacity(capacity);
+
+	pthread_mutex_lock(&pool_mutex);
+	if (index < 0 || pool_stats.idle + capacity > FRAME_POOL_IDLE_MAX) {
+		os_unmap(buffer, capacity);
+		pool_stats.footprint -= capacity;
+	} else {
+		struct idle_buffer *idle = (struct idle_buffer *)buffer;
+		idle->capacity = capacity;
+		idle->next = idle_lists[index];
+		idle_lists[index] = idle;
+		pool_stats.idle += capacity;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+uint8_t *frame_pool_fit(uint8_t **buffer, size_t *capacity, size_t size)
+{
+	if (*buffer && *capacity >= size && *capacity / 2 < size) {
+		return *buffer;
+	}
+
+	frame_pool_release(*buffer, *capacity);
+	*buffer = frame_pool_alloc(size, capacity);
+	if (!*buffer) {
+		*capacity = 0;
+	}
+	return *buffer;
+}
+
+void frame_pool_get_stats(struct frame_pool_stats *stats)
+{
+	pthread_mutex_lock(&pool_mutex);
+	*stats = pool_stats;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+void frame_pool_trim(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+	for (int index = 0; index < FRAME_POOL_CLASSES; index++) {
+		while (idle_lists[index]) {
+			struct idle_buffer *idle = idle_lists[index];
+			idle_lists[index] = idle->next;
+			size_t capacity = idle->capacity;
+			os_unmap((uint8_t *)idle, capacity);
+			pool_stats.footprint -= capacity;
+			pool_stats.idle -= capacity;
+		}
+	}
+	pthread_mutex_unlock(&pool_mutex);
+}
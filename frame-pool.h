@@ -0,0 +1,67 @@
+/**
+ * Process-wide pool of CPU frame buffers in size classes
+ *
+ * Buffers sized width * height * bpp come and go whenever a sender changes
+ * resolution; a sender toggling between preview and full size would
+ * otherwise keep the allocator busy and fragment the heap. Sizes are
+ * rounded up to classes a quarter power of two apart, and released
+ * buffers are kept per class for the next request of that class, from any
+ * source. On Linux buffers of 2 MiB and more are 2 MiB aligned and advised
+ * to use transparent hugepages, so a 4K frame takes a few dozen TLB entries
+ * instead of thousands.
+ *
+ * Contents are not preserved when a buffer is exchanged for a larger one.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct frame_pool_stats {
+	uint64_t requests;
+	// requests served from released buffers
+	uint64_t hits;
+	// bytes taken from the OS, in use or kept for reuse
+	uint64_t footprint;
+	uint64_t peak_footprint;
+	// of footprint, kept for reuse
+	uint64_t idle;
+	// of footprint, advised to use transparent hugepages
+	uint64_t huge;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Returns a buffer of at least size bytes
+ * @param capacity set to the buffer's real size
+ * @return NULL on failure
+ */
+uint8_t *frame_pool_alloc(size_t size, size_t *capacity);
+
+/**
+ * Hands a buffer back for reuse; NULL is ignored
+ */
+void frame_pool_release(uint8_t *buffer, size_t capacity);
+
+/**
+ * Makes sure *buffer holds size bytes: keeps it if it's big enough and
+ * not more than twice the size, otherwise swaps it for a pooled one.
+ * Replaces the usual grow-only brealloc of frame buffers.
+ * @return the buffer, NULL on failure (the old buffer is released)
+ */
+uint8_t *frame_pool_fit(uint8_t **buffer, size_t *capacity, size_t size);
+
+void frame_pool_get_stats(struct frame_pool_stats *stats);
+
+/**
+ * Gives every idle buffer back to the OS
+ */
+void frame_pool_trim(void);
+
+#ifdef __cplusplus
+}
+#endif
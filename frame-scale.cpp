@@ -0,0 +1,87 @@
+/**
+ * CPU frame scaling kernels, see frame-scale.h
+ */
+#include "frame-scale.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_SCALE_SSE2 1
+#endif
+
+static inline void scale_half_pixel(const uint8_t *row0, const uint8_t *row1,
+				    uint8_t *out)
+{
+	for (int c = 0; c < 4; c++) {
+		out[c] = (uint8_t)((row0[c] + row0[c + 4] + row1[c] +
+				    row1[c + 4] + 2) >>
+				   2);
+	}
+}
+
+#ifdef FRAME_SCALE_SSE2
+/**
+ * Sums horizontally adjacent pixel pairs of two registers holding
+ * two 16-bit widened pixels each
+ */
+static inline __m128i sum_pairs(__m128i a, __m128i b)
+{
+	return _mm_add_epi16(_mm_unpacklo_epi64(a, b),
+			     _mm_unpackhi_epi64(a, b));
+}
+
+// 8 source pixels from each of two rows -> 4 destination pixels
+static inline void scale_half_8(const uint8_t *row0, const uint8_t *row1,
+				uint8_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+
+	__m128i a0 = _mm_loadu_si128((const __m128i *)row0);
+	__m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + 16));
+	__m128i b0 = _mm_loadu_si128((const __m128i *)row1);
+	__m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + 16));
+
+	// vertical sums, two pixels per register
+	__m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+				    _mm_unpacklo_epi8(b0, zero));
+	__m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+				    _mm_unpackhi_epi8(b0, zero));
+	__m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+				    _mm_unpacklo_epi8(b1, zero));
+	__m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+				    _mm_unpackhi_epi8(b1, zero));
+
+	__m128i lo = _mm_srli_epi16(_mm_add_epi16(sum_pairs(s01, s23), round),
+				    2);
+	__m128i hi = _mm_srli_epi16(_mm_add_epi16(sum_pairs(s45, s67), round),
+				    2);
+
+	_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(lo, hi));
+}
+#endif
+
+void frame_scale_half(const uint8_t *src, uint32_t src_linesize,
+		      uint32_t width, uint32_t height, uint8_t *dst,
+		      uint32_t dst_linesize)
+{
+	uint32_t out_width = width / 2;
+	uint32_t out_height = height / 2;
+
+	for (uint32_t y = 0; y < out_height; y++) {
+		const uint8_t *row0 = src + (size_t)(y * 2) * src_linesize;
+		const uint8_t *row1 = row0 + src_linesize;
+		uint8_t *out = dst + (size_t)y * dst_linesize;
+		uint32_t x = 0;
+
+#ifdef FRAME_SCALE_SSE2
+		for (; x + 4 <= out_width; x += 4) {
+			scale_half_8(row0 + x * 8, row1 + x * 8, out + x * 4);
+		}
+#endif
+		for (; x < out_width; x++) {
+			scale_half_pixel(row0 + x * 8, row1 + x * 8,
+					 out + x * 4);
+		}
+	}
+}
@@ -0,0 +1,27 @@
+/**
+ * CPU frame scaling kernels for 32-bit (BGRA/RGBA) frames
+ *
+ * Used wherever frames are already on the CPU (shared-memory senders,
+ * the fan-out output). SSE2 where available, scalar otherwise; both give
+ * bit-identical results.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Halves a frame in both directions with a rounded 2x2 box filter.
+ * The destination is (width / 2) x (height / 2), odd edges are dropped.
+ */
+void frame_scale_half(const uint8_t *src, uint32_t src_linesize,
+		      uint32_t width, uint32_t height, uint8_t *dst,
+		      uint32_t dst_linesize);
+
+#ifdef __cplusplus
+}
+#endif
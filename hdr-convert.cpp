@@ -0,0 +1,420 @@
+/**
+ * CPU tone mapping of HDR frames, see hdr-convert.h
+ */
+#include "hdr-convert.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HDR_CONVERT_SSE2 1
+#endif
+
+// largest channel below which colours are left alone, in SDR white units
+#define TONEMAP_KNEE 0.75f
+
+// linear [0, 1] -> sRGB code, fine enough for 8-bit output
+#define ENCODE_STEPS 4096
+
+struct hdr_tonemap {
+	enum hdr_transfer transfer;
+
+	// 10-bit code -> linear, 1.0 = SDR white
+	float decode[1024];
+	uint8_t encode[ENCODE_STEPS];
+
+	bool bt2020;
+
+	// highlight compression, off when the peak is no brighter than white
+	bool compress;
+	float inv_white_sq;
+};
+
+// BT.2020 -> BT.709 primaries, linear light
+static const float bt2020_to_bt709[3][3] = {
+	{1.660491f, -0.587641f, -0.072850f},
+	{-0.124551f, 1.132900f, -0.008349f},
+	{-0.018151f, -0.100579f, 1.118730f},
+};
+
+static double pq_to_nits(double v)
+{
+	const double m1 = 2610.0 / 16384.0;
+	const double m2 = 2523.0 / 4096.0 * 128.0;
+	const double c1 = 3424.0 / 4096.0;
+	const double c2 = 2413.0 / 4096.0 * 32.0;
+	const double c3 = 2392.0 / 4096.0 * 32.0;
+
+	double p = pow(v, 1.0 / m2);
+	double num = p - c1 > 0.0 ? p - c1 : 0.0;
+	return 10000.0 * pow(num / (c2 - c3 * p), 1.0 / m1);
+}
+
+/**
+ * HLG signal to display light for a 1000 nit display, applying the
+ * system gamma per channel rather than on luminance
+ */
+static double hlg_to_nits(double v)
+{
+	const double a = 0.17883277;
+	const double b = 1.0 - 4.0 * a;
+	const double c = 0.5 - a * log(4.0 * a);
+
+	double scene = v <= 0.5 ? v * v / 3.0 : (exp((v - c) / a) + b) / 12.0;
+	return 1000.0 * pow(scene, 1.2);
+}
+
+static double srgb_to_linear(double v)
+{
+	return v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+static double linear_to_srgb(double v)
+{
+	return v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+}
+
+struct hdr_tonemap *hdr_tonemap_create(enum hdr_transfer transfer,
+				       float sdr_white_nits, float peak_nits)
+{
+	if (sdr_white_nits <= 0.0f) {
+		return NULL;
+	}
+
+	struct hdr_tonemap *tonemap =
+		(struct hdr_tonemap *)calloc(1, sizeof(*tonemap));
+	if (!tonemap) {
+		return NULL;
+	}
+
+	tonemap->transfer = transfer;
+	tonemap->bt2020 = transfer == HDR_TRANSFER_PQ ||
+			  transfer == HDR_TRANSFER_HLG;
+
+	for (int i = 0; i < 1024; i++) {
+		double v = i / 1023.0;
+		double linear;
+		switch (transfer) {
+		case HDR_TRANSFER_PQ:
+			linear = pq_to_nits(v) / sdr_white_nits;
+			break;
+		case HDR_TRANSFER_HLG:
+			linear = hlg_to_nits(v) / sdr_white_nits;
+			break;
+		case HDR_TRANSFER_LINEAR:
+			linear = v;
+			break;
+		default:
+			linear = srgb_to_linear(v);
+			break;
+		}
+		tonemap->decode[i] = (float)linear;
+	}
+
+	for (int i = 0; i < ENCODE_STEPS; i++) {
+		double v = linear_to_srgb(i / (double)(ENCODE_STEPS - 1));
+		tonemap->encode[i] = (uint8_t)(v * 255.0 + 0.5);
+	}
+
+	// extended Reinhard on the part above the knee, reaching 1.0 at peak
+	float white = peak_nits / sdr_white_nits;
+	tonemap->compress = transfer != HDR_TRANSFER_SRGB && white > 1.0f;
+	if (tonemap->compress) {
+		float white_excess = (white - TONEMAP_KNEE) /
+				     (1.0f - TONEMAP_KNEE);
+		tonemap->inv_white_sq = 1.0f / (white_excess * white_excess);
+	}
+	return tonemap;
+}
+
+void hdr_tonemap_destroy(struct hdr_tonemap *tonemap)
+{
+	free(tonemap);
+}
+
+enum hdr_transfer hdr_tonemap_transfer(const struct hdr_tonemap *tonemap)
+{
+	return tonemap->transfer;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Scalar path, also used for row tails */
+
+static inline float max_f(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static inline float min_f(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+static inline float half_to_float(uint16_t half)
+{
+	// same steps as half_to_float_4 below
+	uint32_t expmant = half & 0x7FFF;
+	uint32_t sign = (uint32_t)(half ^ expmant) << 16;
+	uint32_t shifted = expmant << 13;
+	uint32_t magic_bits = (254 - 15) << 23;
+	float scaled, magic;
+	memcpy(&scaled, &shifted, 4);
+	memcpy(&magic, &magic_bits, 4);
+	scaled *= magic;
+
+	uint32_t bits;
+	memcpy(&bits, &scaled, 4);
+	bits |= sign;
+	if (expmant > 0x7BFF) {
+		bits |= 255u << 23;
+	}
+	float out;
+	memcpy(&out, &bits, 4);
+	return out;
+}
+
+static inline void map_pixel(const struct hdr_tonemap *tonemap, float r,
+			     float g, float b, float a, uint8_t *out)
+{
+	if (tonemap->bt2020) {
+		const float(*m)[3] = bt2020_to_bt709;
+		float r709 = m[0][0] * r + m[0][1] * g + m[0][2] * b;
+		float g709 = m[1][0] * r + m[1][1] * g + m[1][2] * b;
+		float b709 = m[2][0] * r + m[2][1] * g + m[2][2] * b;
+		r = r709, g = g709, b = b709;
+	}
+	// written so NaNs end up as 0
+	r = max_f(r, 0.0f), g = max_f(g, 0.0f), b = max_f(b, 0.0f);
+
+	if (tonemap->compress) {
+		float m = max_f(r, max_f(g, b));
+		float e = max_f(m - TONEMAP_KNEE, 0.0f) *
+			  (1.0f / (1.0f - TONEMAP_KNEE));
+		float compressed = e * (1.0f + e * tonemap->inv_white_sq) /
+				   (1.0f + e);
+		float mapped = min_f(m, TONEMAP_KNEE) +
+			       (1.0f - TONEMAP_KNEE) * compressed;
+		float scale = mapped / max_f(m, 1e-6f);
+		r *= scale, g *= scale, b *= scale;
+	}
+
+	const float steps = (float)(ENCODE_STEPS - 1);
+	out[0] = tonemap->encode[(int)(min_f(b, 1.0f) * steps + 0.5f)];
+	out[1] = tonemap->encode[(int)(min_f(g, 1.0f) * steps + 0.5f)];
+	out[2] = tonemap->encode[(int)(min_f(r, 1.0f) * steps + 0.5f)];
+	out[3] = (uint8_t)(min_f(max_f(a, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static void rgb10a2_row_scalar(const struct hdr_tonemap *tonemap,
+			       const uint8_t *src, uint8_t *dst,
+			       uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++, src += 4, dst += 4) {
+		uint32_t px;
+		memcpy(&px, src, 4);
+		map_pixel(tonemap, tonemap->decode[px & 0x3FF],
+			  tonemap->decode[(px >> 10) & 0x3FF],
+			  tonemap->decode[(px >> 20) & 0x3FF],
+			  (float)(px >> 30) * (1.0f / 3.0f), dst);
+	}
+}
+
+static void rgba16f_row_scalar(const struct hdr_tonemap *tonemap,
+			       const uint8_t *src, uint8_t *dst,
+			       uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++, src += 8, dst += 4) {
+		uint16_t px[4];
+		memcpy(px, src, 8);
+		map_pixel(tonemap, half_to_float(px[0]), half_to_float(px[1]),
+			  half_to_float(px[2]), half_to_float(px[3]), dst);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 path, four pixels at a time */
+
+#ifdef HDR_CONVERT_SSE2
+/**
+ * Four half floats in the low 16 bits of each lane to floats,
+ * denormals, infinities and NaNs included
+ */
+static inline __m128 half_to_float_4(__m128i half)
+{
+	const __m128i expmant_mask = _mm_set1_epi32(0x7FFF);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128i infnan_above = _mm_set1_epi32(0x7BFF);
+	const __m128 infnan_exp = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+	__m128i expmant = _mm_and_si128(half, expmant_mask);
+	__m128i sign = _mm_slli_epi32(_mm_xor_si128(half, expmant), 16);
+	__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)),
+				   magic);
+	__m128 infnan = _mm_and_ps(
+		_mm_castsi128_ps(_mm_cmpgt_epi32(expmant, infnan_above)),
+		infnan_exp);
+	return _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infnan));
+}
+
+static inline void map_pixels_4(const struct hdr_tonemap *tonemap, __m128 r,
+				__m128 g, __m128 b, __m128 a, uint8_t *out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	if (tonemap->bt2020) {
+		const float(*m)[3] = bt2020_to_bt709;
+		__m128 r709 = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0][0]), r),
+				   _mm_mul_ps(_mm_set1_ps(m[0][1]), g)),
+			_mm_mul_ps(_mm_set1_ps(m[0][2]), b));
+		__m128 g709 = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[1][0]), r),
+				   _mm_mul_ps(_mm_set1_ps(m[1][1]), g)),
+			_mm_mul_ps(_mm_set1_ps(m[1][2]), b));
+		__m128 b709 = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[2][0]), r),
+				   _mm_mul_ps(_mm_set1_ps(m[2][1]), g)),
+			_mm_mul_ps(_mm_set1_ps(m[2][2]), b));
+		r = r709, g = g709, b = b709;
+	}
+	// max with the value first, so NaNs end up as 0
+	r = _mm_max_ps(r, zero), g = _mm_max_ps(g, zero);
+	b = _mm_max_ps(b, zero);
+
+	if (tonemap->compress) {
+		const __m128 knee = _mm_set1_ps(TONEMAP_KNEE);
+		__m128 m = _mm_max_ps(r, _mm_max_ps(g, b));
+		__m128 e = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(m, knee), zero),
+				      _mm_set1_ps(1.0f / (1.0f - TONEMAP_KNEE)));
+		__m128 compressed = _mm_div_ps(
+			_mm_mul_ps(e, _mm_add_ps(one,
+						 _mm_mul_ps(e, _mm_set1_ps(
+								       tonemap->inv_white_sq)))),
+			_mm_add_ps(one, e));
+		__m128 mapped = _mm_add_ps(
+			_mm_min_ps(m, knee),
+			_mm_mul_ps(_mm_set1_ps(1.0f - TONEMAP_KNEE), compressed));
+		__m128 scale = _mm_div_ps(mapped,
+					  _mm_max_ps(m, _mm_set1_ps(1e-6f)));
+		r = _mm_mul_ps(r, scale), g = _mm_mul_ps(g, scale);
+		b = _mm_mul_ps(b, scale);
+	}
+
+	const __m128 steps = _mm_set1_ps((float)(ENCODE_STEPS - 1));
+	const __m128 half = _mm_set1_ps(0.5f);
+	alignas(16) int32_t ir[4], ig[4], ib[4], ia[4];
+	_mm_store_si128((__m128i *)ir,
+			_mm_cvttps_epi32(_mm_add_ps(
+				_mm_mul_ps(_mm_min_ps(r, one), steps), half)));
+	_mm_store_si128((__m128i *)ig,
+			_mm_cvttps_epi32(_mm_add_ps(
+				_mm_mul_ps(_mm_min_ps(g, one), steps), half)));
+	_mm_store_si128((__m128i *)ib,
+			_mm_cvttps_epi32(_mm_add_ps(
+				_mm_mul_ps(_mm_min_ps(b, one), steps), half)));
+	_mm_store_si128(
+		(__m128i *)ia,
+		_mm_cvttps_epi32(_mm_add_ps(
+			_mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), one),
+				   _mm_set1_ps(255.0f)),
+			half)));
+
+	for (int p = 0; p < 4; p++, out += 4) {
+		out[0] = tonemap->encode[ib[p]];
+		out[1] = tonemap->encode[ig[p]];
+		out[2] = tonemap->encode[ir[p]];
+		out[3] = (uint8_t)ia[p];
+	}
+}
+
+static void rgb10a2_row_sse2(const struct hdr_tonemap *tonemap,
+			     const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	const __m128i mask = _mm_set1_epi32(0x3FF);
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4, src += 16, dst += 16) {
+		__m128i px = _mm_loadu_si128((const __m128i *)src);
+		alignas(16) uint32_t cr[4], cg[4], cb[4];
+		_mm_store_si128((__m128i *)cr, _mm_and_si128(px, mask));
+		_mm_store_si128((__m128i *)cg,
+				_mm_and_si128(_mm_srli_epi32(px, 10), mask));
+		_mm_store_si128((__m128i *)cb,
+				_mm_and_si128(_mm_srli_epi32(px, 20), mask));
+
+		const float *decode = tonemap->decode;
+		__m128 r = _mm_setr_ps(decode[cr[0]], decode[cr[1]],
+				       decode[cr[2]], decode[cr[3]]);
+		__m128 g = _mm_setr_ps(decode[cg[0]], decode[cg[1]],
+				       decode[cg[2]], decode[cg[3]]);
+		__m128 b = _mm_setr_ps(decode[cb[0]], decode[cb[1]],
+				       decode[cb[2]], decode[cb[3]]);
+		__m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(px, 30)),
+				      _mm_set1_ps(1.0f / 3.0f));
+		map_pixels_4(tonemap, r, g, b, a, dst);
+	}
+	rgb10a2_row_scalar(tonemap, src, dst, width - x);
+}
+
+static void rgba16f_row_sse2(const struct hdr_tonemap *tonemap,
+			     const uint8_t *src, uint8_t *dst, uint32_t width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	uint32_t x = 0;
+
+	for (; x + 4 <= width; x += 4, src += 32, dst += 16) {
+		__m128i p01 = _mm_loadu_si128((const __m128i *)src);
+		__m128i p23 = _mm_loadu_si128((const __m128i *)(src + 16));
+
+		// RGBA RGBA | RGBA RGBA -> RRRR GGGG | BBBB AAAA
+		__m128i t0 = _mm_unpacklo_epi16(p01, p23);
+		__m128i t1 = _mm_unpackhi_epi16(p01, p23);
+		__m128i rg = _mm_unpacklo_epi16(t0, t1);
+		__m128i ba = _mm_unpackhi_epi16(t0, t1);
+
+		map_pixels_4(tonemap,
+			     half_to_float_4(_mm_unpacklo_epi16(rg, zero)),
+			     half_to_float_4(_mm_unpackhi_epi16(rg, zero)),
+			     half_to_float_4(_mm_unpacklo_epi16(ba, zero)),
+			     half_to_float_4(_mm_unpackhi_epi16(ba, zero)),
+			     dst);
+	}
+	rgba16f_row_scalar(tonemap, src, dst, width - x);
+}
+#endif
+
+void hdr_tonemap_rgb10a2(const struct hdr_tonemap *tonemap,
+			 const uint8_t *src, uint32_t src_linesize,
+			 uint32_t width, uint32_t height, uint8_t *dst,
+			 uint32_t dst_linesize)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *row = src + (size_t)y * src_linesize;
+		uint8_t *out = dst + (size_t)y * dst_linesize;
+#ifdef HDR_CONVERT_SSE2
+		rgb10a2_row_sse2(tonemap, row, out, width);
+#else
+		rgb10a2_row_scalar(tonemap, row, out, width);
+#endif
+	}
+}
+
+void hdr_tonemap_rgba16f(const struct hdr_tonemap *tonemap,
+			 const uint8_t *src, uint32_t src_linesize,
+			 uint32_t width, uint32_t height, uint8_t *dst,
+			 uint32_t dst_linesize)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *row = src + (size_t)y * src_linesize;
+		uint8_t *out = dst + (size_t)y * dst_linesize;
+#ifdef HDR_CONVERT_SSE2
+		rgba16f_row_sse2(tonemap, row, out, width);
+#else
+		rgba16f_row_scalar(tonemap, row, out, width);
+#endif
+	}
+}
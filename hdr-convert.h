@@ -0,0 +1,63 @@
+/**
+ * CPU tone mapping of HDR frames to 8-bit sRGB BGRA
+ *
+ * For shared-memory senders publishing RGB10A2 (PQ / HLG, BT.2020) or
+ * RGBA16F (linear, BT.709, 1.0 = SDR white) frames that should be shown
+ * as SDR without a GPU conversion pass. Transfer functions are decoded
+ * through tables, the rest runs four pixels at a time in SSE2 where
+ * available; the scalar path gives bit-identical results.
+ *
+ * Highlights are compressed above 75% of SDR white on the largest
+ * channel, so hues are kept and SDR content below the knee is unchanged.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum hdr_transfer {
+	HDR_TRANSFER_SRGB = 0,
+	HDR_TRANSFER_LINEAR = 1,
+	HDR_TRANSFER_PQ = 2,
+	HDR_TRANSFER_HLG = 3,
+};
+
+struct hdr_tonemap;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Prepares the tables for one transfer function
+ * @param sdr_white_nits luminance SDR white maps to
+ * @param peak_nits luminance that maps to full white after tone mapping
+ * @return NULL on failure
+ */
+struct hdr_tonemap *hdr_tonemap_create(enum hdr_transfer transfer,
+				       float sdr_white_nits, float peak_nits);
+void hdr_tonemap_destroy(struct hdr_tonemap *tonemap);
+
+enum hdr_transfer hdr_tonemap_transfer(const struct hdr_tonemap *tonemap);
+
+/**
+ * R10G10B10A2 (red in the low bits) to BGRA. PQ and HLG frames are taken
+ * to be BT.2020, sRGB and linear ones BT.709.
+ */
+void hdr_tonemap_rgb10a2(const struct hdr_tonemap *tonemap,
+			 const uint8_t *src, uint32_t src_linesize,
+			 uint32_t width, uint32_t height, uint8_t *dst,
+			 uint32_t dst_linesize);
+
+/**
+ * RGBA16F to BGRA. The tonemap's transfer is ignored, half floats
+ * are always linear.
+ */
+void hdr_tonemap_rgba16f(const struct hdr_tonemap *tonemap,
+			 const uint8_t *src, uint32_t src_linesize,
+			 uint32_t width, uint32_t height, uint8_t *dst,
+			 uint32_t dst_linesize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,167 @@
+/**
+ * Batched initialisation, see init-batch.h
+ */
+#include "init-batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+struct init_batch {
+	pthread_mutex_t mutex;
+	// signalled when a batch is done with its entries
+	pthread_cond_t done_cond;
+
+	struct init_batch_entry **queue;
+	size_t num;
+	size_t capacity;
+
+	uint64_t batches;
+	uint64_t entries;
+};
+
+struct init_batch *init_batch_create(void)
+{
+	struct init_batch *batch =
+		(struct init_batch *)calloc(1, sizeof(*batch));
+	if (!batch) {
+		return NULL;
+	}
+	if (pthread_mutex_init(&batch->mutex, NULL) != 0) {
+		free(batch);
+		return NULL;
+	}
+	if (pthread_cond_init(&batch->done_cond, NULL) != 0) {
+		pthread_mutex_destroy(&batch->mutex);
+		free(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+void init_batch_destroy(struct init_batch *batch)
+{
+	if (!batch) {
+		return;
+	}
+	pthread_cond_destroy(&batch->done_cond);
+	pthread_mutex_destroy(&batch->mutex);
+	free(batch->queue);
+	free(batch);
+}
+
+// call with the mutex held
+static bool push(struct init_batch *batch, struct init_batch_entry *entry)
+{
+	if (batch->num == batch->capacity) {
+		size_t capacity = batch->capacity ? batch->capacity * 2 : 16;
+		struct init_batch_entry **queue =
+			(struct init_batch_entry **)realloc(
+				batch->queue, capacity * sizeof(*queue));
+		if (!queue) {
+			return false;
+		}
+		batch->queue = queue;
+		batch->capacity = capacity;
+	}
+	batch->queue[batch->num++] = entry;
+	entry->queued = true;
+	return true;
+}
+
+void init_batch_queue(struct init_batch *batch, struct init_batch_entry *entry,
+		      void *data)
+{
+	pthread_mutex_lock(&batch->mutex);
+	entry->data = data;
+	if (!entry->queued) {
+		push(batch, entry);
+	}
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+void init_batch_unqueue(struct init_batch *batch,
+			struct init_batch_entry *entry)
+{
+	pthread_mutex_lock(&batch->mutex);
+	// a batch that gives up queues its entries again, so look after it
+	while (entry->in_flight) {
+		pthread_cond_wait(&batch->done_cond, &batch->mutex);
+	}
+	if (entry->queued) {
+		for (size_t i = 0; i < batch->num; i++) {
+			if (batch->queue[i] == entry) {
+				memmove(batch->queue + i, batch->queue + i + 1,
+					(batch->num - i - 1) *
+						sizeof(*batch->queue));
+				batch->num--;
+				break;
+			}
+		}
+		entry->queued = false;
+	}
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+bool init_batch_pending(struct init_batch *batch,
+			const struct init_batch_entry *entry)
+{
+	pthread_mutex_lock(&batch->mutex);
+	bool pending = entry->queued || entry->in_flight;
+	pthread_mutex_unlock(&batch->mutex);
+	return pending;
+}
+
+size_t init_batch_run(struct init_batch *batch, init_batch_run_t run_cb,
+		      void *param)
+{
+	// take the queue over, items queued from now on go in a new one
+	pthread_mutex_lock(&batch->mutex);
+	struct init_batch_entry **entries = batch->queue;
+	size_t count = batch->num;
+	if (!count) {
+		pthread_mutex_unlock(&batch->mutex);
+		return 0;
+	}
+	batch->queue = NULL;
+	batch->num = batch->capacity = 0;
+	for (size_t i = 0; i < count; i++) {
+		entries[i]->queued = false;
+		entries[i]->in_flight = true;
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	bool done = run_cb(param, entries, count);
+
+	pthread_mutex_lock(&batch->mutex);
+	for (size_t i = 0; i < count; i++) {
+		entries[i]->in_flight = false;
+		if (!done && !entries[i]->queued) {
+			push(batch, entries[i]);
+		}
+	}
+	if (done) {
+		batch->batches++;
+		batch->entries += count;
+	}
+	pthread_cond_broadcast(&batch->done_cond);
+	pthread_mutex_unlock(&batch->mutex);
+
+	free(entries);
+	return done ? count : 0;
+}
+
+void init_batch_get_stats(struct init_batch *batch, uint64_t *batches,
+			  uint64_t *entries)
+{
+	pthread_mutex_lock(&batch->mutex);
+	*batches = batch->batches;
+	*entries = batch->entries;
+	pthread_mutex_unlock(&batch->mutex);
+}
@@ -0,0 +1,90 @@
+/**
+ * Batched initialisation
+ *
+ * Items (e.g. sources just shown) queue themselves, and one thread
+ * periodically takes the whole queue and initialises its items together,
+ * so work they share, like listing senders or entering a graphics
+ * context, is done once per batch instead of once per item.
+ *
+ * The queue is only locked to take it over or to change it: a batch runs
+ * without the lock, with its items marked in flight. Removing an item,
+ * e.g. before destroying it, waits only while that item is in a running
+ * batch, never for batches it isn't part of.
+ *
+ * Free of OBS dependencies, so it can be exercised on any platform.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Embedded in each item, guarded by the batch it's queued on
+ */
+struct init_batch_entry {
+	void *data;
+	bool queued;
+	bool in_flight;
+};
+
+/**
+ * Initialises a batch of count entries
+ * @return false to queue them all again, e.g. when what they share isn't
+ *         available yet
+ */
+typedef bool (*init_batch_run_t)(void *param,
+				 struct init_batch_entry **entries,
+				 size_t count);
+
+struct init_batch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @return NULL on failure
+ */
+struct init_batch *init_batch_create(void);
+
+// no batch may be running
+void init_batch_destroy(struct init_batch *batch);
+
+/**
+ * Queues entry for the next batch, does nothing if it's already queued
+ */
+void init_batch_queue(struct init_batch *batch, struct init_batch_entry *entry,
+		      void *data);
+
+/**
+ * Takes entry off the queue. If a running batch holds it, waits until that
+ * batch is done, so entry's item can be destroyed afterwards. Not from
+ * within a batch.
+ */
+void init_batch_unqueue(struct init_batch *batch,
+			struct init_batch_entry *entry);
+
+/**
+ * Whether entry is queued or in a running batch
+ */
+bool init_batch_pending(struct init_batch *batch,
+			const struct init_batch_entry *entry);
+
+/**
+ * Takes every queued entry and passes them to run_cb, without holding the
+ * queue's lock
+ * @return number of entries run
+ */
+size_t init_batch_run(struct init_batch *batch, init_batch_run_t run_cb,
+		      void *param);
+
+/**
+ * Batches run, and entries they initialised, so far
+ */
+void init_batch_get_stats(struct init_batch *batch, uint64_t *batches,
+			  uint64_t *entries);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,440 @@
+/**
+ * 3D colour LUTs, see lut3d.h
+ */
+#include "lut3d.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUT3D_SSE2 1
+#endif
+
+#define LUT3D_MAX_SIZE 256
+
+struct lut3d {
+	uint32_t size;
+
+	// size^3 nodes of 4 floats (R, G, B, 0) scaled to 0..255,
+	// 16-byte aligned inside nodes_alloc
+	float *nodes;
+	void *nodes_alloc;
+
+	// per channel (R, G, B) and input value: offset of the lower node
+	// (in nodes) and the position between it and the next one
+	uint32_t offset[3][256];
+	float frac[3][256];
+	uint32_t stride[3];
+
+	// input value -> position in nodes, before clamping
+	float scale[3];
+	float bias[3];
+};
+
+/**
+ * Position of an input value along one axis, split into the lower node
+ * and the fraction towards the next. Shared by the table set-up and the
+ * SSE2 kernel so both round identically.
+ */
+static inline float node_position(float x, float top, float *lower)
+{
+	x = x < 0.0f ? 0.0f : x;
+	x = x > top + 1.0f ? top + 1.0f : x;
+	float i = (float)(int)x;
+	*lower = i < top ? i : top;
+	return x - *lower;
+}
+
+static struct lut3d *lut3d_build(uint32_t size, const float *rgb,
+				 const float *domain_min,
+				 const float *domain_max)
+{
+	if (size < 2 || size > LUT3D_MAX_SIZE) {
+		return NULL;
+	}
+
+	struct lut3d *lut = (struct lut3d *)calloc(1, sizeof(*lut));
+	if (!lut) {
+		return NULL;
+	}
+
+	size_t count = (size_t)size * size * size;
+	lut->nodes_alloc = malloc(count * 4 * sizeof(float) + 16);
+	if (!lut->nodes_alloc) {
+		free(lut);
+		return NULL;
+	}
+	lut->nodes = (float *)(((uintptr_t)lut->nodes_alloc + 15) &
+			       ~(uintptr_t)15);
+	lut->size = size;
+
+	for (size_t i = 0; i < count; i++) {
+		lut->nodes[i * 4 + 0] = rgb[i * 3 + 0] * 255.0f;
+		lut->nodes[i * 4 + 1] = rgb[i * 3 + 1] * 255.0f;
+		lut->nodes[i * 4 + 2] = rgb[i * 3 + 2] * 255.0f;
+		lut->nodes[i * 4 + 3] = 0.0f;
+	}
+
+	lut->stride[0] = 1;
+	lut->stride[1] = size;
+	lut->stride[2] = size * size;
+
+	const float top = (float)(size - 2);
+	for (int c = 0; c < 3; c++) {
+		float range = domain_max[c] - domain_min[c];
+		if (range <= 0.0f) {
+			range = 1.0f;
+		}
+		lut->scale[c] = (float)(size - 1) / (255.0f * range);
+		lut->bias[c] = -domain_min[c] * (float)(size - 1) / range;
+
+		for (int v = 0; v < 256; v++) {
+			float lower;
+			lut->frac[c][v] = node_position(
+				(float)v * lut->scale[c] + lut->bias[c], top,
+				&lower);
+			lut->offset[c][v] = (uint32_t)lower * lut->stride[c];
+		}
+	}
+	return lut;
+}
+
+struct lut3d *lut3d_create(uint32_t size, const float *rgb)
+{
+	const float domain_min[3] = {0.0f, 0.0f, 0.0f};
+	const float domain_max[3] = {1.0f, 1.0f, 1.0f};
+	return lut3d_build(size, rgb, domain_min, domain_max);
+}
+
+static bool starts_with(const char *line, const char *keyword)
+{
+	size_t len = strlen(keyword);
+	return strncmp(line, keyword, len) == 0 &&
+	       (line[len] == 0 || isspace((unsigned char)line[len]));
+}
+
+static bool parse_floats(const char *str, float *out, int count)
+{
+	for (int i = 0; i < count; i++) {
+		char *end;
+		out[i] = strtof(str, &end);
+		if (end == str) {
+			return false;
+		}
+		str = end;
+	}
+	return true;
+}
+
+struct lut3d *lut3d_load_cube(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return NULL;
+	}
+
+	uint32_t size = 0;
+	float domain_min[3] = {0.0f, 0.0f, 0.0f};
+	float domain_max[3] = {1.0f, 1.0f, 1.0f};
+	float *rgb = NULL;
+	size_t count = 0, filled = 0;
+	bool ok = true;
+	char line[512];
+
+	while (ok && fgets(line, sizeof(line), file)) {
+		char *p = line;
+		while (isspace((unsigned char)*p)) {
+			p++;
+		}
+		if (!*p || *p == '#') {
+			continue;
+		}
+
+		if (starts_with(p, "TITLE")) {
+			continue;
+		} else if (starts_with(p, "LUT_1D_SIZE")) {
+			ok = false;
+		} else if (starts_with(p, "LUT_3D_SIZE")) {
+			long value = strtol(p + 11, NULL, 10);
+			if (rgb || value < 2 || value > LUT3D_MAX_SIZE) {
+				ok = false;
+				break;
+			}
+			size = (uint32_t)value;
+			count = (size_t)size * size * size;
+			rgb = (float *)malloc(count * 3 * sizeof(float));
+			ok = rgb != NULL;
+		} else if (starts_with(p, "DOMAIN_MIN")) {
+			ok = parse_floats(p + 10, domain_min, 3);
+		} else if (starts_with(p, "DOMAIN_MAX")) {
+			ok = parse_floats(p + 10, domain_max, 3);
+		} else if (starts_with(p, "LUT_3D_INPUT_RANGE")) {
+			float range[2];
+			ok = parse_floats(p + 18, range, 2);
+			for (int c = 0; c < 3; c++) {
+				domain_min[c] = range[0];
+				domain_max[c] = range[1];
+			}
+		} else if (isdigit((unsigned char)*p) || *p == '-' ||
+			   *p == '.' || *p == '+') {
+			ok = rgb && filled < count &&
+			     parse_floats(p, rgb + filled * 3, 3);
+			filled++;
+		}
+		// other keywords are ignored, as the format allows
+	}
+	fclose(file);
+
+	struct lut3d *lut = NULL;
+	if (ok && rgb && filled == count) {
+		lut = lut3d_build(size, rgb, domain_min, domain_max);
+	}
+	free(rgb);
+	return lut;
+}
+
+void lut3d_destroy(struct lut3d *lut)
+{
+	if (!lut) {
+		return;
+	}
+	free(lut->nodes_alloc);
+	free(lut);
+}
+
+uint32_t lut3d_size(const struct lut3d *lut)
+{
+	return lut ? lut->size : 0;
+}
+
+static inline float max_f(float a, float b)
+{
+	return a > b ? a : b;
+}
+
+static inline float min_f(float a, float b)
+{
+	return a < b ? a : b;
+}
+
+/**
+ * Picks the tetrahedron of the cube cell containing the colour and
+ * the weights of its four corners: the lower node, one step along the
+ * largest fraction, one more along the second largest, and the upper node.
+ * Written with selects only, colours in real frames don't branch-predict.
+ * @return offset of the lower node
+ */
+static inline uint32_t tetrahedron(const struct lut3d *lut, uint8_t r,
+				   uint8_t g, uint8_t b, uint32_t *step1,
+				   uint32_t *step2, float *weights)
+{
+	const uint32_t sr = lut->stride[0];
+	const uint32_t sg = lut->stride[1];
+	const uint32_t sb = lut->stride[2];
+	const float fr = lut->frac[0][r];
+	const float fg = lut->frac[1][g];
+	const float fb = lut->frac[2][b];
+
+	// ties go to red for the largest and to blue for the smallest,
+	// so the two are always different axes
+	uint32_t largest = (fr >= fg && fr >= fb) ? sr : (fg >= fb ? sg : sb);
+	uint32_t smallest = (fb <= fg && fb <= fr) ? sb
+						   : (fg <= fr ? sg : sr);
+	*step1 = largest;
+	*step2 = sr + sg + sb - smallest;
+
+	float f1 = max_f(fr, max_f(fg, fb));
+	float f3 = min_f(fr, min_f(fg, fb));
+	float f2 = max_f(min_f(fr, fg), min_f(max_f(fr, fg), fb));
+
+	weights[0] = 1.0f - f1;
+	weights[1] = f1 - f2;
+	weights[2] = f2 - f3;
+	weights[3] = f3;
+	return lut->offset[0][r] + lut->offset[1][g] + lut->offset[2][b];
+}
+
+static inline uint8_t clamp_byte(float value)
+{
+	if (value <= 0.0f) {
+		return 0;
+	}
+	if (value >= 255.0f) {
+		return 255;
+	}
+	return (uint8_t)(value + 0.5f);
+}
+
+static void apply_scalar(const struct lut3d *lut, uint8_t *dst,
+			 const uint8_t *src, size_t pixels, int ri, int bi)
+{
+	const uint32_t upper = lut->stride[0] + lut->stride[1] +
+			       lut->stride[2];
+
+	for (size_t i = 0; i < pixels; i++, src += 4, dst += 4) {
+		uint32_t step1, step2;
+		float w[4];
+		uint32_t base = tetrahedron(lut, src[ri], src[1], src[bi],
+					    &step1, &step2, w);
+
+		const float *c0 = lut->nodes + (size_t)base * 4;
+		const float *c1 = c0 + (size_t)step1 * 4;
+		const float *c2 = c0 + (size_t)step2 * 4;
+		const float *c3 = c0 + (size_t)upper * 4;
+
+		float out[3];
+		for (int c = 0; c < 3; c++) {
+			out[c] = w[0] * c0[c] + w[1] * c1[c] + w[2] * c2[c] +
+				 w[3] * c3[c];
+		}
+		uint8_t alpha = src[3];
+		dst[ri] = clamp_byte(out[0]);
+		dst[1] = clamp_byte(out[1]);
+		dst[bi] = clamp_byte(out[2]);
+		dst[3] = alpha;
+	}
+}
+
+#ifdef LUT3D_SSE2
+static inline __m128 select_ps(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i select_si128(__m128 mask, __m128i a, __m128i b)
+{
+	return _mm_castps_si128(select_ps(mask, _mm_castsi128_ps(a),
+					  _mm_castsi128_ps(b)));
+}
+
+static inline __m128 channel(__m128i pixels, int index)
+{
+	return _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(pixels, index * 8),
+					     _mm_set1_epi32(0xFF)));
+}
+
+static inline __m128 weigh_node(const float *node, float weight)
+{
+	return _mm_mul_ps(_mm_set1_ps(weight), _mm_load_ps(node));
+}
+
+/**
+ * Four pixels per iteration: node positions, tetrahedron selection and
+ * weights are computed across the four in SSE registers, then each pixel
+ * blends its four nodes as one RGB vector
+ */
+static void apply_sse2(const struct lut3d *lut, uint8_t *dst,
+		       const uint8_t *src, size_t pixels, bool bgra)
+{
+	const int ri = bgra ? 2 : 0;
+	const int bi = bgra ? 0 : 2;
+	const uint32_t upper = lut->stride[0] + lut->stride[1] +
+			       lut->stride[2];
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 top = _mm_set1_ps((float)(lut->size - 2));
+	const __m128 limit = _mm_set1_ps((float)(lut->size - 1));
+	const __m128i colour_mask = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i sr = _mm_set1_epi32((int)lut->stride[0]);
+	const __m128i sg = _mm_set1_epi32((int)lut->stride[1]);
+	const __m128i sb = _mm_set1_epi32((int)lut->stride[2]);
+	const __m128i s_all = _mm_set1_epi32((int)upper);
+	const __m128 fsg = _mm_set1_ps((float)lut->stride[1]);
+	const __m128 fsb = _mm_set1_ps((float)lut->stride[2]);
+
+	size_t i = 0;
+	for (; i + 4 <= pixels; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(src + i * 4));
+
+		__m128 pos[3], lower[3], frac[3];
+		pos[0] = channel(px, ri);
+		pos[1] = channel(px, 1);
+		pos[2] = channel(px, bi);
+		for (int c = 0; c < 3; c++) {
+			__m128 x = _mm_add_ps(
+				_mm_mul_ps(pos[c], _mm_set1_ps(lut->scale[c])),
+				_mm_set1_ps(lut->bias[c]));
+			x = _mm_min_ps(_mm_max_ps(x, zero), limit);
+			lower[c] = _mm_min_ps(
+				_mm_cvtepi32_ps(_mm_cvttps_epi32(x)), top);
+			frac[c] = _mm_sub_ps(x, lower[c]);
+		}
+		const __m128 fr = frac[0], fg = frac[1], fb = frac[2];
+
+		// node offsets stay below 2^24, exact in floats
+		__m128i base = _mm_cvttps_epi32(_mm_add_ps(
+			_mm_add_ps(lower[0], _mm_mul_ps(lower[1], fsg)),
+			_mm_mul_ps(lower[2], fsb)));
+
+		// same tie rules as tetrahedron()
+		__m128 r_largest = _mm_and_ps(_mm_cmpge_ps(fr, fg),
+					      _mm_cmpge_ps(fr, fb));
+		__m128 g_largest = _mm_cmpge_ps(fg, fb);
+		__m128i step1 = select_si128(r_largest, sr,
+					     select_si128(g_largest, sg, sb));
+		__m128 b_smallest = _mm_and_ps(_mm_cmple_ps(fb, fg),
+					       _mm_cmple_ps(fb, fr));
+		__m128 g_smallest = _mm_cmple_ps(fg, fr);
+		__m128i step2 = _mm_sub_epi32(
+			s_all, select_si128(b_smallest, sb,
+					    select_si128(g_smallest, sg, sr)));
+
+		__m128 f1 = _mm_max_ps(fr, _mm_max_ps(fg, fb));
+		__m128 f3 = _mm_min_ps(fr, _mm_min_ps(fg, fb));
+		__m128 f2 = _mm_max_ps(_mm_min_ps(fr, fg),
+				       _mm_min_ps(_mm_max_ps(fr, fg), fb));
+
+		alignas(16) uint32_t bases[4], steps1[4], steps2[4];
+		alignas(16) float w0[4], w1[4], w2[4], w3[4];
+		_mm_store_si128((__m128i *)bases, base);
+		_mm_store_si128((__m128i *)steps1, step1);
+		_mm_store_si128((__m128i *)steps2, step2);
+		_mm_store_ps(w0, _mm_sub_ps(one, f1));
+		_mm_store_ps(w1, _mm_sub_ps(f1, f2));
+		_mm_store_ps(w2, _mm_sub_ps(f2, f3));
+		_mm_store_ps(w3, f3);
+
+		__m128i out[4];
+		for (int p = 0; p < 4; p++) {
+			const float *c0 = lut->nodes + (size_t)bases[p] * 4;
+			__m128 rgb = weigh_node(c0, w0[p]);
+			rgb = _mm_add_ps(rgb, weigh_node(c0 + (size_t)steps1[p] * 4,
+							 w1[p]));
+			rgb = _mm_add_ps(rgb, weigh_node(c0 + (size_t)steps2[p] * 4,
+							 w2[p]));
+			rgb = _mm_add_ps(rgb,
+					 weigh_node(c0 + (size_t)upper * 4, w3[p]));
+			if (bgra) {
+				rgb = _mm_shuffle_ps(rgb, rgb,
+						     _MM_SHUFFLE(3, 0, 1, 2));
+			}
+			out[p] = _mm_cvttps_epi32(
+				_mm_max_ps(_mm_add_ps(rgb, half), zero));
+		}
+
+		// saturate to bytes and keep the source alpha
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(out[0], out[1]),
+						  _mm_packs_epi32(out[2], out[3]));
+		packed = _mm_or_si128(_mm_and_si128(packed, colour_mask),
+				      _mm_andnot_si128(colour_mask, px));
+		_mm_storeu_si128((__m128i *)(dst + i * 4), packed);
+	}
+
+	apply_scalar(lut, dst + i * 4, src + i * 4, pixels - i, ri, bi);
+}
+#endif
+
+void lut3d_apply(const struct lut3d *lut, uint8_t *dst, const uint8_t *src,
+		 size_t pixels, bool bgra)
+{
+#ifdef LUT3D_SSE2
+	apply_sse2(lut, dst, src, pixels, bgra);
+#else
+	apply_scalar(lut, dst, src, pixels, bgra ? 2 : 0, bgra ? 0 : 2);
+#endif
+}
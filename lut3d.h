@@ -0,0 +1,47 @@
+/**
+ * 3D colour LUTs (.cube files) for 32-bit (BGRA/RGBA) frames
+ *
+ * Applied with tetrahedral interpolation while a frame is copied, so
+ * grading costs no extra pass over the frame. SSE2 where available,
+ * scalar otherwise. Alpha is passed through.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct lut3d;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Loads a .cube file with a LUT_3D_SIZE between 2 and 256.
+ * DOMAIN_MIN / DOMAIN_MAX are honoured, 1D LUTs are refused.
+ * @return NULL on failure
+ */
+struct lut3d *lut3d_load_cube(const char *path);
+
+/**
+ * Builds a LUT from size^3 RGB float triples, red changing fastest
+ * (the .cube data order)
+ * @return NULL on failure
+ */
+struct lut3d *lut3d_create(uint32_t size, const float *rgb);
+
+void lut3d_destroy(struct lut3d *lut);
+
+uint32_t lut3d_size(const struct lut3d *lut);
+
+/**
+ * Copies pixels from src to dst through the LUT. dst may equal src.
+ * @param bgra true if the pixels are BGRA, false if RGBA
+ */
+void lut3d_apply(const struct lut3d *lut, uint8_t *dst, const uint8_t *src,
+		 size_t pixels, bool bgra);
+
+#ifdef __cplusplus
+}
+#endif
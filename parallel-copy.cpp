@@ -0,0 +1,182 @@
+/**
+ * Row copies on a worker pool, see parallel-copy.h
+ */
+#include "parallel-copy.h"
+
+#include <util/threading.h>
+#include <util/platform.h>
+#include <string.h>
+
+// rows one thread copies at a time
+#define PARALLEL_COPY_BAND_ROWS 128
+#define PARALLEL_COPY_MAX_THREADS 7
+
+// one batch at a time
+static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// guards everything below
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t threads[PARALLEL_COPY_MAX_THREADS];
+static int thread_count;
+static bool started;
+static bool stopping;
+
+static const struct parallel_copy_job *batch_jobs;
+static size_t batch_count;
+static size_t next_job;
+static uint32_t next_row;
+static size_t bands_total;
+static size_t bands_done;
+
+/**
+ * Takes the next band of the batch, call with pool_mutex held
+ * @return false if the whole batch has been handed out
+ */
+static bool take_band(const struct parallel_copy_job **job, uint32_t *row,
+		      uint32_t *rows)
+{
+	while (next_job < batch_count && next_row >= batch_jobs[next_job].rows) {
+		next_job++;
+		next_row = 0;
+	}
+	if (next_job >= batch_count) {
+		return false;
+	}
+
+	*job = &batch_jobs[next_job];
+	*row = next_row;
+	uint32_t left = (*job)->rows - next_row;
+	*rows = left < PARALLEL_COPY_BAND_ROWS ? left : PARALLEL_COPY_BAND_ROWS;
+	next_row += *rows;
+	return true;
+}
+
+static void copy_band(const struct parallel_copy_job *job, uint32_t row,
+		      uint32_t rows)
+{
+	uint8_t *dst = job->dst + (size_t)row * job->dst_linesize;
+	const uint8_t *src = job->src + (size_t)row * job->src_linesize;
+	if (job->dst_linesize == job->row_bytes &&
+	    job->src_linesize == job->row_bytes) {
+		memcpy(dst, src, (size_t)job->row_bytes * rows);
+		return;
+	}
+	for (uint32_t y = 0; y < rows; y++) {
+		memcpy(dst, src, job->row_bytes);
+		dst += job->dst_linesize;
+		src += job->src_linesize;
+	}
+}
+
+/**
+ * Copies bands until the batch is handed out, call with pool_mutex held
+ */
+static void work_on_batch(void)
+{
+	const struct parallel_copy_job *job;
+	uint32_t row, rows;
+	while (take_band(&job, &row, &rows)) {
+		pthread_mutex_unlock(&pool_mutex);
+		copy_band(job, row, rows);
+		pthread_mutex_lock(&pool_mutex);
+		if (++bands_done == bands_total) {
+			pthread_cond_signal(&done_cond);
+		}
+	}
+}
+
+static void *copy_thread(void *param)
+{
+	(void)param;
+	os_set_thread_name("spout: parallel copy");
+
+	pthread_mutex_lock(&pool_mutex);
+	while (!stopping) {
+		work_on_batch();
+		if (!stopping) {
+			pthread_cond_wait(&work_cond, &pool_mutex);
+		}
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	return NULL;
+}
+
+// call with call_mutex held
+static void start_pool(void)
+{
+	started = true;
+	int cores = os_get_logical_cores();
+	int count = cores > 1 ? cores - 1 : 0;
+	if (count > PARALLEL_COPY_MAX_THREADS) {
+		count = PARALLEL_COPY_MAX_THREADS;
+	}
+
+	thread_count = 0;
+	for (int i = 0; i < count; i++) {
+		if (pthread_create(&threads[thread_count], NULL, copy_thread,
+				   NULL) != 0) {
+			break;
+		}
+		thread_count++;
+	}
+}
+
+void parallel_copy_rows(const struct parallel_copy_job *jobs, size_t count)
+{
+	size_t bands = 0;
+	for (size_t i = 0; i < count; i++) {
+		bands += (jobs[i].rows + PARALLEL_COPY_BAND_ROWS - 1) /
+			 PARALLEL_COPY_BAND_ROWS;
+	}
+	if (!bands) {
+		return;
+	}
+
+	pthread_mutex_lock(&call_mutex);
+	if (!started) {
+		start_pool();
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	batch_jobs = jobs;
+	batch_count = count;
+	next_job = 0;
+	next_row = 0;
+	bands_total = bands;
+	bands_done = 0;
+	if (bands > 1) {
+		pthread_cond_broadcast(&work_cond);
+	}
+
+	work_on_batch();
+	while (bands_done < bands_total) {
+		pthread_cond_wait(&done_cond, &pool_mutex);
+	}
+	batch_jobs = NULL;
+	batch_count = 0;
+	pthread_mutex_unlock(&pool_mutex);
+
+	pthread_mutex_unlock(&call_mutex);
+}
+
+void parallel_copy_free(void)
+{
+	pthread_mutex_lock(&call_mutex);
+	if (started) {
+		pthread_mutex_lock(&pool_mutex);
+		stopping = true;
+		pthread_cond_broadcast(&work_cond);
+		pthread_mutex_unlock(&pool_mutex);
+
+		for (int i = 0; i < thread_count; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		thread_count = 0;
+		started = false;
+		stopping = false;
+	}
+	pthread_mutex_unlock(&call_mutex);
+}
@@ -0,0 +1,39 @@
+/**
+ * Row copies spread over a small pool of worker threads
+ *
+ * For frames too large to copy on one core in time, e.g. a sender split
+ * into several mapped tile textures. The calling thread works on the
+ * batch too and returns once every row is copied. The pool is started on
+ * first use; with a single core everything runs on the caller.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct parallel_copy_job {
+	uint8_t *dst;
+	uint32_t dst_linesize;
+	const uint8_t *src;
+	uint32_t src_linesize;
+	// bytes copied from each row
+	uint32_t row_bytes;
+	uint32_t rows;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Copies all jobs, split into bands of rows across the pool.
+ * Batches from several threads are run one after another.
+ */
+void parallel_copy_rows(const struct parallel_copy_job *jobs, size_t count);
+
+// Stops the worker threads; the next batch starts them again
+void parallel_copy_free(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,751 @@
+/**
+ * Raw frame recordings, see raw-file.h
+ *
+ * The writer keeps a fixed set of page-aligned buffers. raw_writer_write
+ * copies a frame into a free one and queues it; the writer thread writes
+ * queued buffers in order and hands them back. When the disk can't keep up
+ * every buffer ends up queued and new frames are dropped rather than
+ * stalling the caller.
+ */
+#include "raw-file.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define RAW_FILE_INDEX_SIZE                                               \
+	((sizeof(struct raw_index_header) +                               \
+	  RAW_FILE_INDEX_FRAMES * sizeof(struct raw_index_entry) +        \
+	  RAW_FILE_PAGE - 1) /                                            \
+	 RAW_FILE_PAGE * RAW_FILE_PAGE)
+
+struct raw_buffer {
+	uint8_t *data;
+	size_t capacity;
+	size_t size;
+};
+
+struct raw_writer {
+#ifdef _WIN32
+	HANDLE file;
+#else
+	int fd;
+#endif
+	pthread_t thread;
+	bool thread_started;
+
+	// guards everything down to stats
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct raw_buffer *buffers;
+	uint32_t buffer_count;
+	// indices of free buffers, a stack
+	uint32_t *free_list;
+	uint32_t free_count;
+	// indices of queued buffers, a FIFO
+	uint32_t *queue;
+	uint32_t queue_head;
+	uint32_t queue_count;
+	bool stopping;
+	struct raw_writer_stats stats;
+
+	// writer thread only
+	uint64_t offset;
+	uint64_t prev_index_offset;
+	uint8_t *index;
+};
+
+struct raw_reader {
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+	const uint8_t *base;
+	uint64_t size;
+	uint64_t *offsets;
+	size_t count;
+	char sender[256];
+};
+
+static inline size_t align_up(size_t val, size_t align)
+{
+	return (val + align - 1) / align * align;
+}
+
+static uint64_t monotonic_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint8_t *aligned_alloc_page(size_t size)
+{
+#ifdef _WIN32
+	return (uint8_t *)_aligned_malloc(size, RAW_FILE_PAGE);
+#else
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, RAW_FILE_PAGE, size) != 0) {
+		return NULL;
+	}
+	return (uint8_t *)ptr;
+#endif
+}
+
+static void aligned_free_page(uint8_t *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* Platform file layer */
+
+#ifdef _WIN32
+static HANDLE open_utf8(const char *path, DWORD access, DWORD creation,
+			DWORD flags)
+{
+	wchar_t wpath[MAX_PATH];
+	if (!MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, MAX_PATH)) {
+		return INVALID_HANDLE_VALUE;
+	}
+	return CreateFileW(wpath, access, FILE_SHARE_READ, NULL, creation,
+			   flags, NULL);
+}
+#endif
+
+static bool writer_create_file(struct raw_writer *writer, const char *path)
+{
+#ifdef _WIN32
+	// unbuffered: page-aligned buffers, offsets and sizes
+	writer->file = open_utf8(path, GENERIC_WRITE, CREATE_ALWAYS,
+				 FILE_ATTRIBUTE_NORMAL |
+					 FILE_FLAG_NO_BUFFERING |
+					 FILE_FLAG_SEQUENTIAL_SCAN);
+	return writer->file != INVALID_HANDLE_VALUE;
+#else
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+	writer->fd = open(path, flags | O_DIRECT, 0644);
+	// some file systems (tmpfs) refuse O_DIRECT
+	if (writer->fd < 0 && errno == EINVAL) {
+		writer->fd = open(path, flags, 0644);
+	}
+#else
+	writer->fd = open(path, flags, 0644);
+#endif
+	return writer->fd >= 0;
+#endif
+}
+
+static void writer_close_file(struct raw_writer *writer)
+{
+#ifdef _WIN32
+	CloseHandle(writer->file);
+#else
+	close(writer->fd);
+#endif
+}
+
+static bool writer_write_at(struct raw_writer *writer, const uint8_t *data,
+			    size_t size, uint64_t offset)
+{
+	while (size) {
+#ifdef _WIN32
+		DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		OVERLAPPED overlapped = {0};
+		overlapped.Offset = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+		DWORD written = 0;
+		if (!WriteFile(writer->file, data, chunk, &written,
+			       &overlapped) ||
+		    !written) {
+			return false;
+		}
+#else
+		ssize_t written = pwrite(writer->fd, data, size, (off_t)offset);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+#endif
+		data += written;
+		size -= (size_t)written;
+		offset += (uint64_t)written;
+	}
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Writer */
+
+static bool writer_write_index(struct raw_writer *writer)
+{
+	struct raw_index_header *header =
+		(struct raw_index_header *)writer->index;
+	header->prev_offset = writer->prev_index_offset;
+	size_t size = align_up(sizeof(*header) + header->count *
+						       sizeof(struct raw_index_entry),
+			       RAW_FILE_PAGE);
+	if (!writer_write_at(writer, writer->index, size, writer->offset)) {
+		return false;
+	}
+
+	writer->prev_index_offset = writer->offset;
+	writer->offset += size;
+	memset(writer->index, 0, RAW_FILE_INDEX_SIZE);
+	header->magic = RAW_FILE_INDEX_MAGIC;
+	return true;
+}
+
+static bool writer_write_frame(struct raw_writer *writer,
+			       const struct raw_buffer *buffer)
+{
+	if (!writer_write_at(writer, buffer->data, buffer->size,
+			     writer->offset)) {
+		return false;
+	}
+
+	const struct raw_frame_header *frame =
+		(const struct raw_frame_header *)buffer->data;
+	struct raw_index_header *header =
+		(struct raw_index_header *)writer->index;
+	struct raw_index_entry *entry =
+		(struct raw_index_entry *)(header + 1) + header->count++;
+	entry->offset = writer->offset;
+	entry->timestamp_ns = frame->timestamp_ns;
+	entry->width = frame->width;
+	entry->height = frame->height;
+	entry->format = frame->format;
+	entry->linesize = frame->linesize;
+	entry->size = frame->size;
+	writer->offset += buffer->size;
+
+	if (header->count == RAW_FILE_INDEX_FRAMES) {
+		return writer_write_index(writer);
+	}
+	return true;
+}
+
+static bool writer_finish(struct raw_writer *writer)
+{
+	struct raw_index_header *header =
+		(struct raw_index_header *)writer->index;
+	if (header->count && !writer_write_index(writer)) {
+		return false;
+	}
+
+	// the index buffer is free now, the trailer goes out of its first page
+	memset(writer->index, 0, RAW_FILE_PAGE);
+	struct raw_file_trailer *trailer =
+		(struct raw_file_trailer *)writer->index;
+	memcpy(trailer->magic, RAW_FILE_TRAILER_MAGIC, sizeof(trailer->magic));
+	trailer->index_offset = writer->prev_index_offset;
+	trailer->frame_count = writer->stats.frames;
+	return writer_write_at(writer, writer->index, RAW_FILE_PAGE,
+			       writer->offset);
+}
+
+static void *writer_thread(void *param)
+{
+	struct raw_writer *writer = (struct raw_writer *)param;
+
+	pthread_mutex_lock(&writer->mutex);
+	for (;;) {
+		while (!writer->queue_count && !writer->stopping) {
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		if (!writer->queue_count) {
+			break;
+		}
+
+		uint32_t index = writer->queue[writer->queue_head];
+		writer->queue_head =
+			(writer->queue_head + 1) % writer->buffer_count;
+		writer->queue_count--;
+		bool failed = writer->stats.failed;
+		pthread_mutex_unlock(&writer->mutex);
+
+		struct raw_buffer *buffer = &writer->buffers[index];
+		uint64_t start = monotonic_ns();
+		bool ok = !failed && writer_write_frame(writer, buffer);
+		uint64_t elapsed = monotonic_ns() - start;
+
+		pthread_mutex_lock(&writer->mutex);
+		if (ok) {
+			writer->stats.frames++;
+			writer->stats.bytes += buffer->size;
+			writer->stats.write_ns += elapsed;
+		} else {
+			writer->stats.failed = true;
+			writer->stats.dropped++;
+		}
+		writer->free_list[writer->free_count++] = index;
+	}
+	pthread_mutex_unlock(&writer->mutex);
+
+	if (!writer->stats.failed && !writer_finish(writer)) {
+		writer->stats.failed = true;
+	}
+	return NULL;
+}
+
+static void writer_free(struct raw_writer *writer)
+{
+	if (writer->buffers) {
+		for (uint32_t i = 0; i < writer->buffer_count; i++) {
+			aligned_free_page(writer->buffers[i].data);
+		}
+	}
+	aligned_free_page(writer->index);
+	free(writer->buffers);
+	free(writer->free_list);
+	free(writer->queue);
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->mutex);
+	free(writer);
+}
+
+struct raw_writer *raw_writer_open(const char *path, const char *sender,
+				   uint32_t buffers)
+{
+	if (!buffers) {
+		buffers = 1;
+	}
+
+	struct raw_writer *writer =
+		(struct raw_writer *)calloc(1, sizeof(*writer));
+	if (!writer) {
+		return NULL;
+	}
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, NULL);
+
+	writer->buffers =
+		(struct raw_buffer *)calloc(buffers, sizeof(struct raw_buffer));
+	writer->free_list = (uint32_t *)calloc(buffers, sizeof(uint32_t));
+	writer->queue = (uint32_t *)calloc(buffers, sizeof(uint32_t));
+	writer->index = aligned_alloc_page(RAW_FILE_INDEX_SIZE);
+	if (!writer->buffers || !writer->free_list || !writer->queue ||
+	    !writer->index) {
+		writer_free(writer);
+		return NULL;
+	}
+	writer->buffer_count = buffers;
+	for (uint32_t i = 0; i < buffers; i++) {
+		writer->free_list[i] = i;
+	}
+	writer->free_count = buffers;
+	memset(writer->index, 0, RAW_FILE_INDEX_SIZE);
+	((struct raw_index_header *)writer->index)->magic =
+		RAW_FILE_INDEX_MAGIC;
+
+	if (!writer_create_file(writer, path)) {
+		writer_free(writer);
+		return NULL;
+	}
+
+	// the file header goes out of the index buffer before it's used
+	struct raw_file_header *header =
+		(struct raw_file_header *)writer->index;
+	memcpy(header->magic, RAW_FILE_MAGIC, sizeof(header->magic));
+	header->version = RAW_FILE_VERSION;
+	header->page_size = RAW_FILE_PAGE;
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	header->created_ns =
+		(uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+	snprintf(header->sender, sizeof(header->sender), "%s",
+		 sender ? sender : "");
+	bool written = writer_write_at(writer, writer->index, RAW_FILE_PAGE, 0);
+	memset(writer->index, 0, RAW_FILE_PAGE);
+	((struct raw_index_header *)writer->index)->magic =
+		RAW_FILE_INDEX_MAGIC;
+	writer->offset = RAW_FILE_PAGE;
+
+	if (!written ||
+	    pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+		writer_close_file(writer);
+		writer_free(writer);
+		return NULL;
+	}
+	writer->thread_started = true;
+	return writer;
+}
+
+bool raw_writer_write(struct raw_writer *writer,
+		      const struct raw_frame_header *header,
+		      const uint8_t *pixels)
+{
+	size_t pixel_size = (size_t)header->linesize * header->height;
+	size_t size = align_up(sizeof(*header) + pixel_size, RAW_FILE_PAGE);
+
+	pthread_mutex_lock(&writer->mutex);
+	if (!writer->free_count || writer->stats.failed) {
+		writer->stats.dropped++;
+		pthread_mutex_unlock(&writer->mutex);
+		return false;
+	}
+	uint32_t index = writer->free_list[--writer->free_count];
+	pthread_mutex_unlock(&writer->mutex);
+
+	// the buffer is ours until it's queued
+	struct raw_buffer *buffer = &writer->buffers[index];
+	if (buffer->capacity < size) {
+		aligned_free_page(buffer->data);
+		buffer->data = aligned_alloc_page(size);
+		buffer->capacity = buffer->data ? size : 0;
+	}
+	if (!buffer->data) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->free_list[writer->free_count++] = index;
+		writer->stats.dropped++;
+		pthread_mutex_unlock(&writer->mutex);
+		return false;
+	}
+
+	struct raw_frame_header *frame = (struct raw_frame_header *)buffer->data;
+	*frame = *header;
+	frame->magic = RAW_FILE_FRAME_MAGIC;
+	frame->size = pixel_size;
+	memcpy(frame + 1, pixels, pixel_size);
+	memset((uint8_t *)(frame + 1) + pixel_size, 0,
+	       size - sizeof(*frame) - pixel_size);
+	buffer->size = size;
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->queue[(writer->queue_head + writer->queue_count) %
+		      writer->buffer_count] = index;
+	writer->queue_count++;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	return true;
+}
+
+void raw_writer_get_stats(struct raw_writer *writer,
+			  struct raw_writer_stats *stats)
+{
+	pthread_mutex_lock(&writer->mutex);
+	*stats = writer->stats;
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+void raw_writer_close(struct raw_writer *writer,
+		      struct raw_writer_stats *stats)
+{
+	if (!writer) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	writer->stopping = true;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	if (writer->thread_started) {
+		pthread_join(writer->thread, NULL);
+	}
+
+	if (stats) {
+		*stats = writer->stats;
+	}
+	writer_close_file(writer);
+	writer_free(writer);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Reader */
+
+static bool reader_map(struct raw_reader *reader, const char *path)
+{
+#ifdef _WIN32
+	reader->file = open_utf8(path, GENERIC_READ, OPEN_EXISTING,
+				 FILE_ATTRIBUTE_NORMAL);
+	if (reader->file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(reader->file, &size) || !size.QuadPart) {
+		CloseHandle(reader->file);
+		return false;
+	}
+	reader->mapping = CreateFileMappingA(reader->file, NULL, PAGE_READONLY,
+					     0, 0, NULL);
+	if (!reader->mapping) {
+		CloseHandle(reader->file);
+		return false;
+	}
+	reader->base = (const uint8_t *)MapViewOfFile(reader->mapping,
+						      FILE_MAP_READ, 0, 0, 0);
+	if (!reader->base) {
+		CloseHandle(reader->mapping);
+		CloseHandle(reader->file);
+		return false;
+	}
+	reader->size = (uint64_t)size.QuadPart;
+#else
+	reader->fd = open(path, O_RDONLY);
+	if (reader->fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(reader->fd, &st) != 0 || !st.st_size) {
+		close(reader->fd);
+		return false;
+	}
+	void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+			  reader->fd, 0);
+	if (base == MAP_FAILED) {
+		close(reader->fd);
+		return false;
+	}
+	reader->base = (const uint8_t *)base;
+	reader->size = (uint64_t)st.st_size;
+#endif
+	return true;
+}
+
+static void reader_unmap(struct raw_reader *reader)
+{
+#ifdef _WIN32
+	UnmapViewOfFile(reader->base);
+	CloseHandle(reader->mapping);
+	CloseHandle(reader->file);
+#else
+	munmap((void *)reader->base, (size_t)reader->size);
+	close(reader->fd);
+#endif
+}
+
+static bool reader_add(struct raw_reader *reader, uint64_t offset,
+		       size_t *capacity)
+{
+	if (reader->count == *capacity) {
+		size_t grown = *capacity ? *capacity * 2 : 256;
+		uint64_t *offsets = (uint64_t *)realloc(
+			reader->offsets, grown * sizeof(uint64_t));
+		if (!offsets) {
+			return false;
+		}
+		reader->offsets = offsets;
+		*capacity = grown;
+	}
+	reader->offsets[reader->count++] = offset;
+	return true;
+}
+
+// whether a whole frame starts at offset
+static bool reader_frame_valid(const struct raw_reader *reader,
+			       uint64_t offset)
+{
+	if (offset % RAW_FILE_PAGE ||
+	    offset + sizeof(struct raw_frame_header) > reader->size) {
+		return false;
+	}
+	const struct raw_frame_header *frame =
+		(const struct raw_frame_header *)(reader->base + offset);
+	return frame->magic == RAW_FILE_FRAME_MAGIC &&
+	       frame->size <= reader->size - offset - sizeof(*frame) &&
+	       frame->size >= (uint64_t)frame->linesize * frame->height;
+}
+
+/**
+ * Follows the index blocks back from the trailer
+ * @return false if the trailer or an index block is missing or damaged
+ */
+static bool reader_load_index(struct raw_reader *reader)
+{
+	if (reader->size < 2 * RAW_FILE_PAGE) {
+		return false;
+	}
+	const struct raw_file_trailer *trailer =
+		(const struct raw_file_trailer *)(reader->base + reader->size -
+						  RAW_FILE_PAGE);
+	if (memcmp(trailer->magic, RAW_FILE_TRAILER_MAGIC,
+		   sizeof(trailer->magic)) != 0 ||
+	    trailer->frame_count > reader->size / RAW_FILE_PAGE) {
+		return false;
+	}
+
+	size_t count = (size_t)trailer->frame_count;
+	reader->offsets = (uint64_t *)calloc(count ? count : 1,
+					     sizeof(uint64_t));
+	if (!reader->offsets) {
+		return false;
+	}
+
+	// blocks are visited last first, entries are filled in from the end
+	size_t left = count;
+	uint64_t offset = trailer->index_offset;
+	while (left) {
+		if (!offset || offset % RAW_FILE_PAGE ||
+		    offset + sizeof(struct raw_index_header) > reader->size) {
+			return false;
+		}
+		const struct raw_index_header *header =
+			(const struct raw_index_header *)(reader->base + offset);
+		if (header->magic != RAW_FILE_INDEX_MAGIC ||
+		    header->count > left || header->count > RAW_FILE_INDEX_FRAMES ||
+		    offset + sizeof(*header) +
+				    header->count *
+					    sizeof(struct raw_index_entry) >
+			    reader->size) {
+			return false;
+		}
+
+		const struct raw_index_entry *entries =
+			(const struct raw_index_entry *)(header + 1);
+		for (uint32_t i = header->count; i > 0; i--) {
+			uint64_t frame = entries[i - 1].offset;
+			if (!reader_frame_valid(reader, frame)) {
+				return false;
+			}
+			reader->offsets[--left] = frame;
+		}
+		if (offset <= header->prev_offset) {
+			return false;
+		}
+		offset = header->prev_offset;
+	}
+	reader->count = count;
+	return true;
+}
+
+/**
+ * For files without a trailer: walks the blocks from the start and keeps
+ * every whole frame
+ */
+static bool reader_scan(struct raw_reader *reader)
+{
+	free(reader->offsets);
+	reader->offsets = NULL;
+	reader->count = 0;
+
+	size_t capacity = 0;
+	uint64_t offset = RAW_FILE_PAGE;
+	while (offset + sizeof(uint32_t) <= reader->size) {
+		uint32_t magic = *(const uint32_t *)(reader->base + offset);
+		if (magic == RAW_FILE_FRAME_MAGIC) {
+			if (!reader_frame_valid(reader, offset)) {
+				break;
+			}
+			const struct raw_frame_header *frame =
+				(const struct raw_frame_header *)(reader->base +
+								  offset);
+			if (!reader_add(reader, offset, &capacity)) {
+				return false;
+			}
+			offset += align_up(sizeof(*frame) + frame->size,
+					   RAW_FILE_PAGE);
+		} else if (magic == RAW_FILE_INDEX_MAGIC &&
+			   offset + sizeof(struct raw_index_header) <=
+				   reader->size) {
+			const struct raw_index_header *header =
+				(const struct raw_index_header *)(reader->base +
+								  offset);
+			offset += align_up(sizeof(*header) +
+						   (size_t)header->count *
+							   sizeof(struct raw_index_entry),
+					   RAW_FILE_PAGE);
+		} else {
+			break;
+		}
+	}
+	return true;
+}
+
+struct raw_reader *raw_reader_open(const char *path)
+{
+	struct raw_reader *reader =
+		(struct raw_reader *)calloc(1, sizeof(*reader));
+	if (!reader) {
+		return NULL;
+	}
+	if (!reader_map(reader, path)) {
+		free(reader);
+		return NULL;
+	}
+
+	const struct raw_file_header *header =
+		(const struct raw_file_header *)reader->base;
+	if (reader->size < RAW_FILE_PAGE ||
+	    memcmp(header->magic, RAW_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+	    header->version != RAW_FILE_VERSION ||
+	    header->page_size != RAW_FILE_PAGE) {
+		raw_reader_close(reader);
+		return NULL;
+	}
+	snprintf(reader->sender, sizeof(reader->sender), "%.*s",
+		 (int)sizeof(header->sender), header->sender);
+
+	if (!reader_load_index(reader) && !reader_scan(reader)) {
+		raw_reader_close(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void raw_reader_close(struct raw_reader *reader)
+{
+	if (!reader) {
+		return;
+	}
+	reader_unmap(reader);
+	free(reader->offsets);
+	free(reader);
+}
+
+const char *raw_reader_sender(const struct raw_reader *reader)
+{
+	return reader->sender;
+}
+
+size_t raw_reader_frame_count(const struct raw_reader *reader)
+{
+	return reader->count;
+}
+
+bool raw_reader_frame(const struct raw_reader *reader, size_t index,
+		      struct raw_frame *frame)
+{
+	if (index >= reader->count) {
+		return false;
+	}
+	frame->header = (const struct raw_frame_header *)(reader->base +
+							   reader->offsets[index]);
+	frame->pixels = (const uint8_t *)(frame->header + 1);
+	return true;
+}
@@ -0,0 +1,161 @@
+/**
+ * Raw frame recordings
+ *
+ * Lossless recordings of a sender's frames, written without an encoder so
+ * that post-production gets exactly what the sender published. Like
+ * shm-ring.h this is free of OBS and Spout dependencies, so tools can read
+ * and write recordings on Windows and POSIX alike.
+ *
+ * Layout of a file, every block starting on a RAW_FILE_PAGE boundary:
+ *
+ *   [raw_file_header][frame][frame]...[index][frame]...[index][trailer]
+ *
+ * A frame is a raw_frame_header followed by its pixels (rows linesize
+ * apart, as in the ring). Every RAW_FILE_INDEX_FRAMES frames, and on close,
+ * an index block lists the preceding frames and links to the previous index
+ * block; the trailer points at the last one. A file whose writer died has
+ * no trailer, readers then scan the frame headers instead.
+ *
+ * Writes are page aligned and page sized so they can bypass the OS cache
+ * (FILE_FLAG_NO_BUFFERING / O_DIRECT); they happen on a writer thread so
+ * the thread handing in frames only pays for one copy.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define RAW_FILE_MAGIC "SPOUTRAW"
+#define RAW_FILE_TRAILER_MAGIC "SPRAWEND"
+#define RAW_FILE_FRAME_MAGIC 0x454d5246 // "FRME"
+#define RAW_FILE_INDEX_MAGIC 0x58444e49 // "INDX"
+#define RAW_FILE_VERSION 1
+
+#define RAW_FILE_PAGE 4096
+#define RAW_FILE_INDEX_FRAMES 256
+
+struct raw_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t page_size;
+	uint64_t created_ns;
+	char sender[256];
+};
+
+struct raw_frame_header {
+	uint32_t magic;
+	// one of shm_ring_format
+	uint32_t format;
+	uint64_t seq;
+	// when the frame was received, monotonic
+	uint64_t timestamp_ns;
+	uint32_t width;
+	uint32_t height;
+	uint32_t linesize;
+	// one of shm_ring_transfer
+	uint32_t transfer;
+	uint64_t size;
+	// as published by the sender
+	uint64_t sender_timestamp;
+	uint8_t reserved[8];
+};
+
+struct raw_index_header {
+	uint32_t magic;
+	uint32_t count;
+	// 0 for the first index block
+	uint64_t prev_offset;
+};
+
+struct raw_index_entry {
+	// of the frame's raw_frame_header
+	uint64_t offset;
+	uint64_t timestamp_ns;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t linesize;
+	uint64_t size;
+};
+
+struct raw_file_trailer {
+	char magic[8];
+	uint64_t index_offset;
+	uint64_t frame_count;
+};
+
+struct raw_writer_stats {
+	uint64_t frames;
+	// frames handed in while every buffer was waiting for the disk
+	uint64_t dropped;
+	uint64_t bytes;
+	// time spent in writes, for throughput
+	uint64_t write_ns;
+	// a write failed, later frames were dropped
+	bool failed;
+};
+
+// A frame in a reader's mapping
+struct raw_frame {
+	const struct raw_frame_header *header;
+	const uint8_t *pixels;
+};
+
+struct raw_writer;
+struct raw_reader;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates the file and starts the writer thread
+ * @param buffers frames that can wait for the disk before frames drop
+ * @return NULL on failure
+ */
+struct raw_writer *raw_writer_open(const char *path, const char *sender,
+				   uint32_t buffers);
+
+/**
+ * Queues a copy of a frame for writing, never waits for the disk
+ * @param header magic and size are filled in here
+ * @return false if the frame was dropped
+ */
+bool raw_writer_write(struct raw_writer *writer,
+		      const struct raw_frame_header *header,
+		      const uint8_t *pixels);
+
+/**
+ * Frames written and dropped so far, while recording
+ */
+void raw_writer_get_stats(struct raw_writer *writer,
+			  struct raw_writer_stats *stats);
+
+/**
+ * Writes the queued frames, the last index and the trailer, then closes
+ * the file
+ */
+void raw_writer_close(struct raw_writer *writer,
+		      struct raw_writer_stats *stats);
+
+/**
+ * Maps a recording read-only and loads its index
+ * @return NULL if the file isn't a recording
+ */
+struct raw_reader *raw_reader_open(const char *path);
+void raw_reader_close(struct raw_reader *reader);
+
+const char *raw_reader_sender(const struct raw_reader *reader);
+size_t raw_reader_frame_count(const struct raw_reader *reader);
+
+/**
+ * Looks up frame index, in recording order
+ * @return false past the last frame
+ */
+bool raw_reader_frame(const struct raw_reader *reader, size_t index,
+		      struct raw_frame *frame);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,366 @@
+/**
+ * Instant replay buffer, see replay-buffer.h
+ *
+ * The arena is used as a ring of contiguous records: a frame goes at the
+ * write position if its worst-case size fits before the end, at the start
+ * otherwise. Frames are encoded straight into the arena, so only the
+ * bytes actually written are kept.
+ */
+#include "replay-buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_RECORD_ALIGN 64
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_OP_RGBA 0xff
+#define QOI_MASK_2 0xc0
+#define QOI_END_SIZE 8
+
+struct replay_record {
+	size_t offset;
+	size_t size;
+	uint64_t timestamp_ns;
+	uint32_t width;
+	uint32_t height;
+	uint32_t codec;
+};
+
+struct replay_buffer {
+	uint8_t *arena;
+	size_t capacity;
+	size_t write_pos;
+	size_t used;
+
+	// a ring of REPLAY_BUFFER_MAX_FRAMES, oldest at first
+	struct replay_record *records;
+	size_t first;
+	size_t count;
+};
+
+static inline size_t align_up(size_t val, size_t align)
+{
+	return (val + align - 1) / align * align;
+}
+
+/* ------------------------------------------------------------------------- */
+/* QOI, with the four bytes of a pixel taken in memory order, so BGRA and
+ * RGBA round-trip alike */
+
+static inline uint32_t qoi_hash(const uint8_t *px)
+{
+	return (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+}
+
+static size_t qoi_bound(uint32_t width, uint32_t height)
+{
+	return (size_t)width * height * 5 + QOI_END_SIZE;
+}
+
+static size_t qoi_encode(const uint8_t *pixels, uint32_t linesize,
+			 uint32_t width, uint32_t height, uint8_t *out)
+{
+	uint8_t index[64][4];
+	memset(index, 0, sizeof(index));
+	uint8_t prev[4] = {0, 0, 0, 255};
+	size_t pos = 0;
+	uint32_t run = 0;
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *px = pixels + (size_t)y * linesize;
+		for (uint32_t x = 0; x < width; x++, px += 4) {
+			if (memcmp(px, prev, 4) == 0) {
+				if (++run == 62) {
+					out[pos++] = QOI_OP_RUN | (run - 1);
+					run = 0;
+				}
+				continue;
+			}
+			if (run) {
+				out[pos++] = QOI_OP_RUN | (run - 1);
+				run = 0;
+			}
+
+			uint32_t hash = qoi_hash(px);
+			if (memcmp(index[hash], px, 4) == 0) {
+				out[pos++] = QOI_OP_INDEX | hash;
+			} else {
+				memcpy(index[hash], px, 4);
+				if (px[3] == prev[3]) {
+					int8_t dr = (int8_t)(px[0] - prev[0]);
+					int8_t dg = (int8_t)(px[1] - prev[1]);
+					int8_t db = (int8_t)(px[2] - prev[2]);
+					int8_t dr_dg = (int8_t)(dr - dg);
+					int8_t db_dg = (int8_t)(db - dg);
+					if (dr > -3 && dr < 2 && dg > -3 &&
+					    dg < 2 && db > -3 && db < 2) {
+						out[pos++] = QOI_OP_DIFF |
+							     (dr + 2) << 4 |
+							     (dg + 2) << 2 |
+							     (db + 2);
+					} else if (dg > -33 && dg < 32 &&
+						   dr_dg > -9 && dr_dg < 8 &&
+						   db_dg > -9 && db_dg < 8) {
+						out[pos++] = QOI_OP_LUMA |
+							     (dg + 32);
+						out[pos++] = (uint8_t)((dr_dg + 8)
+									       << 4 |
+								       (db_dg + 8));
+					} else {
+						out[pos++] = QOI_OP_RGB;
+						out[pos++] = px[0];
+						out[pos++] = px[1];
+						out[pos++] = px[2];
+					}
+				} else {
+					out[pos++] = QOI_OP_RGBA;
+					memcpy(out + pos, px, 4);
+					pos += 4;
+				}
+			}
+			memcpy(prev, px, 4);
+		}
+	}
+	if (run) {
+		out[pos++] = QOI_OP_RUN | (run - 1);
+	}
+
+	memset(out + pos, 0, QOI_END_SIZE - 1);
+	out[pos + QOI_END_SIZE - 1] = 1;
+	return pos + QOI_END_SIZE;
+}
+
+static bool qoi_decode(const uint8_t *data, size_t size, uint32_t width,
+		       uint32_t height, uint8_t *dst, uint32_t dst_linesize)
+{
+	uint8_t index[64][4];
+	memset(index, 0, sizeof(index));
+	uint8_t px[4] = {0, 0, 0, 255};
+	size_t pos = 0;
+	size_t end = size - QOI_END_SIZE;
+	uint32_t run = 0;
+
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *out = dst + (size_t)y * dst_linesize;
+		for (uint32_t x = 0; x < width; x++, out += 4) {
+			if (run) {
+				run--;
+			} else {
+				if (pos >= end) {
+					return false;
+				}
+				uint8_t op = data[pos++];
+				if (op == QOI_OP_RGB) {
+					if (pos + 3 > end) {
+						return false;
+					}
+					memcpy(px, data + pos, 3);
+					pos += 3;
+				} else if (op == QOI_OP_RGBA) {
+					if (pos + 4 > end) {
+						return false;
+					}
+					memcpy(px, data + pos, 4);
+					pos += 4;
+				} else if ((op & QOI_MASK_2) == QOI_OP_INDEX) {
+					memcpy(px, index[op], 4);
+				} else if ((op & QOI_MASK_2) == QOI_OP_DIFF) {
+					px[0] += ((op >> 4) & 3) - 2;
+					px[1] += ((op >> 2) & 3) - 2;
+					px[2] += (op & 3) - 2;
+				} else if ((op & QOI_MASK_2) == QOI_OP_LUMA) {
+					if (pos >= end) {
+						return false;
+					}
+					uint8_t next = data[pos++];
+					int dg = (op & 0x3f) - 32;
+					px[0] += dg - 8 + ((next >> 4) & 0x0f);
+					px[1] += dg;
+					px[2] += dg - 8 + (next & 0x0f);
+				} else {
+					run = op & 0x3f;
+				}
+				memcpy(index[qoi_hash(px)], px, 4);
+			}
+			memcpy(out, px, 4);
+		}
+	}
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct replay_buffer *replay_buffer_create(size_t capacity)
+{
+	struct replay_buffer *buffer =
+		(struct replay_buffer *)calloc(1, sizeof(*buffer));
+	if (!buffer) {
+		return NULL;
+	}
+	buffer->arena = (uint8_t *)malloc(capacity);
+	buffer->records = (struct replay_record *)calloc(
+		REPLAY_BUFFER_MAX_FRAMES, sizeof(struct replay_record));
+	if (!buffer->arena || !buffer->records) {
+		replay_buffer_destroy(buffer);
+		return NULL;
+	}
+	buffer->capacity = capacity;
+	return buffer;
+}
+
+void replay_buffer_destroy(struct replay_buffer *buffer)
+{
+	if (!buffer) {
+		return;
+	}
+	free(buffer->arena);
+	free(buffer->records);
+	free(buffer);
+}
+
+static inline struct replay_record *record_at(const struct replay_buffer *buffer,
+					      size_t index)
+{
+	return &buffer->records[(buffer->first + index) %
+				REPLAY_BUFFER_MAX_FRAMES];
+}
+
+static void evict_oldest(struct replay_buffer *buffer)
+{
+	struct replay_record *oldest = record_at(buffer, 0);
+	buffer->used -= align_up(oldest->size, REPLAY_RECORD_ALIGN);
+	buffer->first = (buffer->first + 1) % REPLAY_BUFFER_MAX_FRAMES;
+	if (!--buffer->count) {
+		buffer->write_pos = 0;
+	}
+}
+
+static inline bool overlaps(const struct replay_record *record, size_t start,
+			    size_t end)
+{
+	size_t record_end =
+		record->offset + align_up(record->size, REPLAY_RECORD_ALIGN);
+	return record->offset < end && record_end > start;
+}
+
+/**
+ * Frees [pos, pos + size) for a new record, oldest records first
+ * @return the record's offset
+ */
+static size_t make_room(struct replay_buffer *buffer, size_t size)
+{
+	if (buffer->count == REPLAY_BUFFER_MAX_FRAMES) {
+		evict_oldest(buffer);
+	}
+
+	size_t pos = buffer->write_pos;
+	if (pos + size > buffer->capacity) {
+		// the records past the write position are the oldest ones
+		while (buffer->count && record_at(buffer, 0)->offset >= pos) {
+			evict_oldest(buffer);
+		}
+		pos = 0;
+	}
+	while (buffer->count &&
+	       overlaps(record_at(buffer, 0), pos, pos + size)) {
+		evict_oldest(buffer);
+	}
+	return pos;
+}
+
+bool replay_buffer_push(struct replay_buffer *buffer, const uint8_t *pixels,
+			uint32_t linesize, uint32_t width, uint32_t height,
+			uint64_t timestamp_ns, enum replay_codec codec)
+{
+	size_t row = (size_t)width * 4;
+	size_t bound = codec == REPLAY_CODEC_QOI ? qoi_bound(width, height)
+						 : row * height;
+	if (!width || !height || bound > buffer->capacity) {
+		return false;
+	}
+
+	size_t pos = make_room(buffer, bound);
+	uint8_t *dst = buffer->arena + pos;
+	size_t size;
+	if (codec == REPLAY_CODEC_QOI) {
+		size = qoi_encode(pixels, linesize, width, height, dst);
+	} else {
+		for (uint32_t y = 0; y < height; y++) {
+			memcpy(dst + y * row, pixels + (size_t)y * linesize,
+			       row);
+		}
+		size = row * height;
+	}
+
+	struct replay_record *record = record_at(buffer, buffer->count);
+	record->offset = pos;
+	record->size = size;
+	record->timestamp_ns = timestamp_ns;
+	record->width = width;
+	record->height = height;
+	record->codec = codec;
+	buffer->count++;
+
+	size_t aligned = align_up(size, REPLAY_RECORD_ALIGN);
+	buffer->used += aligned;
+	buffer->write_pos = pos + aligned;
+	return true;
+}
+
+void replay_buffer_clear(struct replay_buffer *buffer)
+{
+	buffer->first = 0;
+	buffer->count = 0;
+	buffer->used = 0;
+	buffer->write_pos = 0;
+}
+
+size_t replay_buffer_count(const struct replay_buffer *buffer)
+{
+	return buffer->count;
+}
+
+size_t replay_buffer_used(const struct replay_buffer *buffer)
+{
+	return buffer->used;
+}
+
+bool replay_buffer_info(const struct replay_buffer *buffer, size_t index,
+			struct replay_frame_info *info)
+{
+	if (index >= buffer->count) {
+		return false;
+	}
+	const struct replay_record *record = record_at(buffer, index);
+	info->timestamp_ns = record->timestamp_ns;
+	info->width = record->width;
+	info->height = record->height;
+	info->size = record->size;
+	return true;
+}
+
+bool replay_buffer_decode(const struct replay_buffer *buffer, size_t index,
+			  uint8_t *dst, uint32_t dst_linesize)
+{
+	if (index >= buffer->count) {
+		return false;
+	}
+	const struct replay_record *record = record_at(buffer, index);
+	const uint8_t *data = buffer->arena + record->offset;
+
+	if (record->codec == REPLAY_CODEC_QOI) {
+		return qoi_decode(data, record->size, record->width,
+				  record->height, dst, dst_linesize);
+	}
+
+	size_t row = (size_t)record->width * 4;
+	for (uint32_t y = 0; y < record->height; y++) {
+		memcpy(dst + (size_t)y * dst_linesize, data + y * row, row);
+	}
+	return true;
+}
@@ -0,0 +1,72 @@
+/**
+ * In-memory instant replay of recent 32-bit (BGRA/RGBA) frames
+ *
+ * A fixed arena, allocated once, holds the most recent frames; pushing a
+ * frame evicts the oldest ones it needs room for, so steady state never
+ * allocates. Frames can be kept raw or QOI-compressed (the QOI chunk
+ * stream, without the file header) to fit more seconds in the same
+ * memory.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// most frames a buffer indexes, whatever their size
+#define REPLAY_BUFFER_MAX_FRAMES 8192
+
+enum replay_codec {
+	REPLAY_CODEC_RAW = 0,
+	REPLAY_CODEC_QOI = 1,
+};
+
+struct replay_frame_info {
+	uint64_t timestamp_ns;
+	uint32_t width;
+	uint32_t height;
+	// bytes the frame takes in the arena
+	size_t size;
+};
+
+struct replay_buffer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocates the arena
+ * @return NULL on failure
+ */
+struct replay_buffer *replay_buffer_create(size_t capacity);
+void replay_buffer_destroy(struct replay_buffer *buffer);
+
+/**
+ * Stores a frame as the newest, evicting the oldest ones as needed
+ * @return false if the frame can't fit even in an empty buffer
+ */
+bool replay_buffer_push(struct replay_buffer *buffer, const uint8_t *pixels,
+			uint32_t linesize, uint32_t width, uint32_t height,
+			uint64_t timestamp_ns, enum replay_codec codec);
+
+void replay_buffer_clear(struct replay_buffer *buffer);
+
+// frames held, oldest first
+size_t replay_buffer_count(const struct replay_buffer *buffer);
+
+// arena bytes in use
+size_t replay_buffer_used(const struct replay_buffer *buffer);
+
+bool replay_buffer_info(const struct replay_buffer *buffer, size_t index,
+			struct replay_frame_info *info);
+
+/**
+ * Unpacks frame index into dst, which must hold width x height pixels
+ */
+bool replay_buffer_decode(const struct replay_buffer *buffer, size_t index,
+			  uint8_t *dst, uint32_t dst_linesize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+/**
+ * Sender binding for first-available sources, see sender-bind.h
+ */
+#include "sender-bind.h"
+
+#include <string.h>
+
+int sender_bind_first_available(const char *bound, const char (*names)[256],
+				int count, sender_bind_skip_t skip)
+{
+	if (bound && *bound && !(skip && skip(bound))) {
+		for (int i = 0; i < count; i++) {
+			if (strcmp(names[i], bound) == 0) {
+				return i;
+			}
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (!skip || !skip(names[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
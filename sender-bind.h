@@ -0,0 +1,39 @@
+/**
+ * Sender binding for first-available sources
+ *
+ * A source set to the first available sender binds to one by name, on its
+ * own: it never touches Spout's active sender, which every receiver on the
+ * machine shares. It keeps the sender it's bound to for as long as that
+ * sender is listed, so senders registering or leaving, and other sources
+ * re-binding, don't move it.
+ *
+ * Free of OBS and Spout dependencies, so it can be exercised on any
+ * platform.
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Whether a sender can't be bound to, e.g. because it's one of the
+ * receiver's own
+ */
+typedef bool (*sender_bind_skip_t)(const char *name);
+
+/**
+ * Picks the sender a first-available source binds to from a snapshot of
+ * the sender names: bound, if it's listed, otherwise the first one
+ * @param bound name the source is bound to, empty if none
+ * @param skip senders never to bind to, NULL to take any
+ * @return index into names, -1 if there are none to take
+ */
+int sender_bind_first_available(const char *bound, const char (*names)[256],
+				int count, sender_bind_skip_t skip);
+
+#ifdef __cplusplus
+}
+#endif
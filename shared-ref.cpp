@@ -0,0 +1,35 @@
+/**
+ * Shared, refcounted objects, see shared-ref.h
+ */
+#include "shared-ref.h"
+
+#include <stddef.h>
+
+void *shared_ref_acquire(struct shared_ref *ref, shared_ref_create_t create)
+{
+	pthread_mutex_lock(&ref->mutex);
+	if (!ref->object) {
+		ref->object = create();
+	}
+	if (ref->object) {
+		ref->refs++;
+	}
+	void *object = ref->object;
+	pthread_mutex_unlock(&ref->mutex);
+	return object;
+}
+
+bool shared_ref_release(struct shared_ref *ref, void *object)
+{
+	if (!object) {
+		return false;
+	}
+
+	pthread_mutex_lock(&ref->mutex);
+	bool last = --ref->refs == 0;
+	if (last) {
+		ref->object = NULL;
+	}
+	pthread_mutex_unlock(&ref->mutex);
+	return last;
+}
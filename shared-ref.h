@@ -0,0 +1,56 @@
+/**
+ * One object shared by every user, created with the first reference and
+ * destroyed with the last
+ *
+ * Taking a reference to an existing object only bumps a count under a
+ * mutex, so users that come and go in numbers, like the sources of a scene
+ * collection, don't each pay for creating it.
+ *
+ * Free of OBS dependencies, so it can be exercised on any platform.
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+struct shared_ref {
+	pthread_mutex_t mutex;
+	void *object;
+	long refs;
+};
+
+#define SHARED_REF_INIT {PTHREAD_MUTEX_INITIALIZER, NULL, 0}
+
+/**
+ * @return a new object, NULL on failure
+ */
+typedef void *(*shared_ref_create_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Takes a reference, creating the object if there is none. create runs
+ * under the mutex, so anyone else taking a reference waits for it: leave
+ * expensive work to the object's first use.
+ * @return the object, NULL if it couldn't be created
+ */
+void *shared_ref_acquire(struct shared_ref *ref, shared_ref_create_t create);
+
+/**
+ * Drops a reference taken by shared_ref_acquire
+ * @return true if it was the last one: the object is no longer shared and
+ *         the caller destroys it, outside the mutex
+ */
+bool shared_ref_release(struct shared_ref *ref, void *object);
+
+#ifdef __cplusplus
+}
+#endif
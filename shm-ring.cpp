@@ -0,0 +1,1147 @@
+/**
+ * Shared-memory frame ring, see shm-ring.h
+ *
+ * Synchronisation is a seqlock-style scheme: the writer reserves space by
+ * advancing write_pos *before* it copies, and a reader validates after its
+ * copy that write_pos hasn't moved more than one ring length past the frame
+ * it read. Nothing ever blocks on either side.
+ */
+#include "shm-ring.h"
+#include "frame-hash.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+#define SHM_RING_DIRECTORY_NAME "obs-spout-ring-directory"
+#define SHM_RING_DIRECTORY_SLOTS 64
+#define SHM_RING_OS_NAME_MAX 128
+#define SHM_RING_RECORD_ALIGN 64
+// Windows allocation granularity; also a multiple of every page size
+#define SHM_RING_MAP_ALIGN 65536
+// smallest page size we touch pages at when prefaulting by hand
+#define SHM_RING_PAGE_SIZE 4096
+
+// tools/shm-ring-bench-baseline defines these, for rings that are neither
+// prefaulted nor mirrored to compare against
+#ifdef SHM_RING_NO_PREFAULT
+static const bool prefault_enabled = false;
+#else
+static const bool prefault_enabled = true;
+#endif
+#ifdef SHM_RING_NO_MIRROR
+static const bool mirror_enabled = false;
+#else
+static const bool mirror_enabled = true;
+#endif
+
+struct shm_ring_directory_entry {
+	volatile uint32_t owner;
+	uint32_t reserved;
+	volatile uint64_t generation;
+	char name[SHM_RING_NAME_MAX];
+};
+
+struct shm_map {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	int fd;
+	char os_name[SHM_RING_OS_NAME_MAX];
+	bool unlink;
+#endif
+	uint8_t *base;
+	size_t size;
+	// bytes of the second view of the data after the first, 0 if the
+	// ring isn't mirrored
+	size_t mirror;
+};
+
+struct shm_ring {
+	struct shm_map map;
+	struct shm_ring_header *header;
+	uint8_t *data;
+	uint64_t capacity;
+	// data is followed by a second mapping of itself, so records that
+	// wrap around the end can be copied in one go
+	bool mirrored;
+	bool writer;
+	uint64_t seq;
+	uint32_t transfer;
+	bool checksum;
+	// size and format of the previous frame written, which dirty
+	// rectangles are relative to
+	uint32_t last_width;
+	uint32_t last_height;
+	uint32_t last_format;
+	uint64_t checksums_verified;
+	uint64_t checksum_mismatches;
+	int directory_slot;
+	// readers: slot in header->consumers, -1 if they were all taken
+	int consumer_slot;
+	char name[SHM_RING_NAME_MAX];
+};
+
+/* ------------------------------------------------------------------------- */
+/* Atomics: plain loads/stores are enough on x86 with compiler barriers, the
+ * GCC/Clang builtins also cover weakly ordered CPUs. */
+
+#ifdef _MSC_VER
+static inline uint64_t load_acquire(const volatile uint64_t *ptr)
+{
+	uint64_t val = *ptr;
+	_ReadWriteBarrier();
+	return val;
+}
+
+static inline void store_release(volatile uint64_t *ptr, uint64_t val)
+{
+	_ReadWriteBarrier();
+	*ptr = val;
+}
+
+static inline void fence_release(void)
+{
+	_ReadWriteBarrier();
+}
+
+static inline void fence_acquire(void)
+{
+	_ReadWriteBarrier();
+}
+
+static inline bool cas_u32(volatile uint32_t *ptr, uint32_t expected,
+			   uint32_t desired)
+{
+	return (uint32_t)_InterlockedCompareExchange((volatile long *)ptr,
+						     (long)desired,
+						     (long)expected) ==
+	       expected;
+}
+
+static inline void *load_acquire_ptr(void *const volatile *ptr)
+{
+	void *val = *ptr;
+	_ReadWriteBarrier();
+	return val;
+}
+
+static inline bool cas_ptr(void *volatile *ptr, void *expected, void *desired)
+{
+	return _InterlockedCompareExchangePointer(ptr, desired, expected) ==
+	       expected;
+}
+#else
+static inline uint64_t load_acquire(const volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(volatile uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline void fence_release(void)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void fence_acquire(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline bool cas_u32(volatile uint32_t *ptr, uint32_t expected,
+			   uint32_t desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+					   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline void *load_acquire_ptr(void *const volatile *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline bool cas_ptr(void *volatile *ptr, void *expected, void *desired)
+{
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+					   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static inline size_t align_up(size_t val, size_t align)
+{
+	return (val + align - 1) / align * align;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Platform mapping layer */
+
+static uint32_t current_pid(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetCurrentProcessId();
+#else
+	return (uint32_t)getpid();
+#endif
+}
+
+static bool process_alive(uint32_t pid)
+{
+	if (pid == current_pid()) {
+		return true;
+	}
+#ifdef _WIN32
+	HANDLE process =
+		OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+	if (!process) {
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+	DWORD code = 0;
+	bool alive = GetExitCodeProcess(process, &code) &&
+		     code == STILL_ACTIVE;
+	CloseHandle(process);
+	return alive;
+#else
+	return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+/**
+ * Faults the whole mapping in up front, so a new sender's first frames
+ * don't pay tens of thousands of page faults. On Linux the mapping is
+ * also advised to use transparent hugepages, which shmem honours when
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled is "advise" or
+ * "within_size".
+ */
+static void shm_map_prefault(struct shm_map *map)
+{
+	if (!prefault_enabled) {
+		return;
+	}
+#ifndef _WIN32
+#ifdef MADV_HUGEPAGE
+	madvise(map->base, map->size, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+	// Linux 5.14+, in one call and without touching the contents
+	if (madvise(map->base, map->size, MADV_POPULATE_WRITE) == 0) {
+		return;
+	}
+#endif
+#endif
+	// a read fault is enough: both shmem and pagefile-backed sections
+	// allocate a page on first access
+	const volatile uint8_t *base = map->base;
+	uint8_t sum = 0;
+	for (size_t offset = 0; offset < map->size;
+	     offset += SHM_RING_PAGE_SIZE) {
+		sum += base[offset];
+	}
+	(void)sum;
+}
+
+static bool shm_map_open(struct shm_map *map, const char *os_name, size_t size,
+			 bool create)
+{
+	memset(map, 0, sizeof(*map));
+#ifdef _WIN32
+	if (create) {
+		map->handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+						 PAGE_READWRITE,
+						 (DWORD)((uint64_t)size >> 32),
+						 (DWORD)size, os_name);
+	} else {
+		map->handle =
+			OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, os_name);
+	}
+	if (!map->handle) {
+		return false;
+	}
+
+	map->base = (uint8_t *)MapViewOfFile(map->handle, FILE_MAP_ALL_ACCESS,
+					     0, 0, size);
+	if (!map->base) {
+		CloseHandle(map->handle);
+		map->handle = NULL;
+		return false;
+	}
+	if (!size) {
+		MEMORY_BASIC_INFORMATION mbi;
+		VirtualQuery(map->base, &mbi, sizeof(mbi));
+		size = mbi.RegionSize;
+	}
+#else
+	snprintf(map->os_name, sizeof(map->os_name), "/%s", os_name);
+	map->fd = shm_open(map->os_name, create ? O_RDWR | O_CREAT : O_RDWR,
+			   0600);
+	if (map->fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(map->fd, &st) != 0) {
+		close(map->fd);
+		return false;
+	}
+	if (create && (size_t)st.st_size < size) {
+		if (ftruncate(map->fd, (off_t)size) != 0) {
+			close(map->fd);
+			return false;
+		}
+	} else if (!size || (size_t)st.st_size < size) {
+		size = (size_t)st.st_size;
+	}
+	if (!size) {
+		close(map->fd);
+		return false;
+	}
+
+	void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			  map->fd, 0);
+	if (base == MAP_FAILED) {
+		close(map->fd);
+		return false;
+	}
+	map->base = (uint8_t *)base;
+#endif
+	map->size = size;
+	return true;
+}
+
+static void shm_map_close(struct shm_map *map)
+{
+	if (!map->base) {
+		return;
+	}
+#ifdef _WIN32
+	if (map->mirror) {
+		UnmapViewOfFile(map->base + map->size - map->mirror);
+	}
+	UnmapViewOfFile(map->base);
+	CloseHandle(map->handle);
+#else
+	munmap(map->base, map->size);
+	close(map->fd);
+	if (map->unlink) {
+		shm_unlink(map->os_name);
+	}
+#endif
+	map->base = NULL;
+}
+
+#ifdef _WIN32
+#ifndef MEM_RESERVE_PLACEHOLDER
+#define MEM_RESERVE_PLACEHOLDER 0x00040000
+#define MEM_REPLACE_PLACEHOLDER 0x00004000
+#define MEM_PRESERVE_PLACEHOLDER 0x00000002
+#endif
+
+// Windows 10 1803+, looked up so older systems still load the plugin
+typedef PVOID(WINAPI *virtual_alloc2_t)(HANDLE, PVOID, SIZE_T, ULONG, ULONG,
+					 void *, ULONG);
+typedef PVOID(WINAPI *map_view_of_file3_t)(HANDLE, HANDLE, PVOID, ULONG64,
+					    SIZE_T, ULONG, ULONG, void *,
+					    ULONG);
+#endif
+
+/**
+ * Remaps the header plus capacity bytes of data at offset header_size so
+ * that the data is immediately followed by a second view of itself.
+ * Both must be multiples of SHM_RING_MAP_ALIGN.
+ * @return false if the system can't, the mapping is left as it was
+ */
+static bool shm_map_mirror(struct shm_map *map, size_t header_size,
+			   size_t capacity)
+{
+	if (!mirror_enabled) {
+		return false;
+	}
+
+	size_t first = header_size + capacity;
+	size_t total = first + capacity;
+#ifdef _WIN32
+	HMODULE kernelbase = GetModuleHandleA("kernelbase.dll");
+	if (!kernelbase) {
+		return false;
+	}
+	virtual_alloc2_t virtual_alloc2 = (virtual_alloc2_t)GetProcAddress(
+		kernelbase, "VirtualAlloc2");
+	map_view_of_file3_t map_view_of_file3 =
+		(map_view_of_file3_t)GetProcAddress(kernelbase,
+						    "MapViewOfFile3");
+	if (!virtual_alloc2 || !map_view_of_file3) {
+		return false;
+	}
+
+	// reserve both views as one placeholder, then split it in two
+	uint8_t *base = (uint8_t *)virtual_alloc2(
+		NULL, NULL, total, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+		PAGE_NOACCESS, NULL, 0);
+	if (!base) {
+		return false;
+	}
+	if (!VirtualFree(base, first, MEM_RELEASE | MEM_PRESERVE_PLACEHOLDER)) {
+		VirtualFree(base, 0, MEM_RELEASE);
+		return false;
+	}
+
+	HANDLE process = GetCurrentProcess();
+	void *view = map_view_of_file3(map->handle, process, base, 0, first,
+				       MEM_REPLACE_PLACEHOLDER, PAGE_READWRITE,
+				       NULL, 0);
+	if (!view) {
+		VirtualFree(base, 0, MEM_RELEASE);
+		VirtualFree(base + first, 0, MEM_RELEASE);
+		return false;
+	}
+	void *mirror = map_view_of_file3(map->handle, process, base + first,
+					 header_size, capacity,
+					 MEM_REPLACE_PLACEHOLDER,
+					 PAGE_READWRITE, NULL, 0);
+	if (!mirror) {
+		UnmapViewOfFile(view);
+		VirtualFree(base + first, 0, MEM_RELEASE);
+		return false;
+	}
+	UnmapViewOfFile(map->base);
+#else
+	// reserve the whole range, then map the file over it twice
+	void *range = mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+			   -1, 0);
+	if (range == MAP_FAILED) {
+		return false;
+	}
+	uint8_t *base = (uint8_t *)range;
+	if (mmap(base, first, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+		 map->fd, 0) == MAP_FAILED ||
+	    mmap(base + first, capacity, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_FIXED, map->fd,
+		 (off_t)header_size) == MAP_FAILED) {
+		munmap(range, total);
+		return false;
+	}
+	munmap(map->base, map->size);
+#endif
+	map->base = base;
+	map->size = total;
+	map->mirror = capacity;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Sender directory */
+
+// mapped by the first caller and kept for the life of the process
+static struct shm_map directory_map;
+static void *volatile directory;
+
+/**
+ * Maps the directory on first use. Callers on several threads may race to
+ * map it: each maps its own view, one publishes it and the others unmap
+ * theirs. A failed mapping is tried again by the next caller.
+ */
+static struct shm_ring_directory_entry *directory_get(void)
+{
+	void *dir = load_acquire_ptr(&directory);
+	if (dir) {
+		return (struct shm_ring_directory_entry *)dir;
+	}
+
+	struct shm_map map;
+	size_t size = sizeof(struct shm_ring_directory_entry) *
+		      SHM_RING_DIRECTORY_SLOTS;
+	if (!shm_map_open(&map, SHM_RING_DIRECTORY_NAME, size, true)) {
+		return NULL;
+	}
+	if (cas_ptr(&directory, NULL, map.base)) {
+		directory_map = map;
+		return (struct shm_ring_directory_entry *)map.base;
+	}
+	shm_map_close(&map);
+	return (struct shm_ring_directory_entry *)load_acquire_ptr(&directory);
+}
+
+static void os_ring_name(char *dst, const char *name, uint64_t generation)
+{
+	char clean[64];
+	size_t i;
+	for (i = 0; name[i] && i < sizeof(clean) - 1; i++) {
+		char c = name[i];
+		bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			  (c >= '0' && c <= '9') || c == '-' || c == '_';
+		clean[i] = ok ? c : '_';
+	}
+	clean[i] = 0;
+	snprintf(dst, SHM_RING_OS_NAME_MAX, "obs-spout-ring-%s-%016llx", clean,
+		 (unsigned long long)generation);
+}
+
+/**
+ * Reads a stable copy of a directory entry
+ * @return generation, 0 if the slot is empty or changed underneath us
+ */
+static uint64_t directory_read(struct shm_ring_directory_entry *entry,
+			       char *name)
+{
+	uint64_t generation = load_acquire(&entry->generation);
+	if (!generation || !process_alive(entry->owner)) {
+		return 0;
+	}
+	memcpy(name, entry->name, SHM_RING_NAME_MAX);
+	name[SHM_RING_NAME_MAX - 1] = 0;
+	fence_acquire();
+	if (load_acquire(&entry->generation) != generation) {
+		return 0;
+	}
+	return generation;
+}
+
+static int directory_register(const char *name, uint64_t generation)
+{
+	struct shm_ring_directory_entry *dir = directory_get();
+	if (!dir) {
+		return -1;
+	}
+
+	uint32_t pid = current_pid();
+	char existing[SHM_RING_NAME_MAX];
+
+	// refuse names another live process already publishes
+	for (int i = 0; i < SHM_RING_DIRECTORY_SLOTS; i++) {
+		if (directory_read(&dir[i], existing) &&
+		    strcmp(existing, name) == 0 && dir[i].owner != pid) {
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < SHM_RING_DIRECTORY_SLOTS; i++) {
+		uint32_t owner = dir[i].owner;
+		if (owner && process_alive(owner)) {
+			continue;
+		}
+		if (!cas_u32(&dir[i].owner, owner, pid)) {
+			continue;
+		}
+
+		store_release(&dir[i].generation, 0);
+		strncpy(dir[i].name, name, SHM_RING_NAME_MAX - 1);
+		dir[i].name[SHM_RING_NAME_MAX - 1] = 0;
+		store_release(&dir[i].generation, generation);
+		return i;
+	}
+	return -1;
+}
+
+static void directory_unregister(int slot)
+{
+	struct shm_ring_directory_entry *dir =
+		(struct shm_ring_directory_entry *)load_acquire_ptr(&directory);
+	if (slot < 0 || !dir) {
+		return;
+	}
+	store_release(&dir[slot].generation, 0);
+	cas_u32(&dir[slot].owner, current_pid(), 0);
+}
+
+static uint64_t directory_find(const char *name)
+{
+	struct shm_ring_directory_entry *dir = directory_get();
+	if (!dir) {
+		return 0;
+	}
+
+	char existing[SHM_RING_NAME_MAX];
+	for (int i = 0; i < SHM_RING_DIRECTORY_SLOTS; i++) {
+		uint64_t generation = directory_read(&dir[i], existing);
+		if (generation && strcmp(existing, name) == 0) {
+			return generation;
+		}
+	}
+	return 0;
+}
+
+size_t shm_ring_enum_senders(void (*enum_cb)(void *param, const char *name),
+			     void *param)
+{
+	struct shm_ring_directory_entry *dir = directory_get();
+	if (!dir) {
+		return 0;
+	}
+
+	size_t count = 0;
+	char name[SHM_RING_NAME_MAX];
+	for (int i = 0; i < SHM_RING_DIRECTORY_SLOTS; i++) {
+		if (!directory_read(&dir[i], name)) {
+			continue;
+		}
+		enum_cb(param, name);
+		count++;
+	}
+	return count;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Consumer slots */
+
+static inline uint64_t consumer_demand(uint32_t flags, uint32_t fps_milli)
+{
+	return (uint64_t)fps_milli << 32 | flags;
+}
+
+/**
+ * Takes a free slot, or one left behind by a dead process, for a reader
+ * of this process; active at any rate until told otherwise
+ * @return the slot, -1 if they're all taken
+ */
+static int consumer_claim(struct shm_ring_header *header)
+{
+	uint32_t pid = current_pid();
+	for (int i = 0; i < SHM_RING_MAX_CONSUMERS; i++) {
+		struct shm_ring_consumer *consumer = &header->consumers[i];
+		uint32_t owner = consumer->owner;
+		if (owner && process_alive(owner)) {
+			continue;
+		}
+		if (!cas_u32(&consumer->owner, owner, pid)) {
+			continue;
+		}
+		store_release(&consumer->demand,
+			      consumer_demand(SHM_RING_CONSUMER_ACTIVE, 0));
+		return i;
+	}
+	return -1;
+}
+
+void shm_ring_set_demand(struct shm_ring *ring, uint32_t flags,
+			 uint32_t fps_milli)
+{
+	if (ring->writer || ring->consumer_slot < 0) {
+		return;
+	}
+	store_release(&ring->header->consumers[ring->consumer_slot].demand,
+		      consumer_demand(flags, fps_milli));
+}
+
+void shm_ring_get_demand(const struct shm_ring *ring,
+			 struct shm_ring_demand *demand)
+{
+	memset(demand, 0, sizeof(*demand));
+	bool every_frame = false;
+	for (int i = 0; i < SHM_RING_MAX_CONSUMERS; i++) {
+		struct shm_ring_consumer *consumer =
+			&ring->header->consumers[i];
+		uint32_t owner = consumer->owner;
+		if (!owner || !process_alive(owner)) {
+			continue;
+		}
+		uint64_t value = load_acquire(&consumer->demand);
+		uint32_t flags = (uint32_t)value;
+		uint32_t fps_milli = (uint32_t)(value >> 32);
+
+		demand->readers++;
+		if (!(flags & SHM_RING_CONSUMER_ACTIVE)) {
+			continue;
+		}
+		demand->consumers++;
+		if (flags & SHM_RING_CONSUMER_PROGRAM) {
+			demand->program++;
+		}
+		if (!fps_milli) {
+			every_frame = true;
+		} else if (fps_milli > demand->fps_milli) {
+			demand->fps_milli = fps_milli;
+		}
+	}
+	if (every_frame) {
+		demand->fps_milli = 0;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Ring */
+
+uint32_t shm_ring_format_bpp(uint32_t format)
+{
+	switch (format) {
+	case SHM_RING_FORMAT_BGRA:
+	case SHM_RING_FORMAT_RGBA:
+	case SHM_RING_FORMAT_RGB10A2:
+		return 4;
+	case SHM_RING_FORMAT_RGBA16F:
+		return 8;
+	}
+	return 0;
+}
+
+// records never exceed half the ring, so a mirrored ring takes any of them
+// in one span
+static void ring_copy_in(struct shm_ring *ring, uint64_t pos, const void *src,
+			 size_t len)
+{
+	size_t offset = (size_t)(pos % ring->capacity);
+	size_t first = (size_t)ring->capacity - offset;
+	if (first >= len || ring->mirrored) {
+		memcpy(ring->data + offset, src, len);
+		return;
+	}
+	memcpy(ring->data + offset, src, first);
+	memcpy(ring->data, (const uint8_t *)src + first, len - first);
+}
+
+static void ring_copy_out(const struct shm_ring *ring, uint64_t pos, void *dst,
+			  size_t len)
+{
+	size_t offset = (size_t)(pos % ring->capacity);
+	size_t first = (size_t)ring->capacity - offset;
+	if (first >= len || ring->mirrored) {
+		memcpy(dst, ring->data + offset, len);
+		return;
+	}
+	memcpy(dst, ring->data + offset, first);
+	memcpy((uint8_t *)dst + first, ring->data, len - first);
+}
+
+static void plain_copy(void *param, const struct shm_ring_frame *frame,
+		       uint8_t *dst, const uint8_t *src, size_t size)
+{
+	(void)param;
+	(void)frame;
+	memcpy(dst, src, size);
+}
+
+static uint32_t ring_checksum(const struct shm_ring *ring, uint64_t pos,
+			      size_t len)
+{
+	size_t offset = (size_t)(pos % ring->capacity);
+	size_t first = (size_t)ring->capacity - offset;
+	if (first >= len || ring->mirrored) {
+		return crc32c_update(0, ring->data + offset, len);
+	}
+	uint32_t crc = crc32c_update(0, ring->data + offset, first);
+	return crc32c_update(crc, ring->data, len - first);
+}
+
+// records are 64-byte aligned, so the split is always pixel aligned
+static void ring_copy_out_with(const struct shm_ring *ring, uint64_t pos,
+			       uint8_t *dst, size_t len,
+			       const struct shm_ring_frame *frame,
+			       shm_ring_copy_t copy_cb, void *param)
+{
+	size_t offset = (size_t)(pos % ring->capacity);
+	size_t first = (size_t)ring->capacity - offset;
+	if (first >= len || ring->mirrored) {
+		copy_cb(param, frame, dst, ring->data + offset, len);
+		return;
+	}
+	copy_cb(param, frame, dst, ring->data + offset, first);
+	copy_cb(param, frame, dst + first, ring->data, len - first);
+}
+
+struct shm_ring *shm_ring_create(const char *name, size_t frame_size,
+				 uint32_t frames)
+{
+	static uint32_t counter = 0;
+
+	if (!name || !*name || frames < 2) {
+		return NULL;
+	}
+
+	struct shm_ring *ring = (struct shm_ring *)calloc(1, sizeof(*ring));
+	if (!ring) {
+		return NULL;
+	}
+
+	size_t record = align_up(sizeof(struct shm_ring_frame_header) +
+					 frame_size,
+				 SHM_RING_RECORD_ALIGN);
+	size_t header_size =
+		align_up(sizeof(struct shm_ring_header), SHM_RING_MAP_ALIGN);
+	ring->capacity = align_up(record * frames, SHM_RING_MAP_ALIGN);
+
+	uint64_t generation = ((uint64_t)current_pid() << 32) | ++counter;
+	char os_name[SHM_RING_OS_NAME_MAX];
+	os_ring_name(os_name, name, generation);
+
+	if (!shm_map_open(&ring->map, os_name,
+			  header_size + (size_t)ring->capacity, true)) {
+		free(ring);
+		return NULL;
+	}
+#ifndef _WIN32
+	ring->map.unlink = true;
+#endif
+	ring->mirrored = shm_map_mirror(&ring->map, header_size,
+					(size_t)ring->capacity);
+	shm_map_prefault(&ring->map);
+
+	ring->writer = true;
+	ring->header = (struct shm_ring_header *)ring->map.base;
+	ring->data = ring->map.base + header_size;
+	strncpy(ring->name, name, SHM_RING_NAME_MAX - 1);
+
+	struct shm_ring_header *header = ring->header;
+	memset(header, 0, sizeof(*header));
+	header->version = SHM_RING_VERSION;
+	header->header_size = (uint32_t)header_size;
+	header->capacity = ring->capacity;
+	strncpy(header->name, name, SHM_RING_NAME_MAX - 1);
+	fence_release();
+	header->magic = SHM_RING_MAGIC;
+
+	ring->directory_slot = directory_register(name, generation);
+	if (ring->directory_slot < 0) {
+		shm_ring_close(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+struct shm_ring *shm_ring_open(const char *name)
+{
+	uint64_t generation = directory_find(name);
+	if (!generation) {
+		return NULL;
+	}
+
+	char os_name[SHM_RING_OS_NAME_MAX];
+	os_ring_name(os_name, name, generation);
+
+	struct shm_ring *ring = (struct shm_ring *)calloc(1, sizeof(*ring));
+	if (!ring) {
+		return NULL;
+	}
+
+	if (!shm_map_open(&ring->map, os_name, 0, false)) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->header = (struct shm_ring_header *)ring->map.base;
+	ring->directory_slot = -1;
+	ring->consumer_slot = -1;
+	strncpy(ring->name, name, SHM_RING_NAME_MAX - 1);
+
+	struct shm_ring_header *header = ring->header;
+	if (ring->map.size < sizeof(*header) ||
+	    header->magic != SHM_RING_MAGIC ||
+	    header->version != SHM_RING_VERSION ||
+	    header->header_size + header->capacity > ring->map.size) {
+		shm_ring_close(ring);
+		return NULL;
+	}
+
+	ring->capacity = header->capacity;
+	if (header->header_size % SHM_RING_MAP_ALIGN == 0 &&
+	    ring->capacity % SHM_RING_MAP_ALIGN == 0) {
+		ring->mirrored = shm_map_mirror(&ring->map, header->header_size,
+						(size_t)ring->capacity);
+		header = ring->header = (struct shm_ring_header *)ring->map.base;
+	}
+	ring->data = ring->map.base + header->header_size;
+	shm_map_prefault(&ring->map);
+	ring->consumer_slot = consumer_claim(header);
+	return ring;
+}
+
+void shm_ring_close(struct shm_ring *ring)
+{
+	if (!ring) {
+		return;
+	}
+
+	if (ring->writer) {
+		directory_unregister(ring->directory_slot);
+		if (ring->header) {
+			ring->header->flags |= SHM_RING_FLAG_CLOSED;
+			fence_release();
+		}
+	} else if (ring->consumer_slot >= 0) {
+		struct shm_ring_consumer *consumer =
+			&ring->header->consumers[ring->consumer_slot];
+		store_release(&consumer->demand, 0);
+		cas_u32(&consumer->owner, current_pid(), 0);
+	}
+	shm_map_close(&ring->map);
+	free(ring);
+}
+
+const char *shm_ring_name(const struct shm_ring *ring)
+{
+	return ring->name;
+}
+
+size_t shm_ring_max_frame_size(const struct shm_ring *ring)
+{
+	// the latest frame must survive while the next one is being written
+	return (size_t)ring->capacity / 2 - sizeof(struct shm_ring_frame_header) -
+	       SHM_RING_RECORD_ALIGN;
+}
+
+/**
+ * Whether rects are all inside the frame and cover at most half of it
+ */
+static bool rects_usable(const struct shm_ring_rect *rects, uint32_t num_rects,
+			 uint32_t width, uint32_t height)
+{
+	if (!rects || !num_rects || num_rects > SHM_RING_MAX_RECTS) {
+		return false;
+	}
+	uint64_t area = 0;
+	for (uint32_t i = 0; i < num_rects; i++) {
+		const struct shm_ring_rect *rect = &rects[i];
+		if (rect->x >= width || rect->y >= height ||
+		    rect->width > width - rect->x ||
+		    rect->height > height - rect->y) {
+			return false;
+		}
+		area += (uint64_t)rect->width * rect->height;
+	}
+	return area <= (uint64_t)width * height / 2;
+}
+
+bool shm_ring_write(struct shm_ring *ring, const uint8_t *data,
+		    uint32_t linesize, uint32_t width, uint32_t height,
+		    uint32_t format, uint64_t timestamp)
+{
+	return shm_ring_write_rects(ring, data, linesize, width, height, format,
+				    timestamp, NULL, 0);
+}
+
+bool shm_ring_write_rects(struct shm_ring *ring, const uint8_t *data,
+			  uint32_t linesize, uint32_t width, uint32_t height,
+			  uint32_t format, uint64_t timestamp,
+			  const struct shm_ring_rect *rects, uint32_t num_rects)
+{
+	uint32_t row = width * shm_ring_format_bpp(format);
+	size_t payload = (size_t)row * height;
+	if (!row || payload > shm_ring_max_frame_size(ring)) {
+		return false;
+	}
+
+	struct shm_ring_header *header = ring->header;
+	size_t rects_size = (size_t)num_rects * sizeof(struct shm_ring_rect);
+	bool dirty = ring->seq && width == ring->last_width &&
+		     height == ring->last_height &&
+		     format == ring->last_format &&
+		     rects_usable(rects, num_rects, width, height) &&
+		     sizeof(struct shm_ring_frame_header) + payload +
+				     rects_size <=
+			     (size_t)ring->capacity / 2;
+	size_t record = align_up(sizeof(struct shm_ring_frame_header) +
+					 payload + (dirty ? rects_size : 0),
+				 SHM_RING_RECORD_ALIGN);
+	ring->last_width = width;
+	ring->last_height = height;
+	ring->last_format = format;
+
+	// reserve before writing so readers can detect the overwrite
+	uint64_t pos = header->write_pos;
+	store_release(&header->write_pos, pos + record);
+	fence_release();
+
+	struct shm_ring_frame_header frame = {};
+	frame.magic = SHM_RING_FRAME_MAGIC;
+	frame.format = format;
+	frame.seq = ++ring->seq;
+	frame.timestamp = timestamp;
+	frame.width = width;
+	frame.height = height;
+	frame.linesize = row;
+	frame.size = (uint32_t)payload;
+	frame.transfer = ring->transfer;
+	if (ring->checksum) {
+		uint32_t crc = 0;
+		if (linesize == row) {
+			crc = crc32c_update(crc, data, payload);
+		} else {
+			for (uint32_t y = 0; y < height; y++) {
+				crc = crc32c_update(
+					crc, data + (size_t)y * linesize, row);
+			}
+		}
+		frame.flags |= SHM_RING_FRAME_CHECKSUM;
+		frame.checksum = crc;
+	}
+	if (dirty) {
+		frame.flags |= SHM_RING_FRAME_DIRTY;
+		frame.num_rects = num_rects;
+	}
+	ring_copy_in(ring, pos, &frame, sizeof(frame));
+
+	uint64_t pixels = pos + sizeof(frame);
+	if (linesize == row) {
+		ring_copy_in(ring, pixels, data, payload);
+	} else {
+		for (uint32_t y = 0; y < height; y++) {
+			ring_copy_in(ring, pixels + (uint64_t)y * row,
+				     data + (size_t)y * linesize, row);
+		}
+	}
+	if (dirty) {
+		ring_copy_in(ring, pixels + payload, rects, rects_size);
+	}
+
+	store_release(&header->last_frame_pos, pos);
+	store_release(&header->frame_seq, frame.seq);
+	return true;
+}
+
+void shm_ring_set_transfer(struct shm_ring *ring, uint32_t transfer)
+{
+	ring->transfer = transfer;
+}
+
+void shm_ring_set_checksum(struct shm_ring *ring, bool enabled)
+{
+	ring->checksum = enabled;
+}
+
+void shm_ring_checksum_stats(const struct shm_ring *ring, uint64_t *verified,
+			     uint64_t *mismatched)
+{
+	*verified = ring->checksums_verified;
+	*mismatched = ring->checksum_mismatches;
+}
+
+uint64_t shm_ring_latest_seq(const struct shm_ring *ring)
+{
+	return load_acquire(&ring->header->frame_seq);
+}
+
+bool shm_ring_is_closed(const struct shm_ring *ring)
+{
+	return (ring->header->flags & SHM_RING_FLAG_CLOSED) != 0;
+}
+
+static inline bool ring_overwritten(const struct shm_ring *ring, uint64_t pos)
+{
+	fence_acquire();
+	return load_acquire(&ring->header->write_pos) - pos > ring->capacity;
+}
+
+int shm_ring_read(struct shm_ring *ring, struct shm_ring_frame *frame,
+		  uint8_t *dst, size_t dst_size)
+{
+	return shm_ring_read_copy(ring, frame, dst, dst_size, plain_copy,
+				  NULL);
+}
+
+int shm_ring_read_copy(struct shm_ring *ring, struct shm_ring_frame *frame,
+		       uint8_t *dst, size_t dst_size, shm_ring_copy_t copy_cb,
+		       void *param)
+{
+	return shm_ring_read_dirty(ring, frame, dst, dst_size, 0, copy_cb,
+				   param);
+}
+
+/**
+ * Copies just the dirty rectangles of the frame at pos into dst
+ * @return false if they aren't valid, dst is untouched then
+ */
+static bool ring_copy_rects(const struct shm_ring *ring, uint64_t pos,
+			    const struct shm_ring_frame_header *fh,
+			    struct shm_ring_frame *frame, uint8_t *dst,
+			    shm_ring_copy_t copy_cb, void *param)
+{
+	uint64_t pixels = pos + sizeof(*fh);
+	size_t rects_size = fh->num_rects * sizeof(struct shm_ring_rect);
+	ring_copy_out(ring, pixels + fh->size, frame->rects, rects_size);
+	if (!rects_usable(frame->rects, fh->num_rects, fh->width, fh->height)) {
+		return false;
+	}
+
+	uint32_t bpp = fh->linesize / fh->width;
+	for (uint32_t i = 0; i < fh->num_rects; i++) {
+		const struct shm_ring_rect *rect = &frame->rects[i];
+		size_t len = (size_t)rect->width * bpp;
+		for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+			size_t offset = (size_t)y * fh->linesize +
+					(size_t)rect->x * bpp;
+			ring_copy_out_with(ring, pixels + offset, dst + offset,
+					   len, frame, copy_cb, param);
+		}
+	}
+	frame->num_rects = fh->num_rects;
+	return true;
+}
+
+int shm_ring_read_dirty(struct shm_ring *ring, struct shm_ring_frame *frame,
+			uint8_t *dst, size_t dst_size, uint64_t dst_seq,
+			shm_ring_copy_t copy_cb, void *param)
+{
+	if (!copy_cb) {
+		copy_cb = plain_copy;
+	}
+
+	struct shm_ring_header *header = ring->header;
+	if (shm_ring_is_closed(ring)) {
+		return SHM_RING_CLOSED;
+	}
+	if (!load_acquire(&header->frame_seq)) {
+		return SHM_RING_NO_FRAME;
+	}
+
+	uint64_t pos = load_acquire(&header->last_frame_pos);
+	struct shm_ring_frame_header fh;
+	ring_copy_out(ring, pos, &fh, sizeof(fh));
+	if (ring_overwritten(ring, pos) || fh.magic != SHM_RING_FRAME_MAGIC ||
+	    fh.size > ring->capacity || !fh.width ||
+	    (uint64_t)fh.linesize * fh.height != fh.size) {
+		return SHM_RING_OVERRUN;
+	}
+
+	frame->seq = fh.seq;
+	frame->timestamp = fh.timestamp;
+	frame->width = fh.width;
+	frame->height = fh.height;
+	frame->linesize = fh.linesize;
+	frame->format = fh.format;
+	frame->transfer = fh.transfer;
+	frame->size = fh.size;
+	frame->num_rects = 0;
+	if (fh.size > dst_size) {
+		return SHM_RING_TOO_SMALL;
+	}
+
+	// dirty rectangles are relative to the frame before
+	bool dirty = dst_seq && fh.seq == dst_seq + 1 &&
+		     (fh.flags & SHM_RING_FRAME_DIRTY) &&
+		     fh.num_rects <= SHM_RING_MAX_RECTS &&
+		     ring_copy_rects(ring, pos, &fh, frame, dst, copy_cb, param);
+	if (!dirty) {
+		ring_copy_out_with(ring, pos + sizeof(fh), dst, fh.size, frame,
+				   copy_cb, param);
+	}
+
+	// checked on the ring's bytes, copy_cb may have transformed dst;
+	// a frame overwritten meanwhile is an overrun, not a mismatch
+	uint32_t crc = 0;
+	if (fh.flags & SHM_RING_FRAME_CHECKSUM) {
+		crc = ring_checksum(ring, pos + sizeof(fh), fh.size);
+	}
+	if (ring_overwritten(ring, pos)) {
+		return SHM_RING_OVERRUN;
+	}
+	if (fh.flags & SHM_RING_FRAME_CHECKSUM) {
+		ring->checksums_verified++;
+		if (crc != fh.checksum) {
+			ring->checksum_mismatches++;
+		}
+	}
+	return SHM_RING_OK;
+}
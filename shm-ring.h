@@ -0,0 +1,313 @@
+/**
+ * Shared-memory frame ring
+ *
+ * A named, byte-addressed ring of video frames living in shared memory. One
+ * process writes, any number of processes read the most recent complete
+ * frame. It is the fallback transport for senders when Spout's GPU texture
+ * sharing is unavailable, and it is deliberately free of OBS and Spout
+ * dependencies so that it builds on Windows and POSIX alike.
+ *
+ * Layout of the mapping:
+ *
+ *   [shm_ring_header][data: capacity bytes ...................]
+ *
+ * Each frame is stored as a 64 byte shm_ring_frame_header followed by its
+ * tightly packed pixels, then by its dirty rectangles when it has any
+ * (SHM_RING_FRAME_DIRTY). Records are 64 byte aligned and may wrap around
+ * the end of the data area. Where the system allows it (POSIX, Windows 10
+ * 1803+) each process maps the data twice back to back, so a wrapping
+ * record is still one contiguous span and is copied in one go.
+ *
+ * Both sides prefault the whole mapping when they create or open a ring,
+ * on Linux advised for transparent hugepages, so the first frames cost no
+ * page faults.
+ *
+ * Senders also register their name in a small shared directory so that
+ * receivers can list them without knowing the names up front.
+ *
+ * Readers in turn take a consumer slot in the ring's header, in which they
+ * publish whether they currently use frames and at what rate. A sender
+ * that nobody watches can then stop rendering, and one whose receivers
+ * run slower than it can render less often.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SHM_RING_NAME_MAX 256
+#define SHM_RING_MAGIC 0x474e5253 // "SRNG"
+#define SHM_RING_FRAME_MAGIC 0x4d524653 // "SFRM"
+#define SHM_RING_VERSION 2
+
+// Number of frames a ring holds when created for a given frame size
+#define SHM_RING_DEFAULT_FRAMES 3
+
+// Most dirty rectangles a frame carries; more are sent as a full frame
+#define SHM_RING_MAX_RECTS 32
+
+// Readers a ring keeps demand for; further readers still receive frames
+// but aren't counted
+#define SHM_RING_MAX_CONSUMERS 32
+
+enum shm_ring_format {
+	SHM_RING_FORMAT_BGRA = 1,
+	SHM_RING_FORMAT_RGBA = 2,
+	// 4 half floats per pixel
+	SHM_RING_FORMAT_RGBA16F = 3,
+	// 10 bits per colour, red in the low bits, 2 bits alpha
+	SHM_RING_FORMAT_RGB10A2 = 4,
+};
+
+// How pixel values encode light, carried with each frame
+enum shm_ring_transfer {
+	// 8-bit and 10-bit SDR
+	SHM_RING_TRANSFER_SRGB = 0,
+	// half floats, BT.709 primaries, 1.0 = SDR white
+	SHM_RING_TRANSFER_LINEAR = 1,
+	// HDR10, BT.2020 primaries
+	SHM_RING_TRANSFER_PQ = 2,
+	// BT.2100 HLG, BT.2020 primaries
+	SHM_RING_TRANSFER_HLG = 3,
+};
+
+enum shm_ring_result {
+	SHM_RING_OK = 0,
+	SHM_RING_NO_FRAME = -1,
+	SHM_RING_TOO_SMALL = -2,
+	SHM_RING_OVERRUN = -3,
+	SHM_RING_CLOSED = -4,
+};
+
+#define SHM_RING_FLAG_CLOSED (1 << 0)
+
+// shm_ring_frame_header.flags: checksum holds the pixels' CRC32C
+#define SHM_RING_FRAME_CHECKSUM (1 << 0)
+// only num_rects rectangles changed since the previous frame
+#define SHM_RING_FRAME_DIRTY (1 << 1)
+
+// shm_ring_set_demand flags: the reader uses frames (e.g. it's shown)
+#define SHM_RING_CONSUMER_ACTIVE (1 << 0)
+// the reader's frames are on air, e.g. in OBS's program output
+#define SHM_RING_CONSUMER_PROGRAM (1 << 1)
+
+struct shm_ring_consumer {
+	// pid of the reader, 0 if the slot is free
+	volatile uint32_t owner;
+	uint32_t reserved;
+	// flags in the low half, wanted frame rate in millihertz in the
+	// high half, so they change together
+	volatile uint64_t demand;
+};
+
+struct shm_ring_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	volatile uint32_t flags;
+	uint64_t capacity;
+	volatile uint64_t write_pos;
+	volatile uint64_t last_frame_pos;
+	volatile uint64_t frame_seq;
+	char name[SHM_RING_NAME_MAX];
+	struct shm_ring_consumer consumers[SHM_RING_MAX_CONSUMERS];
+};
+
+struct shm_ring_frame_header {
+	uint32_t magic;
+	uint32_t format;
+	uint64_t seq;
+	uint64_t timestamp;
+	uint32_t width;
+	uint32_t height;
+	uint32_t linesize;
+	uint32_t size;
+	uint32_t transfer;
+	uint32_t flags;
+	uint32_t checksum;
+	uint32_t num_rects;
+	uint8_t reserved[8];
+};
+
+struct shm_ring_rect {
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct shm_ring_frame {
+	uint64_t seq;
+	uint64_t timestamp;
+	uint32_t width;
+	uint32_t height;
+	uint32_t linesize;
+	uint32_t format;
+	uint32_t transfer;
+	size_t size;
+	// set by shm_ring_read_dirty: the only parts of dst it updated,
+	// 0 when it copied the whole frame
+	uint32_t num_rects;
+	struct shm_ring_rect rects[SHM_RING_MAX_RECTS];
+};
+
+// what a ring's readers currently ask of its writer
+struct shm_ring_demand {
+	// readers with the ring open
+	uint32_t readers;
+	// of those, readers using frames
+	uint32_t consumers;
+	// of those, readers on air
+	uint32_t program;
+	// highest frame rate any consumer wants, in millihertz; 0 when one
+	// of them takes every frame or there are no consumers
+	uint32_t fps_milli;
+};
+
+struct shm_ring;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t shm_ring_format_bpp(uint32_t format);
+
+/**
+ * Creates (or replaces) the ring called name, sized to hold at least
+ * `frames` frames of frame_size bytes, and registers it in the directory.
+ * @return NULL on failure
+ */
+struct shm_ring *shm_ring_create(const char *name, size_t frame_size,
+				 uint32_t frames);
+
+/**
+ * Opens an existing ring for reading
+ * @return NULL if no such ring exists
+ */
+struct shm_ring *shm_ring_open(const char *name);
+
+/**
+ * Closes the ring. Writers mark it closed for readers and remove it from
+ * the directory.
+ */
+void shm_ring_close(struct shm_ring *ring);
+
+const char *shm_ring_name(const struct shm_ring *ring);
+
+/**
+ * Largest frame (in bytes) the ring can carry
+ */
+size_t shm_ring_max_frame_size(const struct shm_ring *ring);
+
+/**
+ * Copies a frame into the ring and publishes it
+ * @return false if the frame doesn't fit in the ring
+ */
+bool shm_ring_write(struct shm_ring *ring, const uint8_t *data,
+		    uint32_t linesize, uint32_t width, uint32_t height,
+		    uint32_t format, uint64_t timestamp);
+
+/**
+ * Like shm_ring_write, with the rectangles that changed since the previous
+ * frame, so readers holding that frame can copy only them. The whole frame
+ * is still stored for readers that don't. Falls back to a plain full frame
+ * when there are more than SHM_RING_MAX_RECTS rectangles, they cover more
+ * than half the frame, or the size or format changed.
+ */
+bool shm_ring_write_rects(struct shm_ring *ring, const uint8_t *data,
+			  uint32_t linesize, uint32_t width, uint32_t height,
+			  uint32_t format, uint64_t timestamp,
+			  const struct shm_ring_rect *rects, uint32_t num_rects);
+
+/**
+ * Sets the transfer function written with the following frames,
+ * SHM_RING_TRANSFER_SRGB until called
+ */
+void shm_ring_set_transfer(struct shm_ring *ring, uint32_t transfer);
+
+/**
+ * Stores a CRC32C of each following frame's pixels in its header, which
+ * readers verify. Off by default; costs the writer and each reader one
+ * more pass over every frame.
+ */
+void shm_ring_set_checksum(struct shm_ring *ring, bool enabled);
+
+/**
+ * Frames this reader checked against their checksum, and how many of
+ * those didn't match. Mismatching frames are still delivered.
+ */
+void shm_ring_checksum_stats(const struct shm_ring *ring, uint64_t *verified,
+			     uint64_t *mismatched);
+
+/**
+ * Sequence number of the most recently published frame, 0 if none yet
+ */
+uint64_t shm_ring_latest_seq(const struct shm_ring *ring);
+
+bool shm_ring_is_closed(const struct shm_ring *ring);
+
+/**
+ * Copies the latest frame into dst (tightly packed rows).
+ * Fills in frame even when dst is too small so the caller can grow it.
+ * @return one of shm_ring_result
+ */
+int shm_ring_read(struct shm_ring *ring, struct shm_ring_frame *frame,
+		  uint8_t *dst, size_t dst_size);
+
+/**
+ * Copies frame bytes out of the ring; may transform them on the way.
+ * Called once, or twice when the frame wraps around the end of a ring
+ * that couldn't be mirrored, always with a multiple of 4 bytes. frame is
+ * already filled in.
+ */
+typedef void (*shm_ring_copy_t)(void *param, const struct shm_ring_frame *frame,
+				uint8_t *dst, const uint8_t *src, size_t size);
+
+/**
+ * Like shm_ring_read, but copies the pixels with copy_cb, so a per-pixel
+ * transform costs no extra pass over the frame
+ */
+int shm_ring_read_copy(struct shm_ring *ring, struct shm_ring_frame *frame,
+		       uint8_t *dst, size_t dst_size, shm_ring_copy_t copy_cb,
+		       void *param);
+
+/**
+ * Like shm_ring_read_copy for a reader that keeps the previous frame:
+ * if dst holds frame dst_seq (0 if nothing) and the latest frame is the
+ * next one with dirty rectangles, only those are copied into dst and
+ * listed in frame->rects. Otherwise the whole frame is copied and
+ * frame->num_rects is 0. dst must not be used on SHM_RING_OVERRUN, it
+ * may be partly updated. copy_cb may be NULL for a plain copy.
+ */
+int shm_ring_read_dirty(struct shm_ring *ring, struct shm_ring_frame *frame,
+			uint8_t *dst, size_t dst_size, uint64_t dst_seq,
+			shm_ring_copy_t copy_cb, void *param);
+
+/**
+ * Publishes what this reader wants from the writer: SHM_RING_CONSUMER_*
+ * flags and the highest frame rate it uses in millihertz (0 for every
+ * frame). Readers start out active at any rate when they open a ring,
+ * so readers that never call this aren't throttled.
+ */
+void shm_ring_set_demand(struct shm_ring *ring, uint32_t flags,
+			 uint32_t fps_milli);
+
+/**
+ * Sums up the demand of the ring's live readers, for the writer to
+ * throttle on. Checks each reader's process, so poll it a few times a
+ * second rather than per frame.
+ */
+void shm_ring_get_demand(const struct shm_ring *ring,
+			 struct shm_ring_demand *demand);
+
+/**
+ * Calls enum_cb for every live sender in the directory
+ * @return number of senders listed
+ */
+size_t shm_ring_enum_senders(void (*enum_cb)(void *param, const char *name),
+			     void *param);
+
+#ifdef __cplusplus
+}
+#endif
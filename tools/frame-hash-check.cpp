@@ -0,0 +1,186 @@
+/**
+ * frame-hash-check: the frame checksums give the values they should
+ * (frame-hash.h)
+ *
+ *   frame-hash-check
+ *
+ * crc32c: the CRC32C of "123456789" must be the standard check value
+ * 0xE3069283. Random buffers of lengths up to a few KiB, at every
+ * alignment, must give what a bitwise CRC32C computes, in one call and
+ * split into two chained calls at a random point. Prints the
+ * implementation crc32c_update picked; only that one is checked.
+ *
+ * frame_hash64: buffers of sizes around the hash's 64 byte stripes and
+ * 1 KiB blocks, up to a 1080p BGRA frame, must hash the same as a copy
+ * of them at another alignment, and differently after any one byte is
+ * changed, at the start, the end, the block edges and random places, or
+ * a zero byte is appended.
+ *
+ * The exit code is 1 if any check fails.
+ */
+#include "frame-hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LENGTH 4096
+#define ROUNDS 2000
+
+static uint32_t next_random(uint32_t *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed >> 8;
+}
+
+// one bit at a time, straight from the definition
+static uint32_t crc32c_bitwise(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0x82F63B78 & (0u - (crc & 1)));
+	}
+	return ~crc;
+}
+
+static bool check_crc32c(void)
+{
+	bool ok = true;
+	uint32_t check = crc32c_update(0, "123456789", 9);
+	if (check != 0xE3069283) {
+		printf("FAIL: CRC32C of \"123456789\" is %08X, not E3069283\n",
+		       check);
+		ok = false;
+	}
+	if (crc32c_update(0, "", 0) != 0) {
+		printf("FAIL: CRC32C of nothing isn't 0\n");
+		ok = false;
+	}
+
+	// room to start the data at every offset of a 16 byte line
+	uint8_t *buffer = (uint8_t *)malloc(MAX_LENGTH + 16);
+	if (!buffer) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+	uint32_t seed = 1;
+	for (int round = 0; round < ROUNDS && ok; round++) {
+		size_t offset = round % 16;
+		size_t size = round < 256 ? (size_t)round
+					  : next_random(&seed) % MAX_LENGTH;
+		uint8_t *data = buffer + offset;
+		for (size_t i = 0; i < size; i++)
+			data[i] = (uint8_t)next_random(&seed);
+
+		size_t split = size ? next_random(&seed) % (size + 1) : 0;
+		uint32_t expected = crc32c_bitwise(data, size);
+		uint32_t whole = crc32c_update(0, data, size);
+		uint32_t chained = crc32c_update(crc32c_update(0, data, split),
+						 data + split, size - split);
+		if (whole != expected || chained != expected) {
+			printf("FAIL: CRC32C of %zu bytes at offset %zu is "
+			       "%08X, %08X split at %zu, not %08X\n",
+			       size, offset, whole, chained, split, expected);
+			ok = false;
+		}
+	}
+	free(buffer);
+
+	printf("crc32c (%s): check value and %d buffers up to %d bytes: %s\n",
+	       crc32c_implementation(), ROUNDS, MAX_LENGTH, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static bool hash_differs(const uint8_t *data, size_t size, uint64_t hash,
+			 const char *what, size_t position)
+{
+	if (frame_hash64(data, size) != hash)
+		return true;
+	printf("FAIL: frame_hash64 of %zu bytes didn't change %s %zu\n", size,
+	       what, position);
+	return false;
+}
+
+static bool check_frame_hash64(void)
+{
+	static const size_t sizes[] = {
+		0,    1,    7,    8,    63,   64,    65,    127,   128,
+		1023, 1024, 1025, 2047, 4096, 65537, 1920 * 1080 * 4,
+	};
+	const size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const size_t max_size = 1920 * 1080 * 4 + 1;
+
+	uint8_t *a = (uint8_t *)malloc(max_size);
+	uint8_t *b = (uint8_t *)malloc(max_size + 16);
+	if (!a || !b) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+	uint32_t seed = 2;
+	for (size_t i = 0; i < max_size; i++)
+		a[i] = (uint8_t)next_random(&seed);
+
+	bool ok = true;
+	int changes = 0;
+	for (size_t s = 0; s < num_sizes; s++) {
+		size_t size = sizes[s];
+		uint64_t hash = frame_hash64(a, size);
+
+		// the same bytes elsewhere
+		uint8_t *copy = b + 1 + s % 15;
+		memcpy(copy, a, size);
+		if (frame_hash64(copy, size) != hash) {
+			printf("FAIL: frame_hash64 of %zu equal bytes differs "
+			       "at another alignment\n",
+			       size);
+			ok = false;
+		}
+
+		// one byte changed, wherever it is
+		size_t positions[16] = {0, size - 1, size / 2, 1023, 1024, 1025};
+		int num_positions = 6;
+		while (num_positions < 16)
+			positions[num_positions++] =
+				size ? next_random(&seed) % size : 0;
+		for (int p = 0; p < num_positions && size; p++) {
+			size_t position = positions[p];
+			if (position >= size)
+				continue;
+			uint8_t old = copy[position];
+			copy[position] ^= (uint8_t)(1 + next_random(&seed) % 255);
+			ok = hash_differs(copy, size, hash, "at byte",
+					  position) && ok;
+			copy[position] = old;
+			changes++;
+		}
+
+		// a trailing zero still counts
+		copy[size] = 0;
+		ok = hash_differs(copy, size + 1, hash, "with a zero at byte",
+				  size) && ok;
+	}
+	free(a);
+	free(b);
+
+	printf("frame_hash64: %zu sizes up to 1080p, %d one-byte changes: %s\n",
+	       num_sizes, changes, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argv;
+	if (argc > 1) {
+		fprintf(stderr, "usage: frame-hash-check\n");
+		return 2;
+	}
+
+	int failed = 0;
+	if (!check_crc32c())
+		failed = 1;
+	if (!check_frame_hash64())
+		failed = 1;
+	return failed;
+}
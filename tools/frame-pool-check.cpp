@@ -0,0 +1,245 @@
+/**
+ * frame-pool-check: size classes, reuse and accounting of the frame buffer
+ * pool (frame-pool.h)
+ *
+ *   frame-pool-check
+ *
+ * Requests buffers of sizes around the class boundaries and of common
+ * frame sizes, and checks each is big enough, writable, and less than
+ * twice the size asked for. Released buffers must come back for the next
+ * request of their class; frame_pool_fit must keep a buffer that fits
+ * within a factor of two and swap it otherwise. After every step the
+ * stats must add up: requests and hits counted, footprint the buffers in
+ * use plus the idle ones, idle bytes what was released, gone after
+ * frame_pool_trim, and never more than the pool's idle limit. Prints the
+ * space each frame size wastes.
+ *
+ * The exit code is 1 if any check fails.
+ */
+#include "frame-pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keep in step with frame-pool.cpp
+#define IDLE_MAX ((uint64_t)512 * 1024 * 1024)
+
+static bool ok = true;
+
+// what the check expects the pool's stats to be
+static struct frame_pool_stats expected;
+
+static void fail(const char *what)
+{
+	printf("FAIL: %s\n", what);
+	ok = false;
+}
+
+static void check_stats(const char *step)
+{
+	struct frame_pool_stats stats;
+	frame_pool_get_stats(&stats);
+	if (stats.requests != expected.requests ||
+	    stats.hits != expected.hits ||
+	    stats.footprint != expected.footprint ||
+	    stats.idle != expected.idle ||
+	    stats.peak_footprint < stats.footprint ||
+	    stats.huge > stats.footprint) {
+		printf("FAIL: after %s: %llu requests (expected %llu), %llu "
+		       "hits (%llu), %llu footprint (%llu), %llu idle (%llu)\n",
+		       step, (unsigned long long)stats.requests,
+		       (unsigned long long)expected.requests,
+		       (unsigned long long)stats.hits,
+		       (unsigned long long)expected.hits,
+		       (unsigned long long)stats.footprint,
+		       (unsigned long long)expected.footprint,
+		       (unsigned long long)stats.idle,
+		       (unsigned long long)expected.idle);
+		ok = false;
+	}
+}
+
+/**
+ * A request the pool can't serve from released buffers
+ */
+static uint8_t *alloc_new(size_t size, size_t *capacity)
+{
+	uint8_t *buffer = frame_pool_alloc(size, capacity);
+	expected.requests++;
+	if (buffer)
+		expected.footprint += *capacity;
+	return buffer;
+}
+
+static void release(uint8_t *buffer, size_t capacity)
+{
+	frame_pool_release(buffer, capacity);
+	expected.idle += capacity;
+}
+
+static void trim(void)
+{
+	frame_pool_trim();
+	expected.footprint -= expected.idle;
+	expected.idle = 0;
+	check_stats("trimming");
+}
+
+static void check_sizes(void)
+{
+	static const struct {
+		const char *name;
+		size_t size;
+	} sizes[] = {
+		{"1 byte", 1},
+		{"64 KiB - 1", 65535},
+		{"64 KiB", 65536},
+		{"64 KiB + 1", 65537},
+		{"320x180 BGRA", 320 * 180 * 4},
+		{"1280x720 BGRA", 1280 * 720 * 4},
+		{"1920x1080 BGRA", 1920 * 1080 * 4},
+		{"1920x1080 RGBA16F", 1920 * 1080 * 8},
+		{"2 MiB + 1", 2 * 1024 * 1024 + 1},
+		{"3840x2160 BGRA", 3840 * 2160 * 4},
+		{"7680x4320 BGRA", (size_t)7680 * 4320 * 4},
+	};
+
+	printf("%-20s %12s %12s %7s\n", "size", "bytes", "capacity", "waste");
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		size_t size = sizes[i].size;
+		size_t capacity = 0;
+		uint8_t *buffer = alloc_new(size, &capacity);
+		if (!buffer) {
+			fail("a buffer couldn't be allocated");
+			continue;
+		}
+		// the whole capacity is usable
+		memset(buffer, 0xA5, capacity);
+		if (capacity < size)
+			fail("a buffer is smaller than asked for");
+		if (size >= 65536 && capacity >= 2 * size)
+			fail("a buffer is twice the size asked for or more");
+		printf("%-20s %12zu %12zu %6.1f%%\n", sizes[i].name, size,
+		       capacity, 100.0 * (capacity - size) / capacity);
+		check_stats("a new buffer");
+
+		// released, it's the next buffer of its class
+		release(buffer, capacity);
+		check_stats("releasing it");
+		size_t again_capacity = 0;
+		uint8_t *again = frame_pool_alloc(size, &again_capacity);
+		expected.requests++;
+		expected.hits++;
+		expected.idle -= capacity;
+		if (again != buffer || again_capacity != capacity)
+			fail("a released buffer wasn't reused for its size");
+		check_stats("reusing it");
+		release(again, again_capacity);
+		trim();
+	}
+	if (expected.footprint)
+		fail("trimming left buffers behind");
+}
+
+static void check_fit(void)
+{
+	const size_t frame = 1920 * 1080 * 4;
+	uint8_t *buffer = NULL;
+	size_t capacity = 0;
+
+	// first fit allocates
+	frame_pool_fit(&buffer, &capacity, frame);
+	expected.requests++;
+	expected.footprint += capacity;
+	uint8_t *first = buffer;
+	size_t first_capacity = capacity;
+	if (!buffer || capacity < frame)
+		fail("fit didn't allocate");
+	check_stats("the first fit");
+
+	// a bit smaller, or up to its capacity, keeps it
+	frame_pool_fit(&buffer, &capacity, frame * 3 / 4);
+	frame_pool_fit(&buffer, &capacity, first_capacity);
+	if (buffer != first || capacity != first_capacity)
+		fail("fit swapped a buffer that fit");
+	check_stats("fits that keep the buffer");
+
+	// a quarter of the size swaps it for a smaller one
+	frame_pool_fit(&buffer, &capacity, frame / 4);
+	expected.requests++;
+	expected.footprint += capacity;
+	expected.idle += first_capacity;
+	if (capacity >= first_capacity || capacity < frame / 4)
+		fail("fit didn't swap a buffer more than twice the size");
+	check_stats("a smaller fit");
+
+	// back to full size takes the first buffer again
+	size_t small_capacity = capacity;
+	frame_pool_fit(&buffer, &capacity, frame);
+	expected.requests++;
+	expected.hits++;
+	expected.idle += small_capacity;
+	expected.idle -= first_capacity;
+	if (buffer != first)
+		fail("fit didn't reuse the released full size buffer");
+	check_stats("a larger fit");
+
+	frame_pool_release(buffer, capacity);
+	expected.idle += capacity;
+	trim();
+}
+
+/**
+ * Released buffers past the idle limit go straight back to the OS. The
+ * buffers are never touched, so they only take address space.
+ */
+static void check_idle_limit(void)
+{
+	const size_t size = 192 * 1024 * 1024;
+	uint8_t *buffers[4];
+	size_t capacities[4];
+	for (int i = 0; i < 4; i++) {
+		buffers[i] = alloc_new(size, &capacities[i]);
+		if (!buffers[i]) {
+			fail("a large buffer couldn't be allocated");
+			return;
+		}
+	}
+	check_stats("large buffers");
+	for (int i = 0; i < 4; i++) {
+		frame_pool_release(buffers[i], capacities[i]);
+		if (expected.idle + capacities[i] > IDLE_MAX) {
+			expected.footprint -= capacities[i];
+		} else {
+			expected.idle += capacities[i];
+		}
+	}
+	check_stats("releasing past the idle limit");
+	if (expected.idle > IDLE_MAX)
+		fail("more than the idle limit was kept");
+
+	trim();
+}
+
+int main(int argc, char **argv)
+{
+	(void)argv;
+	if (argc > 1) {
+		fprintf(stderr, "usage: frame-pool-check\n");
+		return 2;
+	}
+
+	check_sizes();
+	check_fit();
+	check_idle_limit();
+
+	struct frame_pool_stats stats;
+	frame_pool_get_stats(&stats);
+	printf("%llu requests, %llu served from released buffers, peak "
+	       "footprint %.1f MiB: %s\n",
+	       (unsigned long long)stats.requests,
+	       (unsigned long long)stats.hits,
+	       stats.peak_footprint / 1048576.0, ok ? "ok" : "FAIL");
+	return ok ? 0 : 1;
+}
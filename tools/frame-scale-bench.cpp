@@ -0,0 +1,175 @@
+/**
+ * frame-scale-bench: per-level throughput of the Spout output's fan-out
+ * cascade (frame_scale_half), checked against a scalar reference.
+ *
+ *   frame-scale-bench [--size WxH] [--levels N] [--frames N]
+ *
+ * Scales a --size frame (3840x2160 by default) down --levels times (3 by
+ * default, i.e. 1080p, 540p and 270p from 4K), each level from the one
+ * above it as the output does, --frames times (200 by default). Prints
+ * the time per frame and source bytes read per second for every level.
+ * Before timing, every level is compared pixel by pixel with a plain C
+ * box filter; the exit code is 1 if any pixel differs.
+ */
+#include "frame-scale.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MAX_LEVELS 8
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// rounded 2x2 box filter, one channel at a time
+static void reference_scale_half(const uint8_t *src, uint32_t src_linesize,
+				 uint32_t width, uint32_t height, uint8_t *dst,
+				 uint32_t dst_linesize)
+{
+	for (uint32_t y = 0; y < height / 2; y++) {
+		for (uint32_t x = 0; x < width / 2; x++) {
+			for (int c = 0; c < 4; c++) {
+				const uint8_t *p = src +
+						   (size_t)y * 2 * src_linesize +
+						   (size_t)x * 8 + c;
+				unsigned sum = p[0] + p[4] + p[src_linesize] +
+					       p[src_linesize + 4];
+				dst[(size_t)y * dst_linesize + x * 4 + c] =
+					(uint8_t)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+struct level {
+	uint32_t width;
+	uint32_t height;
+	uint32_t linesize;
+	uint8_t *pixels;
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: frame-scale-bench [--size WxH] [--levels N] "
+			"[--frames N]\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t width = 3840;
+	uint32_t height = 2160;
+	int num_levels = 3;
+	int frames = 200;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--levels") == 0 && i + 1 < argc) {
+			num_levels = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (num_levels < 1 || num_levels >= MAX_LEVELS || frames < 1 ||
+	    width < 2 || height < 2) {
+		usage();
+		return 2;
+	}
+
+	struct level levels[MAX_LEVELS] = {};
+	for (int i = 0; i <= num_levels; i++) {
+		levels[i].width = width >> i;
+		levels[i].height = height >> i;
+		levels[i].linesize = levels[i].width * 4;
+		levels[i].pixels = (uint8_t *)malloc(
+			(size_t)levels[i].linesize * levels[i].height + 1);
+		if (!levels[i].width || !levels[i].height ||
+		    !levels[i].pixels) {
+			fprintf(stderr, "Can't make %d levels of %ux%u\n",
+				num_levels, width, height);
+			return 2;
+		}
+	}
+
+	// noise, so rounding of every channel is exercised
+	uint32_t seed = 12345;
+	size_t size = (size_t)levels[0].linesize * levels[0].height;
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1664525u + 1013904223u;
+		levels[0].pixels[i] = (uint8_t)(seed >> 24);
+	}
+
+	int failed = 0;
+	for (int i = 1; i <= num_levels; i++) {
+		struct level *above = &levels[i - 1];
+		struct level *level = &levels[i];
+		size_t level_size = (size_t)level->linesize * level->height;
+		uint8_t *expected = (uint8_t *)malloc(level_size);
+		reference_scale_half(above->pixels, above->linesize,
+				     above->width, above->height, expected,
+				     level->linesize);
+		frame_scale_half(above->pixels, above->linesize, above->width,
+				 above->height, level->pixels, level->linesize);
+		if (memcmp(expected, level->pixels, level_size) != 0) {
+			printf("FAIL: %ux%u level differs from the reference\n",
+			       level->width, level->height);
+			failed = 1;
+		}
+		free(expected);
+	}
+	if (!failed)
+		printf("All %d levels match the reference\n", num_levels);
+
+	uint64_t level_ns[MAX_LEVELS] = {};
+	for (int f = 0; f < frames; f++) {
+		for (int i = 1; i <= num_levels; i++) {
+			struct level *above = &levels[i - 1];
+			uint64_t start = now_ns();
+			frame_scale_half(above->pixels, above->linesize,
+					 above->width, above->height,
+					 levels[i].pixels, levels[i].linesize);
+			level_ns[i] += now_ns() - start;
+		}
+	}
+
+	uint64_t total_ns = 0;
+	for (int i = 1; i <= num_levels; i++) {
+		struct level *above = &levels[i - 1];
+		double ms = (double)level_ns[i] / frames / 1e6;
+		double read = (double)above->linesize * above->height;
+		printf("%5ux%-5u from %5ux%-5u %7.3f ms/frame %8.2f GB/s\n",
+		       levels[i].width, levels[i].height, above->width,
+		       above->height, ms, read / (ms * 1e6));
+		total_ns += level_ns[i];
+	}
+	printf("whole cascade %.3f ms/frame\n", (double)total_ns / frames / 1e6);
+
+	for (int i = 0; i <= num_levels; i++)
+		free(levels[i].pixels);
+	return failed;
+}
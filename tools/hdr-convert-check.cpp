@@ -0,0 +1,344 @@
+/**
+ * hdr-convert-check: accuracy of the CPU tone mapping of HDR frames
+ * (hdr_tonemap_rgba16f and hdr_tonemap_rgb10a2)
+ *
+ *   hdr-convert-check
+ *
+ * Converts every half float value, and every 10-bit PQ and HLG code, as
+ * greys and as random colours, and compares each pixel with a double
+ * precision reference that evaluates the transfer functions, the BT.2020
+ * to BT.709 matrix, the highlight compression and the sRGB encoding
+ * directly instead of through tables. A pixel may be one step off the
+ * reference. Also checks a few fixed values (SDR white, sRGB mid grey,
+ * NaN and infinities). Rows are an odd width, so the scalar tail runs
+ * too. The exit code is 1 if any check fails.
+ */
+#include "hdr-convert.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keep in step with hdr-convert.cpp
+#define TONEMAP_KNEE 0.75
+
+#define ROW_PIXELS 1021
+
+static const double bt2020_to_bt709[3][3] = {
+	{1.660491, -0.587641, -0.072850},
+	{-0.124551, 1.132900, -0.008349},
+	{-0.018151, -0.100579, 1.118730},
+};
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Reference */
+
+static double half_to_double(uint16_t half)
+{
+	int exponent = (half >> 10) & 0x1F;
+	int mantissa = half & 0x3FF;
+	double sign = (half & 0x8000) ? -1.0 : 1.0;
+
+	if (exponent == 0)
+		return sign * ldexp(mantissa, -24);
+	if (exponent == 31)
+		return mantissa ? NAN : sign * INFINITY;
+	return sign * ldexp(mantissa + 1024, exponent - 25);
+}
+
+static double pq_to_nits(double v)
+{
+	const double m1 = 0.1593017578125;
+	const double m2 = 78.84375;
+	const double c1 = 0.8359375;
+	const double c2 = 18.8515625;
+	const double c3 = 18.6875;
+
+	double p = pow(v, 1.0 / m2);
+	return 10000.0 * pow(fmax(p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+}
+
+static double hlg_to_nits(double v)
+{
+	const double a = 0.17883277;
+	const double b = 0.28466892;
+	const double c = 0.55991073;
+
+	double scene = v <= 0.5 ? v * v / 3.0 : (exp((v - c) / a) + b) / 12.0;
+	return 1000.0 * pow(scene, 1.2);
+}
+
+static uint8_t encode_srgb(double v)
+{
+	v = v < 1.0 ? v : 1.0;
+	v = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+	return (uint8_t)(v * 255.0 + 0.5);
+}
+
+struct reference {
+	bool bt2020;
+	bool compress;
+	double white;
+};
+
+static void reference_pixel(const struct reference *ref, double r, double g,
+			    double b, double a, uint8_t *out)
+{
+	if (ref->bt2020) {
+		const double(*m)[3] = bt2020_to_bt709;
+		double r709 = m[0][0] * r + m[0][1] * g + m[0][2] * b;
+		double g709 = m[1][0] * r + m[1][1] * g + m[1][2] * b;
+		double b709 = m[2][0] * r + m[2][1] * g + m[2][2] * b;
+		r = r709, g = g709, b = b709;
+	}
+	// NaNs count as 0
+	r = r > 0.0 ? r : 0.0;
+	g = g > 0.0 ? g : 0.0;
+	b = b > 0.0 ? b : 0.0;
+
+	if (ref->compress) {
+		double peak = (ref->white - TONEMAP_KNEE) / (1.0 - TONEMAP_KNEE);
+		double m = fmax(r, fmax(g, b));
+		if (isinf(m)) {
+			// an infinite highlight is white
+			r = g = b = 1.0;
+		} else if (m > TONEMAP_KNEE) {
+			double e = (m - TONEMAP_KNEE) / (1.0 - TONEMAP_KNEE);
+			double mapped = TONEMAP_KNEE +
+					(1.0 - TONEMAP_KNEE) * e *
+						(1.0 + e / (peak * peak)) /
+						(1.0 + e);
+			r *= mapped / m, g *= mapped / m, b *= mapped / m;
+		}
+	}
+
+	out[0] = encode_srgb(b);
+	out[1] = encode_srgb(g);
+	out[2] = encode_srgb(r);
+	a = a > 0.0 ? (a < 1.0 ? a : 1.0) : 0.0;
+	out[3] = (uint8_t)(a * 255.0 + 0.5);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct result {
+	uint64_t pixels;
+	uint64_t mismatches;
+	int worst;
+};
+
+static void compare(const uint8_t *got, const uint8_t *expected,
+		    uint32_t pixels, struct result *result)
+{
+	for (uint32_t i = 0; i < pixels * 4; i++) {
+		int d = abs((int)got[i] - (int)expected[i]);
+		result->worst = d > result->worst ? d : result->worst;
+		if (d > 1)
+			result->mismatches++;
+	}
+	result->pixels += pixels;
+}
+
+static bool report(const char *name, const struct result *result)
+{
+	printf("%-32s %s, largest difference %d\n", name,
+	       result->mismatches ? "FAIL" : "ok", result->worst);
+	if (result->mismatches)
+		printf("     %llu channels of %llu pixels out of tolerance\n",
+		       (unsigned long long)result->mismatches,
+		       (unsigned long long)result->pixels);
+	return result->mismatches == 0;
+}
+
+/**
+ * Half floats: every value as a grey, then as often again in random
+ * colours, against the linear reference
+ */
+static bool check_rgba16f(float peak_nits)
+{
+	const float white_nits = 80.0f;
+	struct hdr_tonemap *tonemap = hdr_tonemap_create(
+		HDR_TRANSFER_LINEAR, white_nits, peak_nits);
+	struct reference ref = {false, peak_nits > white_nits,
+				peak_nits / white_nits};
+	struct result result = {};
+
+	uint16_t src[ROW_PIXELS * 4];
+	uint8_t got[ROW_PIXELS * 4], expected[ROW_PIXELS * 4];
+	for (uint32_t first = 0; first < 2 * 65536; first += ROW_PIXELS) {
+		uint32_t pixels = 2 * 65536 - first < ROW_PIXELS
+					  ? 2 * 65536 - first
+					  : ROW_PIXELS;
+		for (uint32_t i = 0; i < pixels; i++) {
+			uint32_t value = first + i;
+			uint16_t *px = src + i * 4;
+			if (value < 65536) {
+				px[0] = px[1] = px[2] = (uint16_t)value;
+			} else {
+				px[0] = (uint16_t)value;
+				px[1] = (uint16_t)(next_random() >> 16);
+				px[2] = (uint16_t)(next_random() >> 16);
+			}
+			// alpha from 0 to a little above 1
+			px[3] = (uint16_t)(next_random() % 0x3C80);
+			reference_pixel(&ref, half_to_double(px[0]),
+					half_to_double(px[1]),
+					half_to_double(px[2]),
+					half_to_double(px[3]),
+					expected + i * 4);
+		}
+		hdr_tonemap_rgba16f(tonemap, (const uint8_t *)src,
+				    ROW_PIXELS * 8, pixels, 1, got,
+				    ROW_PIXELS * 4);
+		compare(got, expected, pixels, &result);
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "RGBA16F, peak %.0f nits", peak_nits);
+	hdr_tonemap_destroy(tonemap);
+	return report(name, &result);
+}
+
+/**
+ * 10-bit codes: every code as a grey, then random colours, against the
+ * PQ or HLG reference
+ */
+static bool check_rgb10a2(enum hdr_transfer transfer, const char *name)
+{
+	const float white_nits = 203.0f;
+	const float peak_nits = 1000.0f;
+	struct hdr_tonemap *tonemap =
+		hdr_tonemap_create(transfer, white_nits, peak_nits);
+	struct reference ref = {true, true, peak_nits / white_nits};
+	struct result result = {};
+
+	uint32_t src[ROW_PIXELS];
+	uint8_t got[ROW_PIXELS * 4], expected[ROW_PIXELS * 4];
+	const uint32_t total = 1024 + 256 * 1024;
+	for (uint32_t first = 0; first < total; first += ROW_PIXELS) {
+		uint32_t pixels = total - first < ROW_PIXELS ? total - first
+							     : ROW_PIXELS;
+		for (uint32_t i = 0; i < pixels; i++) {
+			uint32_t value = first + i;
+			uint32_t r, g, b;
+			if (value < 1024) {
+				r = g = b = value;
+			} else {
+				r = value & 0x3FF;
+				g = (next_random() >> 16) & 0x3FF;
+				b = (next_random() >> 16) & 0x3FF;
+			}
+			uint32_t a = next_random() >> 30;
+			src[i] = r | g << 10 | b << 20 | a << 30;
+
+			double nits[3];
+			const uint32_t codes[3] = {r, g, b};
+			for (int c = 0; c < 3; c++) {
+				double v = codes[c] / 1023.0;
+				nits[c] = transfer == HDR_TRANSFER_PQ
+						  ? pq_to_nits(v)
+						  : hlg_to_nits(v);
+			}
+			reference_pixel(&ref, nits[0] / white_nits,
+					nits[1] / white_nits,
+					nits[2] / white_nits, a / 3.0,
+					expected + i * 4);
+		}
+		hdr_tonemap_rgb10a2(tonemap, (const uint8_t *)src,
+				    ROW_PIXELS * 4, pixels, 1, got,
+				    ROW_PIXELS * 4);
+		compare(got, expected, pixels, &result);
+	}
+
+	hdr_tonemap_destroy(tonemap);
+	return report(name, &result);
+}
+
+/**
+ * Values that must come out exactly: with no highlight compression SDR
+ * white is 255, 0.5 linear is sRGB 188, NaN is black and infinity white
+ */
+static bool check_fixed(void)
+{
+	static const struct {
+		uint16_t half;
+		uint8_t expected;
+	} cases[] = {
+		{0x0000, 0},   // 0
+		{0x3800, 188}, // 0.5
+		{0x3C00, 255}, // 1.0
+		{0x4000, 255}, // 2.0, clipped
+		{0xBC00, 0},   // -1.0
+		{0x7C00, 255}, // +infinity
+		{0xFC00, 0},   // -infinity
+		{0x7E00, 0},   // NaN
+	};
+	const size_t count = sizeof(cases) / sizeof(cases[0]);
+
+	struct hdr_tonemap *tonemap =
+		hdr_tonemap_create(HDR_TRANSFER_LINEAR, 80.0f, 80.0f);
+	bool ok = true;
+	// once alone, for the scalar path, and once in a group of four
+	for (uint32_t width = 1; width <= 4; width += 3) {
+		for (size_t i = 0; i < count; i++) {
+			uint16_t src[4 * 4];
+			uint8_t got[4 * 4];
+			for (uint32_t p = 0; p < width; p++) {
+				src[p * 4 + 0] = src[p * 4 + 1] =
+					src[p * 4 + 2] = cases[i].half;
+				src[p * 4 + 3] = 0x3C00;
+			}
+			hdr_tonemap_rgba16f(tonemap, (const uint8_t *)src,
+					    sizeof(src), width, 1, got,
+					    sizeof(got));
+			for (uint32_t p = 0; p < width; p++) {
+				if (got[p * 4] != cases[i].expected ||
+				    got[p * 4 + 1] != cases[i].expected ||
+				    got[p * 4 + 2] != cases[i].expected ||
+				    got[p * 4 + 3] != 255) {
+					printf("FAIL: half %04X gave %u, "
+					       "expected %u\n",
+					       cases[i].half, got[p * 4],
+					       cases[i].expected);
+					ok = false;
+					break;
+				}
+			}
+		}
+	}
+	hdr_tonemap_destroy(tonemap);
+
+	printf("%-32s %s\n", "fixed values", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argv;
+	if (argc > 1) {
+		fprintf(stderr, "usage: hdr-convert-check\n");
+		return 2;
+	}
+
+	int failed = 0;
+	if (!check_fixed())
+		failed = 1;
+	if (!check_rgba16f(80.0f))
+		failed = 1;
+	if (!check_rgba16f(1000.0f))
+		failed = 1;
+	if (!check_rgb10a2(HDR_TRANSFER_PQ, "RGB10A2 PQ, peak 1000 nits"))
+		failed = 1;
+	if (!check_rgb10a2(HDR_TRANSFER_HLG, "RGB10A2 HLG, peak 1000 nits"))
+		failed = 1;
+	return failed;
+}
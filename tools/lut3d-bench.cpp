@@ -0,0 +1,315 @@
+/**
+ * lut3d-bench: accuracy and throughput of the 3D LUT applied to
+ * shared-memory frames (lut3d_apply)
+ *
+ *   lut3d-bench [--size WxH] [--frames N]
+ *
+ * Checks, at LUT sizes 2, 17 and 33, that an identity LUT leaves every one
+ * of the 2^24 colours as it is and that a red/blue swap LUT swaps them,
+ * both for BGRA and RGBA and with the source alpha kept, and that a random
+ * LUT stays within one step of a double precision tetrahedral reference.
+ * The exit code is 1 if any check fails.
+ *
+ * Then times a 33^3 LUT on a --size frame of noise (1920x1080 by default)
+ * --frames times (100 by default), next to a plain copy of the same frame,
+ * which is what the shared-memory path does without a LUT.
+ */
+#include "lut3d.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// all 2^24 colours, applied in chunks of an odd size so the kernel's
+// tail is exercised all the way through
+#define ALL_COLOURS (1u << 24)
+#define CHUNK_PIXELS 1021
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+enum lut_kind {
+	LUT_IDENTITY,
+	LUT_SWAP,
+	LUT_RANDOM,
+};
+
+static float *make_table(uint32_t size, enum lut_kind kind)
+{
+	size_t count = (size_t)size * size * size;
+	float *rgb = (float *)malloc(count * 3 * sizeof(float));
+	if (!rgb)
+		return NULL;
+
+	size_t i = 0;
+	for (uint32_t b = 0; b < size; b++) {
+		for (uint32_t g = 0; g < size; g++) {
+			for (uint32_t r = 0; r < size; r++, i++) {
+				float fr = (float)r / (float)(size - 1);
+				float fg = (float)g / (float)(size - 1);
+				float fb = (float)b / (float)(size - 1);
+				if (kind == LUT_SWAP) {
+					float t = fr;
+					fr = fb;
+					fb = t;
+				} else if (kind == LUT_RANDOM) {
+					// a little outside 0..1, to test clamping
+					fr = (float)(next_random() >> 8) /
+						     (1 << 24) * 1.2f -
+					     0.1f;
+					fg = (float)(next_random() >> 8) /
+						     (1 << 24) * 1.2f -
+					     0.1f;
+					fb = (float)(next_random() >> 8) /
+						     (1 << 24) * 1.2f -
+					     0.1f;
+				}
+				rgb[i * 3 + 0] = fr;
+				rgb[i * 3 + 1] = fg;
+				rgb[i * 3 + 2] = fb;
+			}
+		}
+	}
+	return rgb;
+}
+
+/**
+ * Tetrahedral interpolation, written out plainly: walk from the lower node
+ * to the upper one along the axes in order of decreasing fraction
+ */
+static void reference_apply(const float *rgb, uint32_t size, uint8_t r,
+			    uint8_t g, uint8_t b, double *out)
+{
+	const uint8_t in[3] = {r, g, b};
+	const size_t stride[3] = {1, size, (size_t)size * size};
+	size_t node = 0;
+	double frac[3];
+	int axes[3] = {0, 1, 2};
+
+	for (int c = 0; c < 3; c++) {
+		double x = in[c] / 255.0 * (size - 1);
+		double lower = floor(x);
+		if (lower > size - 2)
+			lower = size - 2;
+		frac[c] = x - lower;
+		node += (size_t)lower * stride[c];
+	}
+	for (int i = 0; i < 3; i++) {
+		for (int j = i + 1; j < 3; j++) {
+			if (frac[axes[j]] > frac[axes[i]]) {
+				int t = axes[i];
+				axes[i] = axes[j];
+				axes[j] = t;
+			}
+		}
+	}
+
+	double weight = 1.0 - frac[axes[0]];
+	for (int c = 0; c < 3; c++)
+		out[c] = weight * rgb[node * 3 + c];
+	for (int i = 0; i < 3; i++) {
+		node += stride[axes[i]];
+		weight = frac[axes[i]] - (i < 2 ? frac[axes[i + 1]] : 0.0);
+		for (int c = 0; c < 3; c++)
+			out[c] += weight * rgb[node * 3 + c];
+	}
+}
+
+static uint8_t reference_byte(double value)
+{
+	value *= 255.0;
+	if (value <= 0.0)
+		return 0;
+	if (value >= 255.0)
+		return 255;
+	return (uint8_t)(value + 0.5);
+}
+
+/**
+ * Runs every colour through the LUT and compares each with what kind says
+ * it should be. Random LUTs may be a step off the reference, the others
+ * must match exactly.
+ */
+static bool check_lut(uint32_t size, enum lut_kind kind, bool bgra)
+{
+	static const char *const names[] = {"identity", "swap", "random"};
+	const int ri = bgra ? 2 : 0;
+	const int bi = bgra ? 0 : 2;
+
+	float *rgb = make_table(size, kind);
+	struct lut3d *lut = rgb ? lut3d_create(size, rgb) : NULL;
+	if (!lut) {
+		printf("FAIL: couldn't create a %u^3 %s LUT\n", size,
+		       names[kind]);
+		free(rgb);
+		return false;
+	}
+
+	uint8_t src[CHUNK_PIXELS * 4];
+	uint8_t dst[CHUNK_PIXELS * 4];
+	uint64_t mismatches = 0;
+	int worst = 0;
+
+	for (uint32_t first = 0; first < ALL_COLOURS; first += CHUNK_PIXELS) {
+		uint32_t pixels = ALL_COLOURS - first < CHUNK_PIXELS
+					  ? ALL_COLOURS - first
+					  : CHUNK_PIXELS;
+		for (uint32_t i = 0; i < pixels; i++) {
+			uint32_t colour = first + i;
+			src[i * 4 + ri] = (uint8_t)colour;
+			src[i * 4 + 1] = (uint8_t)(colour >> 8);
+			src[i * 4 + bi] = (uint8_t)(colour >> 16);
+			src[i * 4 + 3] = (uint8_t)(colour * 7);
+		}
+		// identity also runs in place, as the ring copy may
+		uint8_t *out = kind == LUT_IDENTITY ? src : dst;
+		lut3d_apply(lut, out, src, pixels, bgra);
+
+		for (uint32_t i = 0; i < pixels; i++) {
+			uint32_t colour = first + i;
+			uint8_t r = (uint8_t)colour;
+			uint8_t g = (uint8_t)(colour >> 8);
+			uint8_t b = (uint8_t)(colour >> 16);
+			uint8_t expected[3] = {r, g, b};
+			if (kind == LUT_SWAP) {
+				expected[0] = b;
+				expected[2] = r;
+			} else if (kind == LUT_RANDOM) {
+				double ref[3];
+				reference_apply(rgb, size, r, g, b, ref);
+				for (int c = 0; c < 3; c++)
+					expected[c] = reference_byte(ref[c]);
+			}
+
+			const uint8_t got[3] = {out[i * 4 + ri],
+						out[i * 4 + 1],
+						out[i * 4 + bi]};
+			int diff = 0;
+			for (int c = 0; c < 3; c++) {
+				int d = abs((int)got[c] - (int)expected[c]);
+				diff = d > diff ? d : diff;
+			}
+			int allowed = kind == LUT_RANDOM ? 1 : 0;
+			if (diff > allowed ||
+			    out[i * 4 + 3] != (uint8_t)(colour * 7))
+				mismatches++;
+			worst = diff > worst ? diff : worst;
+		}
+	}
+
+	printf("%-4s %2u^3 %-8s %s, largest difference %d\n",
+	       bgra ? "BGRA" : "RGBA", size, names[kind],
+	       mismatches ? "FAIL" : "ok", worst);
+	if (mismatches)
+		printf("     %llu of %u colours out of tolerance\n",
+		       (unsigned long long)mismatches, ALL_COLOURS);
+
+	lut3d_destroy(lut);
+	free(rgb);
+	return mismatches == 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: lut3d-bench [--size WxH] [--frames N]\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	int frames = 100;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (frames < 1 || !width || !height) {
+		usage();
+		return 2;
+	}
+
+	static const uint32_t sizes[] = {2, 17, 33};
+	int failed = 0;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (int kind = LUT_IDENTITY; kind <= LUT_RANDOM; kind++) {
+			for (int bgra = 1; bgra >= 0; bgra--) {
+				if (!check_lut(sizes[s], (enum lut_kind)kind,
+					       bgra != 0))
+					failed = 1;
+			}
+		}
+	}
+
+	size_t pixels = (size_t)width * height;
+	uint8_t *src = (uint8_t *)malloc(pixels * 4);
+	uint8_t *dst = (uint8_t *)malloc(pixels * 4);
+	float *rgb = make_table(33, LUT_RANDOM);
+	struct lut3d *lut = rgb ? lut3d_create(33, rgb) : NULL;
+	if (!src || !dst || !lut) {
+		fprintf(stderr, "Out of memory for a %ux%u frame\n", width,
+			height);
+		return 2;
+	}
+	for (size_t i = 0; i < pixels * 4; i++)
+		src[i] = (uint8_t)(next_random() >> 24);
+
+	uint64_t copy_ns = 0, lut_ns = 0;
+	for (int f = 0; f < frames; f++) {
+		uint64_t start = now_ns();
+		memcpy(dst, src, pixels * 4);
+		copy_ns += now_ns() - start;
+
+		start = now_ns();
+		lut3d_apply(lut, dst, src, pixels, true);
+		lut_ns += now_ns() - start;
+	}
+
+	double copy_ms = (double)copy_ns / frames / 1e6;
+	double lut_ms = (double)lut_ns / frames / 1e6;
+	printf("%ux%u, 33^3 LUT: copy %.3f ms/frame, copy through the LUT "
+	       "%.3f ms/frame (%.1f Mpixels/s)\n",
+	       width, height, copy_ms, lut_ms, pixels / (lut_ms * 1e3));
+
+	lut3d_destroy(lut);
+	free(rgb);
+	free(dst);
+	free(src);
+	return failed;
+}
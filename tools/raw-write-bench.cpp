@@ -0,0 +1,255 @@
+/**
+ * raw-write-bench: sustained write throughput of raw frame recordings
+ *
+ *   raw-write-bench [--size WxH] [--fps N] [--seconds N] [--buffers N]
+ *                   [--file PATH] [--keep]
+ *
+ * Records --seconds (5 by default) of --size BGRA frames (1920x1080 by
+ * default) to --file (raw-write-bench.spraw in the current directory) with
+ * raw_writer_open and raw_writer_write, the way a Spout2 Capture source
+ * records a sender: frames are handed in at --fps (60 by default; 0 hands
+ * them in back to back, which finds the disk's limit but drops most of
+ * them) and the writer has --buffers (8 by default) frames to queue
+ * before it drops one.
+ *
+ * Prints raw_writer_get_stats once a second, then the frames written and
+ * dropped, the sustained rate over the whole recording and over the time
+ * spent in writes (write_ns), and how long raw_writer_write took the
+ * caller. Put --file on the disk to measure: on a file system without
+ * O_DIRECT, e.g. tmpfs, the writer falls back to buffered writes and
+ * measures the page cache.
+ *
+ * Then reads the recording back and checks every frame is there, in
+ * order, with its pixels. The exit code is 1 if it isn't, or if a write
+ * failed. The file is deleted afterwards unless --keep is given.
+ */
+#include "raw-file.h"
+#include "shm-ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void sleep_until(uint64_t deadline)
+{
+	uint64_t now = now_ns();
+	if (now >= deadline)
+		return;
+#ifdef _WIN32
+	Sleep((DWORD)((deadline - now) / 1000000));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)((deadline - now) / 1000000000ULL);
+	ts.tv_nsec = (long)((deadline - now) % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// a different pattern for every frame, so a stale or misplaced one shows
+static void fill_frame(uint32_t *pixels, size_t count, uint64_t seq)
+{
+	for (size_t i = 0; i < count; i += 64)
+		pixels[i] = (uint32_t)i * 2654435761u + (uint32_t)seq;
+}
+
+static bool frame_matches(const uint32_t *pixels, size_t count, uint64_t seq)
+{
+	for (size_t i = 0; i < count; i += 64) {
+		if (pixels[i] != (uint32_t)i * 2654435761u + (uint32_t)seq)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Reads the recording back: as many frames as were written, in order,
+ * each with its own pixels
+ */
+static bool check_recording(const char *path, uint64_t frames,
+			    uint32_t width, uint32_t height)
+{
+	struct raw_reader *reader = raw_reader_open(path);
+	if (!reader) {
+		printf("FAIL: the recording can't be opened\n");
+		return false;
+	}
+	bool ok = raw_reader_frame_count(reader) == frames;
+	if (!ok)
+		printf("FAIL: %zu frames recorded, %llu written\n",
+		       raw_reader_frame_count(reader),
+		       (unsigned long long)frames);
+
+	uint64_t last_seq = 0;
+	for (size_t i = 0; ok && i < raw_reader_frame_count(reader); i++) {
+		struct raw_frame frame;
+		if (!raw_reader_frame(reader, i, &frame) ||
+		    frame.header->width != width ||
+		    frame.header->height != height ||
+		    frame.header->seq <= last_seq ||
+		    !frame_matches((const uint32_t *)frame.pixels,
+				   (size_t)width * height,
+				   frame.header->seq)) {
+			printf("FAIL: frame %zu differs from the one "
+			       "written\n",
+			       i);
+			ok = false;
+		}
+		last_seq = ok ? frame.header->seq : last_seq;
+	}
+	raw_reader_close(reader);
+	return ok;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: raw-write-bench [--size WxH] [--fps N] [--seconds N] "
+		"[--buffers N] [--file PATH] [--keep]\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	int fps = 60;
+	int seconds = 5;
+	int buffers = 8;
+	const char *path = "raw-write-bench.spraw";
+	bool keep = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--buffers") == 0 && i + 1 < argc) {
+			buffers = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+			path = argv[++i];
+		} else if (strcmp(argv[i], "--keep") == 0) {
+			keep = true;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (!width || !height || fps < 0 || seconds < 1 || buffers < 1) {
+		usage();
+		return 2;
+	}
+
+	size_t count = (size_t)width * height;
+	uint32_t *pixels = (uint32_t *)calloc(count, 4);
+	struct raw_writer *writer =
+		pixels ? raw_writer_open(path, "raw-write-bench",
+					 (uint32_t)buffers)
+		       : NULL;
+	if (!writer) {
+		fprintf(stderr, "Couldn't start recording to %s\n", path);
+		free(pixels);
+		return 1;
+	}
+
+	char rate[32];
+	if (fps)
+		snprintf(rate, sizeof(rate), "%d fps", fps);
+	else
+		snprintf(rate, sizeof(rate), "back to back");
+	printf("%ux%u BGRA, %s for %d s, %d buffers, to %s\n", width, height,
+	       rate, seconds, buffers, path);
+
+	struct raw_frame_header header = {};
+	header.format = SHM_RING_FORMAT_BGRA;
+	header.width = width;
+	header.height = height;
+	header.linesize = width * 4;
+	header.transfer = SHM_RING_TRANSFER_SRGB;
+
+	uint64_t start = now_ns();
+	uint64_t end = start + (uint64_t)seconds * 1000000000ULL;
+	uint64_t next_report = start + 1000000000ULL;
+	uint64_t handed_in = 0, call_ns = 0, longest_call = 0;
+	for (uint64_t seq = 1;; seq++) {
+		uint64_t due = fps ? start + (seq - 1) * 1000000000ULL / fps
+				   : now_ns();
+		if (due >= end)
+			break;
+		sleep_until(due);
+
+		fill_frame(pixels, count, seq);
+		header.seq = seq;
+		header.timestamp_ns = now_ns();
+		header.sender_timestamp = header.timestamp_ns;
+		uint64_t before = now_ns();
+		raw_writer_write(writer, &header, (const uint8_t *)pixels);
+		uint64_t took = now_ns() - before;
+		call_ns += took;
+		longest_call = took > longest_call ? took : longest_call;
+		handed_in++;
+
+		if (now_ns() >= next_report) {
+			struct raw_writer_stats stats;
+			raw_writer_get_stats(writer, &stats);
+			printf("%3llu s %7llu written %5llu dropped %8.2f GB "
+			       "so far\n",
+			       (unsigned long long)((next_report - start) /
+						    1000000000ULL),
+			       (unsigned long long)stats.frames,
+			       (unsigned long long)stats.dropped,
+			       stats.bytes / 1e9);
+			next_report += 1000000000ULL;
+		}
+	}
+
+	struct raw_writer_stats stats;
+	raw_writer_close(writer, &stats);
+	double elapsed = (double)(now_ns() - start);
+
+	printf("%llu frames handed in, %llu written, %llu dropped%s\n",
+	       (unsigned long long)handed_in,
+	       (unsigned long long)stats.frames,
+	       (unsigned long long)stats.dropped,
+	       stats.failed ? ", a write FAILED" : "");
+	printf("sustained %.2f GB/s over the recording, %.2f GB/s in writes "
+	       "(write_ns %.3f ms per frame)\n",
+	       stats.bytes / elapsed,
+	       stats.write_ns ? (double)stats.bytes / stats.write_ns : 0.0,
+	       stats.frames ? stats.write_ns / 1e6 / stats.frames : 0.0);
+	printf("raw_writer_write: %.3f ms per frame, longest %.3f ms\n",
+	       handed_in ? call_ns / 1e6 / handed_in : 0.0,
+	       longest_call / 1e6);
+
+	bool ok = !stats.failed &&
+		  check_recording(path, stats.frames, width, height);
+	if (!keep)
+		remove(path);
+	free(pixels);
+	return ok ? 0 : 1;
+}
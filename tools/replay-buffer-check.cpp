@@ -0,0 +1,268 @@
+/**
+ * replay-buffer-check: frames come back out of the instant replay buffer
+ * exactly as they went in
+ *
+ *   replay-buffer-check
+ *
+ * round trip: pushes frames of a few patterns (flat colour, gradients,
+ * noise, a small palette, changing alpha) and sizes, odd widths and padded
+ * rows included, raw and QOI-compressed, and decodes each into rows of
+ * another pitch. Every pixel must match; prints the size QOI stored each
+ * pattern in.
+ *
+ * eviction: pushes a few hundred frames of random sizes and codecs
+ * through a small arena, so records wrap around its end and old ones are
+ * evicted, and after every push decodes every frame still held. They must
+ * be the newest ones, in order, each with its own pixels.
+ *
+ * The exit code is 1 if any check fails.
+ */
+#include "replay-buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum pattern {
+	PATTERN_FLAT,
+	PATTERN_GRADIENT,
+	PATTERN_NOISE,
+	PATTERN_PALETTE,
+	PATTERN_ALPHA,
+	PATTERN_COUNT,
+};
+
+static const char *pattern_names[PATTERN_COUNT] = {
+	"flat colour", "gradient", "noise", "8 colour palette", "alpha ramp",
+};
+
+static uint32_t next_random(uint32_t *seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return *seed >> 8;
+}
+
+/**
+ * Fills width x height pixels, rows linesize apart, the same way for the
+ * same pattern and seed
+ */
+static void fill_frame(uint8_t *pixels, uint32_t linesize, uint32_t width,
+		       uint32_t height, enum pattern pattern, uint32_t seed)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *px = pixels + (size_t)y * linesize;
+		for (uint32_t x = 0; x < width; x++, px += 4) {
+			uint32_t value;
+			switch (pattern) {
+			case PATTERN_FLAT:
+				value = seed | 0xFF000000u;
+				break;
+			case PATTERN_GRADIENT:
+				value = ((x + seed) & 0xFF) |
+					((y + seed) & 0xFF) << 8 |
+					((x + y) & 0xFF) << 16 | 0xFF000000u;
+				break;
+			case PATTERN_NOISE:
+				value = next_random(&seed) |
+					next_random(&seed) << 24;
+				break;
+			case PATTERN_PALETTE:
+				value = (next_random(&seed) % 8) * 0x20304050u;
+				break;
+			default:
+				value = (seed & 0xFFFFFF) |
+					((x * 255 / width) << 24);
+				break;
+			}
+			memcpy(px, &value, 4);
+		}
+	}
+}
+
+static bool frames_equal(const uint8_t *a, uint32_t a_linesize,
+			 const uint8_t *b, uint32_t b_linesize,
+			 uint32_t width, uint32_t height)
+{
+	for (uint32_t y = 0; y < height; y++) {
+		if (memcmp(a + (size_t)y * a_linesize,
+			   b + (size_t)y * b_linesize, (size_t)width * 4) != 0)
+			return false;
+	}
+	return true;
+}
+
+static bool check_round_trip(void)
+{
+	static const uint32_t sizes[][2] = {
+		{1, 1}, {63, 1}, {64, 64}, {127, 33}, {320, 180}, {1920, 1080},
+	};
+	const size_t num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+	const uint32_t max_width = 1920, max_height = 1080;
+
+	struct replay_buffer *buffer =
+		replay_buffer_create((size_t)max_width * max_height * 6);
+	// rows padded on the way in and out, by different amounts
+	uint32_t src_linesize = max_width * 4 + 64;
+	uint32_t dst_linesize = max_width * 4 + 128;
+	uint8_t *src = (uint8_t *)malloc((size_t)src_linesize * max_height);
+	uint8_t *dst = (uint8_t *)malloc((size_t)dst_linesize * max_height);
+	if (!buffer || !src || !dst) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+
+	bool ok = true;
+	size_t qoi_bytes[PATTERN_COUNT] = {};
+	size_t raw_bytes = 0;
+	for (int codec = REPLAY_CODEC_RAW; codec <= REPLAY_CODEC_QOI;
+	     codec++) {
+		for (int p = 0; p < PATTERN_COUNT; p++) {
+			for (size_t s = 0; s < num_sizes; s++) {
+				uint32_t width = sizes[s][0];
+				uint32_t height = sizes[s][1];
+				uint32_t seed = (uint32_t)(p * 31 + s);
+				fill_frame(src, src_linesize, width, height,
+					   (enum pattern)p, seed);
+				replay_buffer_clear(buffer);
+
+				struct replay_frame_info info;
+				bool good =
+					replay_buffer_push(
+						buffer, src, src_linesize,
+						width, height, s,
+						(enum replay_codec)codec) &&
+					replay_buffer_info(buffer, 0, &info) &&
+					replay_buffer_decode(buffer, 0, dst,
+							     dst_linesize) &&
+					frames_equal(src, src_linesize, dst,
+						     dst_linesize, width,
+						     height);
+				if (!good) {
+					printf("FAIL: %s %ux%u %s doesn't "
+					       "round-trip\n",
+					       pattern_names[p], width, height,
+					       codec == REPLAY_CODEC_QOI
+						       ? "QOI"
+						       : "raw");
+					ok = false;
+					continue;
+				}
+				if (width == max_width && codec == REPLAY_CODEC_QOI)
+					qoi_bytes[p] = info.size;
+				if (width == max_width && codec == REPLAY_CODEC_RAW)
+					raw_bytes = info.size;
+			}
+		}
+	}
+
+	printf("round trip, raw and QOI, %zu sizes: %s\n", num_sizes,
+	       ok ? "ok" : "FAIL");
+	for (int p = 0; p < PATTERN_COUNT && ok; p++)
+		printf("  %-18s 1080p QOI %8zu KiB, %5.1f%% of raw\n",
+		       pattern_names[p], qoi_bytes[p] / 1024,
+		       100.0 * qoi_bytes[p] / raw_bytes);
+
+	replay_buffer_destroy(buffer);
+	free(src);
+	free(dst);
+	return ok;
+}
+
+struct pushed {
+	uint32_t width;
+	uint32_t height;
+	enum pattern pattern;
+	uint32_t seed;
+};
+
+static bool check_eviction(void)
+{
+	const int pushes = 400;
+	const uint32_t max_side = 96;
+	struct replay_buffer *buffer =
+		replay_buffer_create((size_t)max_side * max_side * 4 * 6);
+	struct pushed *history =
+		(struct pushed *)calloc(pushes, sizeof(*history));
+	uint8_t *src = (uint8_t *)malloc((size_t)max_side * max_side * 4);
+	uint8_t *dst = (uint8_t *)malloc((size_t)max_side * max_side * 4);
+	if (!buffer || !history || !src || !dst) {
+		fprintf(stderr, "Out of memory\n");
+		return false;
+	}
+
+	uint32_t seed = 12345;
+	bool ok = true;
+	size_t most_held = 0;
+	for (int i = 0; i < pushes && ok; i++) {
+		struct pushed *frame = &history[i];
+		frame->width = 1 + next_random(&seed) % max_side;
+		frame->height = 1 + next_random(&seed) % max_side;
+		frame->pattern =
+			(enum pattern)(next_random(&seed) % PATTERN_COUNT);
+		frame->seed = next_random(&seed);
+		enum replay_codec codec = next_random(&seed) % 2
+						  ? REPLAY_CODEC_QOI
+						  : REPLAY_CODEC_RAW;
+		fill_frame(src, frame->width * 4, frame->width, frame->height,
+			   frame->pattern, frame->seed);
+		if (!replay_buffer_push(buffer, src, frame->width * 4,
+					frame->width, frame->height,
+					(uint64_t)i, codec)) {
+			printf("FAIL: frame %d wasn't stored\n", i);
+			ok = false;
+			break;
+		}
+
+		// the newest frames, in order, the last one pushed last
+		size_t count = replay_buffer_count(buffer);
+		most_held = count > most_held ? count : most_held;
+		for (size_t k = 0; k < count && ok; k++) {
+			int pushed = i - (int)(count - 1 - k);
+			const struct pushed *expected = &history[pushed];
+			struct replay_frame_info info;
+			fill_frame(src, expected->width * 4, expected->width,
+				   expected->height, expected->pattern,
+				   expected->seed);
+			if (!replay_buffer_info(buffer, k, &info) ||
+			    info.timestamp_ns != (uint64_t)pushed ||
+			    info.width != expected->width ||
+			    info.height != expected->height ||
+			    !replay_buffer_decode(buffer, k, dst,
+						  expected->width * 4) ||
+			    !frames_equal(src, expected->width * 4, dst,
+					  expected->width * 4, expected->width,
+					  expected->height)) {
+				printf("FAIL: after push %d, frame %zu of %zu "
+				       "isn't frame %d\n",
+				       i, k, count, pushed);
+				ok = false;
+			}
+		}
+	}
+	printf("eviction, %d frames through a %zu KiB arena, up to %zu held: "
+	       "%s\n",
+	       pushes, (size_t)max_side * max_side * 4 * 6 / 1024, most_held,
+	       ok ? "ok" : "FAIL");
+
+	replay_buffer_destroy(buffer);
+	free(history);
+	free(src);
+	free(dst);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	(void)argv;
+	if (argc > 1) {
+		fprintf(stderr, "usage: replay-buffer-check\n");
+		return 2;
+	}
+
+	int failed = 0;
+	if (!check_round_trip())
+		failed = 1;
+	if (!check_eviction())
+		failed = 1;
+	return failed;
+}
@@ -0,0 +1,192 @@
+/**
+ * sender-bind-check: first-available sources keep their senders
+ *
+ *   sender-bind-check [--instances N] [--steps N]
+ *
+ * Runs --instances (32 by default) first-available sources for --steps
+ * (3000 by default). On every step senders may register, in front of the
+ * others or behind them, or leave, and a random source re-binds, as it
+ * does when it's shown again or its sender changes. Each source binds with
+ * sender_bind_first_available, as the plugin's do.
+ *
+ * A source moving to another sender while its own is still listed is a
+ * cascade: one source's or sender's change pulling others along. Prints
+ * how often sources moved and why.
+ *
+ * Also checks a source never binds to a sender it has to skip, as the
+ * plugin's own outputs and filters are, even one it was bound to. The
+ * exit code is 1 if a source cascaded or took a skipped sender.
+ */
+#include "sender-bind.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SENDERS 64
+
+struct registry {
+	char names[MAX_SENDERS][256];
+	int count;
+	int next_id;
+};
+
+struct instance {
+	char bound[256];
+};
+
+static uint32_t seed = 12345;
+
+static uint32_t next_random(void)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+static bool listed(const struct registry *registry, const char *name)
+{
+	for (int i = 0; i < registry->count; i++) {
+		if (strcmp(registry->names[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void add_sender(struct registry *registry)
+{
+	if (registry->count == MAX_SENDERS)
+		return;
+	// new senders often show up first, which is what moved sources
+	// bound to "whatever is first"
+	int at = next_random() % 2 ? 0 : registry->count;
+	memmove(registry->names[at + 1], registry->names[at],
+		sizeof(registry->names[0]) * (registry->count - at));
+	snprintf(registry->names[at], sizeof(registry->names[at]), "sender %d",
+		 registry->next_id++);
+	registry->count++;
+}
+
+static void remove_sender(struct registry *registry)
+{
+	if (registry->count <= 1)
+		return;
+	int at = (int)(next_random() % registry->count);
+	memmove(registry->names[at], registry->names[at + 1],
+		sizeof(registry->names[0]) * (registry->count - at - 1));
+	registry->count--;
+}
+
+/**
+ * @return whether the instance moved to another sender
+ */
+static bool bind(struct instance *instance, const struct registry *registry)
+{
+	int index = sender_bind_first_available(
+		instance->bound, (const char(*)[256])registry->names,
+		registry->count, NULL);
+	if (index < 0 || strcmp(registry->names[index], instance->bound) == 0)
+		return false;
+	strcpy(instance->bound, registry->names[index]);
+	return true;
+}
+
+static bool skip_own(const char *name)
+{
+	return strncmp(name, "own", 3) == 0;
+}
+
+static bool check_skip(void)
+{
+	static const char names[3][256] = {"own output", "sender", "own filter"};
+	static const char own[2][256] = {"own output", "own filter"};
+	bool ok = sender_bind_first_available("", names, 3, skip_own) == 1 &&
+		  sender_bind_first_available("own filter", names, 3,
+					      skip_own) == 1 &&
+		  sender_bind_first_available("", own, 2, skip_own) == -1 &&
+		  sender_bind_first_available("", names, 0, NULL) == -1;
+	printf("the plugin's own senders are skipped: %s\n",
+	       ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: sender-bind-check [--instances N] [--steps N]\n");
+}
+
+int main(int argc, char **argv)
+{
+	int count = 32;
+	int steps = 3000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+			steps = atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (count < 1 || steps < 1) {
+		usage();
+		return 2;
+	}
+
+	struct registry *registry =
+		(struct registry *)calloc(1, sizeof(*registry));
+	struct instance *instances =
+		(struct instance *)calloc((size_t)count, sizeof(*instances));
+	if (!registry || !instances) {
+		fprintf(stderr, "Out of memory\n");
+		return 2;
+	}
+	for (int i = 0; i < 4; i++)
+		add_sender(registry);
+	for (int i = 0; i < count; i++)
+		bind(&instances[i], registry);
+
+	uint64_t rebinds = 0, moved = 0, cascades = 0;
+	for (int step = 0; step < steps; step++) {
+		uint32_t change = next_random() % 4;
+		if (change == 0)
+			add_sender(registry);
+		else if (change == 1)
+			remove_sender(registry);
+
+		struct instance *instance = &instances[next_random() % count];
+		bool had_sender = listed(registry, instance->bound);
+		rebinds++;
+		if (bind(instance, registry)) {
+			if (had_sender)
+				cascades++;
+			else
+				moved++;
+		}
+
+		// nobody else may have been moved by that
+		for (int i = 0; i < count; i++) {
+			struct instance *other = &instances[i];
+			if (listed(registry, other->bound) &&
+			    bind(other, registry))
+				cascades++;
+		}
+	}
+
+	printf("%d sources, %d steps: %llu re-binds, %llu moved after their "
+	       "sender left, %llu cascades\n",
+	       count, steps, (unsigned long long)rebinds,
+	       (unsigned long long)moved,
+	       (unsigned long long)cascades);
+	if (cascades)
+		printf("FAIL: sources moved while their sender was listed\n");
+
+	bool ok = check_skip() && !cascades;
+
+	free(instances);
+	free(registry);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,600 @@
+/**
+ * shm-ring-bench: costs of the shared-memory frame ring
+ *
+ *   shm-ring-bench [--size WxH] [--frames N]
+ *
+ * connect: creates a ring for three --size frames (3840x2160 BGRA by
+ * default), opens it as a reader would, then writes and reads its first
+ * frame and --frames more (10 by default). Prints the time of each step,
+ * and the page faults and, where perf events are allowed, dTLB misses of
+ * the first frame and of the frames after it. Writer and reader run in
+ * this one process, so faults and misses are those of both sides.
+ *
+ * wrap: writes and reads frames of a few sizes through 3-frame rings, in
+ * which a good part of the frames wrap around the end of the ring. Prints
+ * the read time per frame and how many reads had to be split in two.
+ *
+ * dirty: sends 1080p frames in which only overlay-like rectangles change
+ * (a ticker, a scoreboard and clock, a lower third), with their dirty
+ * rectangles, plus whole frames and frames with too many rectangles for
+ * comparison. A reader keeping its previous frame reads them with
+ * shm_ring_read_dirty and skips a frame now and then. Prints the bytes
+ * copied per frame and the read time, and checks the reader's frame is
+ * the sender's after every read.
+ *
+ * throughput: writes and reads 1080p and 4K BGRA frames back to back
+ * through a 3-frame ring, about 4 GB each way, as a sender and a receiver
+ * keeping up with each other would. Prints the write and read rates in
+ * GB/s and the frames per second of both together.
+ *
+ * shm-ring-bench-baseline is the same program built with rings that are
+ * neither prefaulted nor mirrored, as rings were before they were. Every
+ * frame read is compared with the one written; the exit code is 1 if any
+ * differs.
+ */
+#include "shm-ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static uint64_t page_faults(void)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+				  sizeof(counters)))
+		return 0;
+	return counters.PageFaultCount;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (uint64_t)usage.ru_minflt + (uint64_t)usage.ru_majflt;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* dTLB misses, Linux only and only where perf events are allowed */
+
+static int tlb_fd = -1;
+
+static void tlb_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	tlb_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+static void tlb_start(void)
+{
+#ifdef __linux__
+	if (tlb_fd >= 0) {
+		ioctl(tlb_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(tlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+// -1 if they can't be counted
+static int64_t tlb_stop(void)
+{
+#ifdef __linux__
+	uint64_t count;
+	if (tlb_fd >= 0) {
+		ioctl(tlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(tlb_fd, &count, sizeof(count)) == sizeof(count))
+			return (int64_t)count;
+	}
+#endif
+	return -1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct frame_source {
+	uint32_t width;
+	uint32_t height;
+	uint8_t *pixels;
+	uint8_t *read;
+	size_t size;
+};
+
+static bool frame_source_init(struct frame_source *source, uint32_t width,
+			      uint32_t height)
+{
+	source->width = width;
+	source->height = height;
+	source->size = (size_t)width * height * 4;
+	source->pixels = (uint8_t *)malloc(source->size);
+	source->read = (uint8_t *)malloc(source->size);
+	if (!source->pixels || !source->read)
+		return false;
+	// faulted in now, so only the ring's faults are counted; not with
+	// zeroes, malloc and memset to 0 may be turned into calloc
+	memset(source->pixels, 1, source->size);
+	memset(source->read, 1, source->size);
+	return true;
+}
+
+static void frame_source_free(struct frame_source *source)
+{
+	free(source->pixels);
+	free(source->read);
+}
+
+// a different pattern for every frame, so a stale read shows
+static void frame_source_fill(struct frame_source *source, uint32_t frame)
+{
+	uint32_t *px = (uint32_t *)source->pixels;
+	for (size_t i = 0; i < source->size / 4; i++)
+		px[i] = (uint32_t)i * 2654435761u + frame;
+}
+
+static bool write_frame(struct shm_ring *ring, struct frame_source *source,
+			uint64_t timestamp)
+{
+	return shm_ring_write(ring, source->pixels, source->width * 4,
+			      source->width, source->height,
+			      SHM_RING_FORMAT_BGRA, timestamp);
+}
+
+static bool read_frame(struct shm_ring *reader, struct frame_source *source)
+{
+	struct shm_ring_frame frame;
+	return shm_ring_read(reader, &frame, source->read, source->size) ==
+		       SHM_RING_OK &&
+	       memcmp(source->read, source->pixels, source->size) == 0;
+}
+
+static void ring_name(char *name, size_t size, const char *what)
+{
+#ifdef _WIN32
+	unsigned long pid = GetCurrentProcessId();
+#else
+	unsigned long pid = (unsigned long)getpid();
+#endif
+	snprintf(name, size, "shm-ring-bench %s %lu", what, pid);
+}
+
+static void print_counts(const char *what, double ms, uint64_t faults,
+			 int64_t tlb_misses)
+{
+	printf("%-22s %9.3f ms %8llu faults", what, ms,
+	       (unsigned long long)faults);
+	if (tlb_misses >= 0)
+		printf(" %10lld dTLB misses", (long long)tlb_misses);
+	printf("\n");
+}
+
+static bool bench_connect(uint32_t width, uint32_t height, int frames)
+{
+	struct frame_source source;
+	if (!frame_source_init(&source, width, height)) {
+		fprintf(stderr, "Out of memory for a %ux%u frame\n", width,
+			height);
+		return false;
+	}
+
+	char name[64];
+	ring_name(name, sizeof(name), "connect");
+
+	printf("connect, %ux%u BGRA, %d frames ring\n", width, height,
+	       SHM_RING_DEFAULT_FRAMES);
+	uint64_t start = now_ns();
+	struct shm_ring *ring = shm_ring_create(name, source.size,
+						SHM_RING_DEFAULT_FRAMES);
+	uint64_t created = now_ns();
+	struct shm_ring *reader = ring ? shm_ring_open(name) : NULL;
+	uint64_t opened = now_ns();
+	if (!ring || !reader) {
+		fprintf(stderr, "Couldn't create and open a ring\n");
+		shm_ring_close(ring);
+		frame_source_free(&source);
+		return false;
+	}
+	printf("%-22s %9.3f ms\n", "create", (created - start) / 1e6);
+	printf("%-22s %9.3f ms\n", "open", (opened - created) / 1e6);
+
+	bool ok = true;
+	frame_source_fill(&source, 0);
+	uint64_t faults = page_faults();
+	tlb_start();
+	start = now_ns();
+	ok = write_frame(ring, &source, 0) && read_frame(reader, &source) &&
+	     ok;
+	uint64_t end = now_ns();
+	int64_t tlb_misses = tlb_stop();
+	print_counts("first frame", (end - start) / 1e6, page_faults() - faults,
+		     tlb_misses);
+
+	// frames are filled outside the counted part
+	uint64_t elapsed = 0;
+	faults = 0;
+	tlb_misses = 0;
+	for (int i = 1; i <= frames; i++) {
+		frame_source_fill(&source, (uint32_t)i);
+		uint64_t faults_before = page_faults();
+		tlb_start();
+		start = now_ns();
+		ok = write_frame(ring, &source, (uint64_t)i) &&
+		     read_frame(reader, &source) && ok;
+		elapsed += now_ns() - start;
+		int64_t misses = tlb_stop();
+		tlb_misses = misses >= 0 ? tlb_misses + misses : -1;
+		faults += page_faults() - faults_before;
+	}
+	char what[32];
+	snprintf(what, sizeof(what), "next %d, per frame", frames);
+	print_counts(what, elapsed / 1e6 / frames, faults / frames,
+		     tlb_misses >= 0 ? tlb_misses / frames : -1);
+
+	shm_ring_close(reader);
+	shm_ring_close(ring);
+	frame_source_free(&source);
+	if (!ok)
+		printf("FAIL: a frame read back differs from the one written\n");
+	return ok;
+}
+
+struct split_count {
+	uint64_t calls;
+};
+
+// shm_ring_read_copy calls this twice for a frame split by the ring's end
+static void counting_copy(void *param, const struct shm_ring_frame *frame,
+			  uint8_t *dst, const uint8_t *src, size_t size)
+{
+	(void)frame;
+	struct split_count *count = (struct split_count *)param;
+	count->calls++;
+	memcpy(dst, src, size);
+}
+
+static bool bench_wrap_size(uint32_t width, uint32_t height)
+{
+	struct frame_source source;
+	if (!frame_source_init(&source, width, height)) {
+		fprintf(stderr, "Out of memory for a %ux%u frame\n", width,
+			height);
+		return false;
+	}
+
+	char name[64];
+	ring_name(name, sizeof(name), "wrap");
+	struct shm_ring *ring = shm_ring_create(name, source.size,
+						SHM_RING_DEFAULT_FRAMES);
+	struct shm_ring *reader = ring ? shm_ring_open(name) : NULL;
+	if (!ring || !reader) {
+		fprintf(stderr, "Couldn't create and open a ring\n");
+		shm_ring_close(ring);
+		frame_source_free(&source);
+		return false;
+	}
+
+	// about 4 GB through the ring, at least 200 frames
+	uint64_t frames = (4ULL << 30) / source.size;
+	frames = frames < 200 ? 200 : frames;
+
+	struct split_count count = {};
+	uint64_t elapsed = 0;
+	bool ok = true;
+	for (uint64_t i = 0; i < frames; i++) {
+		// only the first pixel changes, filling whole frames would
+		// take longer than the reads
+		((uint32_t *)source.pixels)[0] = (uint32_t)i;
+		ok = write_frame(ring, &source, i) && ok;
+
+		struct shm_ring_frame frame;
+		uint64_t start = now_ns();
+		int result = shm_ring_read_copy(reader, &frame, source.read,
+						source.size, counting_copy,
+						&count);
+		elapsed += now_ns() - start;
+		ok = result == SHM_RING_OK &&
+		     memcmp(source.read, source.pixels, source.size) == 0 && ok;
+	}
+	printf("%5ux%-5u %8llu frames %10.3f us/read %8llu split\n", width,
+	       height, (unsigned long long)frames,
+	       (double)elapsed / frames / 1e3,
+	       (unsigned long long)(count.calls - frames));
+
+	shm_ring_close(reader);
+	shm_ring_close(ring);
+	frame_source_free(&source);
+	if (!ok)
+		printf("FAIL: a frame read back differs from the one written\n");
+	return ok;
+}
+
+static bool bench_wrap(void)
+{
+	printf("wrap, BGRA, %d frames rings\n", SHM_RING_DEFAULT_FRAMES);
+	bool ok = bench_wrap_size(64, 64);
+	ok = bench_wrap_size(320, 180) && ok;
+	ok = bench_wrap_size(1920, 1080) && ok;
+	return ok;
+}
+
+#define DIRTY_WIDTH 1920
+#define DIRTY_HEIGHT 1080
+#define DIRTY_FRAMES 300
+// the reader misses a frame this often, and has to read a whole one
+#define DIRTY_SKIP_EVERY 50
+
+struct dirty_workload {
+	const char *name;
+	uint32_t num_rects;
+	struct shm_ring_rect rects[40];
+};
+
+static void fill_rect(struct frame_source *source,
+		      const struct shm_ring_rect *rect, uint32_t frame)
+{
+	for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+		uint32_t *px = (uint32_t *)source->pixels +
+			       (size_t)y * source->width + rect->x;
+		for (uint32_t x = 0; x < rect->width; x++)
+			px[x] = (x + y) * 2654435761u + frame;
+	}
+}
+
+static bool bench_dirty_workload(const struct dirty_workload *workload)
+{
+	struct frame_source source;
+	if (!frame_source_init(&source, DIRTY_WIDTH, DIRTY_HEIGHT)) {
+		fprintf(stderr, "Out of memory for a %ux%u frame\n",
+			DIRTY_WIDTH, DIRTY_HEIGHT);
+		return false;
+	}
+	frame_source_fill(&source, 0);
+
+	char name[64];
+	ring_name(name, sizeof(name), "dirty");
+	struct shm_ring *ring = shm_ring_create(name, source.size,
+						SHM_RING_DEFAULT_FRAMES);
+	struct shm_ring *reader = ring ? shm_ring_open(name) : NULL;
+	if (!ring || !reader) {
+		fprintf(stderr, "Couldn't create and open a ring\n");
+		shm_ring_close(ring);
+		frame_source_free(&source);
+		return false;
+	}
+
+	const struct shm_ring_rect whole = {0, 0, DIRTY_WIDTH, DIRTY_HEIGHT};
+	uint64_t bytes = 0, elapsed = 0, reads = 0, dst_seq = 0;
+	bool ok = true;
+	for (uint32_t i = 1; i <= DIRTY_FRAMES; i++) {
+		if (workload->num_rects) {
+			for (uint32_t r = 0; r < workload->num_rects; r++)
+				fill_rect(&source, &workload->rects[r], i);
+			ok = shm_ring_write_rects(ring, source.pixels,
+						  DIRTY_WIDTH * 4, DIRTY_WIDTH,
+						  DIRTY_HEIGHT,
+						  SHM_RING_FORMAT_BGRA, i,
+						  workload->rects,
+						  workload->num_rects) &&
+			     ok;
+		} else {
+			fill_rect(&source, &whole, i);
+			ok = write_frame(ring, &source, i) && ok;
+		}
+		if (i % DIRTY_SKIP_EVERY == 0)
+			continue;
+
+		struct shm_ring_frame frame;
+		uint64_t start = now_ns();
+		int result = shm_ring_read_dirty(reader, &frame, source.read,
+						 source.size, dst_seq, NULL,
+						 NULL);
+		elapsed += now_ns() - start;
+		reads++;
+		if (result != SHM_RING_OK) {
+			ok = false;
+			dst_seq = 0;
+			continue;
+		}
+		dst_seq = frame.seq;
+
+		if (!frame.num_rects)
+			bytes += frame.size;
+		for (uint32_t r = 0; r < frame.num_rects; r++)
+			bytes += (uint64_t)frame.rects[r].width *
+				 frame.rects[r].height * 4;
+		ok = memcmp(source.read, source.pixels, source.size) == 0 &&
+		     ok;
+	}
+	printf("%-28s %8.0f KiB/frame %6.1f%% %8.1f us/read\n",
+	       workload->name, (double)bytes / reads / 1024.0,
+	       100.0 * bytes / reads / source.size,
+	       (double)elapsed / reads / 1e3);
+
+	shm_ring_close(reader);
+	shm_ring_close(ring);
+	frame_source_free(&source);
+	if (!ok)
+		printf("FAIL: the reader's frame differs from the sender's\n");
+	return ok;
+}
+
+static bool bench_dirty(void)
+{
+	static struct dirty_workload workloads[] = {
+		{"ticker strip (1920x60)", 1, {{0, 1000, 1920, 60}}},
+		{"scoreboard + clock",
+		 2,
+		 {{80, 60, 480, 90}, {1700, 60, 140, 50}}},
+		{"lower third (1200x150)", 1, {{360, 860, 1200, 150}}},
+		{"full frame, no rects", 0, {}},
+		{"40 small rects, too many", 40, {}},
+	};
+	struct dirty_workload *many = &workloads[4];
+	for (uint32_t r = 0; r < many->num_rects; r++) {
+		many->rects[r].x = (r % 8) * 240;
+		many->rects[r].y = (r / 8) * 200;
+		many->rects[r].width = 64;
+		many->rects[r].height = 32;
+	}
+
+	printf("dirty, %ux%u BGRA, %d frames, the reader skipping every "
+	       "%dth\n",
+	       DIRTY_WIDTH, DIRTY_HEIGHT, DIRTY_FRAMES, DIRTY_SKIP_EVERY);
+	bool ok = true;
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+		ok = bench_dirty_workload(&workloads[i]) && ok;
+	return ok;
+}
+
+#define THROUGHPUT_BYTES (4ULL << 30)
+
+static bool bench_throughput_size(uint32_t width, uint32_t height)
+{
+	struct frame_source source;
+	if (!frame_source_init(&source, width, height)) {
+		fprintf(stderr, "Out of memory for a %ux%u frame\n", width,
+			height);
+		return false;
+	}
+	frame_source_fill(&source, 0);
+
+	char name[64];
+	ring_name(name, sizeof(name), "throughput");
+	struct shm_ring *ring = shm_ring_create(name, source.size,
+						SHM_RING_DEFAULT_FRAMES);
+	struct shm_ring *reader = ring ? shm_ring_open(name) : NULL;
+	if (!ring || !reader) {
+		fprintf(stderr, "Couldn't create and open a ring\n");
+		shm_ring_close(ring);
+		frame_source_free(&source);
+		return false;
+	}
+
+	uint64_t frames = THROUGHPUT_BYTES / source.size;
+	frames = frames < 100 ? 100 : frames;
+
+	uint64_t write_ns = 0, read_ns = 0;
+	bool ok = true;
+	for (uint64_t i = 0; i < frames; i++) {
+		// as in wrap, only the first pixel changes between frames
+		((uint32_t *)source.pixels)[0] = (uint32_t)i;
+		uint64_t start = now_ns();
+		ok = write_frame(ring, &source, i) && ok;
+		uint64_t written = now_ns();
+
+		struct shm_ring_frame frame;
+		int result = shm_ring_read(reader, &frame, source.read,
+					   source.size);
+		uint64_t end = now_ns();
+		write_ns += written - start;
+		read_ns += end - written;
+		ok = result == SHM_RING_OK &&
+		     memcmp(source.read, source.pixels, source.size) == 0 && ok;
+	}
+	double bytes = (double)source.size * frames;
+	printf("%5ux%-5u %6llu frames %7.2f GB/s write %7.2f GB/s read "
+	       "%8.1f frames/s\n",
+	       width, height, (unsigned long long)frames, bytes / write_ns,
+	       bytes / read_ns, frames * 1e9 / (write_ns + read_ns));
+
+	shm_ring_close(reader);
+	shm_ring_close(ring);
+	frame_source_free(&source);
+	if (!ok)
+		printf("FAIL: a frame read back differs from the one written\n");
+	return ok;
+}
+
+static bool bench_throughput(void)
+{
+	printf("throughput, BGRA, %d frames rings, write then read\n",
+	       SHM_RING_DEFAULT_FRAMES);
+	bool ok = bench_throughput_size(1920, 1080);
+	ok = bench_throughput_size(3840, 2160) && ok;
+	return ok;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: shm-ring-bench [--size WxH] [--frames N]\n");
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t width = 3840;
+	uint32_t height = 2160;
+	int frames = 10;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (frames < 1 || !width || !height) {
+		usage();
+		return 2;
+	}
+
+#ifdef SHM_RING_NO_PREFAULT
+	printf("baseline: rings are neither prefaulted nor mirrored\n");
+#endif
+	tlb_open();
+	if (tlb_fd < 0)
+		printf("dTLB misses can't be counted here\n");
+
+	int failed = 0;
+	if (!bench_connect(width, height, frames))
+		failed = 1;
+	if (!bench_wrap())
+		failed = 1;
+	if (!bench_dirty())
+		failed = 1;
+	if (!bench_throughput())
+		failed = 1;
+	return failed;
+}
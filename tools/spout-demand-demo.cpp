@@ -0,0 +1,308 @@
+/**
+ * spout-demand-demo: a shared-memory sender that only renders what its
+ * receivers ask for (see shm_ring_set_demand), and a receiver to drive it.
+ *
+ *   spout-demand-demo [--name NAME] [--fps N] [--size WxH] [--no-throttle]
+ *   spout-demand-demo --receive NAME [--fps N] [--hide-after S]
+ *
+ * The sender renders a moving test pattern at --fps (60 by default) and
+ * prints once a second how many receivers it has, the rate they want,
+ * the frames it rendered and the CPU time that took. Without receivers
+ * it renders nothing; with --no-throttle it renders every frame anyway,
+ * for comparison.
+ *
+ * The receiver reads frames at its own --fps (30 by default) and, with
+ * --hide-after, stops using them after S seconds, as a hidden OBS source
+ * would.
+ */
+#include "shm-ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+#define DEMAND_INTERVAL_NS 100000000ULL
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// user plus system time of this process
+static uint64_t cpu_ns(void)
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+	uint64_t k = (uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime;
+	uint64_t u = (uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime;
+	return (k + u) * 100;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return ((uint64_t)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		       1000000000ULL +
+	       ((uint64_t)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		       1000ULL;
+#endif
+}
+
+static void sleep_until(uint64_t target_ns)
+{
+	uint64_t now = now_ns();
+	if (target_ns <= now)
+		return;
+#ifdef _WIN32
+	Sleep((DWORD)((target_ns - now) / 1000000));
+#else
+	uint64_t wait = target_ns - now;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(wait / 1000000000ULL);
+	ts.tv_nsec = (long)(wait % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: spout-demand-demo [--name NAME] [--fps N] [--size WxH] "
+		"[--no-throttle]\n"
+		"       spout-demand-demo --receive NAME [--fps N] "
+		"[--hide-after S]\n"
+		"  --name         sender name, spout-demand-demo by default\n"
+		"  --fps          rate to render or receive at\n"
+		"  --size         frame size, 1920x1080 by default\n"
+		"  --no-throttle  render every frame, receivers or not\n"
+		"  --receive      receive NAME instead of sending\n"
+		"  --hide-after   stop using frames after S seconds\n");
+}
+
+/**
+ * Stands in for a real renderer: a gradient with a bar moving across,
+ * computed per pixel
+ */
+static void render_pattern(uint8_t *pixels, uint32_t width, uint32_t height,
+			   uint64_t frame)
+{
+	uint32_t bar = (uint32_t)(frame * 8 % width);
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t *px = pixels + (size_t)y * width * 4;
+		for (uint32_t x = 0; x < width; x++, px += 4) {
+			bool in_bar = x >= bar && x < bar + 32;
+			px[0] = in_bar ? 255 : (uint8_t)(x * 255 / width);
+			px[1] = in_bar ? 255 : (uint8_t)(y * 255 / height);
+			px[2] = (uint8_t)((x + y + frame) & 255);
+			px[3] = 255;
+		}
+	}
+}
+
+static int run_sender(const char *name, double fps, uint32_t width,
+		      uint32_t height, bool throttle)
+{
+	size_t size = (size_t)width * height * 4;
+	uint8_t *pixels = (uint8_t *)malloc(size);
+	struct shm_ring *ring =
+		shm_ring_create(name, size, SHM_RING_DEFAULT_FRAMES);
+	if (!pixels || !ring) {
+		fprintf(stderr, "Couldn't create sender %s\n", name);
+		free(pixels);
+		return 1;
+	}
+	printf("Sending %ux%u as %s at up to %.2f fps%s\n", width, height,
+	       name, fps, throttle ? "" : ", not throttled");
+
+	uint64_t interval = (uint64_t)(1e9 / fps);
+	uint64_t tick = now_ns();
+	uint64_t demand_checked = 0;
+	uint64_t next_frame = 0;
+	struct shm_ring_demand demand = {};
+
+	uint64_t report_ns = tick;
+	uint64_t report_cpu = cpu_ns();
+	uint64_t rendered = 0;
+	uint64_t frame = 0;
+
+	while (!stopping) {
+		uint64_t now = now_ns();
+		if (now - demand_checked >= DEMAND_INTERVAL_NS) {
+			shm_ring_get_demand(ring, &demand);
+			demand_checked = now;
+		}
+
+		// same pacing as the plugin's senders: none without consumers,
+		// otherwise at most at the highest rate one of them wants
+		bool wanted = true;
+		if (throttle && !demand.consumers) {
+			wanted = false;
+		} else if (throttle && demand.fps_milli && next_frame) {
+			uint64_t period = 1000000000000ULL / demand.fps_milli;
+			wanted = now + period / 4 >= next_frame;
+		}
+		if (wanted) {
+			render_pattern(pixels, width, height, frame);
+			shm_ring_write(ring, pixels, width * 4, width, height,
+				       SHM_RING_FORMAT_BGRA, now);
+			rendered++;
+			if (throttle && demand.fps_milli) {
+				uint64_t period =
+					1000000000000ULL / demand.fps_milli;
+				next_frame = next_frame &&
+							     now < next_frame + period
+						     ? next_frame + period
+						     : now + period;
+			} else {
+				next_frame = 0;
+			}
+		}
+		frame++;
+
+		if (now - report_ns >= 1000000000ULL) {
+			uint64_t cpu = cpu_ns();
+			double seconds = (double)(now - report_ns) / 1e9;
+			printf("%u readers, %u consumers (%u on air), wanted "
+			       "%.2f fps: rendered %.1f fps, CPU %.1f%%\n",
+			       demand.readers, demand.consumers, demand.program,
+			       demand.fps_milli / 1000.0,
+			       (double)rendered / seconds,
+			       100.0 * (double)(cpu - report_cpu) / 1e9 /
+				       seconds);
+			fflush(stdout);
+			report_ns = now;
+			report_cpu = cpu;
+			rendered = 0;
+		}
+
+		tick += interval;
+		sleep_until(tick);
+	}
+
+	shm_ring_close(ring);
+	free(pixels);
+	return 0;
+}
+
+static int run_receiver(const char *name, double fps, double hide_after)
+{
+	struct shm_ring *ring = shm_ring_open(name);
+	if (!ring) {
+		fprintf(stderr, "No sender called %s\n", name);
+		return 1;
+	}
+	uint32_t fps_milli = (uint32_t)(fps * 1000.0);
+	shm_ring_set_demand(ring, SHM_RING_CONSUMER_ACTIVE, fps_milli);
+	printf("Receiving %s at %.2f fps\n", name, fps);
+
+	uint8_t *buffer = NULL;
+	size_t buffer_size = 0;
+	uint64_t interval = (uint64_t)(1e9 / fps);
+	uint64_t start = now_ns();
+	uint64_t tick = start;
+	bool hidden = false;
+	uint64_t received = 0;
+
+	while (!stopping && !shm_ring_is_closed(ring)) {
+		if (!hidden && hide_after > 0.0 &&
+		    (double)(now_ns() - start) / 1e9 >= hide_after) {
+			shm_ring_set_demand(ring, 0, fps_milli);
+			printf("Hidden after %llu frames\n",
+			       (unsigned long long)received);
+			fflush(stdout);
+			hidden = true;
+		}
+		if (!hidden) {
+			struct shm_ring_frame frame;
+			int result =
+				shm_ring_read(ring, &frame, buffer, buffer_size);
+			if (result == SHM_RING_TOO_SMALL) {
+				free(buffer);
+				buffer_size = frame.size;
+				buffer = (uint8_t *)malloc(buffer_size);
+				result = shm_ring_read(ring, &frame, buffer,
+						       buffer_size);
+			}
+			if (result == SHM_RING_OK)
+				received++;
+		}
+		tick += interval;
+		sleep_until(tick);
+	}
+
+	printf("Received %llu frames\n", (unsigned long long)received);
+	shm_ring_close(ring);
+	free(buffer);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = "spout-demand-demo";
+	const char *receive = NULL;
+	double fps = 0.0;
+	double hide_after = 0.0;
+	uint32_t width = 1920;
+	uint32_t height = 1080;
+	bool throttle = true;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+			name = argv[++i];
+		} else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			fps = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+				usage();
+				return 2;
+			}
+		} else if (strcmp(argv[i], "--no-throttle") == 0) {
+			throttle = false;
+		} else if (strcmp(argv[i], "--receive") == 0 && i + 1 < argc) {
+			receive = argv[++i];
+		} else if (strcmp(argv[i], "--hide-after") == 0 &&
+			   i + 1 < argc) {
+			hide_after = atof(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (fps <= 0.0)
+		fps = receive ? 30.0 : 60.0;
+	if (!width || !height) {
+		usage();
+		return 2;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	if (receive)
+		return run_receiver(receive, fps, hide_after);
+	return run_sender(name, fps, width, height, throttle);
+}
@@ -0,0 +1,204 @@
+/**
+ * spout-hang-sim: drives a fake Spout sender registry that hangs, to see
+ * how a capture source's tick copes on any platform.
+ *
+ *   spout-hang-sim [--seconds N] [--hang-at S] [--hang-for S]
+ *                  [--timeout MS] [--unguarded]
+ *
+ * A loop stands in for win_spout_tick at 60 fps: each tick asks the fake
+ * registry for the sender's info, as a source receiving a shared texture
+ * does. At --hang-at seconds (1 by default) the registry's lock is held
+ * for --hang-for seconds (3 by default), as by a hung sender process.
+ *
+ * Guarded, registry calls go through a deadline_worker with --timeout
+ * (20 ms by default), like the plugin's. Calls that overrun are skipped
+ * for that tick and counted, and ticks carry on at frame rate. With
+ * --unguarded the tick calls the registry directly and stalls for the
+ * whole hang. Either way the stall watchdog reports slow ticks.
+ */
+#include "deadline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define TICK_NS 16666667ULL
+#define WATCHDOG_THRESHOLD_MS 100
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void sleep_ns(uint64_t wait)
+{
+#ifdef _WIN32
+	Sleep((DWORD)(wait / 1000000));
+#else
+	struct timespec ts;
+	ts.tv_sec = (time_t)(wait / 1000000000ULL);
+	ts.tv_nsec = (long)(wait % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* Fake registry: one sender, behind a lock that is held for the length of
+ * the injected hang */
+
+static uint64_t start_ns;
+static uint64_t hang_start_ns;
+static uint64_t hang_end_ns;
+
+struct fake_sender_info {
+	char name[256];
+	uint32_t width;
+	uint32_t height;
+	bool found;
+};
+
+static void fake_get_sender_info(void *args)
+{
+	struct fake_sender_info *info = (struct fake_sender_info *)args;
+	uint64_t now = now_ns() - start_ns;
+	if (now >= hang_start_ns && now < hang_end_ns)
+		sleep_ns(hang_end_ns - now);
+	info->width = 1920;
+	info->height = 1080;
+	info->found = strcmp(info->name, "fake sender") == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void log_stall(const struct stall_section *section, uint64_t stalled_ms,
+		      bool finished)
+{
+	double at = (double)(now_ns() - start_ns) / 1e9;
+	if (finished)
+		printf("%6.2f s  watchdog: %s took %llu ms\n", at, section->name,
+		       (unsigned long long)stalled_ms);
+	else
+		printf("%6.2f s  watchdog: %s stalled for %llu ms so far\n", at,
+		       section->name, (unsigned long long)stalled_ms);
+	fflush(stdout);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: spout-hang-sim [--seconds N] [--hang-at S] "
+		"[--hang-for S] [--timeout MS] [--unguarded]\n");
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = 6.0;
+	double hang_at = 1.0;
+	double hang_for = 3.0;
+	uint32_t timeout_ms = 20;
+	bool guarded = true;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--hang-at") == 0 && i + 1 < argc) {
+			hang_at = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--hang-for") == 0 && i + 1 < argc) {
+			hang_for = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+			timeout_ms = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--unguarded") == 0) {
+			guarded = false;
+		} else {
+			usage();
+			return 2;
+		}
+	}
+
+	struct deadline_worker *worker =
+		deadline_worker_create(sizeof(struct fake_sender_info));
+	if (!worker) {
+		fprintf(stderr, "Couldn't start the worker\n");
+		return 1;
+	}
+
+	start_ns = now_ns();
+	hang_start_ns = (uint64_t)(hang_at * 1e9);
+	hang_end_ns = hang_start_ns + (uint64_t)(hang_for * 1e9);
+
+	struct stall_section tick;
+	stall_section_add(&tick, "tick");
+	stall_watchdog_start(WATCHDOG_THRESHOLD_MS, log_stall);
+	printf("Registry hangs from %.2f s for %.2f s, calls %s\n", hang_at,
+	       hang_for, guarded ? "guarded" : "unguarded");
+
+	uint64_t ticks = 0;
+	uint64_t skipped = 0;
+	uint64_t longest = 0;
+	uint64_t end = start_ns + (uint64_t)(seconds * 1e9);
+	uint64_t next = start_ns;
+
+	while (now_ns() < end) {
+		uint64_t tick_start = now_ns();
+		stall_section_enter(&tick);
+
+		struct fake_sender_info info = {};
+		strcpy(info.name, "fake sender");
+		if (guarded) {
+			if (deadline_worker_call(worker, fake_get_sender_info,
+						 &info, sizeof(info),
+						 timeout_ms) != DEADLINE_OK)
+				skipped++;
+		} else {
+			fake_get_sender_info(&info);
+		}
+
+		stall_section_leave(&tick);
+		uint64_t elapsed = now_ns() - tick_start;
+		if (elapsed > longest)
+			longest = elapsed;
+		ticks++;
+
+		next += TICK_NS;
+		uint64_t now = now_ns();
+		if (next > now)
+			sleep_ns(next - now);
+		else
+			next = now;
+	}
+
+	stall_watchdog_stop();
+	stall_section_remove(&tick);
+
+	struct deadline_stats stats;
+	deadline_worker_get_stats(worker, &stats);
+	printf("%llu ticks in %.1f s, longest %.1f ms, %llu watchdog stalls\n",
+	       (unsigned long long)ticks, seconds, (double)longest / 1e6,
+	       (unsigned long long)tick.stalls);
+	if (guarded)
+		printf("%llu registry calls skipped: %llu timed out, %llu "
+		       "refused while the hung one ran\n",
+		       (unsigned long long)skipped,
+		       (unsigned long long)stats.timeouts,
+		       (unsigned long long)stats.busy);
+
+	if (!deadline_worker_destroy(worker))
+		printf("A registry call was still hung at exit\n");
+	return 0;
+}
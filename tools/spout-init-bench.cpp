@@ -0,0 +1,571 @@
+/**
+ * spout-init-bench: how long showing a scene collection's Spout sources
+ * takes, initialised one by one or batched, against a fake backend, and
+ * checks of the batch queue (init-batch.h) the plugin uses.
+ *
+ *   spout-init-bench [--sources N] [--enum-us US] [--info-us US]
+ *                    [--graphics-us US] [--spout-us US]
+ *
+ * Stands in for OBS loading a scene collection with --sources (100 by
+ * default) Spout2 Capture sources, all shown in the same frame. The fake
+ * registry runs on a deadline_worker like the plugin's, and takes
+ * --enum-us to list its senders and --info-us to look one up; entering
+ * the fake graphics context takes --graphics-us. Only the registry and
+ * the graphics context are faked: batches go through init_batch_queue and
+ * init_batch_run as in the plugin.
+ *
+ * One by one, as sources initialise on their own, each source lists the
+ * senders, looks its own up and opens its texture in a graphics section of
+ * its own. Batched, as the plugin's tick callback does, the senders are
+ * listed once and all textures are opened in one graphics section.
+ *
+ * Then, with a batch running on a thread of its own, removes a source
+ * queued after the batch started and one the batch holds, as destroying
+ * them would, and checks the first doesn't wait for the batch and the
+ * second isn't removed before the batch is done with it. Also checks a
+ * batch that gives up queues its sources again.
+ *
+ * Last, creates and destroys the sources' registries: each its own, with
+ * a worker and a Spout object (whose creation and release take
+ * --spout-us), as sources used to, and one shared through shared_ref
+ * (shared-ref.h) as in the plugin, whose Spout object is created by the
+ * first call. Checks the shared one is created once and gone with the last
+ * source. The exit code is 1 if a check fails.
+ */
+#include "deadline.h"
+#include "init-batch.h"
+#include "shared-ref.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+// pthreads come with libobs on Windows
+#include <util/threading.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define FAKE_SENDERS 8
+#define MAX_SENDERS 64
+#define CALL_TIMEOUT_MS 20
+// opening a shared texture, inside the graphics section
+#define OPEN_TEXTURE_US 5
+
+static uint32_t enum_us = 200;
+static uint32_t info_us = 20;
+static uint32_t graphics_us = 50;
+static uint32_t spout_us = 300;
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// busy, like a registry walk or a driver call
+static void spin_us(uint32_t us)
+{
+	uint64_t end = now_ns() + (uint64_t)us * 1000;
+	while (now_ns() < end)
+		;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Fake backend */
+
+struct fake_names {
+	int count;
+	char names[MAX_SENDERS][256];
+};
+
+struct fake_info {
+	char name[256];
+	uint32_t width;
+	uint32_t height;
+};
+
+static void fake_sender_names(void *args)
+{
+	struct fake_names *list = (struct fake_names *)args;
+	spin_us(enum_us);
+	list->count = FAKE_SENDERS;
+	for (int i = 0; i < FAKE_SENDERS; i++)
+		snprintf(list->names[i], sizeof(list->names[i]), "sender %d",
+			 i);
+}
+
+static void fake_sender_info(void *args)
+{
+	struct fake_info *info = (struct fake_info *)args;
+	spin_us(info_us);
+	info->width = 1920;
+	info->height = 1080;
+}
+
+static uint64_t enumerations;
+static uint64_t graphics_sections;
+
+static void fake_enter_graphics(void)
+{
+	spin_us(graphics_us);
+	graphics_sections++;
+}
+
+static void fake_leave_graphics(void) {}
+
+/* ------------------------------------------------------------------------- */
+
+static void list_senders(struct deadline_worker *worker,
+			 struct fake_names *list)
+{
+	deadline_worker_call(worker, fake_sender_names, list, sizeof(*list),
+			     CALL_TIMEOUT_MS);
+	enumerations++;
+}
+
+static void look_up(struct deadline_worker *worker,
+		    const struct fake_names *list, int source)
+{
+	struct fake_info info = {};
+	strcpy(info.name, list->names[source % list->count]);
+	deadline_worker_call(worker, fake_sender_info, &info, sizeof(info),
+			     CALL_TIMEOUT_MS);
+}
+
+struct fake_source {
+	struct init_batch_entry entry;
+	int index;
+	bool initialized;
+	// the batch is still using the source, under flag_mutex
+	bool in_batch;
+};
+
+// for the removal checks, which look at sources the batch thread uses
+static pthread_mutex_t flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_in_batch(struct init_batch_entry **entries, size_t count,
+			 bool in_batch)
+{
+	pthread_mutex_lock(&flag_mutex);
+	for (size_t i = 0; i < count; i++)
+		((struct fake_source *)entries[i]->data)->in_batch = in_batch;
+	pthread_mutex_unlock(&flag_mutex);
+}
+
+static bool get_in_batch(const struct fake_source *source)
+{
+	pthread_mutex_lock(&flag_mutex);
+	bool in_batch = source->in_batch;
+	pthread_mutex_unlock(&flag_mutex);
+	return in_batch;
+}
+
+struct batch_context {
+	struct deadline_worker *worker;
+	struct fake_names *list;
+	// give up instead of initialising, as on a hung registry
+	bool give_up;
+	// extra time holding the graphics section, for the removal checks
+	uint32_t hold_us;
+};
+
+static bool init_entries(void *param, struct init_batch_entry **entries,
+			 size_t count)
+{
+	struct batch_context *batch = (struct batch_context *)param;
+	if (batch->give_up)
+		return false;
+
+	set_in_batch(entries, count, true);
+
+	list_senders(batch->worker, batch->list);
+	for (size_t i = 0; i < count; i++) {
+		struct fake_source *source =
+			(struct fake_source *)entries[i]->data;
+		look_up(batch->worker, batch->list, source->index);
+	}
+	fake_enter_graphics();
+	for (size_t i = 0; i < count; i++) {
+		struct fake_source *source =
+			(struct fake_source *)entries[i]->data;
+		spin_us(OPEN_TEXTURE_US);
+		source->initialized = true;
+	}
+	spin_us(batch->hold_us);
+	fake_leave_graphics();
+
+	set_in_batch(entries, count, false);
+	return true;
+}
+
+static double run(struct init_batch *queue, struct batch_context *batch,
+		  struct fake_source *sources, int count, bool batched)
+{
+	enumerations = 0;
+	graphics_sections = 0;
+	for (int i = 0; i < count; i++)
+		sources[i].initialized = false;
+	uint64_t start = now_ns();
+
+	if (batched) {
+		for (int i = 0; i < count; i++)
+			init_batch_queue(queue, &sources[i].entry, &sources[i]);
+		init_batch_run(queue, init_entries, batch);
+	} else {
+		for (int i = 0; i < count; i++) {
+			list_senders(batch->worker, batch->list);
+			look_up(batch->worker, batch->list, i);
+			fake_enter_graphics();
+			spin_us(OPEN_TEXTURE_US);
+			sources[i].initialized = true;
+			fake_leave_graphics();
+		}
+	}
+	return (double)(now_ns() - start) / 1e6;
+}
+
+struct batch_thread {
+	struct init_batch *queue;
+	struct batch_context *batch;
+};
+
+static void *run_batch_thread(void *param)
+{
+	struct batch_thread *thread = (struct batch_thread *)param;
+	init_batch_run(thread->queue, init_entries, thread->batch);
+	return NULL;
+}
+
+/**
+ * Removes sources while a batch runs, as destroying them does
+ */
+static bool check_removal(struct init_batch *queue,
+			  struct batch_context *batch,
+			  struct fake_source *sources, int count)
+{
+	const uint32_t hold_ms = 200;
+	bool ok = true;
+
+	// all but the last source in the batch
+	for (int i = 0; i < count - 1; i++) {
+		sources[i].initialized = false;
+		init_batch_queue(queue, &sources[i].entry, &sources[i]);
+	}
+	batch->hold_us = hold_ms * 1000;
+	struct batch_thread thread = {queue, batch};
+	pthread_t handle;
+	if (pthread_create(&handle, NULL, run_batch_thread, &thread) != 0) {
+		fprintf(stderr, "Couldn't start the batch thread\n");
+		return false;
+	}
+	while (!get_in_batch(&sources[0]))
+		spin_us(100);
+
+	// queued after the batch took the queue, so it isn't in it
+	struct fake_source *late = &sources[count - 1];
+	init_batch_queue(queue, &late->entry, late);
+	uint64_t start = now_ns();
+	init_batch_unqueue(queue, &late->entry);
+	double late_ms = (double)(now_ns() - start) / 1e6;
+	if (late_ms > hold_ms / 2 || init_batch_pending(queue, &late->entry)) {
+		printf("FAIL: removing a source outside the batch took "
+		       "%.1f ms\n",
+		       late_ms);
+		ok = false;
+	}
+
+	start = now_ns();
+	init_batch_unqueue(queue, &sources[0].entry);
+	double held_ms = (double)(now_ns() - start) / 1e6;
+	if (get_in_batch(&sources[0]) || !sources[0].initialized) {
+		printf("FAIL: a source was removed while the batch used it\n");
+		ok = false;
+	}
+	pthread_join(handle, NULL);
+	batch->hold_us = 0;
+
+	printf("removing a source while a %u ms batch runs: %.3f ms if it's "
+	       "not in the batch, %.1f ms if it is\n",
+	       hold_ms, late_ms, held_ms);
+	return ok;
+}
+
+/**
+ * A batch that gives up, as on a hung registry, keeps its sources queued
+ */
+static bool check_give_up(struct init_batch *queue,
+			  struct batch_context *batch,
+			  struct fake_source *sources, int count)
+{
+	bool ok = true;
+	for (int i = 0; i < count; i++)
+		init_batch_queue(queue, &sources[i].entry, &sources[i]);
+	batch->give_up = true;
+	if (init_batch_run(queue, init_entries, batch) != 0)
+		ok = false;
+	for (int i = 0; i < count; i++) {
+		if (!init_batch_pending(queue, &sources[i].entry))
+			ok = false;
+	}
+	batch->give_up = false;
+	for (int i = 0; i < count; i++)
+		init_batch_unqueue(queue, &sources[i].entry);
+	printf("a batch that gives up keeps its sources queued: %s\n",
+	       ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Registry lifetime */
+
+struct fake_registry {
+	struct deadline_worker *worker;
+	// only used on the worker
+	bool spout;
+};
+
+struct fake_registry_call {
+	struct fake_registry *registry;
+};
+
+static uint64_t workers_started;
+static uint64_t spout_objects;
+
+// the first call creates the Spout object, as GetSpout does
+static void fake_registry_call(void *args)
+{
+	struct fake_registry *registry =
+		((struct fake_registry_call *)args)->registry;
+	if (!registry->spout) {
+		spin_us(spout_us);
+		registry->spout = true;
+		spout_objects++;
+	}
+}
+
+static void fake_registry_release(void *args)
+{
+	struct fake_registry *registry =
+		((struct fake_registry_call *)args)->registry;
+	if (registry->spout) {
+		spin_us(spout_us);
+		registry->spout = false;
+	}
+}
+
+static void *fake_registry_create(void)
+{
+	struct fake_registry *registry =
+		(struct fake_registry *)calloc(1, sizeof(*registry));
+	if (!registry)
+		return NULL;
+	registry->worker =
+		deadline_worker_create(sizeof(struct fake_registry_call));
+	if (!registry->worker) {
+		free(registry);
+		return NULL;
+	}
+	workers_started++;
+	return registry;
+}
+
+static void fake_registry_use(struct fake_registry *registry,
+			      deadline_fn fn)
+{
+	struct fake_registry_call call = {registry};
+	deadline_worker_call(registry->worker, fn, &call, sizeof(call),
+			     CALL_TIMEOUT_MS);
+}
+
+static void fake_registry_destroy(struct fake_registry *registry)
+{
+	fake_registry_use(registry, fake_registry_release);
+	deadline_worker_destroy(registry->worker);
+	free(registry);
+}
+
+/**
+ * Creates a registry for each of count sources, as they're created with
+ * a scene collection, then destroys them
+ */
+static bool check_lifetime(int count, bool shared)
+{
+	struct fake_registry **registries = (struct fake_registry **)calloc(
+		(size_t)count, sizeof(*registries));
+	struct shared_ref ref = SHARED_REF_INIT;
+	if (!registries)
+		return false;
+	workers_started = 0;
+	spout_objects = 0;
+	bool ok = true;
+
+	uint64_t start = now_ns();
+	for (int i = 0; i < count; i++) {
+		if (shared) {
+			registries[i] = (struct fake_registry *)
+				shared_ref_acquire(&ref, fake_registry_create);
+		} else {
+			// sources used to create Spout with their registry
+			registries[i] = (struct fake_registry *)
+				fake_registry_create();
+			if (registries[i])
+				fake_registry_use(registries[i],
+						  fake_registry_call);
+		}
+		if (!registries[i]) {
+			fprintf(stderr, "Couldn't create a registry\n");
+			ok = false;
+			count = i;
+			break;
+		}
+	}
+	double create_ms = (double)(now_ns() - start) / 1e6;
+	uint64_t workers = workers_started;
+
+	// the first scan of each source
+	for (int i = 0; i < count; i++)
+		fake_registry_use(registries[i], fake_registry_call);
+
+	start = now_ns();
+	for (int i = 0; i < count; i++) {
+		if (!shared)
+			fake_registry_destroy(registries[i]);
+		else if (shared_ref_release(&ref, registries[i]))
+			fake_registry_destroy(registries[i]);
+	}
+	double destroy_ms = (double)(now_ns() - start) / 1e6;
+
+	printf("%-11s %4llu workers, %4llu Spout objects, %7.2f ms to "
+	       "create, %7.2f ms to destroy\n",
+	       shared ? "shared:" : "per source:",
+	       (unsigned long long)workers, (unsigned long long)spout_objects,
+	       create_ms, destroy_ms);
+
+	if (shared && ok) {
+		if (workers != 1 || spout_objects != 1) {
+			printf("FAIL: the shared registry was created more "
+			       "than once\n");
+			ok = false;
+		}
+		if (ref.object || ref.refs) {
+			printf("FAIL: the shared registry outlived its "
+			       "sources\n");
+			ok = false;
+		}
+		// a new scene collection gets a new one
+		struct fake_registry *again = (struct fake_registry *)
+			shared_ref_acquire(&ref, fake_registry_create);
+		if (!again || workers_started != 2) {
+			printf("FAIL: no new registry after the last one "
+			       "went\n");
+			ok = false;
+		}
+		if (shared_ref_release(&ref, again))
+			fake_registry_destroy(again);
+	}
+	pthread_mutex_destroy(&ref.mutex);
+	free(registries);
+	return ok;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: spout-init-bench [--sources N] [--enum-us US] "
+			"[--info-us US] [--graphics-us US] [--spout-us US]\n");
+}
+
+int main(int argc, char **argv)
+{
+	int sources = 100;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--sources") == 0 && i + 1 < argc) {
+			sources = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--enum-us") == 0 && i + 1 < argc) {
+			enum_us = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--info-us") == 0 && i + 1 < argc) {
+			info_us = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--graphics-us") == 0 &&
+			   i + 1 < argc) {
+			graphics_us = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--spout-us") == 0 && i + 1 < argc) {
+			spout_us = (uint32_t)atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (sources < 1) {
+		usage();
+		return 2;
+	}
+
+	struct deadline_worker *worker =
+		deadline_worker_create(sizeof(struct fake_names));
+	struct fake_names *list =
+		(struct fake_names *)calloc(1, sizeof(*list));
+	struct fake_source *fake_sources = (struct fake_source *)calloc(
+		(size_t)sources, sizeof(*fake_sources));
+	struct init_batch *queue = init_batch_create();
+	if (!worker || !list || !fake_sources || !queue) {
+		fprintf(stderr, "Couldn't start the fake registry\n");
+		return 1;
+	}
+	for (int i = 0; i < sources; i++)
+		fake_sources[i].index = i;
+	struct batch_context batch = {worker, list, false, 0};
+
+	printf("%d sources; listing senders %u us, a lookup %u us, entering "
+	       "graphics %u us\n",
+	       sources, enum_us, info_us, graphics_us);
+	for (int batched = 0; batched < 2; batched++) {
+		double ms = run(queue, &batch, fake_sources, sources, batched);
+		printf("%-11s %4llu enumerations, %4llu graphics sections, "
+		       "%7.1f ms\n",
+		       batched ? "batched:" : "one by one:",
+		       (unsigned long long)enumerations,
+		       (unsigned long long)graphics_sections, ms);
+	}
+
+	int failed = 0;
+	for (int i = 0; i < sources; i++) {
+		if (!fake_sources[i].initialized)
+			failed = 1;
+	}
+	if (failed)
+		printf("FAIL: the batch left sources uninitialised\n");
+	if (sources > 1 && !check_removal(queue, &batch, fake_sources, sources))
+		failed = 1;
+	if (!check_give_up(queue, &batch, fake_sources, sources))
+		failed = 1;
+
+	printf("%d sources' registries; creating or releasing Spout %u us\n",
+	       sources, spout_us);
+	if (!check_lifetime(sources, false))
+		failed = 1;
+	if (!check_lifetime(sources, true))
+		failed = 1;
+
+	init_batch_destroy(queue);
+	free(fake_sources);
+	free(list);
+	deadline_worker_destroy(worker);
+	return failed;
+}
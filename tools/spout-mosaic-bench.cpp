@@ -0,0 +1,303 @@
+/**
+ * spout-mosaic-bench: what a Spout mosaic of N senders costs per poll next
+ * to N Spout2 Capture sources, against a fake backend
+ *
+ *   spout-mosaic-bench [--cells N] [--polls N] [--enum-us US]
+ *                      [--info-us US] [--graphics-us US]
+ *
+ * Stands in for --cells (16 by default) senders shown either as one mosaic
+ * or as one capture source each, polled --polls times (300 by default, 30
+ * seconds at the default 100 ms poll). Now and then a sender restarts with
+ * a new texture, and halfway through all of them do, as when the sending
+ * application restarts. The fake registry runs on a deadline_worker like
+ * the plugin's, and takes --enum-us to list its senders and --info-us to
+ * look one up; entering the fake graphics context takes --graphics-us.
+ *
+ * Capture sources each look their sender up on their own poll, and those
+ * whose sender changed are initialised again in one batch, as the plugin's
+ * do: senders listed once, one graphics section. The mosaic lists the
+ * senders only while a cell has none, looks every cell up and opens the
+ * changed cells' textures in one graphics section.
+ *
+ * Prints the registry calls, graphics sections and time of each, and the
+ * effect passes and draws a frame of them takes; GPU time isn't measured.
+ * The exit code is 1 if the mosaic and the sources don't end up showing
+ * the same textures.
+ */
+#include "deadline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MAX_CELLS 64
+#define CALL_TIMEOUT_MS 20
+// opening a shared texture, inside the graphics section
+#define OPEN_TEXTURE_US 5
+// a sender restarts this often
+#define RESTART_EVERY 25
+
+static uint32_t enum_us = 200;
+static uint32_t info_us = 20;
+static uint32_t graphics_us = 50;
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// busy, like a registry walk or a driver call
+static void spin_us(uint32_t us)
+{
+	uint64_t end = now_ns() + (uint64_t)us * 1000;
+	while (now_ns() < end)
+		;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Fake backend */
+
+// the senders' shared texture handles, changed by the main thread between
+// registry calls only
+static uint32_t sender_handles[MAX_CELLS];
+static int num_senders;
+
+struct fake_names {
+	int count;
+};
+
+struct fake_info {
+	int sender;
+	uint32_t handle;
+	bool found;
+};
+
+static void fake_sender_names(void *args)
+{
+	struct fake_names *list = (struct fake_names *)args;
+	spin_us(enum_us);
+	list->count = num_senders;
+}
+
+static void fake_sender_info(void *args)
+{
+	struct fake_info *info = (struct fake_info *)args;
+	spin_us(info_us);
+	info->handle = sender_handles[info->sender];
+	info->found = true;
+}
+
+struct counts {
+	uint64_t enumerations;
+	uint64_t lookups;
+	uint64_t graphics_sections;
+	uint64_t opened;
+	uint64_t elapsed_ns;
+};
+
+static void list_senders(struct deadline_worker *worker,
+			 struct counts *counts)
+{
+	struct fake_names list = {};
+	deadline_worker_call(worker, fake_sender_names, &list, sizeof(list),
+			     CALL_TIMEOUT_MS);
+	counts->enumerations++;
+}
+
+static uint32_t look_up(struct deadline_worker *worker, int sender,
+			struct counts *counts)
+{
+	struct fake_info info = {sender, 0, false};
+	deadline_worker_call(worker, fake_sender_info, &info, sizeof(info),
+			     CALL_TIMEOUT_MS);
+	counts->lookups++;
+	return info.found ? info.handle : 0;
+}
+
+static void fake_enter_graphics(struct counts *counts)
+{
+	spin_us(graphics_us);
+	counts->graphics_sections++;
+}
+
+static void open_texture(uint32_t *opened, uint32_t handle,
+			 struct counts *counts)
+{
+	spin_us(OPEN_TEXTURE_US);
+	*opened = handle;
+	counts->opened++;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/**
+ * One poll of count capture sources: each looks its sender up, the ones
+ * whose texture changed are initialised again in one batch
+ */
+static void poll_sources(struct deadline_worker *worker, uint32_t *textures,
+			 int count, struct counts *counts)
+{
+	bool changed[MAX_CELLS];
+	int num_changed = 0;
+	for (int i = 0; i < count; i++) {
+		changed[i] = !textures[i] ||
+			     look_up(worker, i, counts) != textures[i];
+		num_changed += changed[i];
+	}
+	if (!num_changed)
+		return;
+
+	list_senders(worker, counts);
+	uint32_t handles[MAX_CELLS];
+	for (int i = 0; i < count; i++) {
+		if (changed[i])
+			handles[i] = look_up(worker, i, counts);
+	}
+	fake_enter_graphics(counts);
+	for (int i = 0; i < count; i++) {
+		if (changed[i])
+			open_texture(&textures[i], handles[i], counts);
+	}
+}
+
+/**
+ * One poll of a mosaic of count cells, as spout_mosaic_do_tick does it
+ */
+static void poll_mosaic(struct deadline_worker *worker, uint32_t *cells,
+			int count, struct counts *counts)
+{
+	bool all_open = true;
+	for (int i = 0; i < count; i++)
+		all_open = all_open && cells[i];
+	if (!all_open)
+		list_senders(worker, counts);
+
+	uint32_t handles[MAX_CELLS];
+	bool changed = false;
+	for (int i = 0; i < count; i++) {
+		handles[i] = look_up(worker, i, counts);
+		changed = changed || handles[i] != cells[i];
+	}
+	if (!changed)
+		return;
+
+	fake_enter_graphics(counts);
+	for (int i = 0; i < count; i++) {
+		if (handles[i] != cells[i])
+			open_texture(&cells[i], handles[i], counts);
+	}
+}
+
+static void print_counts(const char *name, const struct counts *counts,
+			 int polls)
+{
+	printf("%-16s %6llu enumerations %6llu lookups %5llu graphics "
+	       "sections %5llu opened %8.1f us/poll\n",
+	       name, (unsigned long long)counts->enumerations,
+	       (unsigned long long)counts->lookups,
+	       (unsigned long long)counts->graphics_sections,
+	       (unsigned long long)counts->opened,
+	       (double)counts->elapsed_ns / polls / 1e3);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: spout-mosaic-bench [--cells N] [--polls N] "
+		"[--enum-us US] [--info-us US] [--graphics-us US]\n");
+}
+
+int main(int argc, char **argv)
+{
+	int cells = 16;
+	int polls = 300;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--cells") == 0 && i + 1 < argc) {
+			cells = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--polls") == 0 && i + 1 < argc) {
+			polls = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--enum-us") == 0 && i + 1 < argc) {
+			enum_us = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--info-us") == 0 && i + 1 < argc) {
+			info_us = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--graphics-us") == 0 &&
+			   i + 1 < argc) {
+			graphics_us = (uint32_t)atoi(argv[++i]);
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (cells < 1 || cells > MAX_CELLS || polls < 1) {
+		usage();
+		return 2;
+	}
+
+	struct deadline_worker *worker =
+		deadline_worker_create(sizeof(struct fake_info));
+	if (!worker) {
+		fprintf(stderr, "Couldn't start the fake registry\n");
+		return 1;
+	}
+	num_senders = cells;
+	uint32_t next_handle = 1;
+	for (int i = 0; i < cells; i++)
+		sender_handles[i] = next_handle++;
+
+	uint32_t sources[MAX_CELLS] = {}, mosaic[MAX_CELLS] = {};
+	struct counts source_counts = {}, mosaic_counts = {};
+	for (int poll = 0; poll < polls; poll++) {
+		if (poll == polls / 2) {
+			for (int i = 0; i < cells; i++)
+				sender_handles[i] = next_handle++;
+		} else if (poll && poll % RESTART_EVERY == 0) {
+			sender_handles[poll % cells] = next_handle++;
+		}
+
+		uint64_t start = now_ns();
+		poll_sources(worker, sources, cells, &source_counts);
+		uint64_t middle = now_ns();
+		poll_mosaic(worker, mosaic, cells, &mosaic_counts);
+		mosaic_counts.elapsed_ns += now_ns() - middle;
+		source_counts.elapsed_ns += middle - start;
+	}
+
+	printf("%d senders, %d polls; listing senders %u us, a lookup %u us, "
+	       "entering graphics %u us\n",
+	       cells, polls, enum_us, info_us, graphics_us);
+	print_counts("capture sources:", &source_counts, polls);
+	print_counts("mosaic:", &mosaic_counts, polls);
+	printf("each frame: %d effect passes of one draw for the sources, one "
+	       "pass of %d draws for the mosaic\n",
+	       cells, cells);
+
+	int failed = 0;
+	for (int i = 0; i < cells; i++) {
+		if (sources[i] != sender_handles[i] ||
+		    mosaic[i] != sender_handles[i])
+			failed = 1;
+	}
+	if (failed)
+		printf("FAIL: the mosaic and the sources show different "
+		       "textures\n");
+
+	deadline_worker_destroy(worker);
+	return failed;
+}
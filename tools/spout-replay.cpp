@@ -0,0 +1,198 @@
+/**
+ * spout-replay: publishes a raw recording (raw-file.h) as a shared-memory
+ * sender, so receivers can be measured against a real show's frames,
+ * resolution changes and timing without the renderers that produced them.
+ *
+ *   spout-replay [--name NAME] [--speed X] [--loop] recording.spraw
+ *
+ * Frames go out at their recorded receive times divided by --speed
+ * (1 by default); --speed 0 publishes as fast as the ring takes them.
+ * The recording is memory-mapped and frames are copied straight from the
+ * mapping into the ring.
+ */
+#include "shm-ring.h"
+#include "raw-file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static volatile sig_atomic_t stopping = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void sleep_until(uint64_t target_ns)
+{
+	uint64_t now = now_ns();
+	if (target_ns <= now)
+		return;
+#ifdef _WIN32
+	Sleep((DWORD)((target_ns - now) / 1000000));
+#else
+	uint64_t wait = target_ns - now;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(wait / 1000000000ULL);
+	ts.tv_nsec = (long)(wait % 1000000000ULL);
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: spout-replay [--name NAME] [--speed X] [--loop] "
+		"recording.spraw\n"
+		"  --name   sender name, the recorded sender's by default\n"
+		"  --speed  pace relative to the recording, 0 for flat out\n"
+		"  --loop   start over at the end until interrupted\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *name = NULL;
+	const char *path = NULL;
+	double speed = 1.0;
+	bool loop = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+			name = argv[++i];
+		} else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+			speed = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--loop") == 0) {
+			loop = true;
+		} else if (argv[i][0] != '-' && !path) {
+			path = argv[i];
+		} else {
+			usage();
+			return 2;
+		}
+	}
+	if (!path || speed < 0.0) {
+		usage();
+		return 2;
+	}
+
+	struct raw_reader *reader = raw_reader_open(path);
+	if (!reader) {
+		fprintf(stderr, "%s isn't a raw recording\n", path);
+		return 1;
+	}
+	size_t count = raw_reader_frame_count(reader);
+	if (!name || !*name)
+		name = raw_reader_sender(reader);
+	if (!*name)
+		name = "spout-replay";
+
+	// the ring has to carry the largest frame of the recording
+	size_t max_size = 0;
+	for (size_t i = 0; i < count; i++) {
+		struct raw_frame frame;
+		raw_reader_frame(reader, i, &frame);
+		size_t size = (size_t)frame.header->width *
+			      shm_ring_format_bpp(frame.header->format) *
+			      frame.header->height;
+		if (size > max_size)
+			max_size = size;
+	}
+	if (!count || !max_size) {
+		fprintf(stderr, "%s has no frames\n", path);
+		raw_reader_close(reader);
+		return 1;
+	}
+
+	struct shm_ring *ring =
+		shm_ring_create(name, max_size, SHM_RING_DEFAULT_FRAMES);
+	if (!ring) {
+		fprintf(stderr, "Couldn't create sender %s\n", name);
+		raw_reader_close(reader);
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	printf("Publishing %zu frames of %s as %s\n", count, path, name);
+
+	struct raw_frame first;
+	raw_reader_frame(reader, 0, &first);
+	uint64_t first_ns = first.header->timestamp_ns;
+	uint64_t start_ns = now_ns();
+	uint64_t loop_offset = 0;
+	uint64_t published = 0;
+	uint64_t failed = 0;
+	uint64_t bytes = 0;
+	uint32_t transfer = SHM_RING_TRANSFER_SRGB;
+
+	do {
+		uint64_t last_ns = first_ns;
+		for (size_t i = 0; i < count && !stopping; i++) {
+			struct raw_frame frame;
+			raw_reader_frame(reader, i, &frame);
+			const struct raw_frame_header *header = frame.header;
+
+			last_ns = header->timestamp_ns;
+			if (speed > 0.0) {
+				uint64_t offset = loop_offset + header->timestamp_ns -
+						  first_ns;
+				sleep_until(start_ns +
+					    (uint64_t)((double)offset / speed));
+			}
+
+			if (header->transfer != transfer) {
+				transfer = header->transfer;
+				shm_ring_set_transfer(ring, transfer);
+			}
+			if (shm_ring_write(ring, frame.pixels, header->linesize,
+					   header->width, header->height,
+					   header->format, now_ns())) {
+				published++;
+				bytes += (uint64_t)header->linesize *
+					 header->height;
+			} else {
+				failed++;
+			}
+		}
+
+		// the next pass starts one average frame interval after the last
+		uint64_t duration = last_ns - first_ns;
+		loop_offset += duration + (count > 1 ? duration / (count - 1)
+						      : 16666667);
+	} while (loop && !stopping);
+
+	double seconds = (double)(now_ns() - start_ns) / 1e9;
+	printf("Published %llu frames (%llu failed) in %.2f s: %.1f fps, "
+	       "%.0f MB/s\n",
+	       (unsigned long long)published, (unsigned long long)failed,
+	       seconds, seconds > 0.0 ? (double)published / seconds : 0.0,
+	       seconds > 0.0 ? (double)bytes / 1e6 / seconds : 0.0);
+
+	shm_ring_close(ring);
+	raw_reader_close(reader);
+	return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * Spout filter: publishes the filtered source or scene as a named sender
+ *
+ * The filter renders its input once into its own render target and then
+ * draws that same texture as its output, so publishing costs no render
+ * pass on top of what any non-direct filter does. The texture is read back
+ * through a pair of stage surfaces, one frame behind, so mapping never
+ * stalls on the GPU. Preview, program and projectors each render the
+ * filter; only the first render of a frame publishes, the others draw the
+ * texture it left.
+ *
+ * Spout binds the sender's OpenGL context to the graphics thread, which
+ * renders, so the sender is created, closed and destroyed there only.
+ */
+#include "win-spout.h"
+#include "win-spout-sender.h"
+
+#include <util/platform.h>
+#include <util/threading.h>
+#include <string.h>
+
+#define info(message, ...)                                                    \
+	blog(LOG_INFO, "[%s] " message, obs_source_get_name(context->source), \
+	     ##__VA_ARGS__)
+#define warn(message, ...)                 \
+	blog(LOG_WARNING, "[%s] " message, \
+	     obs_source_get_name(context->source), ##__VA_ARGS__)
+
+struct spout_filter {
+	obs_source_t *source;
+
+	// settings from update, applied by the next render
+	pthread_mutex_t settings_mutex;
+	char senderName[256];
+	int transport;
+	bool checksum;
+	bool throttle;
+	bool sender_changed;
+	bool settings_changed;
+
+	// only used on the graphics thread
+	struct spout_sender *sender;
+	// whether this frame was rendered, and the texture it left
+	bool rendered;
+	gs_texture_t *texture;
+
+	gs_texrender_t *texrender;
+	gs_stagesurf_t *stagesurfaces[2];
+	bool staged[2];
+	int stage_index;
+
+	uint32_t width;
+	uint32_t height;
+};
+
+static const char *spout_filter_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("filtername");
+}
+
+static void spout_filter_update(void *data, obs_data_t *settings)
+{
+	struct spout_filter *context = (spout_filter *)data;
+
+	auto senderName = obs_data_get_string(settings, SPOUT_SENDER_NAME);
+	auto transport = (int)obs_data_get_int(settings, SPOUT_SENDER_TRANSPORT);
+	bool checksum = obs_data_get_bool(settings, SPOUT_SENDER_CHECKSUM);
+	bool throttle = obs_data_get_bool(settings, SPOUT_SENDER_THROTTLE);
+
+	pthread_mutex_lock(&context->settings_mutex);
+	if (strcmp(senderName, context->senderName) != 0 ||
+	    transport != context->transport) {
+		memset(context->senderName, 0, 256);
+		strncpy(context->senderName, senderName, 255);
+		context->transport = transport;
+		context->sender_changed = true;
+	}
+	context->checksum = checksum;
+	context->throttle = throttle;
+	context->settings_changed = true;
+	pthread_mutex_unlock(&context->settings_mutex);
+}
+
+// on the graphics thread
+static void spout_filter_close_sender(void *param)
+{
+	struct spout_sender *sender = (struct spout_sender *)param;
+	spout_sender_close(sender);
+	spout_sender_destroy(sender);
+}
+
+/**
+ * Re-registers the sender under the configured name and applies changed
+ * settings. On the graphics thread.
+ * @return bool whether there is a sender to publish to
+ */
+static bool spout_filter_check_sender(struct spout_filter *context)
+{
+	char senderName[256];
+	int transport = 0;
+	bool checksum = false, throttle = false;
+
+	pthread_mutex_lock(&context->settings_mutex);
+	bool sender_changed = context->sender_changed;
+	bool settings_changed = context->settings_changed;
+	if (sender_changed) {
+		strcpy(senderName, context->senderName);
+		transport = context->transport;
+	}
+	checksum = context->checksum;
+	throttle = context->throttle;
+	context->sender_changed = false;
+	context->settings_changed = false;
+	pthread_mutex_unlock(&context->settings_mutex);
+
+	if (sender_changed) {
+		if (context->sender) {
+			spout_filter_close_sender(context->sender);
+		}
+		context->sender = spout_sender_create(senderName, transport);
+		if (!context->sender) {
+			warn("Could not publish sender %s", senderName);
+			return false;
+		}
+	}
+	if (context->sender && (sender_changed || settings_changed)) {
+		spout_sender_set_checksum(context->sender, checksum);
+		spout_sender_set_throttle(context->sender, throttle);
+	}
+	return context->sender != NULL;
+}
+
+static void spout_filter_defaults(obs_data_t *settings)
+{
+	spout_sender_defaults(settings, "OBS Filter");
+}
+
+static void *spout_filter_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct spout_filter *context =
+		(spout_filter *)bzalloc(sizeof(spout_filter));
+	context->source = source;
+	pthread_mutex_init(&context->settings_mutex, NULL);
+
+	obs_enter_graphics();
+	context->texrender = gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	obs_leave_graphics();
+
+	spout_filter_update(context, settings);
+	return context;
+}
+
+static void spout_filter_destroy_stagesurfaces(struct spout_filter *context)
+{
+	for (int i = 0; i < 2; i++) {
+		gs_stagesurface_destroy(context->stagesurfaces[i]);
+		context->stagesurfaces[i] = NULL;
+		context->staged[i] = false;
+	}
+}
+
+static void spout_filter_destroy(void *data)
+{
+	struct spout_filter *context = (spout_filter *)data;
+
+	// destroy runs on the UI thread, leave the sender to the graphics
+	// thread's next frame
+	if (context->sender) {
+		obs_queue_task(OBS_TASK_GRAPHICS, spout_filter_close_sender,
+			       context->sender, false);
+	}
+
+	obs_enter_graphics();
+	spout_filter_destroy_stagesurfaces(context);
+	gs_texrender_destroy(context->texrender);
+	obs_leave_graphics();
+
+	pthread_mutex_destroy(&context->settings_mutex);
+	bfree(context);
+}
+
+/**
+ * Publishes the frame staged on the previous render and
+ * stages the current one
+ */
+static void spout_filter_publish(struct spout_filter *context,
+				 gs_texture_t *texture)
+{
+	int current = context->stage_index;
+	int previous = current ^ 1;
+
+	if (context->staged[previous]) {
+		uint8_t *pixels;
+		uint32_t linesize;
+		gs_stagesurf_t *surface = context->stagesurfaces[previous];
+		if (gs_stagesurface_map(surface, &pixels, &linesize)) {
+			spout_sender_send(context->sender, pixels, linesize,
+					  context->width, context->height,
+					  os_gettime_ns());
+			gs_stagesurface_unmap(surface);
+		}
+		context->staged[previous] = false;
+	}
+
+	// no read back when no receiver takes the frame
+	if (spout_sender_wants_frame(context->sender, os_gettime_ns())) {
+		gs_stage_texture(context->stagesurfaces[current], texture);
+		context->staged[current] = true;
+	}
+	context->stage_index = previous;
+}
+
+static void spout_filter_tick(void *data, float seconds)
+{
+	UNUSED_PARAMETER(seconds);
+	struct spout_filter *context = (spout_filter *)data;
+	context->rendered = false;
+}
+
+static void spout_filter_draw(gs_texture_t *texture)
+{
+	// the render target doubles as the filter's output
+	gs_effect_t *draw = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	while (gs_effect_loop(draw, "Draw")) {
+		obs_source_draw(texture, 0, 0, 0, 0, false);
+	}
+}
+
+static void spout_filter_render(void *data, gs_effect_t *effect)
+{
+	UNUSED_PARAMETER(effect);
+	struct spout_filter *context = (spout_filter *)data;
+
+	// further views of the same frame reuse its render and don't publish
+	if (context->rendered) {
+		if (context->texture) {
+			spout_filter_draw(context->texture);
+		} else {
+			obs_source_skip_video_filter(context->source);
+		}
+		return;
+	}
+	context->rendered = true;
+	context->texture = NULL;
+
+	obs_source_t *target = obs_filter_get_target(context->source);
+	uint32_t width = obs_source_get_base_width(target);
+	uint32_t height = obs_source_get_base_height(target);
+
+	if (!spout_filter_check_sender(context) || !width || !height) {
+		obs_source_skip_video_filter(context->source);
+		return;
+	}
+
+	if (width != context->width || height != context->height) {
+		spout_filter_destroy_stagesurfaces(context);
+		for (int i = 0; i < 2; i++) {
+			context->stagesurfaces[i] =
+				gs_stagesurface_create(width, height, GS_BGRA);
+		}
+		context->width = width;
+		context->height = height;
+	}
+
+	gs_texrender_reset(context->texrender);
+	if (!gs_texrender_begin(context->texrender, width, height)) {
+		obs_source_skip_video_filter(context->source);
+		return;
+	}
+
+	struct vec4 clear_color;
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+	obs_source_video_render(target);
+	gs_blend_state_pop();
+
+	gs_texrender_end(context->texrender);
+
+	gs_texture_t *texture = gs_texrender_get_texture(context->texrender);
+	context->texture = texture;
+	spout_filter_draw(texture);
+	spout_filter_publish(context, texture);
+}
+
+static obs_properties_t *spout_filter_properties(void *data)
+{
+	UNUSED_PARAMETER(data);
+
+	obs_properties_t *props = obs_properties_create();
+	spout_sender_properties(props);
+	return props;
+}
+
+void win_spout_filter_register(void)
+{
+	obs_source_info info = {};
+	info.id = "spout_filter";
+	info.type = OBS_SOURCE_TYPE_FILTER;
+	info.output_flags = OBS_SOURCE_VIDEO;
+	info.get_name = spout_filter_get_name;
+	info.create = spout_filter_create;
+	info.destroy = spout_filter_destroy;
+	info.update = spout_filter_update;
+	info.get_defaults = spout_filter_defaults;
+	info.video_tick = spout_filter_tick;
+	info.video_render = spout_filter_render;
+	info.get_properties = spout_filter_properties;
+	obs_register_source(&info);
+}
@@ -0,0 +1,480 @@
+/**
+ * Spout mosaic: draws a list of Spout senders as a grid in one source
+ *
+ * Meant for multiviewers. Compared to one Spout2 Capture per sender the
+ * mosaic enumerates the Spout registry once per poll for all of its cells,
+ * and draws every cell within a single pass of one effect.
+ *
+ * Only senders that share a texture are shown; shared-memory senders need
+ * a per-frame upload each and are better served by Spout2 Capture.
+ */
+#include "win-spout.h"
+
+#include "deadline.h"
+
+#include <util/threading.h>
+#include <string.h>
+
+#define info(message, ...)                                                    \
+	blog(LOG_INFO, "[%s] " message, obs_source_get_name(context->source), \
+	     ##__VA_ARGS__)
+#define warn(message, ...)                 \
+	blog(LOG_WARNING, "[%s] " message, \
+	     obs_source_get_name(context->source), ##__VA_ARGS__)
+
+#define SPOUT_MOSAIC_SENDERS "senders"
+#define SPOUT_MOSAIC_COLUMNS "columns"
+#define SPOUT_MOSAIC_WIDTH "width"
+#define SPOUT_MOSAIC_HEIGHT "height"
+#define SPOUT_MOSAIC_POLL "tickspeedlimit"
+
+#define SPOUT_MOSAIC_MAX_CELLS 64
+
+struct spout_mosaic_cell {
+	char senderName[256];
+
+	HANDLE dxHandle;
+	DWORD dxFormat;
+	uint32_t width;
+	uint32_t height;
+
+	gs_texture_t *texture;
+};
+
+/**
+ * What a poll found out about a cell's sender, looked up by the tick
+ * outside the graphics section and applied to the cell after
+ */
+struct spout_mosaic_lookup {
+	char senderName[256];
+
+	// whether the sender was in the registry snapshot
+	bool listed;
+	int result;
+
+	// the cell's texture as the poll started
+	bool open;
+	HANDLE openHandle;
+	DWORD openFormat;
+	uint32_t openWidth;
+	uint32_t openHeight;
+
+	HANDLE dxHandle;
+	DWORD dxFormat;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct spout_mosaic {
+	obs_source_t *source;
+
+	// Spout's sender registry, shared by all sources
+	struct spout_registry *registry;
+	struct stall_section tick_section;
+
+	/* Guards the cells and the settings below. Taken inside the graphics
+	 * section wherever both are held, never the other way around. */
+	pthread_mutex_t cells_mutex;
+	struct spout_mosaic_cell cells[SPOUT_MOSAIC_MAX_CELLS];
+	int num_cells;
+	int columns;
+	// bumped by every update, so a poll that raced one is dropped
+	uint32_t generation;
+
+	uint32_t width;
+	uint32_t height;
+
+	ULONGLONG tick_speed_limit;
+
+	// tick only
+	struct spout_mosaic_lookup lookups[SPOUT_MOSAIC_MAX_CELLS];
+	uint32_t lookupGeneration;
+	ULONGLONG lastCheckTick;
+};
+
+static const char *spout_mosaic_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("mosaicname");
+}
+
+static void spout_mosaic_close_cell(struct spout_mosaic_cell *cell)
+{
+	win_spout_texture_close(cell->texture);
+	cell->texture = NULL;
+	cell->dxHandle = NULL;
+	cell->width = cell->height = 0;
+}
+
+static void spout_mosaic_close_cells(struct spout_mosaic *context)
+{
+	for (int i = 0; i < context->num_cells; i++) {
+		spout_mosaic_close_cell(&context->cells[i]);
+	}
+}
+
+static void spout_mosaic_update(void *data, obs_data_t *settings)
+{
+	struct spout_mosaic *context = (spout_mosaic *)data;
+
+	obs_data_array_t *senders =
+		obs_data_get_array(settings, SPOUT_MOSAIC_SENDERS);
+	size_t count = obs_data_array_count(senders);
+	if (count > SPOUT_MOSAIC_MAX_CELLS) {
+		warn("Only the first %d senders are shown",
+		     SPOUT_MOSAIC_MAX_CELLS);
+		count = SPOUT_MOSAIC_MAX_CELLS;
+	}
+	int columns = (int)obs_data_get_int(settings, SPOUT_MOSAIC_COLUMNS);
+	if (columns < 1) {
+		columns = 1;
+	}
+
+	// the old cells' textures are released before the cells are reset
+	obs_enter_graphics();
+	pthread_mutex_lock(&context->cells_mutex);
+	spout_mosaic_close_cells(context);
+	memset(context->cells, 0, sizeof(context->cells));
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(senders, i);
+		strncpy(context->cells[i].senderName,
+			obs_data_get_string(item, "value"), 255);
+		obs_data_release(item);
+	}
+
+	context->num_cells = (int)count;
+	context->columns = columns;
+	context->width = (uint32_t)obs_data_get_int(settings, SPOUT_MOSAIC_WIDTH);
+	context->height =
+		(uint32_t)obs_data_get_int(settings, SPOUT_MOSAIC_HEIGHT);
+	context->tick_speed_limit =
+		obs_data_get_int(settings, SPOUT_MOSAIC_POLL);
+	// the next tick polls at once
+	context->generation++;
+	pthread_mutex_unlock(&context->cells_mutex);
+	obs_leave_graphics();
+
+	obs_data_array_release(senders);
+}
+
+static void spout_mosaic_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, SPOUT_MOSAIC_COLUMNS, 4);
+	obs_data_set_default_int(settings, SPOUT_MOSAIC_WIDTH, 1920);
+	obs_data_set_default_int(settings, SPOUT_MOSAIC_HEIGHT, 1080);
+	obs_data_set_default_int(settings, SPOUT_MOSAIC_POLL, 100);
+}
+
+static void *spout_mosaic_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct spout_mosaic *context =
+		(spout_mosaic *)bzalloc(sizeof(spout_mosaic));
+	context->source = source;
+	context->registry = spout_registry_acquire();
+	pthread_mutex_init(&context->cells_mutex, NULL);
+	win_spout_watchdog_add(&context->tick_section, source);
+
+	spout_mosaic_update(context, settings);
+	return context;
+}
+
+static void spout_mosaic_destroy(void *data)
+{
+	struct spout_mosaic *context = (spout_mosaic *)data;
+
+	obs_enter_graphics();
+	spout_mosaic_close_cells(context);
+	obs_leave_graphics();
+
+	stall_section_remove(&context->tick_section);
+	spout_registry_release(context->registry);
+	pthread_mutex_destroy(&context->cells_mutex);
+
+	bfree(context);
+}
+
+static uint32_t spout_mosaic_getwidth(void *data)
+{
+	struct spout_mosaic *context = (spout_mosaic *)data;
+	return context->width;
+}
+
+static uint32_t spout_mosaic_getheight(void *data)
+{
+	struct spout_mosaic *context = (spout_mosaic *)data;
+	return context->height;
+}
+
+/**
+ * Enumerates the Spout registry once and marks which of the polled cells
+ * have a live sender. Returns false, leaving the cells as they are, while
+ * the registry doesn't respond.
+ */
+static bool spout_mosaic_snapshot(struct spout_mosaic *context, int num_cells)
+{
+	char(*senderNames)[256] = (char(*)[256])bmalloc(
+		sizeof(*senderNames) * SPOUT_REGISTRY_MAX_SENDERS);
+	int totalSenders = 0;
+	if (spout_registry_sender_names(context->registry, senderNames,
+					&totalSenders) == SPOUT_CALL_SKIPPED) {
+		bfree(senderNames);
+		return false;
+	}
+
+	for (int i = 0; i < num_cells; i++) {
+		struct spout_mosaic_lookup *lookup = &context->lookups[i];
+		lookup->listed = false;
+		for (int index = 0; index < totalSenders; index++) {
+			if (strcmp(lookup->senderName, senderNames[index]) ==
+			    0) {
+				lookup->listed = true;
+				break;
+			}
+		}
+	}
+	bfree(senderNames);
+	return true;
+}
+
+/**
+ * Looks the cell's sender up, outside the graphics section. Returns
+ * whether the cell's texture has to be opened, replaced or closed.
+ */
+static bool spout_mosaic_look_up(struct spout_mosaic *context,
+				 struct spout_mosaic_lookup *lookup)
+{
+	unsigned int width = 0, height = 0;
+
+	lookup->result = SPOUT_CALL_FAILED;
+	lookup->dxHandle = NULL;
+	lookup->dxFormat = 0;
+	if (lookup->listed) {
+		lookup->result = spout_registry_sender_info(
+			context->registry, lookup->senderName, &width, &height,
+			&lookup->dxHandle, &lookup->dxFormat);
+	}
+	lookup->width = width;
+	lookup->height = height;
+
+	if (lookup->result == SPOUT_CALL_SKIPPED) {
+		return false;
+	}
+	if (lookup->result != SPOUT_CALL_OK) {
+		return lookup->open;
+	}
+	return !lookup->open || lookup->dxHandle != lookup->openHandle ||
+	       lookup->width != lookup->openWidth ||
+	       lookup->height != lookup->openHeight ||
+	       lookup->dxFormat != lookup->openFormat;
+}
+
+/**
+ * Applies a lookup to its cell, inside the graphics section: re-opens the
+ * cell's texture when its sender's texture has changed, and leaves it as
+ * it is while the registry doesn't respond
+ */
+static void spout_mosaic_apply(struct spout_mosaic *context,
+			       struct spout_mosaic_cell *cell,
+			       const struct spout_mosaic_lookup *lookup)
+{
+	if (lookup->result == SPOUT_CALL_SKIPPED) {
+		return;
+	}
+	if (lookup->result != SPOUT_CALL_OK) {
+		if (cell->texture) {
+			info("Sender %s has gone away", cell->senderName);
+			spout_mosaic_close_cell(cell);
+		}
+		return;
+	}
+
+	if (cell->texture && lookup->dxHandle == cell->dxHandle &&
+	    lookup->width == cell->width && lookup->height == cell->height &&
+	    lookup->dxFormat == cell->dxFormat) {
+		return;
+	}
+
+	spout_mosaic_close_cell(cell);
+	cell->texture = win_spout_texture_open(lookup->dxHandle);
+	if (!cell->texture) {
+		return;
+	}
+	cell->dxHandle = lookup->dxHandle;
+	cell->dxFormat = lookup->dxFormat;
+	cell->width = lookup->width;
+	cell->height = lookup->height;
+}
+
+static void spout_mosaic_do_tick(struct spout_mosaic *context)
+{
+	if (context->registry == NULL ||
+	    !obs_source_active(context->source)) {
+		return;
+	}
+
+	// copy what the poll needs, so the lookups run without the lock
+	pthread_mutex_lock(&context->cells_mutex);
+	uint32_t generation = context->generation;
+	int num_cells = context->num_cells;
+	bool due = generation != context->lookupGeneration ||
+		   GetTickCount64() - context->lastCheckTick >=
+			   context->tick_speed_limit;
+	bool all_open = true;
+	if (due) {
+		for (int i = 0; i < num_cells; i++) {
+			struct spout_mosaic_cell *cell = &context->cells[i];
+			struct spout_mosaic_lookup *lookup =
+				&context->lookups[i];
+			strcpy(lookup->senderName, cell->senderName);
+			lookup->open = cell->texture != NULL;
+			lookup->openHandle = cell->dxHandle;
+			lookup->openFormat = cell->dxFormat;
+			lookup->openWidth = cell->width;
+			lookup->openHeight = cell->height;
+			all_open = all_open && lookup->open;
+		}
+	}
+	pthread_mutex_unlock(&context->cells_mutex);
+
+	if (!due || !num_cells) {
+		return;
+	}
+	context->lookupGeneration = generation;
+	context->lastCheckTick = GetTickCount64();
+	// the registry is only listed while a cell has no sender, an open
+	// cell's lookup fails once its sender has gone
+	if (all_open) {
+		for (int i = 0; i < num_cells; i++) {
+			context->lookups[i].listed = true;
+		}
+	} else if (!spout_mosaic_snapshot(context, num_cells)) {
+		return;
+	}
+
+	bool changed = false;
+	for (int i = 0; i < num_cells; i++) {
+		if (spout_mosaic_look_up(context, &context->lookups[i])) {
+			changed = true;
+		}
+	}
+	if (!changed) {
+		return;
+	}
+
+	// all cells are (re)opened within one graphics section
+	obs_enter_graphics();
+	pthread_mutex_lock(&context->cells_mutex);
+	if (context->generation == generation) {
+		for (int i = 0; i < num_cells; i++) {
+			spout_mosaic_apply(context, &context->cells[i],
+					   &context->lookups[i]);
+		}
+	}
+	pthread_mutex_unlock(&context->cells_mutex);
+	obs_leave_graphics();
+}
+
+static void spout_mosaic_tick(void *data, float seconds)
+{
+	UNUSED_PARAMETER(seconds);
+	struct spout_mosaic *context = (spout_mosaic *)data;
+
+	stall_section_enter(&context->tick_section);
+	spout_mosaic_do_tick(context);
+	stall_section_leave(&context->tick_section);
+}
+
+static void spout_mosaic_render(void *data, gs_effect_t *effect)
+{
+	UNUSED_PARAMETER(effect);
+	struct spout_mosaic *context = (spout_mosaic *)data;
+
+	pthread_mutex_lock(&context->cells_mutex);
+	if (!context->num_cells) {
+		pthread_mutex_unlock(&context->cells_mutex);
+		return;
+	}
+
+	int rows = (context->num_cells + context->columns - 1) /
+		   context->columns;
+	float cell_width = (float)context->width / context->columns;
+	float cell_height = (float)context->height / rows;
+
+	effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	while (gs_effect_loop(effect, "Draw")) {
+		for (int i = 0; i < context->num_cells; i++) {
+			struct spout_mosaic_cell *cell = &context->cells[i];
+			if (!cell->texture || !cell->width || !cell->height) {
+				continue;
+			}
+
+			// fit the sender into its cell, keeping its aspect
+			float scale = cell_width / cell->width;
+			if (cell->height * scale > cell_height) {
+				scale = cell_height / cell->height;
+			}
+			float draw_width = cell->width * scale;
+			float draw_height = cell->height * scale;
+			float x = (i % context->columns) * cell_width +
+				  (cell_width - draw_width) / 2.0f;
+			float y = (i / context->columns) * cell_height +
+				  (cell_height - draw_height) / 2.0f;
+
+			obs_source_draw(cell->texture, (int)x, (int)y,
+					(uint32_t)draw_width,
+					(uint32_t)draw_height, false);
+		}
+	}
+	pthread_mutex_unlock(&context->cells_mutex);
+}
+
+static obs_properties_t *spout_mosaic_properties(void *data)
+{
+	UNUSED_PARAMETER(data);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_editable_list(props, SPOUT_MOSAIC_SENDERS,
+					 obs_module_text("SpoutSenders"),
+					 OBS_EDITABLE_LIST_TYPE_STRINGS, NULL,
+					 NULL);
+	obs_properties_add_int(props, SPOUT_MOSAIC_COLUMNS,
+			       obs_module_text("columns"), 1, 16, 1);
+	obs_properties_add_int(props, SPOUT_MOSAIC_WIDTH,
+			       obs_module_text("width"), 16, 16384, 1);
+	obs_properties_add_int(props, SPOUT_MOSAIC_HEIGHT,
+			       obs_module_text("height"), 16, 16384, 1);
+
+	obs_property_t *tick_speed_limit_list = obs_properties_add_list(
+		props, SPOUT_MOSAIC_POLL, obs_module_text("tickspeedlimit"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(tick_speed_limit_list,
+				  obs_module_text("tickspeedcrazy"), 1);
+	obs_property_list_add_int(tick_speed_limit_list,
+				  obs_module_text("tickspeedfast"), 100);
+	obs_property_list_add_int(tick_speed_limit_list,
+				  obs_module_text("tickspeednormal"), 500);
+	obs_property_list_add_int(tick_speed_limit_list,
+				  obs_module_text("tickspeedslow"), 1000);
+
+	return props;
+}
+
+void win_spout_mosaic_register(void)
+{
+	obs_source_info info = {};
+	info.id = "spout_mosaic";
+	info.type = OBS_SOURCE_TYPE_INPUT;
+	info.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW;
+	info.get_name = spout_mosaic_get_name;
+	info.create = spout_mosaic_create;
+	info.destroy = spout_mosaic_destroy;
+	info.update = spout_mosaic_update;
+	info.get_defaults = spout_mosaic_defaults;
+	info.get_width = spout_mosaic_getwidth;
+	info.get_height = spout_mosaic_getheight;
+	info.video_render = spout_mosaic_render;
+	info.video_tick = spout_mosaic_tick;
+	info.get_properties = spout_mosaic_properties;
+	obs_register_source(&info);
+}
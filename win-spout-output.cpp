@@ -0,0 +1,343 @@
+/**
+ * Spout output: publishes the OBS program feed as a Spout sender
+ *
+ * OBS hands us BGRA frames on the video thread, which are published
+ * through a spout_sender (see win-spout-sender.h).
+ *
+ * Senders bind Spout's OpenGL context to the thread that sends, so they are
+ * also closed there: stop asks the next raw_video call to close them and
+ * waits for it before ending the capture.
+ *
+ * Optionally the output fans out to further senders at half, quarter, ...
+ * resolution. The levels form a cascade: each one is box-filtered down
+ * from the level above it, so the program is only rendered once and each
+ * pixel is only read once per level.
+ */
+#include "win-spout.h"
+#include "win-spout-sender.h"
+#include "frame-scale.h"
+#include "frame-pool.h"
+
+#include <util/threading.h>
+#include <stdio.h>
+#include <string.h>
+
+#define info(message, ...)                                                    \
+	blog(LOG_INFO, "[%s] " message, obs_output_get_name(context->output), \
+	     ##__VA_ARGS__)
+#define warn(message, ...)                 \
+	blog(LOG_WARNING, "[%s] " message, \
+	     obs_output_get_name(context->output), ##__VA_ARGS__)
+
+#define SPOUT_OUTPUT_FANOUT "fanoutlevels"
+
+#define SPOUT_OUTPUT_MAX_LEVELS 4
+#define SPOUT_OUTPUT_MIN_LEVEL_SIZE 16
+// how long stop waits for the video thread to close the senders
+#define SPOUT_OUTPUT_CLOSE_TIMEOUT_MS 1000
+
+struct spout_output_level {
+	struct spout_sender *sender;
+	uint32_t width;
+	uint32_t height;
+
+	// scaled frame, unused for the full resolution level
+	uint8_t *buffer;
+	size_t buffer_size;
+	uint32_t linesize;
+};
+
+struct spout_output {
+	obs_output_t *output;
+
+	char senderName[256];
+	int transport;
+	bool checksum;
+	bool throttle;
+	int fanout;
+
+	struct spout_output_level levels[SPOUT_OUTPUT_MAX_LEVELS];
+	int num_levels;
+
+	uint32_t width;
+	uint32_t height;
+
+	bool active;
+
+	// set by stop, raw_video then closes the senders and signals
+	volatile bool close_senders;
+	os_event_t *senders_closed;
+};
+
+static const char *spout_output_get_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("outputname");
+}
+
+static void spout_output_update(void *data, obs_data_t *settings)
+{
+	struct spout_output *context = (spout_output *)data;
+
+	// the sender name can only change while stopped
+	if (context->active) {
+		return;
+	}
+
+	memset(context->senderName, 0, 256);
+	strncpy(context->senderName,
+		obs_data_get_string(settings, SPOUT_SENDER_NAME), 255);
+	context->transport =
+		(int)obs_data_get_int(settings, SPOUT_SENDER_TRANSPORT);
+	context->checksum = obs_data_get_bool(settings, SPOUT_SENDER_CHECKSUM);
+	context->throttle = obs_data_get_bool(settings, SPOUT_SENDER_THROTTLE);
+	context->fanout = (int)obs_data_get_int(settings, SPOUT_OUTPUT_FANOUT);
+}
+
+static void spout_output_defaults(obs_data_t *settings)
+{
+	spout_sender_defaults(settings, SPOUT_DEFAULT_OUTPUT_NAME);
+	obs_data_set_default_int(settings, SPOUT_OUTPUT_FANOUT, 0);
+}
+
+static void *spout_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct spout_output *context =
+		(spout_output *)bzalloc(sizeof(spout_output));
+	context->output = output;
+	if (os_event_init(&context->senders_closed, OS_EVENT_TYPE_MANUAL) !=
+	    0) {
+		bfree(context);
+		return NULL;
+	}
+
+	spout_output_update(context, settings);
+	return context;
+}
+
+// on the video thread
+static void spout_output_close_levels(struct spout_output *context)
+{
+	for (int i = 0; i < context->num_levels; i++) {
+		spout_sender_close(context->levels[i].sender);
+	}
+}
+
+static void spout_output_destroy_levels(struct spout_output *context)
+{
+	for (int i = 0; i < context->num_levels; i++) {
+		struct spout_output_level *level = &context->levels[i];
+		spout_sender_destroy(level->sender);
+		frame_pool_release(level->buffer, level->buffer_size);
+		memset(level, 0, sizeof(*level));
+	}
+	context->num_levels = 0;
+}
+
+/**
+ * Sets up the full resolution sender plus one sender per fan-out level,
+ * named after the main sender and their resolution
+ * @return bool success
+ */
+static bool spout_output_create_levels(struct spout_output *context)
+{
+	uint32_t width = context->width;
+	uint32_t height = context->height;
+
+	for (int i = 0; i <= context->fanout && i < SPOUT_OUTPUT_MAX_LEVELS;
+	     i++) {
+		if (width < SPOUT_OUTPUT_MIN_LEVEL_SIZE ||
+		    height < SPOUT_OUTPUT_MIN_LEVEL_SIZE) {
+			break;
+		}
+
+		struct spout_output_level *level = &context->levels[i];
+		char name[256];
+		if (i == 0) {
+			strcpy(name, context->senderName);
+		} else {
+			snprintf(name, sizeof(name), "%s %ux%u",
+				 context->senderName, width, height);
+			level->linesize = width * 4;
+			level->buffer = frame_pool_alloc(
+				(size_t)width * height * 4, &level->buffer_size);
+			if (!level->buffer) {
+				// the levels below are scaled from this one
+				warn("Out of memory for the %ux%u level, "
+				     "leaving it and those below out",
+				     width, height);
+				memset(level, 0, sizeof(*level));
+				break;
+			}
+		}
+
+		level->width = width;
+		level->height = height;
+		level->sender = spout_sender_create(name, context->transport);
+		context->num_levels = i + 1;
+		if (!level->sender) {
+			warn("Could not publish sender %s", name);
+			return false;
+		}
+		spout_sender_set_checksum(level->sender, context->checksum);
+		spout_sender_set_throttle(level->sender, context->throttle);
+
+		width /= 2;
+		height /= 2;
+	}
+	return context->num_levels > 0;
+}
+
+static void spout_output_destroy(void *data)
+{
+	struct spout_output *context = (spout_output *)data;
+
+	spout_output_destroy_levels(context);
+	os_event_destroy(context->senders_closed);
+	bfree(context);
+}
+
+static bool spout_output_start(void *data)
+{
+	struct spout_output *context = (spout_output *)data;
+
+	video_t *video = obs_output_video(context->output);
+	context->width = video_output_get_width(video);
+	context->height = video_output_get_height(video);
+
+	if (!obs_output_can_begin_data_capture(context->output, 0)) {
+		return false;
+	}
+
+	if (!spout_output_create_levels(context)) {
+		spout_output_destroy_levels(context);
+		return false;
+	}
+
+	struct video_scale_info conversion = {};
+	conversion.format = VIDEO_FORMAT_BGRA;
+	conversion.width = context->width;
+	conversion.height = context->height;
+	conversion.range = VIDEO_RANGE_FULL;
+	conversion.colorspace = VIDEO_CS_SRGB;
+	obs_output_set_video_conversion(context->output, &conversion);
+
+	os_atomic_set_bool(&context->close_senders, false);
+	os_event_reset(context->senders_closed);
+	context->active = true;
+	if (!obs_output_begin_data_capture(context->output, 0)) {
+		context->active = false;
+		spout_output_destroy_levels(context);
+		return false;
+	}
+
+	info("Publishing program feed as %s (%dx%d, %d levels)",
+	     context->senderName, context->width, context->height,
+	     context->num_levels);
+	return true;
+}
+
+static void spout_output_stop(void *data, uint64_t ts)
+{
+	UNUSED_PARAMETER(ts);
+	struct spout_output *context = (spout_output *)data;
+
+	// the senders' GL contexts belong to the video thread, have its
+	// next frame close them
+	os_atomic_set_bool(&context->close_senders, true);
+	if (os_event_timedwait(context->senders_closed,
+			       SPOUT_OUTPUT_CLOSE_TIMEOUT_MS) != 0) {
+		warn("Video thread didn't close the senders in time");
+	}
+
+	// no more raw_video calls after this returns
+	obs_output_end_data_capture(context->output);
+	context->active = false;
+
+	spout_output_destroy_levels(context);
+}
+
+static void spout_output_raw_video(void *data, struct video_data *frame)
+{
+	struct spout_output *context = (spout_output *)data;
+
+	if (!context->active) {
+		return;
+	}
+	if (os_atomic_load_bool(&context->close_senders)) {
+		if (os_event_try(context->senders_closed) != 0) {
+			spout_output_close_levels(context);
+			os_event_signal(context->senders_closed);
+		}
+		return;
+	}
+
+	const uint8_t *pixels = frame->data[0];
+	uint32_t linesize = frame->linesize[0];
+
+	// levels below the last one a receiver wants aren't even scaled
+	bool wanted[SPOUT_OUTPUT_MAX_LEVELS];
+	int num_levels = 0;
+	for (int i = 0; i < context->num_levels; i++) {
+		wanted[i] = spout_sender_wants_frame(context->levels[i].sender,
+						     frame->timestamp);
+		if (wanted[i]) {
+			num_levels = i + 1;
+		}
+	}
+
+	for (int i = 0; i < num_levels; i++) {
+		struct spout_output_level *level = &context->levels[i];
+		if (level->buffer) {
+			// each level is reduced from the one above it
+			frame_scale_half(pixels, linesize, level->width * 2,
+					 level->height * 2, level->buffer,
+					 level->linesize);
+			pixels = level->buffer;
+			linesize = level->linesize;
+		}
+		if (wanted[i]) {
+			spout_sender_send(level->sender, pixels, linesize,
+					  level->width, level->height,
+					  frame->timestamp);
+		}
+	}
+}
+
+static obs_properties_t *spout_output_properties(void *data)
+{
+	UNUSED_PARAMETER(data);
+
+	obs_properties_t *props = obs_properties_create();
+	spout_sender_properties(props);
+
+	obs_property_t *fanout_list = obs_properties_add_list(
+		props, SPOUT_OUTPUT_FANOUT, obs_module_text("fanoutlevels"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(fanout_list, obs_module_text("fanoutnone"),
+				  0);
+	obs_property_list_add_int(fanout_list, obs_module_text("fanouthalf"),
+				  1);
+	obs_property_list_add_int(fanout_list,
+				  obs_module_text("fanoutquarter"), 2);
+	obs_property_list_add_int(fanout_list, obs_module_text("fanouteighth"),
+				  3);
+	return props;
+}
+
+void win_spout_output_register(void)
+{
+	obs_output_info info = {};
+	info.id = "spout_output";
+	info.flags = OBS_OUTPUT_VIDEO;
+	info.get_name = spout_output_get_name;
+	info.create = spout_output_create;
+	info.destroy = spout_output_destroy;
+	info.start = spout_output_start;
+	info.stop = spout_output_stop;
+	info.raw_video = spout_output_raw_video;
+	info.update = spout_output_update;
+	info.get_defaults = spout_output_defaults;
+	info.get_properties = spout_output_properties;
+	obs_register_output(&info);
+}
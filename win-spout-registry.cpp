@@ -0,0 +1,265 @@
+/**
+ * Spout sender registry calls with a deadline
+ *
+ * GetSenderCount, GetSenderInfo etc. take Spout's cross-process mutexes,
+ * which a hung sender can hold forever. The registry owns a SpoutLibrary
+ * handle that is only ever used on its deadline_worker (see deadline.h),
+ * so such a call costs the caller at most SPOUT_REGISTRY_TIMEOUT_MS.
+ * Calls are then skipped, and counted, until the hung one returns.
+ *
+ * There is one registry for all sources, refcounted. The handle, with its
+ * shared memory maps and mutexes, is only created by the first call that
+ * needs it, on the worker, and released with the last reference.
+ */
+#include "win-spout.h"
+#include "deadline.h"
+#include "shared-ref.h"
+
+#include <util/threading.h>
+#include <string.h>
+
+#include "Include/SpoutLibrary.h"
+
+#define info(message, ...) \
+	blog(LOG_INFO, "[win-spout] " message, ##__VA_ARGS__)
+#define warn(message, ...) \
+	blog(LOG_WARNING, "[win-spout] " message, ##__VA_ARGS__)
+
+// well above what a registry call takes, well below a frame at 30 fps
+#define SPOUT_REGISTRY_TIMEOUT_MS 20
+// Release waits for its own mutexes, give it longer at shutdown
+#define SPOUT_REGISTRY_RELEASE_TIMEOUT_MS 200
+
+enum registry_op {
+	REGISTRY_SENDER_NAMES,
+	REGISTRY_SENDER_INFO,
+	REGISTRY_RELEASE,
+};
+
+// everything a call takes and returns, copied to and from the worker
+struct registry_call {
+	struct spout_registry *registry;
+	enum registry_op op;
+	bool result;
+
+	char name[256];
+	unsigned int width;
+	unsigned int height;
+	HANDLE handle;
+	DWORD format;
+};
+
+struct registry_names_call {
+	struct registry_call call;
+	int count;
+	char names[SPOUT_REGISTRY_MAX_SENDERS][256];
+};
+
+struct spout_registry {
+	// only used on the worker, NULL until the first call
+	SPOUTHANDLE spoutptr;
+	bool spout_failed;
+	struct deadline_worker *worker;
+
+	pthread_mutex_t mutex;
+	// calls skipped since the last one that returned in time
+	uint64_t skipped;
+	uint64_t total_skipped;
+};
+
+// the registry all sources share
+static struct shared_ref shared_registry = SHARED_REF_INIT;
+
+static const char *registry_op_name(enum registry_op op)
+{
+	switch (op) {
+	case REGISTRY_SENDER_NAMES:
+		return "GetSenderName";
+	case REGISTRY_SENDER_INFO:
+		return "GetSenderInfo";
+	case REGISTRY_RELEASE:
+		return "Release";
+	}
+	return "?";
+}
+
+// runs on the worker thread
+static void registry_run(void *args)
+{
+	struct registry_call *call = (struct registry_call *)args;
+	struct spout_registry *registry = call->registry;
+
+	call->result = false;
+	if (call->op == REGISTRY_RELEASE) {
+		if (registry->spoutptr) {
+			registry->spoutptr->Release();
+			registry->spoutptr = NULL;
+		}
+		call->result = true;
+		return;
+	}
+	if (!registry->spoutptr && !registry->spout_failed) {
+		registry->spoutptr = GetSpout();
+		registry->spout_failed = registry->spoutptr == NULL;
+	}
+	SPOUTHANDLE spoutptr = registry->spoutptr;
+	if (!spoutptr) {
+		return;
+	}
+
+	switch (call->op) {
+	case REGISTRY_SENDER_NAMES: {
+		struct registry_names_call *list =
+			(struct registry_names_call *)args;
+		int total = spoutptr->GetSenderCount();
+		list->count = 0;
+		for (int i = 0;
+		     i < total && list->count < SPOUT_REGISTRY_MAX_SENDERS;
+		     i++) {
+			if (spoutptr->GetSenderName(i,
+						    list->names[list->count])) {
+				list->count++;
+			}
+		}
+		call->result = true;
+		break;
+	}
+	case REGISTRY_SENDER_INFO:
+		call->result = spoutptr->GetSenderInfo(call->name, call->width,
+						       call->height,
+						       call->handle,
+						       call->format);
+		break;
+	case REGISTRY_RELEASE:
+		break;
+	}
+}
+
+/**
+ * Makes a call on the worker
+ * @param size of the call, a registry_names_call for sender names
+ * @return one of spout_call_result
+ */
+static int registry_call(struct spout_registry *registry,
+			 struct registry_call *call, size_t size,
+			 uint32_t timeout_ms)
+{
+	call->registry = registry;
+	int result = deadline_worker_call(registry->worker, registry_run, call,
+					  size, timeout_ms);
+
+	pthread_mutex_lock(&registry->mutex);
+	if (result == DEADLINE_OK) {
+		if (registry->skipped) {
+			info("Spout registry is responding again, %llu calls "
+			     "were skipped",
+			     (unsigned long long)registry->skipped);
+			registry->skipped = 0;
+		}
+	} else {
+		if (result == DEADLINE_TIMEOUT) {
+			warn("Spout %s didn't return within %u ms, skipping "
+			     "registry calls until it does",
+			     registry_op_name(call->op), timeout_ms);
+		}
+		registry->skipped++;
+		registry->total_skipped++;
+	}
+	pthread_mutex_unlock(&registry->mutex);
+
+	if (result != DEADLINE_OK) {
+		return SPOUT_CALL_SKIPPED;
+	}
+	return call->result ? SPOUT_CALL_OK : SPOUT_CALL_FAILED;
+}
+
+static void *registry_create(void)
+{
+	struct spout_registry *registry =
+		(struct spout_registry *)bzalloc(sizeof(*registry));
+	registry->worker =
+		deadline_worker_create(sizeof(struct registry_names_call));
+	if (!registry->worker) {
+		bfree(registry);
+		return NULL;
+	}
+	pthread_mutex_init(&registry->mutex, NULL);
+	return registry;
+}
+
+static void registry_destroy(struct spout_registry *registry)
+{
+	struct registry_call call = {};
+	call.op = REGISTRY_RELEASE;
+	int result = registry_call(registry, &call, sizeof(call),
+				   SPOUT_REGISTRY_RELEASE_TIMEOUT_MS);
+
+	struct deadline_stats stats;
+	deadline_worker_get_stats(registry->worker, &stats);
+	if (stats.timeouts) {
+		info("Spout registry: %llu of %llu calls timed out, %llu "
+		     "skipped, longest took %llu ms",
+		     (unsigned long long)stats.timeouts,
+		     (unsigned long long)stats.calls,
+		     (unsigned long long)registry->total_skipped,
+		     (unsigned long long)(stats.longest_ns / 1000000));
+	}
+	if (!deadline_worker_destroy(registry->worker) ||
+	    result == SPOUT_CALL_SKIPPED) {
+		// the hung call still uses the registry and the Spout handle,
+		// which are leaked
+		warn("Left a hung Spout registry call behind");
+		return;
+	}
+	pthread_mutex_destroy(&registry->mutex);
+	bfree(registry);
+}
+
+struct spout_registry *spout_registry_acquire(void)
+{
+	return (struct spout_registry *)shared_ref_acquire(&shared_registry,
+							   registry_create);
+}
+
+void spout_registry_release(struct spout_registry *registry)
+{
+	if (shared_ref_release(&shared_registry, registry)) {
+		registry_destroy(registry);
+	}
+}
+
+int spout_registry_sender_names(struct spout_registry *registry,
+				char (*names)[256], int *count)
+{
+	struct registry_names_call *list =
+		(struct registry_names_call *)bzalloc(sizeof(*list));
+	list->call.op = REGISTRY_SENDER_NAMES;
+	int result = registry_call(registry, &list->call, sizeof(*list),
+				   SPOUT_REGISTRY_TIMEOUT_MS);
+	*count = 0;
+	if (result == SPOUT_CALL_OK) {
+		*count = list->count;
+		memcpy(names, list->names, sizeof(list->names[0]) * list->count);
+	}
+	bfree(list);
+	return result;
+}
+
+int spout_registry_sender_info(struct spout_registry *registry,
+			       const char *name, unsigned int *width,
+			       unsigned int *height, HANDLE *handle,
+			       DWORD *format)
+{
+	struct registry_call call = {};
+	call.op = REGISTRY_SENDER_INFO;
+	strncpy(call.name, name, sizeof(call.name) - 1);
+	int result = registry_call(registry, &call, sizeof(call),
+				   SPOUT_REGISTRY_TIMEOUT_MS);
+	if (result == SPOUT_CALL_OK) {
+		*width = call.width;
+		*height = call.height;
+		*handle = call.handle;
+		*format = call.format;
+	}
+	return result;
+}
@@ -0,0 +1,431 @@
+/**
+ * Publishing side shared by the Spout output and the Spout filter,
+ * see win-spout-sender.h
+ */
+#include "win-spout.h"
+#include "win-spout-sender.h"
+#include "shm-ring.h"
+#include "frame-pool.h"
+
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/darray.h>
+#include <string.h>
+
+#include "Include/SpoutLibrary.h"
+
+#ifndef GL_BGRA_EXT
+#define GL_BGRA_EXT 0x80E1
+#endif
+
+// how often receivers' demand is checked, which is also how long a new
+// receiver of a paused sender waits for its first frame
+#define DEMAND_INTERVAL_NS 100000000ULL
+
+#define info(message, ...) \
+	blog(LOG_INFO, "[%s] " message, sender->name, ##__VA_ARGS__)
+#define warn(message, ...) \
+	blog(LOG_WARNING, "[%s] " message, sender->name, ##__VA_ARGS__)
+
+struct spout_sender {
+	char name[256];
+	int transport;
+
+	SPOUTHANDLE spoutptr;
+	bool gl_ready;
+	bool sender_created;
+
+	struct shm_ring *ring;
+	bool checksum;
+
+	bool throttle;
+	struct shm_ring_demand demand;
+	uint64_t demand_checked;
+	// earliest timestamp of the next frame at the receivers' rate
+	uint64_t next_frame;
+	int throttle_status;
+
+	uint32_t width;
+	uint32_t height;
+
+	// packed copy of the frame for Spout, which doesn't take a pitch
+	uint8_t *packed;
+	size_t packed_size;
+
+	int send_status;
+};
+
+// names published by this plugin instance
+static pthread_mutex_t sender_names_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct spout_sender *) sender_names;
+
+// caller holds sender_names_mutex
+static bool sender_names_contains(const char *name)
+{
+	for (size_t i = 0; i < sender_names.num; i++) {
+		if (strcmp(sender_names.array[i]->name, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool sender_names_add(struct spout_sender *sender)
+{
+	bool added = false;
+	pthread_mutex_lock(&sender_names_mutex);
+	if (!sender_names_contains(sender->name)) {
+		da_push_back(sender_names, &sender);
+		added = true;
+	}
+	pthread_mutex_unlock(&sender_names_mutex);
+	return added;
+}
+
+static void sender_names_remove(struct spout_sender *sender)
+{
+	pthread_mutex_lock(&sender_names_mutex);
+	da_erase_item(sender_names, &sender);
+	if (!sender_names.num) {
+		da_free(sender_names);
+	}
+	pthread_mutex_unlock(&sender_names_mutex);
+}
+
+struct spout_sender *spout_sender_create(const char *name, int transport)
+{
+	if (!name || !*name) {
+		return NULL;
+	}
+
+	struct spout_sender *sender =
+		(spout_sender *)bzalloc(sizeof(spout_sender));
+	strncpy(sender->name, name, 255);
+	sender->transport = transport;
+	sender->throttle = true;
+
+	if (!sender_names_add(sender)) {
+		warn("Sender name is already in use");
+		bfree(sender);
+		return NULL;
+	}
+
+	// not the sources' shared spout_registry: a SpoutLibrary object
+	// publishes one sender, with its own OpenGL context made current on
+	// the sending thread, and SendImage has to run there rather than on
+	// the registry's worker
+	sender->spoutptr = GetSpout();
+	return sender;
+}
+
+void spout_sender_close(struct spout_sender *sender)
+{
+	if (sender->sender_created) {
+		sender->spoutptr->ReleaseSender();
+		sender->sender_created = false;
+	}
+	if (sender->gl_ready) {
+		sender->spoutptr->CloseOpenGL();
+		sender->gl_ready = false;
+	}
+	shm_ring_close(sender->ring);
+	sender->ring = NULL;
+}
+
+void spout_sender_destroy(struct spout_sender *sender)
+{
+	if (!sender) {
+		return;
+	}
+
+	if (sender->gl_ready) {
+		// not closed on the sending thread, Spout can still release
+		// what doesn't depend on it
+		warn("Sender destroyed before it was closed");
+	}
+	spout_sender_close(sender);
+	sender_names_remove(sender);
+
+	if (sender->spoutptr != NULL) {
+		sender->spoutptr->Release();
+	}
+
+	info("Stopped publishing");
+	frame_pool_release(sender->packed, sender->packed_size);
+	bfree(sender);
+}
+
+bool spout_sender_name_in_use(const char *name)
+{
+	pthread_mutex_lock(&sender_names_mutex);
+	bool in_use = sender_names_contains(name);
+	pthread_mutex_unlock(&sender_names_mutex);
+	return in_use;
+}
+
+void spout_sender_set_checksum(struct spout_sender *sender, bool enabled)
+{
+	sender->checksum = enabled;
+	if (sender->ring) {
+		shm_ring_set_checksum(sender->ring, enabled);
+	}
+}
+
+void spout_sender_set_throttle(struct spout_sender *sender, bool enabled)
+{
+	sender->throttle = enabled;
+}
+
+/**
+ * Refreshes the receivers' demand every DEMAND_INTERVAL_NS and logs
+ * when the sender pauses or resumes
+ */
+static void spout_sender_check_demand(struct spout_sender *sender)
+{
+	uint64_t now = os_gettime_ns();
+	if (sender->demand_checked &&
+	    now - sender->demand_checked < DEMAND_INTERVAL_NS) {
+		return;
+	}
+	sender->demand_checked = now;
+	shm_ring_get_demand(sender->ring, &sender->demand);
+
+	int status = sender->demand.consumers ? 0 : -1;
+	if (status != sender->throttle_status) {
+		if (status) {
+			info("No receiver shows the sender, pausing");
+		} else {
+			info("Resuming for %u receivers", sender->demand.consumers);
+		}
+		sender->throttle_status = status;
+	}
+}
+
+bool spout_sender_wants_frame(struct spout_sender *sender, uint64_t timestamp)
+{
+	if (!sender->ring || !sender->throttle) {
+		return true;
+	}
+	spout_sender_check_demand(sender);
+	if (!sender->demand.consumers) {
+		return false;
+	}
+	if (!sender->demand.fps_milli || !sender->next_frame) {
+		return true;
+	}
+	// a quarter interval early still counts, so frames from a source
+	// at a multiple of the wanted rate aren't dropped by jitter
+	uint64_t interval = 1000000000000ULL / sender->demand.fps_milli;
+	return timestamp + interval / 4 >= sender->next_frame;
+}
+
+/**
+ * Schedules the next frame at the receivers' rate, keeping the cadence
+ * unless the sender fell a whole interval behind
+ */
+static void spout_sender_frame_sent(struct spout_sender *sender,
+				    uint64_t timestamp)
+{
+	if (!sender->demand.fps_milli) {
+		sender->next_frame = 0;
+		return;
+	}
+	uint64_t interval = 1000000000000ULL / sender->demand.fps_milli;
+	if (sender->next_frame && timestamp < sender->next_frame + interval) {
+		sender->next_frame += interval;
+	} else {
+		sender->next_frame = timestamp + interval;
+	}
+}
+
+/**
+ * Works out whether frames go through Spout's shared texture
+ * or through the shared-memory ring
+ */
+static bool spout_sender_use_texture(struct spout_sender *sender)
+{
+	if (sender->spoutptr == NULL) {
+		return false;
+	}
+
+	switch (sender->transport) {
+	case SPOUT_TRANSPORT_TEXTURE:
+		return true;
+	case SPOUT_TRANSPORT_MEMORY:
+		return false;
+	default:
+		return !sender->spoutptr->GetMemoryShareMode();
+	}
+}
+
+static bool spout_sender_create_ring(struct spout_sender *sender)
+{
+	size_t frame_size = (size_t)sender->width * sender->height * 4;
+	sender->ring = shm_ring_create(sender->name, frame_size,
+				       SHM_RING_DEFAULT_FRAMES);
+	if (!sender->ring) {
+		if (sender->send_status != -5) {
+			warn("Could not create shared memory sender");
+			sender->send_status = -5;
+		}
+		return false;
+	}
+	shm_ring_set_checksum(sender->ring, sender->checksum);
+	sender->demand_checked = 0;
+	sender->next_frame = 0;
+	sender->throttle_status = 0;
+	info("Publishing through shared memory (%dx%d%s)", sender->width,
+	     sender->height, sender->checksum ? ", CRC32C checksums" : "");
+	return true;
+}
+
+/**
+ * In auto mode a sender that can't get a shared texture
+ * carries on through the shared-memory ring instead
+ */
+static void spout_sender_texture_failed(struct spout_sender *sender)
+{
+	if (sender->transport != SPOUT_TRANSPORT_AUTO) {
+		return;
+	}
+	spout_sender_close(sender);
+	sender->transport = SPOUT_TRANSPORT_MEMORY;
+	spout_sender_create_ring(sender);
+}
+
+static bool spout_sender_send_texture(struct spout_sender *sender,
+				      const uint8_t *data, uint32_t linesize)
+{
+	// Spout needs an OpenGL context on the thread that sends,
+	// so create it lazily on the first frame
+	if (!sender->gl_ready) {
+		if (!sender->spoutptr->CreateOpenGL()) {
+			if (sender->send_status != -1) {
+				warn("Could not create OpenGL context for Spout");
+				sender->send_status = -1;
+			}
+			spout_sender_texture_failed(sender);
+			return false;
+		}
+		sender->gl_ready = true;
+	}
+
+	if (!sender->sender_created) {
+		if (!sender->spoutptr->CreateSender(sender->name, sender->width,
+						    sender->height)) {
+			if (sender->send_status != -2) {
+				warn("Could not create sender");
+				sender->send_status = -2;
+			}
+			spout_sender_texture_failed(sender);
+			return false;
+		}
+		sender->sender_created = true;
+		info("Publishing through a shared texture (%dx%d)",
+		     sender->width, sender->height);
+	}
+
+	const uint8_t *pixels = data;
+	uint32_t row = sender->width * 4;
+	if (linesize != row) {
+		size_t size = (size_t)row * sender->height;
+		if (!frame_pool_fit(&sender->packed, &sender->packed_size,
+				    size)) {
+			return false;
+		}
+		for (uint32_t y = 0; y < sender->height; y++) {
+			memcpy(sender->packed + (size_t)y * row,
+			       data + (size_t)y * linesize, row);
+		}
+		pixels = sender->packed;
+	}
+
+	if (!sender->spoutptr->SendImage(pixels, sender->width, sender->height,
+					 GL_BGRA_EXT)) {
+		if (sender->send_status != -3) {
+			warn("Sending failed");
+			sender->send_status = -3;
+		}
+		return false;
+	}
+	return true;
+}
+
+bool spout_sender_send(struct spout_sender *sender, const uint8_t *data,
+		       uint32_t linesize, uint32_t width, uint32_t height,
+		       uint64_t timestamp)
+{
+	if (width != sender->width || height != sender->height) {
+		sender->width = width;
+		sender->height = height;
+		if (sender->sender_created) {
+			sender->spoutptr->UpdateSender(sender->name, width,
+						       height);
+		}
+		// a ring only has to be recreated when frames outgrow it
+		if (sender->ring && (size_t)width * height * 4 >
+					    shm_ring_max_frame_size(sender->ring)) {
+			shm_ring_close(sender->ring);
+			sender->ring = NULL;
+		}
+	}
+
+	if (!sender->ring && !sender->sender_created &&
+	    !spout_sender_use_texture(sender) &&
+	    !spout_sender_create_ring(sender)) {
+		return false;
+	}
+
+	if (!sender->ring) {
+		if (!spout_sender_send_texture(sender, data, linesize)) {
+			return false;
+		}
+	} else if (!spout_sender_wants_frame(sender, timestamp)) {
+		return true;
+	} else if (!shm_ring_write(sender->ring, data, linesize, width, height,
+				   SHM_RING_FORMAT_BGRA, timestamp)) {
+		if (sender->send_status != -4) {
+			warn("Frame doesn't fit in the shared memory ring");
+			sender->send_status = -4;
+		}
+		return false;
+	} else {
+		spout_sender_frame_sent(sender, timestamp);
+	}
+
+	sender->send_status = 0;
+	return true;
+}
+
+void spout_sender_properties(obs_properties_t *props)
+{
+	obs_properties_add_text(props, SPOUT_SENDER_NAME,
+				obs_module_text("spoutname"), OBS_TEXT_DEFAULT);
+
+	obs_property_t *transport_list = obs_properties_add_list(
+		props, SPOUT_SENDER_TRANSPORT, obs_module_text("transport"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(transport_list,
+				  obs_module_text("transportauto"),
+				  SPOUT_TRANSPORT_AUTO);
+	obs_property_list_add_int(transport_list,
+				  obs_module_text("transporttexture"),
+				  SPOUT_TRANSPORT_TEXTURE);
+	obs_property_list_add_int(transport_list,
+				  obs_module_text("transportmemory"),
+				  SPOUT_TRANSPORT_MEMORY);
+
+	obs_properties_add_bool(props, SPOUT_SENDER_CHECKSUM,
+				obs_module_text("checksum"));
+	obs_properties_add_bool(props, SPOUT_SENDER_THROTTLE,
+				obs_module_text("throttle"));
+}
+
+void spout_sender_defaults(obs_data_t *settings, const char *name)
+{
+	obs_data_set_default_string(settings, SPOUT_SENDER_NAME, name);
+	obs_data_set_default_int(settings, SPOUT_SENDER_TRANSPORT,
+				 SPOUT_TRANSPORT_AUTO);
+	obs_data_set_default_bool(settings, SPOUT_SENDER_CHECKSUM, false);
+	obs_data_set_default_bool(settings, SPOUT_SENDER_THROTTLE, true);
+}
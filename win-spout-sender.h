@@ -0,0 +1,84 @@
+/**
+ * Publishing side shared by the Spout output and the Spout filter.
+ *
+ * A spout_sender owns one sender name for its whole lifetime. Names are
+ * reserved in the plugin's list of sender names on create and released on
+ * destroy, so two outputs/filters in the same OBS can never fight over
+ * the same name. Frames go through Spout's shared texture where possible
+ * and through the shared-memory ring (shm-ring.h) otherwise.
+ */
+#pragma once
+
+#include <obs-module.h>
+
+#define SPOUT_SENDER_NAME "spoutname"
+#define SPOUT_SENDER_TRANSPORT "transport"
+#define SPOUT_SENDER_CHECKSUM "checksum"
+#define SPOUT_SENDER_THROTTLE "throttle"
+
+#define SPOUT_TRANSPORT_AUTO 0
+#define SPOUT_TRANSPORT_TEXTURE 1
+#define SPOUT_TRANSPORT_MEMORY 2
+
+struct spout_sender;
+
+/**
+ * Reserves name in the plugin's list of sender names
+ * @return NULL if the name is empty or already published by this plugin
+ */
+struct spout_sender *spout_sender_create(const char *name, int transport);
+
+/**
+ * Frees the sender and its name. Once frames were sent,
+ * spout_sender_close has to be called on the sending thread first.
+ */
+void spout_sender_destroy(struct spout_sender *sender);
+
+/**
+ * Stops publishing: releases the shared texture and the OpenGL context
+ * Spout made current on the sending thread, or the shared-memory ring.
+ * Call from the thread that sends. Sending again publishes anew.
+ */
+void spout_sender_close(struct spout_sender *sender);
+
+/**
+ * Publishes one BGRA frame. Must always be called from the same thread,
+ * as Spout binds its OpenGL context to the thread that sends.
+ * @return bool success
+ */
+bool spout_sender_send(struct spout_sender *sender, const uint8_t *data,
+		       uint32_t linesize, uint32_t width, uint32_t height,
+		       uint64_t timestamp);
+
+/**
+ * Adds a CRC32C of each frame sent through shared memory, which receivers
+ * verify. Has no effect on shared textures.
+ */
+void spout_sender_set_checksum(struct spout_sender *sender, bool enabled);
+
+/**
+ * Publishes through shared memory only as often as its receivers ask
+ * for frames, and not at all while none of them shows the sender. On by
+ * default; has no effect on shared textures, whose receivers can't be
+ * counted.
+ */
+void spout_sender_set_throttle(struct spout_sender *sender, bool enabled);
+
+/**
+ * Whether spout_sender_send would publish a frame with this timestamp,
+ * so callers can skip preparing frames nobody takes
+ */
+bool spout_sender_wants_frame(struct spout_sender *sender, uint64_t timestamp);
+
+/**
+ * Receivers use it to leave the plugin's own senders out, receiving
+ * them would feed back into the source
+ * @return bool whether this plugin already publishes a sender called name
+ */
+bool spout_sender_name_in_use(const char *name);
+
+/**
+ * Adds the sender name, transport, checksum and throttle properties
+ */
+void spout_sender_properties(obs_properties_t *props);
+void spout_sender_defaults(obs_data_t *settings, const char *name);
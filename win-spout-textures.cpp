@@ -0,0 +1,64 @@
+/**
+ * Shared texture cache
+ *
+ * Opening a sender's shared handle creates a new D3D texture object each
+ * time. Sources that look at the same sender (atlas tiles, mosaic cells)
+ * go through this cache instead, so a sender is opened once and
+ * refcounted. All calls must be made inside obs_enter_graphics, which is
+ * also what serialises access to the cache.
+ */
+#include "win-spout.h"
+
+#include <util/darray.h>
+
+struct shared_texture {
+	HANDLE handle;
+	gs_texture_t *texture;
+	long refs;
+};
+
+static DARRAY(struct shared_texture) shared_textures;
+
+gs_texture_t *win_spout_texture_open(HANDLE handle)
+{
+	for (size_t i = 0; i < shared_textures.num; i++) {
+		struct shared_texture *entry = &shared_textures.array[i];
+		if (entry->handle == handle) {
+			entry->refs++;
+			return entry->texture;
+		}
+	}
+
+	gs_texture_t *texture = gs_texture_open_shared((uint32_t)handle);
+	if (!texture) {
+		return NULL;
+	}
+
+	struct shared_texture *entry = da_push_back_new(shared_textures);
+	entry->handle = handle;
+	entry->texture = texture;
+	entry->refs = 1;
+	return texture;
+}
+
+void win_spout_texture_close(gs_texture_t *texture)
+{
+	if (!texture) {
+		return;
+	}
+
+	for (size_t i = 0; i < shared_textures.num; i++) {
+		struct shared_texture *entry = &shared_textures.array[i];
+		if (entry->texture != texture) {
+			continue;
+		}
+		if (--entry->refs == 0) {
+			gs_texture_destroy(texture);
+			da_erase(shared_textures, i);
+			if (!shared_textures.num) {
+				da_free(shared_textures);
+			}
+		}
+		return;
+	}
+}
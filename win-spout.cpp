@@ -7,12 +7,30 @@
  * Many thanks to authors of https://github.com/baffler/OBS-OpenVR-Input-Plugin which
  * was used as guidance to working with the OBS Studio APIs
  */
-#include <obs-module.h>
+#include "win-spout.h"
+#include "win-spout-sender.h"
+#include "shm-ring.h"
+#include "frame-scale.h"
+#include "autocrop.h"
+#include "lut3d.h"
+#include "hdr-convert.h"
+#include "parallel-copy.h"
+#include "raw-file.h"
+#include "replay-buffer.h"
+#include "frame-pool.h"
+#include "frame-hash.h"
+#include "deadline.h"
+#include "init-batch.h"
+#include "sender-bind.h"
+
 #include <graphics/image-file.h>
+#include <graphics/vec2.h>
 #include <util/platform.h>
 #include <util/dstr.h>
+#include <util/threading.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <dxgiformat.h>
 
 #include "Include/SpoutLibrary.h"
 #ifdef _WIN64
@@ -24,9 +42,6 @@
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("win-spout", "en-US")
 
-#define blog(log_level, message, ...) \
-	blog(log_level, "[win_spout] " message, ##__VA_ARGS__)
-
 #define debug(message, ...)                                                    \
 	blog(LOG_DEBUG, "[%s] " message, obs_source_get_name(context->source), \
 	     ##__VA_ARGS__)
@@ -41,11 +56,67 @@ OBS_MODULE_USE_DEFAULT_LOCALE("win-spout", "en-US")
 #define USE_FIRST_AVAILABLE_SENDER "usefirstavailablesender"
 #define SPOUT_TICK_SPEED_LIMIT "tickspeedlimit"
 #define SPOUT_COMPOSITE_MODE "compositemode"
+#define SPOUT_CROP_X "cropx"
+#define SPOUT_CROP_Y "cropy"
+#define SPOUT_CROP_WIDTH "cropwidth"
+#define SPOUT_CROP_HEIGHT "cropheight"
+#define SPOUT_AUTOCROP "autocrop"
+#define SPOUT_AUTOCROP_THRESHOLD "autocropthreshold"
+#define SPOUT_AUTOCROP_INTERVAL "autocropinterval"
+#define SPOUT_FLIP_H "fliphorizontal"
+#define SPOUT_FLIP_V "flipvertical"
+#define SPOUT_COLOR_KEY "colorkey"
+#define SPOUT_KEY_COLOR "keycolor"
+#define SPOUT_KEY_SIMILARITY "keysimilarity"
+#define SPOUT_KEY_SMOOTHNESS "keysmoothness"
+#define SPOUT_ALPHA_FROM_LUMA "alphafromluma"
+#define SPOUT_GAMMA "gamma"
+#define SPOUT_LUT_FILE "lutfile"
+#define SPOUT_COLOR_TRANSFER "colortransfer"
+#define SPOUT_TONEMAP "tonemapsdr"
+#define SPOUT_SKIP_DUPLICATES "skipduplicates"
+#define SPOUT_INGEST_SCALE "ingestscale"
+#define SPOUT_RECORD_RAW "recordraw"
+#define SPOUT_RECORD_RAW_PATH "recordrawpath"
+#define SPOUT_REPLAY_MEMORY "replaymemory"
+#define SPOUT_REPLAY_SCALE "replayscale"
+#define SPOUT_REPLAY_COMPRESS "replaycompress"
+
+// auto crop scans a copy no wider than this
+#define AUTOCROP_SAMPLE_WIDTH 512
+
+// ingest never reduces a sender below this
+#define INGEST_MIN_SIZE 16
+
+// frames a raw recording can queue for the disk
+#define RAW_RECORD_BUFFERS 8
+
+// largest texture a Direct3D 11 device can create
+#define MAX_TEXTURE_SIZE 16384
+// tiles fit feature level 10 devices too
+#define TILE_SIZE 8192
 
 #define COMPOSITE_MODE_OPAQUE 1
 #define COMPOSITE_MODE_ALPHA 2
 #define COMPOSITE_MODE_DEFAULT 3
 
+#define GAMMA_MODE_NONE 0
+#define GAMMA_MODE_TO_LINEAR 1
+#define GAMMA_MODE_TO_SRGB 2
+
+// otherwise one of shm_ring_transfer
+#define COLOR_TRANSFER_AUTO -1
+
+// data/spout-draw.effect, shared by all sources
+static gs_effect_t *draw_effect = NULL;
+
+// oversize senders seen by all sources, logged on unload
+static volatile long oversize_tiled = 0;
+static volatile long oversize_refused = 0;
+
+// video ticks taking longer than this are logged while they're stuck
+#define TICK_STALL_THRESHOLD_MS 100
+
 struct win_spout {
 	obs_source_t *source;
 
@@ -58,9 +129,113 @@ struct win_spout {
 	HANDLE dxHandle;
 	DWORD dxFormat;
 
-	SPOUTHANDLE spoutptr;
+	// Spout's sender registry, shared by all sources
+	struct spout_registry *registry;
+	struct stall_section tick_section;
+
+	// set when the sender is received through the shared-memory ring
+	// instead of a shared texture
+	struct shm_ring *ring;
+	uint64_t ring_seq;
+	// frame whose pixels frame_buffer holds, 0 if none, for dirty
+	// rectangle reads
+	uint64_t buffer_seq;
+	// checksum mismatches of ring frames already reported
+	uint64_t ring_mismatches;
+	// content hash of the last ring frame uploaded, so frames a paused
+	// sender republishes unchanged are skipped
+	bool skip_duplicates;
+	bool frame_hash_valid;
+	uint64_t frame_hash;
+	uint32_t frame_hash_width;
+	uint32_t frame_hash_height;
+	uint32_t frame_hash_format;
+	uint32_t frame_hash_transfer;
+	uint64_t ring_frames;
+	uint64_t ring_duplicates;
+
+	// for senders with dirty rectangles texture isn't dynamic, frames
+	// are staged in patch_texture and only their rectangles copied over
+	gs_texture_t *patch_texture;
+	// frame whose pixels texture holds
+	uint64_t texture_seq;
+	uint64_t patched_frames;
+	uint64_t patched_bytes;
+	uint64_t patched_frame_bytes;
+	uint8_t *frame_buffer;
+	size_t frame_buffer_size;
+
+	// colour LUT applied while copying ring frames, swapped by update
+	struct lut3d *lut;
+	char lut_path[512];
+	pthread_mutex_t lut_mutex;
+
+	// transfer function of the pixels in our own upload texture
+	uint32_t ring_transfer;
+	// HDR ring frames converted to SDR BGRA on the CPU
+	bool tonemap;
+	struct hdr_tonemap *hdr_tonemap;
+	float tonemap_white;
+	float tonemap_peak;
+	uint8_t *tonemap_buffer;
+	size_t tonemap_buffer_size;
+
+	int color_transfer;
+
+	// reduced copy of the sender, ingest_scale halvings
+	uint32_t ingest_scale;
+	// halvings already applied to texture on the CPU
+	uint32_t texture_shift;
+	gs_texrender_t *ingest_texrender;
+	enum gs_color_format ingest_format;
+	bool ingest_rendered;
+	uint8_t *ingest_buffer;
+	size_t ingest_buffer_size;
+
+	// ring frames too large for one texture, uploaded as a grid
+	// of TILE_SIZE tiles instead of texture
+	gs_texture_t **tiles;
+	uint32_t tile_cols;
+	uint32_t tile_rows;
+	uint32_t tiles_width;
+	uint32_t tiles_height;
+	enum gs_color_format tiles_format;
+	struct parallel_copy_job *tile_jobs;
+	size_t tile_jobs_size;
+
+	// raw recording of ring frames, swapped under raw_mutex
+	struct raw_writer *raw_writer;
+	char raw_path[512];
+	pthread_mutex_t raw_mutex;
+
+	// instant replay, the buffer is swapped under replay_mutex
+	struct replay_buffer *replay;
+	pthread_mutex_t replay_mutex;
+	size_t replay_memory;
+	uint32_t replay_scale;
+	bool replay_compress;
+	enum gs_color_format replay_format;
+	uint8_t *replay_scaled;
+	size_t replay_scaled_size;
+	// texture senders are read back one frame late
+	gs_texrender_t *replay_texrender;
+	gs_stagesurf_t *replay_stage;
+	bool replay_staged;
+	bool replay_rendered;
+	// playback, toggled by the hotkey
+	obs_hotkey_id replay_hotkey;
+	volatile bool replay_toggle;
+	bool replay_playing;
+	double replay_clock;
+	size_t replay_index;
+	gs_texture_t *replay_texture;
+	uint8_t *replay_pixels;
+	size_t replay_pixels_size;
 
 	ULONGLONG lastCheckTick;
+	// last time an initialised texture source asked the registry
+	// whether its sender is still there
+	ULONGLONG lastLivenessTick;
 
 	int width;
 	int height;
@@ -72,29 +247,65 @@ struct win_spout {
 
 	ULONGLONG composite_mode;
 
+	// part of the sender texture to show, a zero size means
+	// up to the right / bottom edge
+	uint32_t crop_x;
+	uint32_t crop_y;
+	uint32_t crop_width;
+	uint32_t crop_height;
+
+	// automatic letterbox / pillarbox crop, in sender pixels
+	bool autocrop;
+	uint8_t autocrop_threshold;
+	ULONGLONG autocrop_interval;
+	ULONGLONG autocrop_last;
+	bool autocrop_valid;
+	struct autocrop_rect autocrop_rect;
+	struct autocrop_rect autocrop_pending;
+	gs_texrender_t *autocrop_texrender;
+	gs_stagesurf_t *autocrop_stage;
+	bool autocrop_staged;
+	uint32_t autocrop_shift;
+	uint8_t *autocrop_buffer;
+	size_t autocrop_buffer_size;
+	uint64_t autocrop_scans;
+	uint64_t autocrop_time_ns;
+
+	// drawing options, applied in one pass of draw_effect
+	bool flip_h;
+	bool flip_v;
+	bool color_key;
+	struct vec4 key_color;
+	float key_similarity;
+	float key_smoothness;
+	bool alpha_from_luma;
+	int gamma_mode;
+
 	int spout_status;
 	int render_status;
 	int tick_status;
-	bool should_release;
+	// for the next batched init, see win_spout_init_batch
+	struct init_batch_entry init_entry;
 };
 
 /**
  * Writes sender texture details (width & height) to the context
- * @return bool success
+ * @return one of spout_call_result
  */
-static bool win_spout_store_sender_info(win_spout *context)
+static int win_spout_store_sender_info(win_spout *context)
 {
 	unsigned int width, height;
 	// get info about this active sender:
-	if (!context->spoutptr->GetSenderInfo(context->senderName, width,
-					      height, context->dxHandle,
-					      context->dxFormat)) {
-		return false;
+	int result = spout_registry_sender_info(
+		context->registry, context->senderName, &width, &height,
+		&context->dxHandle, &context->dxFormat);
+	if (result != SPOUT_CALL_OK) {
+		return result;
 	}
 
 	context->width = width;
 	context->height = height;
-	return true;
+	return SPOUT_CALL_OK;
 }
 
 /**
@@ -105,11 +316,28 @@ static bool win_spout_store_sender_info(win_spout *context)
  */
 static bool win_spout_sender_has_changed(win_spout *context)
 {
+	if (context->ring) {
+		return shm_ring_is_closed(context->ring);
+	}
+
+	// a registry round trip per source per frame adds up, the poll time
+	// bounds how soon a change shows as it does for new senders
+	if (GetTickCount64() - context->lastLivenessTick <
+	    context->tick_speed_limit) {
+		return false;
+	}
+	context->lastLivenessTick = GetTickCount64();
+
 	DWORD oldFormat = context->dxFormat;
 	auto oldWidth = context->width;
 	auto oldHeight = context->height;
 
-	if (!win_spout_store_sender_info(context)) {
+	int result = win_spout_store_sender_info(context);
+	if (result == SPOUT_CALL_SKIPPED) {
+		// the registry is hung, look again next tick
+		return false;
+	}
+	if (result != SPOUT_CALL_OK) {
 		// assume that if it fails, it has changed
 		// ie sender no longer exists
 		return true;
@@ -121,94 +349,365 @@ static bool win_spout_sender_has_changed(win_spout *context)
 	return false;
 }
 
-static void win_spout_init(void *data, bool forced = false)
+/**
+ * Tells a shared-memory sender that this source shows its frames, at the
+ * OBS frame rate, and whether it's on air. Hidden sources close the ring,
+ * which takes them off the sender's count.
+ */
+static void win_spout_publish_demand(win_spout *context, bool program)
 {
-	struct win_spout *context = (win_spout *)data;
-	if (context->initialized) {
-		context->spout_status = 0;
+	if (!context->ring) {
 		return;
 	}
+	uint32_t fps_milli = 0;
+	struct obs_video_info ovi;
+	if (obs_get_video_info(&ovi) && ovi.fps_den) {
+		fps_milli = (uint32_t)((uint64_t)ovi.fps_num * 1000 /
+				       ovi.fps_den);
+	}
+	uint32_t flags = SHM_RING_CONSUMER_ACTIVE;
+	if (program) {
+		flags |= SHM_RING_CONSUMER_PROGRAM;
+	}
+	shm_ring_set_demand(context->ring, flags, fps_milli);
+}
 
-	if (GetTickCount64() - context->lastCheckTick <
-		    context->tick_speed_limit &&
-	    !forced) {
-		return;
+/**
+ * Connects to a sender published through the shared-memory ring
+ * @return bool success
+ */
+static bool win_spout_init_memory(win_spout *context)
+{
+	context->ring = shm_ring_open(context->senderName);
+	if (!context->ring) {
+		return false;
 	}
-	context->lastCheckTick = GetTickCount64();
+	info("Receiving sender %s through shared memory", context->senderName);
+	win_spout_publish_demand(context, obs_source_active(context->source));
+	context->ring_seq = 0;
+	context->spout_status = 0;
+	context->initialized = true;
+	return true;
+}
 
-	if (context->spoutptr == NULL) {
-		if (context->spout_status != -1) {
-			warn("Spout pointer didn't exist");
-			context->spout_status = -1;
-		}
-		return;
+static void store_first_ring_sender(void *param, const char *name)
+{
+	char *senderName = (char *)param;
+	if (!*senderName && !spout_sender_name_in_use(name)) {
+		strncpy(senderName, name, 255);
 	}
-	int totalSenders = context->spoutptr->GetSenderCount();
-	if (totalSenders == 0) {
+}
+
+/**
+ * Picks the sender to receive from a registry snapshot, or connects to a
+ * shared-memory sender instead
+ * @return bool whether there's a Spout sender to open
+ */
+static bool win_spout_find_sender(win_spout *context,
+				  const char (*senderNames)[256],
+				  int totalSenders)
+{
+	int bindIndex = -1;
+	if (context->useFirstSender) {
+		// bound by name to this source only, Spout's active sender is
+		// shared by every receiver on the machine and isn't touched.
+		// Never the plugin's own outputs and filters: a source showing
+		// its own sender would feed back into itself.
+		bindIndex = sender_bind_first_available(
+			context->senderName, senderNames, totalSenders,
+			spout_sender_name_in_use);
+	}
+
+	if (totalSenders == 0 || (context->useFirstSender && bindIndex < 0)) {
+		// no Spout senders, but there may be shared memory ones
+		if (context->useFirstSender) {
+			memset(context->senderName, 0, 256);
+			shm_ring_enum_senders(store_first_ring_sender,
+					      context->senderName);
+		}
+		if (win_spout_init_memory(context)) {
+			return false;
+		}
+		if (context->registry == NULL) {
+			if (context->spout_status != -1) {
+				warn("Spout pointer didn't exist");
+				context->spout_status = -1;
+			}
+			return false;
+		}
 		if (context->spout_status != -2) {
 			info("No active Spout cameras");
 			context->spout_status = -2;
 		}
-		return;
+		return false;
 	}
 
 	if (context->useFirstSender) {
-		if (context->spoutptr->GetSenderName(0, context->senderName)) {
-			if (!context->spoutptr->SetActiveSender(
-				    context->senderName)) {
-				if (context->spout_status != -4) {
-					info("WoW , i can't set active sender as %s",
-					     context->senderName);
-					context->spout_status = -4;
-				}
-				return;
-			}
-		} else {
-			if (context->spout_status != -3) {
-				info("Strange , there is a sender without name ?");
-				context->spout_status = -3;
-			}
-			return;
+		if (strcmp(senderNames[bindIndex], context->senderName) != 0) {
+			memset(context->senderName, 0, 256);
+			strncpy(context->senderName, senderNames[bindIndex],
+				255);
 		}
+		context->spout_status = 0;
 	} else {
-		int index;
-		char senderName[256];
 		bool exists = false;
-		// then get the name of each sender from SPOUT
-		for (index = 0; index < totalSenders; index++) {
-			context->spoutptr->GetSenderName(index, senderName);
-			if (strcmp(senderName, context->senderName) == 0) {
+		for (int index = 0; index < totalSenders; index++) {
+			if (strcmp(senderNames[index], context->senderName) ==
+			    0) {
 				exists = true;
 				break;
 			}
 		}
+		if (!exists && win_spout_init_memory(context)) {
+			return false;
+		}
 		if (!exists) {
 			if (context->spout_status != -5) {
 				info("Sorry, Sender Name %s not found",
 				     context->senderName);
 				context->spout_status = -5;
 			}
-			return;
+			return false;
 		} else {
 			context->spout_status = 0;
 		}
 	}
+	return true;
+}
+
+/**
+ * Picks the sender from a registry snapshot and looks its texture up
+ * @return bool whether there's a shared texture to open, false if there's
+ *         none yet, or the source is receiving through shared memory
+ */
+static bool win_spout_init_lookup(win_spout *context,
+				  const char (*senderNames)[256],
+				  int totalSenders)
+{
+	if (!win_spout_find_sender(context, senderNames, totalSenders)) {
+		return false;
+	}
 
 	info("Getting info for sender %s", context->senderName);
-	if (!win_spout_store_sender_info(context)) {
+	int result = win_spout_store_sender_info(context);
+	if (result == SPOUT_CALL_SKIPPED) {
+		return false;
+	} else if (result != SPOUT_CALL_OK) {
 		warn("Named %s sender not found", context->senderName);
 	} else {
 		info("Sender %s is of dimensions %d x %d", context->senderName,
 		     context->width, context->height);
 	};
+	return true;
+}
+
+/**
+ * Opens the texture win_spout_init_lookup found. Call inside
+ * obs_enter_graphics.
+ */
+static void win_spout_init_texture(win_spout *context)
+{
+	win_spout_texture_close(context->texture);
+	context->texture = win_spout_texture_open(context->dxHandle);
+
+	if (!context->texture && context->spout_status != -6) {
+		if (context->width > MAX_TEXTURE_SIZE ||
+		    context->height > MAX_TEXTURE_SIZE) {
+			warn("Sender %s is %d x %d, larger than a GPU texture "
+			     "can be (%d); publish it through shared memory "
+			     "to receive it in tiles",
+			     context->senderName, context->width,
+			     context->height, MAX_TEXTURE_SIZE);
+			os_atomic_inc_long(&oversize_refused);
+		} else {
+			warn("Couldn't open the shared texture of sender %s",
+			     context->senderName);
+		}
+		context->spout_status = -6;
+	}
+
+	// the lookup that found the sender counts as its first check
+	context->lastLivenessTick = GetTickCount64();
+	context->initialized = true;
+}
+
+/**
+ * Takes a snapshot of the Spout sender names
+ * @return one of spout_call_result; names is NULL unless it's
+ *         SPOUT_CALL_OK, and has to be freed with bfree
+ */
+static int win_spout_snapshot(struct spout_registry *registry,
+			      char (**names)[256], int *total)
+{
+	*names = NULL;
+	*total = 0;
+	if (registry == NULL) {
+		// no Spout, shared-memory senders only
+		return SPOUT_CALL_OK;
+	}
+	*names = (char(*)[256])bmalloc(sizeof(**names) *
+				       SPOUT_REGISTRY_MAX_SENDERS);
+	int result = spout_registry_sender_names(registry, *names, total);
+	if (result != SPOUT_CALL_OK) {
+		bfree(*names);
+		*names = NULL;
+		*total = 0;
+	}
+	return result;
+}
+
+static void win_spout_init(void *data)
+{
+	struct win_spout *context = (win_spout *)data;
+	if (context->initialized) {
+		context->spout_status = 0;
+		return;
+	}
+
+	if (GetTickCount64() - context->lastCheckTick <
+	    context->tick_speed_limit) {
+		return;
+	}
+	context->lastCheckTick = GetTickCount64();
+
+	int totalSenders = 0;
+	char(*senderNames)[256] = NULL;
+	if (win_spout_snapshot(context->registry, &senderNames,
+			       &totalSenders) == SPOUT_CALL_SKIPPED) {
+		// the registry is hung, try again on a later tick
+		return;
+	}
+	bool found = win_spout_init_lookup(
+		context, (const char(*)[256])senderNames, totalSenders);
+	bfree(senderNames);
+	if (!found) {
+		return;
+	}
 
 	obs_enter_graphics();
-	gs_texture_destroy(context->texture);
-	context->should_release = true;
-	context->texture = gs_texture_open_shared((uint32_t)context->dxHandle);
+	win_spout_init_texture(context);
 	obs_leave_graphics();
+}
 
-	context->initialized = true;
+/* ------------------------------------------------------------------------- */
+/* Batched init
+ *
+ * Sources that are shown don't initialise straight away: they are queued
+ * and all initialised together by a tick callback, which OBS runs before
+ * the sources' own ticks, with one registry snapshot and one graphics
+ * section between them. Loading a scene collection with many sources
+ * then costs one enumeration instead of one per source.
+ */
+
+// NULL if it couldn't be created, sources then initialise on their own
+static struct init_batch *init_batch;
+
+static void win_spout_queue_init(win_spout *context)
+{
+	if (init_batch) {
+		init_batch_queue(init_batch, &context->init_entry, context);
+	}
+}
+
+/**
+ * Takes the source off the queue, and waits if the running batch is
+ * initialising it. Not inside obs_enter_graphics, the batch may be waiting
+ * for it.
+ */
+static void win_spout_unqueue_init(win_spout *context)
+{
+	if (init_batch) {
+		init_batch_unqueue(init_batch, &context->init_entry);
+	}
+}
+
+static bool win_spout_init_queued(win_spout *context)
+{
+	return init_batch && init_batch_pending(init_batch, &context->init_entry);
+}
+
+static bool win_spout_init_entries(void *param,
+				   struct init_batch_entry **entries,
+				   size_t count)
+{
+	UNUSED_PARAMETER(param);
+
+	// all sources share the registry
+	struct spout_registry *registry =
+		((win_spout *)entries[0]->data)->registry;
+	int totalSenders = 0;
+	char(*senderNames)[256] = NULL;
+	if (win_spout_snapshot(registry, &senderNames, &totalSenders) ==
+	    SPOUT_CALL_SKIPPED) {
+		// keep them queued, the registry is hung
+		return false;
+	}
+
+	size_t opening = 0;
+	for (size_t i = 0; i < count; i++) {
+		struct win_spout *context = (win_spout *)entries[i]->data;
+		context->lastCheckTick = GetTickCount64();
+		if (context->initialized ||
+		    !win_spout_init_lookup(context,
+					   (const char(*)[256])senderNames,
+					   totalSenders)) {
+			continue;
+		}
+		// keep the sources with a texture to open at the front
+		struct init_batch_entry *entry = entries[opening];
+		entries[opening++] = entries[i];
+		entries[i] = entry;
+	}
+	bfree(senderNames);
+
+	if (opening) {
+		obs_enter_graphics();
+		for (size_t i = 0; i < opening; i++) {
+			win_spout_init_texture((win_spout *)entries[i]->data);
+		}
+		obs_leave_graphics();
+	}
+	return true;
+}
+
+static void win_spout_init_batch(void *param, float seconds)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(seconds);
+
+	if (init_batch) {
+		init_batch_run(init_batch, win_spout_init_entries, NULL);
+	}
+}
+
+static void win_spout_destroy_tiles(win_spout *context)
+{
+	if (!context->tiles) {
+		return;
+	}
+	obs_enter_graphics();
+	for (uint32_t i = 0; i < context->tile_cols * context->tile_rows;
+	     i++) {
+		gs_texture_destroy(context->tiles[i]);
+	}
+	obs_leave_graphics();
+	bfree(context->tiles);
+	context->tiles = NULL;
+	context->tile_cols = 0;
+	context->tile_rows = 0;
+}
+
+/**
+ * Destroys the texture frames from the ring are uploaded to. Call in the
+ * graphics context.
+ */
+static void win_spout_destroy_texture(win_spout *context)
+{
+	gs_texture_destroy(context->texture);
+	gs_texture_destroy(context->patch_texture);
+	context->texture = NULL;
+	context->patch_texture = NULL;
+	context->texture_seq = 0;
 }
 
 static void win_spout_deinit(void *data)
@@ -217,15 +716,53 @@ static void win_spout_deinit(void *data)
 	context->initialized = false;
 	if (context->texture) {
 		obs_enter_graphics();
-		gs_texture_destroy(context->texture);
+		if (context->ring) {
+			// our own upload texture
+			win_spout_destroy_texture(context);
+		} else {
+			win_spout_texture_close(context->texture);
+		}
 		obs_leave_graphics();
 		context->texture = NULL;
 	}
-	// cleanup spout
-	if (context->should_release) {
-		context->spoutptr->ReleaseReceiver();
-		context->should_release = false;
+	win_spout_destroy_tiles(context);
+	if (context->ring) {
+		uint64_t verified, mismatched;
+		shm_ring_checksum_stats(context->ring, &verified, &mismatched);
+		if (verified) {
+			info("Checksums: %llu frames verified, %llu mismatched",
+			     (unsigned long long)verified,
+			     (unsigned long long)mismatched);
+		}
+		if (context->ring_duplicates) {
+			info("%llu of %llu frames were unchanged and not "
+			     "uploaded (%.1f%%)",
+			     (unsigned long long)context->ring_duplicates,
+			     (unsigned long long)context->ring_frames,
+			     100.0 * (double)context->ring_duplicates /
+				     (double)context->ring_frames);
+		}
+		if (context->patched_frames) {
+			info("%llu frames patched by dirty rectangles, "
+			     "uploading %.1f%% of their pixels",
+			     (unsigned long long)context->patched_frames,
+			     100.0 * (double)context->patched_bytes /
+				     (double)context->patched_frame_bytes);
+		}
+		shm_ring_close(context->ring);
+		context->ring = NULL;
+		context->buffer_seq = 0;
+		context->ring_mismatches = 0;
+		context->frame_hash_valid = false;
+		context->ring_frames = 0;
+		context->ring_duplicates = 0;
+		context->patched_frames = 0;
+		context->patched_bytes = 0;
+		context->patched_frame_bytes = 0;
 	}
+	context->autocrop_valid = false;
+	context->autocrop_staged = false;
+	context->texture_shift = 0;
 }
 
 static const char *win_spout_get_name(void *unused)
@@ -234,6 +771,126 @@ static const char *win_spout_get_name(void *unused)
 	return obs_module_text("sourcename");
 }
 
+/**
+ * Loads the LUT when its path has changed; the file is read here
+ * and the result swapped in under the lock the receive path holds
+ */
+static void win_spout_update_lut(win_spout *context, const char *path)
+{
+	if (strcmp(context->lut_path, path) == 0) {
+		return;
+	}
+	memset(context->lut_path, 0, sizeof(context->lut_path));
+	strncpy(context->lut_path, path, sizeof(context->lut_path) - 1);
+
+	struct lut3d *lut = NULL;
+	if (*path) {
+		lut = lut3d_load_cube(path);
+		if (lut) {
+			uint32_t size = lut3d_size(lut);
+			info("Loaded %ux%ux%u LUT %s", size, size, size, path);
+		} else {
+			warn("Could not load LUT %s", path);
+		}
+	}
+
+	pthread_mutex_lock(&context->lut_mutex);
+	struct lut3d *old = context->lut;
+	context->lut = lut;
+	// frame_buffer went through the old LUT, read the next frame whole
+	context->buffer_seq = 0;
+	pthread_mutex_unlock(&context->lut_mutex);
+	lut3d_destroy(old);
+}
+
+/**
+ * Logs what a finished raw recording wrote
+ */
+static void win_spout_close_raw(win_spout *context, struct raw_writer *writer)
+{
+	if (!writer) {
+		return;
+	}
+	struct raw_writer_stats stats;
+	raw_writer_close(writer, &stats);
+	double seconds = (double)stats.write_ns / 1000000000.0;
+	info("raw recording %s: %llu frames, %llu dropped, %.0f MB/s%s",
+	     context->raw_path, (unsigned long long)stats.frames,
+	     (unsigned long long)stats.dropped,
+	     seconds > 0.0 ? (double)stats.bytes / 1000000.0 / seconds : 0.0,
+	     stats.failed ? ", a write failed" : "");
+}
+
+/**
+ * Starts a raw recording in a new file of directory, or stops it;
+ * the writer is swapped in under the lock the receive path holds
+ */
+static void win_spout_update_raw(win_spout *context, bool record,
+				 const char *directory)
+{
+	if (record == (context->raw_writer != NULL)) {
+		return;
+	}
+
+	struct raw_writer *writer = NULL;
+	if (record) {
+		if (!*directory) {
+			warn("Raw recording needs a directory");
+			return;
+		}
+		char *name = os_generate_formatted_filename(
+			"spraw", true, "Spout %CCYY-%MM-%DD %hh-%mm-%ss");
+		snprintf(context->raw_path, sizeof(context->raw_path), "%s/%s",
+			 directory, name);
+		bfree(name);
+
+		writer = raw_writer_open(context->raw_path, context->senderName,
+					 RAW_RECORD_BUFFERS);
+		if (!writer) {
+			warn("Could not create raw recording %s",
+			     context->raw_path);
+			return;
+		}
+		info("Recording raw frames to %s", context->raw_path);
+	}
+
+	pthread_mutex_lock(&context->raw_mutex);
+	struct raw_writer *old = context->raw_writer;
+	context->raw_writer = writer;
+	pthread_mutex_unlock(&context->raw_mutex);
+	win_spout_close_raw(context, old);
+}
+
+/**
+ * (Re)allocates the replay buffer when its memory changes, and empties
+ * it when the frames it holds would no longer match the settings
+ */
+static void win_spout_update_replay(win_spout *context, size_t memory,
+				    uint32_t scale, bool compress)
+{
+	pthread_mutex_lock(&context->replay_mutex);
+	struct replay_buffer *old = NULL;
+	if (memory != context->replay_memory) {
+		old = context->replay;
+		context->replay = NULL;
+		if (memory) {
+			context->replay = replay_buffer_create(memory);
+			if (!context->replay) {
+				warn("Could not allocate a %zu MB replay buffer",
+				     memory / (1024 * 1024));
+			}
+		}
+		context->replay_memory = memory;
+	} else if (context->replay && (scale != context->replay_scale ||
+				       compress != context->replay_compress)) {
+		replay_buffer_clear(context->replay);
+	}
+	context->replay_scale = scale;
+	context->replay_compress = compress;
+	pthread_mutex_unlock(&context->replay_mutex);
+	replay_buffer_destroy(old);
+}
+
 static void win_spout_update(void *data, obs_data_t *settings)
 {
 	struct win_spout *context = (win_spout *)data;
@@ -254,6 +911,62 @@ static void win_spout_update(void *data, obs_data_t *settings)
 	auto compositeMode = obs_data_get_int(settings, SPOUT_COMPOSITE_MODE);
 	context->composite_mode = compositeMode;
 
+	context->crop_x = (uint32_t)obs_data_get_int(settings, SPOUT_CROP_X);
+	context->crop_y = (uint32_t)obs_data_get_int(settings, SPOUT_CROP_Y);
+	context->crop_width =
+		(uint32_t)obs_data_get_int(settings, SPOUT_CROP_WIDTH);
+	context->crop_height =
+		(uint32_t)obs_data_get_int(settings, SPOUT_CROP_HEIGHT);
+
+	context->autocrop = obs_data_get_bool(settings, SPOUT_AUTOCROP);
+	context->autocrop_threshold =
+		(uint8_t)obs_data_get_int(settings, SPOUT_AUTOCROP_THRESHOLD);
+	context->autocrop_interval =
+		obs_data_get_int(settings, SPOUT_AUTOCROP_INTERVAL);
+	context->autocrop_valid = false;
+	context->autocrop_last = 0;
+
+	context->flip_h = obs_data_get_bool(settings, SPOUT_FLIP_H);
+	context->flip_v = obs_data_get_bool(settings, SPOUT_FLIP_V);
+	context->color_key = obs_data_get_bool(settings, SPOUT_COLOR_KEY);
+	vec4_from_rgba(&context->key_color,
+		       (uint32_t)obs_data_get_int(settings, SPOUT_KEY_COLOR));
+	context->key_similarity =
+		(float)obs_data_get_int(settings, SPOUT_KEY_SIMILARITY) /
+		1000.0f;
+	context->key_smoothness =
+		(float)obs_data_get_int(settings, SPOUT_KEY_SMOOTHNESS) /
+		1000.0f;
+	if (context->key_smoothness < 0.001f) {
+		context->key_smoothness = 0.001f;
+	}
+	context->alpha_from_luma =
+		obs_data_get_bool(settings, SPOUT_ALPHA_FROM_LUMA);
+	context->gamma_mode = (int)obs_data_get_int(settings, SPOUT_GAMMA);
+
+	win_spout_update_lut(context,
+			     obs_data_get_string(settings, SPOUT_LUT_FILE));
+
+	context->color_transfer =
+		(int)obs_data_get_int(settings, SPOUT_COLOR_TRANSFER);
+	context->tonemap = obs_data_get_bool(settings, SPOUT_TONEMAP);
+	context->skip_duplicates =
+		obs_data_get_bool(settings, SPOUT_SKIP_DUPLICATES);
+	context->ingest_scale =
+		(uint32_t)obs_data_get_int(settings, SPOUT_INGEST_SCALE);
+
+	win_spout_update_raw(context,
+			     obs_data_get_bool(settings, SPOUT_RECORD_RAW),
+			     obs_data_get_string(settings,
+						 SPOUT_RECORD_RAW_PATH));
+
+	win_spout_update_replay(
+		context,
+		(size_t)obs_data_get_int(settings, SPOUT_REPLAY_MEMORY) * 1024 *
+			1024,
+		(uint32_t)obs_data_get_int(settings, SPOUT_REPLAY_SCALE),
+		obs_data_get_bool(settings, SPOUT_REPLAY_COMPRESS));
+
 	if (context->initialized) {
 		win_spout_deinit(data);
 		win_spout_init(data);
@@ -265,63 +978,1117 @@ static void win_spout_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, SPOUT_SENDER_LIST,
 				    USE_FIRST_AVAILABLE_SENDER);
 	obs_data_set_default_int(settings, "tickspeedlimit", 100);
+	obs_data_set_default_int(settings, SPOUT_AUTOCROP_THRESHOLD, 16);
+	obs_data_set_default_int(settings, SPOUT_AUTOCROP_INTERVAL, 1000);
+	obs_data_set_default_int(settings, SPOUT_KEY_COLOR, 0xFF00FF00);
+	obs_data_set_default_int(settings, SPOUT_KEY_SIMILARITY, 80);
+	obs_data_set_default_int(settings, SPOUT_KEY_SMOOTHNESS, 50);
+	obs_data_set_default_int(settings, SPOUT_GAMMA, GAMMA_MODE_NONE);
+	obs_data_set_default_int(settings, SPOUT_INGEST_SCALE, 0);
+	obs_data_set_default_bool(settings, SPOUT_SKIP_DUPLICATES, true);
+	obs_data_set_default_int(settings, SPOUT_COLOR_TRANSFER,
+				 COLOR_TRANSFER_AUTO);
 }
 
-static uint32_t win_spout_getwidth(void *data)
+/**
+ * Halvings the ingest resolution applies to the current sender,
+ * stopping short of INGEST_MIN_SIZE
+ */
+static uint32_t win_spout_ingest_shift(win_spout *context)
 {
-	struct win_spout *context = (win_spout *)data;
-	return context->width;
+	if (!draw_effect) {
+		// formats the CPU can't halve are reduced with draw_effect
+		return 0;
+	}
+	uint32_t shift = context->ingest_scale;
+	while (shift && (((uint32_t)context->width >> shift) < INGEST_MIN_SIZE ||
+			 ((uint32_t)context->height >> shift) <
+				 INGEST_MIN_SIZE)) {
+		shift--;
+	}
+	return shift;
 }
 
-static uint32_t win_spout_getheight(void *data)
+/**
+ * Works out the part of the sender texture this source shows,
+ * clamped to the texture, in sender pixels
+ */
+static void win_spout_sender_rect(win_spout *context, uint32_t *x, uint32_t *y,
+				  uint32_t *cx, uint32_t *cy)
 {
-	struct win_spout *context = (win_spout *)data;
-	return context->height;
+	uint32_t width = (uint32_t)context->width;
+	uint32_t height = (uint32_t)context->height;
+
+	*x = context->crop_x < width ? context->crop_x : 0;
+	*y = context->crop_y < height ? context->crop_y : 0;
+	*cx = width - *x;
+	*cy = height - *y;
+	if (context->crop_width && context->crop_width < *cx) {
+		*cx = context->crop_width;
+	}
+	if (context->crop_height && context->crop_height < *cy) {
+		*cy = context->crop_height;
+	}
+
+	if (!context->autocrop || !context->autocrop_valid) {
+		return;
+	}
+
+	// detected content bounds within the manual crop
+	const struct autocrop_rect *content = &context->autocrop_rect;
+	uint32_t x1 = *x + *cx, y1 = *y + *cy;
+	uint32_t cx1 = content->x + content->cx, cy1 = content->y + content->cy;
+	uint32_t left = content->x > *x ? content->x : *x;
+	uint32_t top = content->y > *y ? content->y : *y;
+	uint32_t right = cx1 < x1 ? cx1 : x1;
+	uint32_t bottom = cy1 < y1 ? cy1 : y1;
+	if (right > left && bottom > top) {
+		*x = left;
+		*y = top;
+		*cx = right - left;
+		*cy = bottom - top;
+	}
 }
 
-static void win_spout_show(void *data)
+/**
+ * The sender rectangle in pixels of the ingest resolution
+ */
+static void win_spout_crop_rect(win_spout *context, uint32_t *x, uint32_t *y,
+				uint32_t *cx, uint32_t *cy)
 {
-	win_spout_init(data, true); // When showing do forced init without delay
+	win_spout_sender_rect(context, x, y, cx, cy);
+
+	uint32_t shift = win_spout_ingest_shift(context);
+	*x >>= shift;
+	*y >>= shift;
+	*cx = *cx >> shift ? *cx >> shift : 1;
+	*cy = *cy >> shift ? *cy >> shift : 1;
 }
 
-static void win_spout_hide(void *data)
+static inline uint32_t min_u32(uint32_t a, uint32_t b)
 {
-	win_spout_deinit(data);
+	return a < b ? a : b;
 }
 
-// Create our context struct which will be passed to each
-// of the plugin functions as void *data
-static void *win_spout_create(obs_data_t *settings, obs_source_t *source)
+/**
+ * @return power of two the frame is reduced by for auto crop detection
+ */
+static uint32_t win_spout_autocrop_shift(uint32_t width)
 {
-	struct win_spout *context = (win_spout *)bzalloc(sizeof(win_spout));
-	info("initialising spout");
-	context->spoutptr = GetSpout();
-	context->source = source;
-	context->useFirstSender = true;
-
-	context->initialized = false;
-	context->tick_speed_limit = 0;
-	context->texture = NULL;
-	context->dxHandle = NULL;
-	context->active = false;
-	context->initialized = false;
-
-	// set the initial size as 100x100 until we
-	// have the actual dimensions from SPOUT
-	context->width = context->height = 100;
-
-	win_spout_update(context, settings);
-	return context;
+	uint32_t shift = 0;
+	while ((width >> shift) > AUTOCROP_SAMPLE_WIDTH) {
+		shift++;
+	}
+	return shift;
 }
 
-static void win_spout_tick(void *data, float seconds)
+static bool win_spout_autocrop_due(win_spout *context)
 {
-	UNUSED_PARAMETER(seconds);
+	return context->autocrop &&
+	       GetTickCount64() - context->autocrop_last >=
+		       context->autocrop_interval;
+}
+
+/**
+ * Detects the content bounds in a reduced copy of the frame and applies
+ * them once the same bounds are seen twice in a row, so fades and dark
+ * scenes don't make the crop jump around
+ */
+static void win_spout_autocrop_detect(win_spout *context,
+				      const uint8_t *pixels, uint32_t linesize,
+				      uint32_t width, uint32_t height,
+				      uint64_t start_ns)
+{
+	struct autocrop_rect rect;
+	bool found = autocrop_detect(pixels, linesize, width, height,
+				     context->autocrop_threshold, &rect);
+
+	uint64_t elapsed = os_gettime_ns() - start_ns;
+	context->autocrop_scans++;
+	context->autocrop_time_ns += elapsed;
+	debug("auto crop scan of %ux%u took %llu us", width, height,
+	      (unsigned long long)(elapsed / 1000));
+
+	// all black, keep whatever we had
+	if (!found) {
+		return;
+	}
+
+	// scale back up; content touching the sample's edge extends to the
+	// frame's edge, covering what the reduction rounded away
+	uint32_t shift = context->autocrop_shift;
+	uint32_t full_width = (uint32_t)context->width;
+	uint32_t full_height = (uint32_t)context->height;
+	bool to_right = rect.x + rect.cx >= width;
+	bool to_bottom = rect.y + rect.cy >= height;
+	rect.x = min_u32(rect.x << shift, full_width - 1);
+	rect.y = min_u32(rect.y << shift, full_height - 1);
+	rect.cx = to_right ? full_width - rect.x
+			   : min_u32(rect.cx << shift, full_width - rect.x);
+	rect.cy = to_bottom ? full_height - rect.y
+			    : min_u32(rect.cy << shift, full_height - rect.y);
+
+	if (memcmp(&rect, &context->autocrop_pending, sizeof(rect)) != 0) {
+		context->autocrop_pending = rect;
+		if (context->autocrop_valid) {
+			return;
+		}
+	}
+	if (!context->autocrop_valid ||
+	    memcmp(&rect, &context->autocrop_rect, sizeof(rect)) != 0) {
+		info("auto crop: content at %u,%u %ux%u", rect.x, rect.y,
+		     rect.cx, rect.cy);
+	}
+	context->autocrop_rect = rect;
+	context->autocrop_valid = true;
+}
+
+/**
+ * Memory path: halves the frame down to the sample size on the CPU
+ */
+static void win_spout_autocrop_memory(win_spout *context,
+				      const uint8_t *pixels, uint32_t linesize,
+				      uint32_t width, uint32_t height)
+{
+	if (!win_spout_autocrop_due(context)) {
+		return;
+	}
+	context->autocrop_last = GetTickCount64();
+
+	uint64_t start_ns = os_gettime_ns();
+	uint32_t shift = win_spout_autocrop_shift(width);
+	context->autocrop_shift = shift;
+	if (!shift) {
+		win_spout_autocrop_detect(context, pixels, linesize, width,
+					  height, start_ns);
+		return;
+	}
+
+	// first halving into the scratch buffer, the rest in place
+	uint32_t sample_linesize = (width / 2) * 4;
+	size_t size = (size_t)sample_linesize * (height / 2);
+	if (!frame_pool_fit(&context->autocrop_buffer,
+			    &context->autocrop_buffer_size, size)) {
+		return;
+	}
+	frame_scale_half(pixels, linesize, width, height,
+			 context->autocrop_buffer, sample_linesize);
+	width /= 2;
+	height /= 2;
+	for (uint32_t i = 1; i < shift; i++) {
+		frame_scale_half(context->autocrop_buffer, sample_linesize,
+				 width, height, context->autocrop_buffer,
+				 sample_linesize);
+		width /= 2;
+		height /= 2;
+	}
+
+	win_spout_autocrop_detect(context, context->autocrop_buffer,
+				  sample_linesize, width, height, start_ns);
+}
+
+/**
+ * Texture path: draws a reduced copy on the GPU and reads it back one
+ * frame later so mapping doesn't stall
+ */
+static void win_spout_autocrop_texture(win_spout *context)
+{
+	if (context->autocrop_staged) {
+		uint64_t start_ns = os_gettime_ns();
+		uint8_t *pixels;
+		uint32_t linesize;
+		gs_stagesurf_t *stage = context->autocrop_stage;
+		if (gs_stagesurface_map(stage, &pixels, &linesize)) {
+			win_spout_autocrop_detect(
+				context, pixels, linesize,
+				gs_stagesurface_get_width(stage),
+				gs_stagesurface_get_height(stage), start_ns);
+			gs_stagesurface_unmap(stage);
+		}
+		context->autocrop_staged = false;
+		return;
+	}
+
+	if (!win_spout_autocrop_due(context)) {
+		return;
+	}
+	context->autocrop_last = GetTickCount64();
+
+	uint32_t shift = win_spout_autocrop_shift((uint32_t)context->width);
+	uint32_t width = (uint32_t)context->width >> shift;
+	uint32_t height = (uint32_t)context->height >> shift;
+	if (!width || !height) {
+		return;
+	}
+	context->autocrop_shift = shift;
+
+	if (!context->autocrop_texrender) {
+		context->autocrop_texrender =
+			gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	}
+	if (!context->autocrop_stage ||
+	    gs_stagesurface_get_width(context->autocrop_stage) != width ||
+	    gs_stagesurface_get_height(context->autocrop_stage) != height) {
+		gs_stagesurface_destroy(context->autocrop_stage);
+		context->autocrop_stage =
+			gs_stagesurface_create(width, height, GS_BGRA);
+	}
+
+	gs_texrender_reset(context->autocrop_texrender);
+	if (!gs_texrender_begin(context->autocrop_texrender, width, height)) {
+		return;
+	}
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
+	while (gs_effect_loop(effect, "Draw")) {
+		obs_source_draw(context->texture, 0, 0, width, height, false);
+	}
+	gs_texrender_end(context->autocrop_texrender);
+
+	gs_stage_texture(context->autocrop_stage,
+			 gs_texrender_get_texture(context->autocrop_texrender));
+	context->autocrop_staged = true;
+}
 
+/**
+ * Box filters the texture down shift halvings into ingest_texrender,
+ * once per frame however often the source is drawn
+ * @return the reduced texture, or NULL to draw the texture as it is
+ */
+static gs_texture_t *win_spout_ingest_texture(win_spout *context,
+					      uint32_t shift)
+{
+	if (context->ingest_rendered) {
+		return gs_texrender_get_texture(context->ingest_texrender);
+	}
+
+	uint32_t src_width = gs_texture_get_width(context->texture);
+	uint32_t src_height = gs_texture_get_height(context->texture);
+	uint32_t width = src_width >> shift;
+	uint32_t height = src_height >> shift;
+	if (!width || !height) {
+		return NULL;
+	}
+
+	enum gs_color_format format =
+		gs_texture_get_color_format(context->texture);
+	if (!context->ingest_texrender || context->ingest_format != format) {
+		gs_texrender_destroy(context->ingest_texrender);
+		context->ingest_texrender =
+			gs_texrender_create(format, GS_ZS_NONE);
+		context->ingest_format = format;
+	}
+
+	gs_texrender_reset(context->ingest_texrender);
+	if (!gs_texrender_begin(context->ingest_texrender, width, height)) {
+		return NULL;
+	}
+	gs_ortho(0.0f, (float)src_width, 0.0f, (float)src_height, -100.0f,
+		 100.0f);
+	gs_blend_state_push();
+	gs_enable_blending(false);
+
+	struct vec2 texel;
+	vec2_set(&texel, 1.0f / (float)src_width, 1.0f / (float)src_height);
+	gs_effect_set_texture(gs_effect_get_param_by_name(draw_effect, "image"),
+			      context->texture);
+	gs_effect_set_vec2(gs_effect_get_param_by_name(draw_effect, "texel"),
+			   &texel);
+	gs_effect_set_int(gs_effect_get_param_by_name(draw_effect, "box_taps"),
+			  1 << (shift - 1));
+	while (gs_effect_loop(draw_effect, "Box")) {
+		gs_draw_sprite(context->texture, 0, 0, 0);
+	}
+
+	gs_blend_state_pop();
+	gs_texrender_end(context->ingest_texrender);
+
+	context->ingest_rendered = true;
+	return gs_texrender_get_texture(context->ingest_texrender);
+}
+
+/**
+ * Adds a frame to the replay buffer, halved shift times first.
+ * Nothing is added while the buffer plays back.
+ */
+static void win_spout_replay_push(win_spout *context, const uint8_t *pixels,
+				  uint32_t linesize, uint32_t width,
+				  uint32_t height, enum gs_color_format format,
+				  uint32_t shift)
+{
+	if (!context->replay || context->replay_playing) {
+		return;
+	}
+
+	while (shift && ((width >> shift) < INGEST_MIN_SIZE ||
+			 (height >> shift) < INGEST_MIN_SIZE)) {
+		shift--;
+	}
+	if (shift) {
+		// first halving into the scratch buffer, the rest in place
+		uint32_t scaled_linesize = (width / 2) * 4;
+		size_t size = (size_t)scaled_linesize * (height / 2);
+		if (!frame_pool_fit(&context->replay_scaled,
+				    &context->replay_scaled_size, size)) {
+			return;
+		}
+		frame_scale_half(pixels, linesize, width, height,
+				 context->replay_scaled, scaled_linesize);
+		width /= 2;
+		height /= 2;
+		for (uint32_t i = 1; i < shift; i++) {
+			frame_scale_half(context->replay_scaled,
+					 scaled_linesize, width, height,
+					 context->replay_scaled,
+					 scaled_linesize);
+			width /= 2;
+			height /= 2;
+		}
+		pixels = context->replay_scaled;
+		linesize = scaled_linesize;
+	}
+
+	pthread_mutex_lock(&context->replay_mutex);
+	if (context->replay) {
+		// a buffer holds frames of one channel order
+		if (format != context->replay_format) {
+			replay_buffer_clear(context->replay);
+			context->replay_format = format;
+		}
+		replay_buffer_push(context->replay, pixels, linesize, width,
+				   height, os_gettime_ns(),
+				   context->replay_compress ? REPLAY_CODEC_QOI
+							    : REPLAY_CODEC_RAW);
+	}
+	pthread_mutex_unlock(&context->replay_mutex);
+}
+
+/**
+ * Texture path of the replay buffer: draws the sender reduced by
+ * replay_scale and maps it one frame later so mapping doesn't stall
+ */
+static void win_spout_replay_readback(win_spout *context)
+{
+	if (context->replay_rendered || !context->replay ||
+	    context->replay_playing) {
+		return;
+	}
+	context->replay_rendered = true;
+
+	if (context->replay_staged) {
+		uint8_t *pixels;
+		uint32_t linesize;
+		gs_stagesurf_t *stage = context->replay_stage;
+		if (gs_stagesurface_map(stage, &pixels, &linesize)) {
+			win_spout_replay_push(
+				context, pixels, linesize,
+				gs_stagesurface_get_width(stage),
+				gs_stagesurface_get_height(stage), GS_BGRA, 0);
+			gs_stagesurface_unmap(stage);
+		}
+		context->replay_staged = false;
+	}
+
+	uint32_t shift = context->replay_scale;
+	while (shift && (((uint32_t)context->width >> shift) < INGEST_MIN_SIZE ||
+			 ((uint32_t)context->height >> shift) <
+				 INGEST_MIN_SIZE)) {
+		shift--;
+	}
+	uint32_t width = (uint32_t)context->width >> shift;
+	uint32_t height = (uint32_t)context->height >> shift;
+
+	if (!context->replay_texrender) {
+		context->replay_texrender =
+			gs_texrender_create(GS_BGRA, GS_ZS_NONE);
+	}
+	if (!context->replay_stage ||
+	    gs_stagesurface_get_width(context->replay_stage) != width ||
+	    gs_stagesurface_get_height(context->replay_stage) != height) {
+		gs_stagesurface_destroy(context->replay_stage);
+		context->replay_stage =
+			gs_stagesurface_create(width, height, GS_BGRA);
+	}
+
+	gs_texrender_reset(context->replay_texrender);
+	if (!gs_texrender_begin(context->replay_texrender, width, height)) {
+		return;
+	}
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	gs_effect_t *effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	while (gs_effect_loop(effect, "Draw")) {
+		obs_source_draw(context->texture, 0, 0, width, height, false);
+	}
+	gs_texrender_end(context->replay_texrender);
+
+	gs_stage_texture(context->replay_stage,
+			 gs_texrender_get_texture(context->replay_texrender));
+	context->replay_staged = true;
+}
+
+static uint32_t win_spout_getwidth(void *data)
+{
+	struct win_spout *context = (win_spout *)data;
+	uint32_t x, y, cx, cy;
+	win_spout_crop_rect(context, &x, &y, &cx, &cy);
+	return cx;
+}
+
+static uint32_t win_spout_getheight(void *data)
+{
+	struct win_spout *context = (win_spout *)data;
+	uint32_t x, y, cx, cy;
+	win_spout_crop_rect(context, &x, &y, &cx, &cy);
+	return cy;
+}
+
+static void win_spout_show(void *data)
+{
+	// initialised without delay, along with any others shown this frame
+	win_spout_queue_init((win_spout *)data);
+}
+
+static void win_spout_hide(void *data)
+{
+	win_spout_unqueue_init((win_spout *)data);
+	win_spout_deinit(data);
+}
+
+static void win_spout_activate(void *data)
+{
+	win_spout_publish_demand((win_spout *)data, true);
+}
+
+static void win_spout_deactivate(void *data)
+{
+	win_spout_publish_demand((win_spout *)data, false);
+}
+
+static void win_spout_replay_hotkey(void *data, obs_hotkey_id id,
+				    obs_hotkey_t *hotkey, bool pressed)
+{
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(hotkey);
+	struct win_spout *context = (win_spout *)data;
+
+	// handled on the next tick
+	if (pressed) {
+		os_atomic_set_bool(&context->replay_toggle, true);
+	}
+}
+
+// Create our context struct which will be passed to each
+// of the plugin functions as void *data
+static void *win_spout_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct win_spout *context = (win_spout *)bzalloc(sizeof(win_spout));
+	info("initialising spout");
+	context->source = source;
+	context->registry = spout_registry_acquire();
+	win_spout_watchdog_add(&context->tick_section, source);
+	context->useFirstSender = true;
+
+	context->initialized = false;
+	context->tick_speed_limit = 0;
+	context->texture = NULL;
+	context->dxHandle = NULL;
+	context->active = false;
+	context->initialized = false;
+
+	// set the initial size as 100x100 until we
+	// have the actual dimensions from SPOUT
+	context->width = context->height = 100;
+
+	pthread_mutex_init(&context->lut_mutex, NULL);
+	pthread_mutex_init(&context->raw_mutex, NULL);
+	pthread_mutex_init(&context->replay_mutex, NULL);
+
+	context->replay_hotkey = obs_hotkey_register_source(
+		source, "SpoutReplay.Play", obs_module_text("replayplay"),
+		win_spout_replay_hotkey, context);
+
+	win_spout_update(context, settings);
+	return context;
+}
+
+static void win_spout_lut_copy(void *param, const struct shm_ring_frame *frame,
+			       uint8_t *dst, const uint8_t *src, size_t size)
+{
+	// the LUT is for 8-bit frames only
+	if (frame->format != SHM_RING_FORMAT_BGRA &&
+	    frame->format != SHM_RING_FORMAT_RGBA) {
+		memcpy(dst, src, size);
+		return;
+	}
+	lut3d_apply((const struct lut3d *)param, dst, src, size / 4,
+		    frame->format == SHM_RING_FORMAT_BGRA);
+}
+
+/**
+ * Reads the newest ring frame into frame_buffer, through the LUT if
+ * there is one, only its dirty rectangles if frame_buffer holds the frame
+ * before. Call with lut_mutex held.
+ */
+static int win_spout_read_frame(win_spout *context,
+				struct shm_ring_frame *frame)
+{
+	int result = shm_ring_read_dirty(
+		context->ring, frame, context->frame_buffer,
+		context->frame_buffer_size, context->buffer_seq,
+		context->lut ? win_spout_lut_copy : NULL, context->lut);
+	context->buffer_seq = result == SHM_RING_OK ? frame->seq : 0;
+	return result;
+}
+
+static enum gs_color_format win_spout_ring_color_format(uint32_t format)
+{
+	switch (format) {
+	case SHM_RING_FORMAT_RGBA:
+		return GS_RGBA;
+	case SHM_RING_FORMAT_RGBA16F:
+		return GS_RGBA16F;
+	case SHM_RING_FORMAT_RGB10A2:
+		return GS_R10G10B10A2;
+	default:
+		return GS_BGRA;
+	}
+}
+
+/**
+ * Tone maps an HDR ring frame to SDR BGRA in tonemap_buffer
+ * @return false if the tables or the buffer couldn't be set up
+ */
+static bool win_spout_tonemap_frame(win_spout *context,
+				    const struct shm_ring_frame *frame,
+				    uint32_t transfer)
+{
+	float white = obs_get_video_sdr_white_level();
+	float peak = obs_get_video_hdr_nominal_peak_level();
+
+	if (!context->hdr_tonemap ||
+	    hdr_tonemap_transfer(context->hdr_tonemap) !=
+		    (enum hdr_transfer)transfer ||
+	    context->tonemap_white != white || context->tonemap_peak != peak) {
+		hdr_tonemap_destroy(context->hdr_tonemap);
+		context->hdr_tonemap = hdr_tonemap_create(
+			(enum hdr_transfer)transfer, white, peak);
+		context->tonemap_white = white;
+		context->tonemap_peak = peak;
+		if (!context->hdr_tonemap) {
+			return false;
+		}
+	}
+
+	size_t size = (size_t)frame->width * frame->height * 4;
+	if (!frame_pool_fit(&context->tonemap_buffer,
+			    &context->tonemap_buffer_size, size)) {
+		return false;
+	}
+
+	if (frame->format == SHM_RING_FORMAT_RGBA16F) {
+		hdr_tonemap_rgba16f(context->hdr_tonemap, context->frame_buffer,
+				    frame->linesize, frame->width,
+				    frame->height, context->tonemap_buffer,
+				    frame->width * 4);
+	} else {
+		hdr_tonemap_rgb10a2(context->hdr_tonemap, context->frame_buffer,
+				    frame->linesize, frame->width,
+				    frame->height, context->tonemap_buffer,
+				    frame->width * 4);
+	}
+	return true;
+}
+
+/**
+ * Halves 8-bit pixels shift times into ingest_buffer, whose rows are
+ * half the sender's width apart
+ * @return the reduced pixels, NULL if the buffer couldn't be allocated
+ */
+static const uint8_t *win_spout_ingest_memory(win_spout *context,
+					      const uint8_t *pixels,
+					      uint32_t linesize,
+					      uint32_t *width,
+					      uint32_t *height, uint32_t shift)
+{
+	uint32_t ingest_linesize = (*width / 2) * 4;
+	size_t size = (size_t)ingest_linesize * (*height / 2);
+	if (!frame_pool_fit(&context->ingest_buffer,
+			    &context->ingest_buffer_size, size)) {
+		return NULL;
+	}
+
+	// first halving out of the frame, the rest in place
+	frame_scale_half(pixels, linesize, *width, *height,
+			 context->ingest_buffer, ingest_linesize);
+	*width /= 2;
+	*height /= 2;
+	for (uint32_t i = 1; i < shift; i++) {
+		frame_scale_half(context->ingest_buffer, ingest_linesize,
+				 *width, *height, context->ingest_buffer,
+				 ingest_linesize);
+		*width /= 2;
+		*height /= 2;
+	}
+	return context->ingest_buffer;
+}
+
+/**
+ * Uploads a frame into a grid of tiles, (re)creating the grid when the
+ * frame's size or format changes. The tiles are mapped and filled by
+ * the parallel copy pool, then unmapped together.
+ */
+static void win_spout_upload_tiles(win_spout *context, const uint8_t *pixels,
+				   uint32_t linesize, uint32_t width,
+				   uint32_t height, enum gs_color_format format)
+{
+	if (!context->tiles || context->tiles_width != width ||
+	    context->tiles_height != height ||
+	    context->tiles_format != format) {
+		win_spout_destroy_tiles(context);
+		obs_enter_graphics();
+		win_spout_destroy_texture(context);
+		obs_leave_graphics();
+
+		uint32_t cols = (width + TILE_SIZE - 1) / TILE_SIZE;
+		uint32_t rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+		context->tiles = (gs_texture_t **)bzalloc(
+			sizeof(gs_texture_t *) * cols * rows);
+		context->tile_cols = cols;
+		context->tile_rows = rows;
+		context->tiles_width = width;
+		context->tiles_height = height;
+		context->tiles_format = format;
+
+		bool created = true;
+		obs_enter_graphics();
+		for (uint32_t row = 0; row < rows; row++) {
+			for (uint32_t col = 0; col < cols; col++) {
+				uint32_t x = col * TILE_SIZE;
+				uint32_t y = row * TILE_SIZE;
+				uint32_t cx = width - x < TILE_SIZE ? width - x
+								    : TILE_SIZE;
+				uint32_t cy = height - y < TILE_SIZE
+						      ? height - y
+						      : TILE_SIZE;
+				gs_texture_t *tile = gs_texture_create(
+					cx, cy, format, 1, NULL, GS_DYNAMIC);
+				context->tiles[row * cols + col] = tile;
+				created = created && tile;
+			}
+		}
+		obs_leave_graphics();
+
+		if (!created) {
+			if (context->spout_status != -7) {
+				warn("Couldn't create %u x %u tiles for the "
+				     "%u x %u frames of sender %s",
+				     cols, rows, width, height,
+				     context->senderName);
+				context->spout_status = -7;
+			}
+			win_spout_destroy_tiles(context);
+			return;
+		}
+		info("Sender %s is %u x %u, receiving it in %u x %u tiles",
+		     context->senderName, width, height, cols, rows);
+		os_atomic_inc_long(&oversize_tiled);
+	}
+
+	size_t count = (size_t)context->tile_cols * context->tile_rows;
+	if (context->tile_jobs_size < count) {
+		context->tile_jobs = (struct parallel_copy_job *)brealloc(
+			context->tile_jobs, sizeof(struct parallel_copy_job) * count);
+		context->tile_jobs_size = count;
+	}
+
+	uint32_t bytes = gs_get_format_bpp(format) / 8;
+	obs_enter_graphics();
+	size_t mapped = 0;
+	for (; mapped < count; mapped++) {
+		gs_texture_t *tile = context->tiles[mapped];
+		struct parallel_copy_job *job = &context->tile_jobs[mapped];
+		if (!gs_texture_map(tile, &job->dst, &job->dst_linesize)) {
+			break;
+		}
+		uint32_t x = (uint32_t)(mapped % context->tile_cols) * TILE_SIZE;
+		uint32_t y = (uint32_t)(mapped / context->tile_cols) * TILE_SIZE;
+		job->src = pixels + (size_t)y * linesize + (size_t)x * bytes;
+		job->src_linesize = linesize;
+		job->row_bytes = gs_texture_get_width(tile) * bytes;
+		job->rows = gs_texture_get_height(tile);
+	}
+	if (mapped == count) {
+		parallel_copy_rows(context->tile_jobs, count);
+	}
+	for (size_t i = 0; i < mapped; i++) {
+		gs_texture_unmap(context->tiles[i]);
+	}
+	obs_leave_graphics();
+}
+
+/**
+ * Whether a ring frame is identical to the one last uploaded, remembering
+ * it otherwise. The frame has already been recorded; skipping it saves
+ * the tone mapping, ingest, upload, auto crop and replay work.
+ */
+static bool win_spout_duplicate_frame(win_spout *context,
+				      const struct shm_ring_frame *frame,
+				      uint32_t transfer)
+{
+	// a frame with dirty rectangles has changed, and hashing it would
+	// read all the pixels the rectangles spared
+	if (!context->skip_duplicates || frame->num_rects) {
+		context->frame_hash_valid = false;
+		return false;
+	}
+
+	uint64_t hash = frame_hash64(context->frame_buffer, frame->size);
+	if (context->frame_hash_valid && context->frame_hash == hash &&
+	    context->frame_hash_width == frame->width &&
+	    context->frame_hash_height == frame->height &&
+	    context->frame_hash_format == frame->format &&
+	    context->frame_hash_transfer == transfer) {
+		return true;
+	}
+	context->frame_hash_valid = true;
+	context->frame_hash = hash;
+	context->frame_hash_width = frame->width;
+	context->frame_hash_height = frame->height;
+	context->frame_hash_format = frame->format;
+	context->frame_hash_transfer = transfer;
+	return false;
+}
+
+/**
+ * Uploads a ring frame to texture, (re)creating it as needed. Once a
+ * sender sends dirty rectangles, frames are staged in patch_texture and
+ * only the rectangles are written and copied into texture, as long as it
+ * holds the frame before. Call in the graphics context.
+ * @return false if the texture couldn't be created
+ */
+static bool win_spout_upload_texture(win_spout *context, const uint8_t *pixels,
+				     uint32_t linesize, uint32_t width,
+				     uint32_t height, enum gs_color_format format,
+				     const struct shm_ring_frame *frame)
+{
+	// rectangles are only known for the pixels as read
+	bool patch = (context->patch_texture || frame->num_rects) &&
+		     pixels == context->frame_buffer;
+	if (!context->texture ||
+	    gs_texture_get_width(context->texture) != width ||
+	    gs_texture_get_height(context->texture) != height ||
+	    gs_texture_get_color_format(context->texture) != format ||
+	    patch != (context->patch_texture != NULL)) {
+		win_spout_destroy_texture(context);
+		if (patch) {
+			context->texture = gs_texture_create(
+				width, height, format, 1, NULL, 0);
+			context->patch_texture = gs_texture_create(
+				width, height, format, 1, NULL, GS_DYNAMIC);
+			if (!context->texture || !context->patch_texture) {
+				win_spout_destroy_texture(context);
+				patch = false;
+			}
+		}
+		if (!patch) {
+			context->texture = gs_texture_create(
+				width, height, format, 1, NULL, GS_DYNAMIC);
+		}
+		if (!context->texture) {
+			return false;
+		}
+	}
+
+	if (!patch) {
+		gs_texture_set_image(context->texture, pixels, linesize, false);
+		context->texture_seq = frame->seq;
+		return true;
+	}
+
+	uint8_t *ptr;
+	uint32_t pitch;
+	if (!gs_texture_map(context->patch_texture, &ptr, &pitch)) {
+		return true;
+	}
+	bool partial = frame->num_rects &&
+		       context->texture_seq + 1 == frame->seq;
+	uint32_t bpp = gs_get_format_bpp(format) / 8;
+	size_t bytes = 0;
+	if (partial) {
+		for (uint32_t i = 0; i < frame->num_rects; i++) {
+			const struct shm_ring_rect *rect = &frame->rects[i];
+			size_t offset = (size_t)rect->x * bpp;
+			size_t len = (size_t)rect->width * bpp;
+			for (uint32_t y = rect->y; y < rect->y + rect->height;
+			     y++) {
+				memcpy(ptr + (size_t)y * pitch + offset,
+				       pixels + (size_t)y * linesize + offset,
+				       len);
+			}
+			bytes += len * rect->height;
+		}
+	} else {
+		size_t row = (size_t)width * bpp;
+		for (uint32_t y = 0; y < height; y++) {
+			memcpy(ptr + (size_t)y * pitch,
+			       pixels + (size_t)y * linesize, row);
+		}
+	}
+	gs_texture_unmap(context->patch_texture);
+
+	if (partial) {
+		for (uint32_t i = 0; i < frame->num_rects; i++) {
+			const struct shm_ring_rect *rect = &frame->rects[i];
+			gs_copy_texture_region(context->texture, rect->x,
+					       rect->y, context->patch_texture,
+					       rect->x, rect->y, rect->width,
+					       rect->height);
+		}
+		context->patched_frames++;
+		context->patched_bytes += bytes;
+		context->patched_frame_bytes += (size_t)width * bpp * height;
+	} else {
+		gs_copy_texture(context->texture, context->patch_texture);
+	}
+	context->texture_seq = frame->seq;
+	return true;
+}
+
+/**
+ * Copies the newest frame out of the shared-memory ring
+ * and uploads it to our own texture
+ */
+static void win_spout_receive_memory(win_spout *context)
+{
+	if (shm_ring_latest_seq(context->ring) == context->ring_seq) {
+		return;
+	}
+
+	struct shm_ring_frame frame;
+	pthread_mutex_lock(&context->lut_mutex);
+	int result = win_spout_read_frame(context, &frame);
+	if (result == SHM_RING_TOO_SMALL) {
+		frame_pool_fit(&context->frame_buffer,
+			       &context->frame_buffer_size, frame.size);
+		result = win_spout_read_frame(context, &frame);
+	}
+	pthread_mutex_unlock(&context->lut_mutex);
+	if (result != SHM_RING_OK) {
+		// overrun or no frame yet, try again next tick
+		return;
+	}
+	context->ring_seq = frame.seq;
+
+	uint64_t verified, mismatched;
+	shm_ring_checksum_stats(context->ring, &verified, &mismatched);
+	if (mismatched > context->ring_mismatches) {
+		if (!context->ring_mismatches) {
+			warn("Frame %llu doesn't match its checksum, it was "
+			     "corrupted after the sender wrote it",
+			     (unsigned long long)frame.seq);
+		}
+		context->ring_mismatches = mismatched;
+	}
+
+	pthread_mutex_lock(&context->raw_mutex);
+	if (context->raw_writer) {
+		struct raw_frame_header header = {};
+		header.format = frame.format;
+		header.seq = frame.seq;
+		header.timestamp_ns = os_gettime_ns();
+		header.width = frame.width;
+		header.height = frame.height;
+		header.linesize = frame.linesize;
+		header.transfer = frame.transfer;
+		header.sender_timestamp = frame.timestamp;
+		raw_writer_write(context->raw_writer, &header,
+				 context->frame_buffer);
+	}
+	pthread_mutex_unlock(&context->raw_mutex);
+
+	uint32_t transfer = context->color_transfer != COLOR_TRANSFER_AUTO
+				    ? (uint32_t)context->color_transfer
+				    : frame.transfer;
+	if (frame.format == SHM_RING_FORMAT_RGBA16F) {
+		// half floats are always linear
+		transfer = SHM_RING_TRANSFER_LINEAR;
+	}
+
+	context->ring_frames++;
+	if (win_spout_duplicate_frame(context, &frame, transfer)) {
+		// texture already holds the same pixels
+		context->texture_seq = frame.seq;
+		context->ring_duplicates++;
+		return;
+	}
+
+	enum gs_color_format format = win_spout_ring_color_format(frame.format);
+	const uint8_t *pixels = context->frame_buffer;
+	uint32_t linesize = frame.linesize;
+
+	bool hdr_format = frame.format == SHM_RING_FORMAT_RGBA16F ||
+			  frame.format == SHM_RING_FORMAT_RGB10A2;
+	if (hdr_format && context->tonemap &&
+	    win_spout_tonemap_frame(context, &frame, transfer)) {
+		format = GS_BGRA;
+		pixels = context->tonemap_buffer;
+		linesize = frame.width * 4;
+		transfer = SHM_RING_TRANSFER_SRGB;
+	}
+	context->ring_transfer = transfer;
+
+	context->width = frame.width;
+	context->height = frame.height;
+
+	// 8-bit frames are reduced here, others on the GPU when drawn
+	const uint8_t *upload = pixels;
+	uint32_t upload_linesize = linesize;
+	uint32_t width = frame.width;
+	uint32_t height = frame.height;
+	uint32_t shift = win_spout_ingest_shift(context);
+	bool bits8 = format == GS_BGRA || format == GS_RGBA;
+	context->texture_shift = bits8 ? shift : 0;
+	if (context->texture_shift) {
+		upload = win_spout_ingest_memory(context, pixels, linesize,
+						 &width, &height, shift);
+		upload_linesize = (frame.width / 2) * 4;
+		if (!upload) {
+			// out of memory, upload at full size
+			upload = pixels;
+			upload_linesize = linesize;
+			context->texture_shift = 0;
+		}
+	}
+
+	// frames a single texture can't hold go into tiles
+	bool tiled = width > MAX_TEXTURE_SIZE || height > MAX_TEXTURE_SIZE ||
+		     (context->tiles && context->tiles_width == width &&
+		      context->tiles_height == height &&
+		      context->tiles_format == format);
+
+	obs_enter_graphics();
+	if (!tiled) {
+		// e.g. above the limit of a feature level 10 device
+		tiled = !win_spout_upload_texture(context, upload,
+						  upload_linesize, width,
+						  height, format, &frame);
+	}
+	obs_leave_graphics();
+
+	if (tiled) {
+		win_spout_upload_tiles(context, upload, upload_linesize, width,
+				       height, format);
+	} else {
+		win_spout_destroy_tiles(context);
+	}
+
+	// auto crop scans the full resolution, 8-bit pixels only
+	if (bits8) {
+		win_spout_autocrop_memory(context, pixels, linesize,
+					  frame.width, frame.height);
+
+		uint32_t replay_shift =
+			context->replay_scale > context->texture_shift
+				? context->replay_scale -
+					  context->texture_shift
+				: 0;
+		win_spout_replay_push(context, upload, upload_linesize, width,
+				      height, format, replay_shift);
+	}
+}
+
+/**
+ * Starts or stops playback on the hotkey and, while playing, uploads the
+ * buffered frame due at the replay clock. Live frames aren't buffered
+ * during playback, so the frames played stay put.
+ */
+static void win_spout_replay_tick(win_spout *context, float seconds)
+{
+	pthread_mutex_lock(&context->replay_mutex);
+	struct replay_buffer *replay = context->replay;
+
+	if (os_atomic_load_bool(&context->replay_toggle)) {
+		os_atomic_set_bool(&context->replay_toggle, false);
+		context->replay_playing = !context->replay_playing && replay &&
+					  replay_buffer_count(replay);
+		context->replay_clock = 0.0;
+		context->replay_index = SIZE_MAX;
+		info("%s", context->replay_playing ? "Playing instant replay"
+						   : "Instant replay stopped");
+	}
+	if (!context->replay_playing) {
+		pthread_mutex_unlock(&context->replay_mutex);
+		return;
+	}
+	if (!replay || !replay_buffer_count(replay)) {
+		// emptied by a change of settings
+		context->replay_playing = false;
+		pthread_mutex_unlock(&context->replay_mutex);
+		return;
+	}
+
+	struct replay_frame_info first, entry;
+	replay_buffer_info(replay, 0, &first);
+	size_t count = replay_buffer_count(replay);
+	size_t index = context->replay_index < count ? context->replay_index
+						     : 0;
+	uint64_t clock_ns = (uint64_t)(context->replay_clock * 1000000000.0);
+	while (index + 1 < count && replay_buffer_info(replay, index + 1, &entry) &&
+	       entry.timestamp_ns - first.timestamp_ns <= clock_ns) {
+		index++;
+	}
+	replay_buffer_info(replay, count - 1, &entry);
+	if (clock_ns > entry.timestamp_ns - first.timestamp_ns +
+			       (uint64_t)(seconds * 1000000000.0)) {
+		// past the last frame, back to live
+		context->replay_playing = false;
+		pthread_mutex_unlock(&context->replay_mutex);
+		info("Instant replay finished");
+		return;
+	}
+	context->replay_clock += seconds;
+
+	if (index != context->replay_index) {
+		context->replay_index = index;
+		replay_buffer_info(replay, index, &entry);
+		uint32_t linesize = entry.width * 4;
+		size_t size = (size_t)linesize * entry.height;
+		if (frame_pool_fit(&context->replay_pixels,
+				   &context->replay_pixels_size, size) &&
+		    replay_buffer_decode(replay, index, context->replay_pixels,
+					 linesize)) {
+			obs_enter_graphics();
+			if (!context->replay_texture ||
+			    gs_texture_get_width(context->replay_texture) !=
+				    entry.width ||
+			    gs_texture_get_height(context->replay_texture) !=
+				    entry.height ||
+			    gs_texture_get_color_format(
+				    context->replay_texture) !=
+				    context->replay_format) {
+				gs_texture_destroy(context->replay_texture);
+				context->replay_texture = gs_texture_create(
+					entry.width, entry.height,
+					context->replay_format, 1, NULL,
+					GS_DYNAMIC);
+			}
+			if (context->replay_texture) {
+				gs_texture_set_image(context->replay_texture,
+						     context->replay_pixels,
+						     linesize, false);
+			}
+			obs_leave_graphics();
+		}
+	}
+	pthread_mutex_unlock(&context->replay_mutex);
+}
+
+static void win_spout_do_tick(void *data, float seconds)
+{
 	struct win_spout *context = (win_spout *)data;
 
 	context->active = obs_source_active(context->source);
-	if (win_spout_sender_has_changed(context)) {
+	if (context->initialized && win_spout_sender_has_changed(context)) {
 		if (context->tick_status != -1) {
 			info("Sender %s has changed / gone away. Resetting ",
 			     context->senderName);
@@ -332,30 +2099,297 @@ static void win_spout_tick(void *data, float seconds)
 		win_spout_init(data);
 		return;
 	}
-	if (!context->initialized) {
+	// queued sources are left to the next batched init
+	if (!context->initialized && !win_spout_init_queued(context)) {
 		if (context->tick_status != -2) {
 			context->tick_status = -2;
 		}
 		win_spout_init(data);
 	}
+	if (context->ring && context->active) {
+		win_spout_receive_memory(context);
+	}
 	if (context->tick_status != 0) {
 		context->tick_status = 0;
 	}
+	context->ingest_rendered = false;
+	context->replay_rendered = false;
+	win_spout_replay_tick(context, seconds);
+}
+
+static void win_spout_tick(void *data, float seconds)
+{
+	struct win_spout *context = (win_spout *)data;
+
+	stall_section_enter(&context->tick_section);
+	win_spout_do_tick(data, seconds);
+	stall_section_leave(&context->tick_section);
 }
 
 static void win_spout_destroy(void *data)
 {
 	struct win_spout *context = (win_spout *)data;
 
+	win_spout_unqueue_init(context);
 	win_spout_deinit(data);
 
-	if (context->spoutptr != NULL) {
-		context->spoutptr->Release();
+	if (context->tick_section.stalls) {
+		info("video tick stalled %llu times",
+		     (unsigned long long)context->tick_section.stalls);
 	}
+	stall_section_remove(&context->tick_section);
+	spout_registry_release(context->registry);
+
+	if (context->autocrop_scans) {
+		info("auto crop: %llu scans, %llu us average",
+		     (unsigned long long)context->autocrop_scans,
+		     (unsigned long long)(context->autocrop_time_ns /
+					  context->autocrop_scans / 1000));
+	}
+
+	obs_enter_graphics();
+	gs_texrender_destroy(context->autocrop_texrender);
+	gs_stagesurface_destroy(context->autocrop_stage);
+	gs_texrender_destroy(context->ingest_texrender);
+	gs_texrender_destroy(context->replay_texrender);
+	gs_stagesurface_destroy(context->replay_stage);
+	gs_texture_destroy(context->replay_texture);
+	obs_leave_graphics();
+
+	lut3d_destroy(context->lut);
+	pthread_mutex_destroy(&context->lut_mutex);
+
+	win_spout_close_raw(context, context->raw_writer);
+	pthread_mutex_destroy(&context->raw_mutex);
+
+	obs_hotkey_unregister(context->replay_hotkey);
+	replay_buffer_destroy(context->replay);
+	pthread_mutex_destroy(&context->replay_mutex);
+	frame_pool_release(context->replay_scaled, context->replay_scaled_size);
+	frame_pool_release(context->replay_pixels, context->replay_pixels_size);
 
+	hdr_tonemap_destroy(context->hdr_tonemap);
+	frame_pool_release(context->tonemap_buffer,
+			   context->tonemap_buffer_size);
+
+	bfree(context->tile_jobs);
+	frame_pool_release(context->ingest_buffer, context->ingest_buffer_size);
+	frame_pool_release(context->autocrop_buffer,
+			   context->autocrop_buffer_size);
+	frame_pool_release(context->frame_buffer, context->frame_buffer_size);
 	bfree(context);
 }
 
+/**
+ * Works out how the texture's pixels encode light: from the ring frames,
+ * or from the shared texture's format unless set in the properties
+ * @return one of shm_ring_transfer
+ */
+static uint32_t win_spout_transfer(win_spout *context)
+{
+	if (context->ring) {
+		return context->ring_transfer;
+	}
+	if (context->color_transfer != COLOR_TRANSFER_AUTO) {
+		return (uint32_t)context->color_transfer;
+	}
+	return context->dxFormat == DXGI_FORMAT_R16G16B16A16_FLOAT
+		       ? SHM_RING_TRANSFER_LINEAR
+		       : SHM_RING_TRANSFER_SRGB;
+}
+
+static enum gs_color_space
+win_spout_get_color_space(void *data, size_t count,
+			  const enum gs_color_space *preferred_spaces)
+{
+	UNUSED_PARAMETER(count);
+	UNUSED_PARAMETER(preferred_spaces);
+	struct win_spout *context = (win_spout *)data;
+
+	// PQ and HLG are decoded to linear by draw_effect
+	return win_spout_transfer(context) == SHM_RING_TRANSFER_SRGB
+		       ? GS_CS_SRGB
+		       : GS_CS_709_EXTENDED;
+}
+
+/**
+ * Whether the source needs draw_effect rather than
+ * one of the base effects, which clamp or can't decode HDR
+ */
+static bool win_spout_uses_draw_effect(win_spout *context)
+{
+	return draw_effect &&
+	       (context->color_key || context->alpha_from_luma ||
+		context->gamma_mode != GAMMA_MODE_NONE ||
+		win_spout_transfer(context) != SHM_RING_TRANSFER_SRGB);
+}
+
+static void win_spout_set_draw_params(win_spout *context,
+				      gs_texture_t *texture)
+{
+	gs_effect_set_texture(gs_effect_get_param_by_name(draw_effect, "image"),
+			      texture);
+	gs_effect_set_int(gs_effect_get_param_by_name(draw_effect,
+						      "composite_mode"),
+			  (int)context->composite_mode);
+	gs_effect_set_bool(gs_effect_get_param_by_name(draw_effect,
+						       "color_key"),
+			   context->color_key);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(draw_effect,
+						       "key_color"),
+			   &context->key_color);
+	gs_effect_set_float(gs_effect_get_param_by_name(draw_effect,
+							"key_similarity"),
+			    context->key_similarity);
+	gs_effect_set_float(gs_effect_get_param_by_name(draw_effect,
+							"key_smoothness"),
+			    context->key_smoothness);
+	gs_effect_set_bool(gs_effect_get_param_by_name(draw_effect,
+						       "alpha_from_luma"),
+			   context->alpha_from_luma);
+	gs_effect_set_int(gs_effect_get_param_by_name(draw_effect,
+						      "gamma_mode"),
+			  context->gamma_mode);
+
+	uint32_t transfer = win_spout_transfer(context);
+	float multiplier = 1.0f;
+	if (transfer == SHM_RING_TRANSFER_PQ) {
+		multiplier = 10000.0f / obs_get_video_sdr_white_level();
+	} else if (transfer == SHM_RING_TRANSFER_HLG) {
+		multiplier = 1000.0f / obs_get_video_sdr_white_level();
+	}
+	gs_effect_set_int(gs_effect_get_param_by_name(draw_effect, "transfer"),
+			  (int)transfer);
+	gs_effect_set_float(gs_effect_get_param_by_name(draw_effect,
+							"multiplier"),
+			    multiplier);
+}
+
+// the base effect for the composite mode
+static gs_effect_t *win_spout_base_effect(win_spout *context)
+{
+	switch (context->composite_mode) {
+	case COMPOSITE_MODE_OPAQUE:
+		return obs_get_base_effect(OBS_EFFECT_OPAQUE);
+	case COMPOSITE_MODE_ALPHA:
+		return obs_get_base_effect(OBS_EFFECT_PREMULTIPLIED_ALPHA);
+	case COMPOSITE_MODE_DEFAULT:
+		return obs_get_base_effect(OBS_EFFECT_DEFAULT);
+	default:
+		return obs_get_base_effect(OBS_EFFECT_OPAQUE);
+	}
+}
+
+/**
+ * Draws the part of each tile inside the crop, placed where it sits in
+ * the cropped and flipped frame
+ */
+static void win_spout_render_tiles(win_spout *context, uint32_t flip)
+{
+	gs_effect_t *effect;
+	if (win_spout_uses_draw_effect(context)) {
+		effect = draw_effect;
+		win_spout_set_draw_params(context, context->tiles[0]);
+	} else {
+		effect = win_spout_base_effect(context);
+	}
+	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
+
+	// the crop in tile pixels; an ingest reduction the CPU didn't make
+	// is left to the sampler
+	uint32_t left, top, width, height;
+	win_spout_sender_rect(context, &left, &top, &width, &height);
+	left >>= context->texture_shift;
+	top >>= context->texture_shift;
+	width >>= context->texture_shift;
+	height >>= context->texture_shift;
+	uint32_t shift = win_spout_ingest_shift(context);
+	uint32_t reduce = shift > context->texture_shift
+				  ? shift - context->texture_shift
+				  : 0;
+
+	gs_matrix_push();
+	if (reduce) {
+		float scale = 1.0f / (float)(1 << reduce);
+		gs_matrix_scale3f(scale, scale, 1.0f);
+	}
+
+	for (uint32_t row = 0; row < context->tile_rows; row++) {
+		for (uint32_t col = 0; col < context->tile_cols; col++) {
+			gs_texture_t *tile =
+				context->tiles[row * context->tile_cols + col];
+			uint32_t tile_x = col * TILE_SIZE;
+			uint32_t tile_y = row * TILE_SIZE;
+			uint32_t x0 = left > tile_x ? left : tile_x;
+			uint32_t y0 = top > tile_y ? top : tile_y;
+			uint32_t x1 = tile_x + gs_texture_get_width(tile);
+			uint32_t y1 = tile_y + gs_texture_get_height(tile);
+			x1 = left + width < x1 ? left + width : x1;
+			y1 = top + height < y1 ? top + height : y1;
+			if (x1 <= x0 || y1 <= y0) {
+				continue;
+			}
+
+			uint32_t dst_x = (flip & GS_FLIP_U) ? left + width - x1
+							    : x0 - left;
+			uint32_t dst_y = (flip & GS_FLIP_V) ? top + height - y1
+							    : y0 - top;
+
+			gs_matrix_push();
+			gs_matrix_translate3f((float)dst_x, (float)dst_y,
+					      0.0f);
+			gs_effect_set_texture(image, tile);
+			while (gs_effect_loop(effect, "Draw")) {
+				gs_draw_sprite_subregion(tile, flip,
+							 x0 - tile_x,
+							 y0 - tile_y, x1 - x0,
+							 y1 - y0);
+			}
+			gs_matrix_pop();
+		}
+	}
+
+	gs_matrix_pop();
+}
+
+/**
+ * Draws the replay frame in place of the sender: the same crop, mapped
+ * onto the replay's resolution, and stretched to the source's size
+ */
+static void win_spout_render_replay(win_spout *context, uint32_t flip)
+{
+	gs_texture_t *texture = context->replay_texture;
+	uint32_t width = gs_texture_get_width(texture);
+	uint32_t height = gs_texture_get_height(texture);
+
+	uint32_t x, y, cx, cy;
+	win_spout_sender_rect(context, &x, &y, &cx, &cy);
+	uint64_t sender_width = context->width > 0 ? context->width : 1;
+	uint64_t sender_height = context->height > 0 ? context->height : 1;
+	uint32_t sub_x = (uint32_t)(x * width / sender_width);
+	uint32_t sub_y = (uint32_t)(y * height / sender_height);
+	uint32_t sub_cx = (uint32_t)(cx * width / sender_width);
+	uint32_t sub_cy = (uint32_t)(cy * height / sender_height);
+	sub_cx = sub_cx ? sub_cx : 1;
+	sub_cy = sub_cy ? sub_cy : 1;
+
+	uint32_t out_x, out_y, out_cx, out_cy;
+	win_spout_crop_rect(context, &out_x, &out_y, &out_cx, &out_cy);
+
+	gs_effect_t *effect = win_spout_base_effect(context);
+	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture(image, texture);
+
+	gs_matrix_push();
+	gs_matrix_scale3f((float)out_cx / (float)sub_cx,
+			  (float)out_cy / (float)sub_cy, 1.0f);
+	while (gs_effect_loop(effect, "Draw")) {
+		gs_draw_sprite_subregion(texture, flip, sub_x, sub_y, sub_cx,
+					 sub_cy);
+	}
+	gs_matrix_pop();
+}
+
 static void win_spout_render(void *data, gs_effect_t *effect)
 {
 	struct win_spout *context = (win_spout *)data;
@@ -378,7 +2412,7 @@ static void win_spout_render(void *data, gs_effect_t *effect)
 		return;
 	}
 
-	if (!context->texture) {
+	if (!context->texture && !context->tiles) {
 		if (context->render_status != -3) {
 			debug("no texture");
 			context->render_status = -3;
@@ -391,27 +2425,76 @@ static void win_spout_render(void *data, gs_effect_t *effect)
 		context->render_status = 0;
 	}
 
-	switch (context->composite_mode) {
-	case COMPOSITE_MODE_OPAQUE:
-		effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
-		break;
-	case COMPOSITE_MODE_ALPHA:
-		effect = obs_get_base_effect(OBS_EFFECT_PREMULTIPLIED_ALPHA);
-		break;
-	case COMPOSITE_MODE_DEFAULT:
-		effect = obs_get_base_effect(OBS_EFFECT_DEFAULT);
-		break;
-	default:
-		effect = obs_get_base_effect(OBS_EFFECT_OPAQUE);
-		break;
+	if (context->autocrop && !context->ring) {
+		win_spout_autocrop_texture(context);
+	}
+	if (context->replay && !context->ring) {
+		win_spout_replay_readback(context);
+	}
+
+	uint32_t x, y, cx, cy;
+	win_spout_crop_rect(context, &x, &y, &cx, &cy);
+
+	uint32_t flip = (context->flip_h ? GS_FLIP_U : 0) |
+			(context->flip_v ? GS_FLIP_V : 0);
+
+	if (context->replay_playing && context->replay_texture) {
+		win_spout_render_replay(context, flip);
+		return;
+	}
+
+	if (context->tiles) {
+		win_spout_render_tiles(context, flip);
+		return;
+	}
+
+	// senders the CPU couldn't reduce on ingest are reduced here
+	gs_texture_t *texture = context->texture;
+	uint32_t shift = win_spout_ingest_shift(context);
+	if (shift > context->texture_shift) {
+		gs_texture_t *reduced = win_spout_ingest_texture(
+			context, shift - context->texture_shift);
+		if (reduced) {
+			texture = reduced;
+		}
+	}
+
+	if (win_spout_uses_draw_effect(context)) {
+		win_spout_set_draw_params(context, texture);
+		while (gs_effect_loop(draw_effect, "Draw")) {
+			gs_draw_sprite_subregion(texture, flip, x, y, cx, cy);
+		}
+		return;
+	}
+
+	effect = win_spout_base_effect(context);
+
+	if (!flip && cx == gs_texture_get_width(texture) &&
+	    cy == gs_texture_get_height(texture)) {
+		while (gs_effect_loop(effect, "Draw")) {
+			obs_source_draw(texture, 0, 0, 0, 0, false);
+		}
+		return;
 	}
 
+	// crop and flip by texture coordinates, straight from the shared texture
+	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture(image, texture);
 	while (gs_effect_loop(effect, "Draw")) {
-		obs_source_draw(context->texture, 0, 0, 0, 0, false);
+		gs_draw_sprite_subregion(texture, flip, x, y, cx, cy);
+	}
+}
+
+static void add_ring_sender(void *param, const char *name)
+{
+	if (!spout_sender_name_in_use(name)) {
+		obs_property_list_add_string((obs_property_t *)param, name,
+					     name);
 	}
 }
 
-static void fill_senders(SPOUTHANDLE spoutptr, obs_property_t *list)
+static void fill_senders(struct spout_registry *registry,
+			 obs_property_t *list)
 {
 	// clear the list first
 	obs_property_list_clear(list);
@@ -420,17 +2503,28 @@ static void fill_senders(SPOUTHANDLE spoutptr, obs_property_t *list)
 	obs_property_list_add_string(list,
 				     obs_module_text("usefirstavailablesender"),
 				     USE_FIRST_AVAILABLE_SENDER);
-	int totalSenders = spoutptr->GetSenderCount();
-	if (totalSenders == 0) {
+
+	// senders publishing through shared memory
+	shm_ring_enum_senders(add_ring_sender, list);
+
+	if (registry == NULL) {
 		return;
 	}
-	int index;
-	char senderName[256];
-	// then get the name of each sender from SPOUT
-	for (index = 0; index < totalSenders; index++) {
-		spoutptr->GetSenderName(index, senderName);
-		obs_property_list_add_string(list, senderName, senderName);
+	char(*senderNames)[256] = (char(*)[256])bmalloc(
+		sizeof(*senderNames) * SPOUT_REGISTRY_MAX_SENDERS);
+	int totalSenders = 0;
+	// then the Spout senders, unless the registry is hung. Those this
+	// plugin publishes itself are left out, a source receiving one would
+	// feed back into itself.
+	spout_registry_sender_names(registry, senderNames, &totalSenders);
+	for (int index = 0; index < totalSenders; index++) {
+		if (spout_sender_name_in_use(senderNames[index])) {
+			continue;
+		}
+		obs_property_list_add_string(list, senderNames[index],
+					     senderNames[index]);
 	}
+	bfree(senderNames);
 }
 
 // initialise the gui fields
@@ -444,7 +2538,7 @@ static obs_properties_t *win_spout_properties(void *data)
 		props, SPOUT_SENDER_LIST, obs_module_text("SpoutSenders"),
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 
-	fill_senders(context->spoutptr, sender_list);
+	fill_senders(context->registry, sender_list);
 
 	obs_property_t *composite_mode_list = obs_properties_add_list(
 		props, SPOUT_COMPOSITE_MODE, obs_module_text("compositemode"),
@@ -459,6 +2553,113 @@ static obs_properties_t *win_spout_properties(void *data)
 				  obs_module_text("compositemodedefault"),
 				  COMPOSITE_MODE_DEFAULT);
 
+	obs_properties_add_int(props, SPOUT_CROP_X, obs_module_text("cropx"), 0,
+			       16384, 1);
+	obs_properties_add_int(props, SPOUT_CROP_Y, obs_module_text("cropy"), 0,
+			       16384, 1);
+	obs_properties_add_int(props, SPOUT_CROP_WIDTH,
+			       obs_module_text("cropwidth"), 0, 16384, 1);
+	obs_properties_add_int(props, SPOUT_CROP_HEIGHT,
+			       obs_module_text("cropheight"), 0, 16384, 1);
+
+	obs_properties_add_bool(props, SPOUT_AUTOCROP,
+				obs_module_text("autocrop"));
+	obs_properties_add_int_slider(props, SPOUT_AUTOCROP_THRESHOLD,
+				      obs_module_text("autocropthreshold"), 0,
+				      64, 1);
+	obs_property_t *autocrop_interval = obs_properties_add_int(
+		props, SPOUT_AUTOCROP_INTERVAL,
+		obs_module_text("autocropinterval"), 100, 10000, 100);
+	obs_property_int_set_suffix(autocrop_interval, " ms");
+
+	obs_properties_add_bool(props, SPOUT_FLIP_H,
+				obs_module_text("fliphorizontal"));
+	obs_properties_add_bool(props, SPOUT_FLIP_V,
+				obs_module_text("flipvertical"));
+	obs_properties_add_bool(props, SPOUT_COLOR_KEY,
+				obs_module_text("colorkey"));
+	obs_properties_add_color(props, SPOUT_KEY_COLOR,
+				 obs_module_text("keycolor"));
+	obs_properties_add_int_slider(props, SPOUT_KEY_SIMILARITY,
+				      obs_module_text("keysimilarity"), 1,
+				      1000, 1);
+	obs_properties_add_int_slider(props, SPOUT_KEY_SMOOTHNESS,
+				      obs_module_text("keysmoothness"), 1,
+				      1000, 1);
+	obs_properties_add_bool(props, SPOUT_ALPHA_FROM_LUMA,
+				obs_module_text("alphafromluma"));
+
+	obs_properties_add_path(props, SPOUT_LUT_FILE,
+				obs_module_text("lutfile"), OBS_PATH_FILE,
+				"Cube LUT (*.cube);;All files (*.*)", NULL);
+
+	obs_property_t *transfer_list = obs_properties_add_list(
+		props, SPOUT_COLOR_TRANSFER, obs_module_text("colortransfer"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(transfer_list,
+				  obs_module_text("colortransferauto"),
+				  COLOR_TRANSFER_AUTO);
+	obs_property_list_add_int(transfer_list,
+				  obs_module_text("colortransfersrgb"),
+				  SHM_RING_TRANSFER_SRGB);
+	obs_property_list_add_int(transfer_list,
+				  obs_module_text("colortransferlinear"),
+				  SHM_RING_TRANSFER_LINEAR);
+	obs_property_list_add_int(transfer_list,
+				  obs_module_text("colortransferpq"),
+				  SHM_RING_TRANSFER_PQ);
+	obs_property_list_add_int(transfer_list,
+				  obs_module_text("colortransferhlg"),
+				  SHM_RING_TRANSFER_HLG);
+	obs_properties_add_bool(props, SPOUT_TONEMAP,
+				obs_module_text("tonemapsdr"));
+	obs_properties_add_bool(props, SPOUT_SKIP_DUPLICATES,
+				obs_module_text("skipduplicates"));
+
+	obs_property_t *gamma_list = obs_properties_add_list(
+		props, SPOUT_GAMMA, obs_module_text("gamma"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(gamma_list, obs_module_text("gammanone"),
+				  GAMMA_MODE_NONE);
+	obs_property_list_add_int(gamma_list, obs_module_text("gammatolinear"),
+				  GAMMA_MODE_TO_LINEAR);
+	obs_property_list_add_int(gamma_list, obs_module_text("gammatosrgb"),
+				  GAMMA_MODE_TO_SRGB);
+
+	// halvings of the sender
+	obs_property_t *ingest_list = obs_properties_add_list(
+		props, SPOUT_INGEST_SCALE, obs_module_text("ingestscale"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(ingest_list, obs_module_text("ingestfull"),
+				  0);
+	obs_property_list_add_int(ingest_list, obs_module_text("ingesthalf"),
+				  1);
+	obs_property_list_add_int(ingest_list,
+				  obs_module_text("ingestquarter"), 2);
+	obs_property_list_add_int(ingest_list, obs_module_text("ingesteighth"),
+				  3);
+
+	// shared memory senders only, their frames are already on the CPU
+	obs_properties_add_bool(props, SPOUT_RECORD_RAW,
+				obs_module_text("recordraw"));
+	obs_properties_add_path(props, SPOUT_RECORD_RAW_PATH,
+				obs_module_text("recordrawpath"),
+				OBS_PATH_DIRECTORY, NULL, NULL);
+
+	obs_properties_add_int(props, SPOUT_REPLAY_MEMORY,
+			       obs_module_text("replaymemory"), 0, 16384, 64);
+	obs_property_t *replay_list = obs_properties_add_list(
+		props, SPOUT_REPLAY_SCALE, obs_module_text("replayscale"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(replay_list, obs_module_text("ingestfull"),
+				  0);
+	obs_property_list_add_int(replay_list, obs_module_text("ingesthalf"),
+				  1);
+	obs_property_list_add_int(replay_list,
+				  obs_module_text("ingestquarter"), 2);
+	obs_properties_add_bool(props, SPOUT_REPLAY_COMPRESS,
+				obs_module_text("replaycompress"));
+
 	obs_property_t *tick_speed_limit_list = obs_properties_add_list(
 		props, SPOUT_TICK_SPEED_LIMIT, obs_module_text("tickspeedlimit"),
 		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
@@ -474,6 +2675,25 @@ static obs_properties_t *win_spout_properties(void *data)
 	return props;
 }
 
+// runs on the watchdog thread, section names are the sources' names
+static void win_spout_log_stall(const struct stall_section *section,
+				uint64_t stalled_ms, bool finished)
+{
+	if (finished) {
+		blog(LOG_WARNING, "[%s] video tick took %llu ms", section->name,
+		     (unsigned long long)stalled_ms);
+	} else {
+		blog(LOG_WARNING, "[%s] video tick stalled for %llu ms so far",
+		     section->name, (unsigned long long)stalled_ms);
+	}
+}
+
+void win_spout_watchdog_add(struct stall_section *section,
+			    obs_source_t *source)
+{
+	stall_section_add(section, obs_source_get_name(source));
+}
+
 bool obs_module_load(void)
 {
 	obs_source_info info = {};
@@ -487,11 +2707,73 @@ bool obs_module_load(void)
 	info.get_defaults = win_spout_defaults;
 	info.show = win_spout_show;
 	info.hide = win_spout_hide;
+	info.activate = win_spout_activate;
+	info.deactivate = win_spout_deactivate;
 	info.get_width = win_spout_getwidth;
 	info.get_height = win_spout_getheight;
 	info.video_render = win_spout_render;
 	info.video_tick = win_spout_tick;
 	info.get_properties = win_spout_properties;
+	info.video_get_color_space = win_spout_get_color_space;
 	obs_register_source(&info);
+
+	char *effect_file = obs_module_file("spout-draw.effect");
+	obs_enter_graphics();
+	draw_effect = gs_effect_create_from_file(effect_file, NULL);
+	obs_leave_graphics();
+	bfree(effect_file);
+	if (!draw_effect) {
+		blog(LOG_WARNING, "Could not load spout-draw.effect, colour "
+				  "key, alpha from luma and gamma are disabled");
+	}
+
+	win_spout_output_register();
+	win_spout_filter_register();
+	win_spout_mosaic_register();
+	stall_watchdog_start(TICK_STALL_THRESHOLD_MS, win_spout_log_stall);
+	init_batch = init_batch_create();
+	obs_add_tick_callback(win_spout_init_batch, NULL);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	obs_remove_tick_callback(win_spout_init_batch, NULL);
+	if (init_batch) {
+		uint64_t batches, batched;
+		init_batch_get_stats(init_batch, &batches, &batched);
+		if (batches) {
+			blog(LOG_INFO,
+			     "batched init: %llu sources in %llu batches",
+			     (unsigned long long)batched,
+			     (unsigned long long)batches);
+		}
+		init_batch_destroy(init_batch);
+		init_batch = NULL;
+	}
+	stall_watchdog_stop();
+	parallel_copy_free();
+	if (oversize_tiled || oversize_refused) {
+		blog(LOG_INFO,
+		     "oversize senders: %ld received in tiles, "
+		     "%ld shared textures too large to open",
+		     oversize_tiled, oversize_refused);
+	}
+
+	struct frame_pool_stats pool;
+	frame_pool_get_stats(&pool);
+	if (pool.requests) {
+		blog(LOG_INFO,
+		     "frame pool: %llu of %llu buffers reused, "
+		     "peak %.1f MB, %.1f MB on hugepages at unload",
+		     (unsigned long long)pool.hits,
+		     (unsigned long long)pool.requests,
+		     pool.peak_footprint / 1048576.0, pool.huge / 1048576.0);
+	}
+	frame_pool_trim();
+
+	obs_enter_graphics();
+	gs_effect_destroy(draw_effect);
+	obs_leave_graphics();
+	draw_effect = NULL;
+}
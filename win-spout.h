@@ -0,0 +1,71 @@
+/**
+ * Shared declarations for the win-spout plugin.
+ *
+ * The module is split into one file per OBS type (source, output, ...);
+ * each of them registers itself from obs_module_load in win-spout.cpp.
+ */
+#pragma once
+
+#include <obs-module.h>
+#include <windows.h>
+
+#define blog(log_level, message, ...) \
+	blog(log_level, "[win_spout] " message, ##__VA_ARGS__)
+
+// Names the sender publishes / receives when nothing is configured
+#define SPOUT_DEFAULT_OUTPUT_NAME "OBS Spout Output"
+
+/**
+ * Opens a sender's shared texture, or adds a reference to it if another
+ * source already has it open. Call inside obs_enter_graphics.
+ * @return NULL if the handle can't be opened
+ */
+gs_texture_t *win_spout_texture_open(HANDLE handle);
+void win_spout_texture_close(gs_texture_t *texture);
+
+#define SPOUT_REGISTRY_MAX_SENDERS 64
+
+struct spout_registry;
+struct stall_section;
+
+enum spout_call_result {
+	SPOUT_CALL_OK = 0,
+	// Spout returned false
+	SPOUT_CALL_FAILED = -1,
+	// the call overran its deadline or an earlier one still hangs; try
+	// again on a later tick
+	SPOUT_CALL_SKIPPED = -2,
+};
+
+/**
+ * The SpoutLibrary handle shared by all sources, whose sender registry
+ * calls run on a worker thread with a deadline, so a hung sender can't
+ * stall the caller. Refcounted; Spout itself is only loaded by the first
+ * call and released with the last reference, so acquiring is cheap.
+ * @return NULL if the worker can't be started
+ */
+struct spout_registry *spout_registry_acquire(void);
+void spout_registry_release(struct spout_registry *registry);
+
+/**
+ * Lists up to SPOUT_REGISTRY_MAX_SENDERS sender names in one call
+ * @return one of spout_call_result
+ */
+int spout_registry_sender_names(struct spout_registry *registry,
+				char (*names)[256], int *count);
+int spout_registry_sender_info(struct spout_registry *registry,
+			       const char *name, unsigned int *width,
+			       unsigned int *height, HANDLE *handle,
+			       DWORD *format);
+
+/**
+ * Reports video ticks that run long, see deadline.h. Started and
+ * stopped with the module.
+ */
+void win_spout_watchdog_add(struct stall_section *section,
+			    obs_source_t *source);
+
+// Registration hooks for the non-source types
+void win_spout_output_register(void);
+void win_spout_filter_register(void);
+void win_spout_mosaic_register(void);